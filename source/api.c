@@ -114,6 +114,11 @@ static const mem_api_t api_mem = {
     Hunk_TempAlloc
 };
 
+static const capture_api_t api_capture = {
+    Capture_AudioActive,
+    Capture_Audio
+};
+
 static const quake_api_t api_quake = {
     &api_cvar,
     &api_cmd,
@@ -124,6 +129,7 @@ static const quake_api_t api_quake = {
     &api_str,
     &api_math,
     &api_mem,
+    &api_capture,
 };
 
 const quake_api_t* GetQuakeAPI()
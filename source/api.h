@@ -203,6 +203,13 @@ typedef struct mem_api_t {
 
 } mem_api_t;
 
+// movie capture, the sound module feeds it its mix
+typedef struct capture_api_t
+{
+    bool (*Active)(void);
+    void (*Audio)(const short* samples, int count, int rate);
+} capture_api_t;
+
 // api agregator
 typedef struct quake_api_t
 {
@@ -215,6 +222,7 @@ typedef struct quake_api_t
     const str_api_t* str;
     const math_api_t* math;
     const mem_api_t* mem;
+    const capture_api_t* capture;
 } quake_api_t;
 
 extern const quake_api_t* GetQuakeAPI();
@@ -0,0 +1,1033 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// capture.c -- screenshots and movie capture, encoded and written on a thread of their own
+
+#define _SDL_main_h
+#include <SDL.h>
+
+#include "quakedef.h"
+
+// the main thread reads frames back, through a ring of pixel buffer objects when it
+// can so the read doesn't stall on the frame being finished, and queues them. the
+// capture thread owns the files: it converts and encodes the frames, writes them
+// along with the audio tapped from the mix, and finishes the files at CAP_END.
+// frames are timed on host_frametime, so with host_framerate set every frame of the
+// game is captured however slowly it renders. when the queue is full a frame is
+// dropped and the one before it is written again in its place, so the timing holds.
+
+cvar_t capture_fps = { "capture_fps", "30", true };
+cvar_t capture_format = { "capture_format", "y4m", true }; // y4m stream or png sequence
+cvar_t capture_audio = { "capture_audio", "1", true }; // wav file alongside
+cvar_t capture_queue = { "capture_queue", "8", true }; // frames waiting for the encoder before new ones are dropped
+
+typedef enum
+{
+    CAP_BEGIN,
+    CAP_FRAME,
+    CAP_AUDIO,
+    CAP_IMAGE,
+    CAP_END
+} captype_t;
+
+typedef enum
+{
+    CAPFMT_Y4M,
+    CAPFMT_PNG,
+    CAPFMT_TGA // screenshots only
+} capformat_t;
+
+typedef struct capitem_s
+{
+    struct capitem_s* next;
+    captype_t type;
+    capformat_t format; // CAP_BEGIN, CAP_IMAGE
+    int width, height; // CAP_BEGIN, CAP_FRAME, CAP_IMAGE
+    int rate; // CAP_BEGIN frames per second, CAP_AUDIO samples per second
+    int copies; // CAP_FRAME: times it's written, with no data the last frame is written again
+    int size; // bytes of data
+    char name[MAX_OSPATH]; // CAP_BEGIN path without extension, CAP_IMAGE the file
+    uint8_t* data; // RGBA for frames, RGB for images, both bottom to top
+} capitem_t;
+
+// only touched by the capture thread
+typedef struct
+{
+    bool open, failed;
+    char name[MAX_OSPATH];
+    capformat_t format;
+    int width, height, fps;
+    int frames; // written so far
+    FILE* video; // y4m
+    uint8_t* last; // last frame as written, yuv or a png file
+    int lastsize;
+    FILE* audio; // wav
+    int audiorate, audiobytes;
+} capstream_t;
+
+static capstream_t cap_stream;
+
+static SDL_Thread* cap_thread;
+static SDL_mutex* cap_lock;
+static SDL_sem* cap_ready; // posted once per queued item
+static capitem_t *cap_head, *cap_tail;
+static int cap_queued; // items not finished yet, under cap_lock
+static int cap_queuedframes; // frames with data among them
+static char cap_messages[8][128]; // from the capture thread, printed by the main thread
+static int cap_nummessages;
+
+// recording state, main thread
+#define CAP_PBOS 3
+
+static bool cap_recording;
+static bool cap_testing; // capturetest feeds its own audio, so the mixer is kept out
+static char cap_name[MAX_OSPATH];
+static int cap_width, cap_height, cap_fps;
+static double cap_time; // capture clock, advanced by host_frametime
+static int cap_frames; // output frames so far, captured or covered by copies
+static int cap_dropped; // output frames the queue had no room for
+static bool cap_usepbo; // reading back through cap_pbos
+static GLuint cap_pbos[CAP_PBOS];
+static int cap_pbocopies[CAP_PBOS]; // copies of the frame read into each, 0 for none
+static int cap_pbonext; // the oldest, and next to be read into
+static SDL_mutex* cap_audiolock; // sdl mixes in its audio callback, on a thread of its own
+static short* cap_audio; // mixed since the last frame
+static int cap_audiocount, cap_audiomax, cap_audiorate;
+
+//==============================================================================
+//
+//  CAPTURE THREAD
+//
+//==============================================================================
+
+/*
+================
+Capture_Message -- printed on the main thread, Con_Printf isn't safe here
+================
+*/
+static void Capture_Message(const char* fmt, ...)
+{
+    va_list argptr;
+
+    SDL_mutexP(cap_lock);
+    if (cap_nummessages < 8)
+    {
+        va_start(argptr, fmt);
+        vsnprintf(cap_messages[cap_nummessages], sizeof(cap_messages[0]), fmt, argptr);
+        va_end(argptr);
+        cap_nummessages++;
+    }
+    SDL_mutexV(cap_lock);
+}
+
+/*
+================
+Capture_WriteFile
+================
+*/
+static bool Capture_WriteFile(const char* path, const uint8_t* data, int size)
+{
+    FILE* f;
+    bool ok;
+
+    f = fopen(path, "wb");
+    if (!f)
+        return false;
+    ok = fwrite(data, 1, size, f) == (size_t)size;
+    return fclose(f) == 0 && ok;
+}
+
+/*
+================
+Capture_WAVHeader -- 16 bit stereo pcm
+================
+*/
+static void Capture_WAVHeader(FILE* f, int rate, int bytes)
+{
+    uint8_t header[44];
+    int i;
+    const int fields[][2] = { // offset, value
+        { 4, 36 + bytes }, { 16, 16 }, { 24, rate }, { 28, rate * 4 }, { 40, bytes }
+    };
+
+    memcpy(header, "RIFF\0\0\0\0WAVEfmt \0\0\0\0\1\0\2\0\0\0\0\0\0\0\0\0\4\0\20\0data\0\0\0\0", 44);
+    for (i = 0; i < 5; i++)
+    {
+        header[fields[i][0]] = fields[i][1] & 255;
+        header[fields[i][0] + 1] = (fields[i][1] >> 8) & 255;
+        header[fields[i][0] + 2] = (fields[i][1] >> 16) & 255;
+        header[fields[i][0] + 3] = (fields[i][1] >> 24) & 255;
+    }
+
+    fseek(f, 0, SEEK_SET);
+    fwrite(header, 1, 44, f);
+}
+
+/*
+================
+Capture_ToYUV -- bottom up RGBA to 4:2:0 planes with full range bt.601, the y4m C420jpeg layout
+================
+*/
+static void Capture_ToYUV(const uint8_t* data, int stride, int width, int height, uint8_t* out)
+{
+    const uint8_t *r0, *r1;
+    uint8_t *y0, *y1, *u, *v;
+    int x, y, i, r, g, b, c;
+
+    u = out + width * height;
+    v = u + (width / 2) * (height / 2);
+    for (y = 0; y < height; y += 2)
+    {
+        r0 = data + (height - 1 - y) * stride;
+        r1 = r0 - stride;
+        y0 = out + y * width;
+        y1 = y0 + width;
+        for (x = 0; x < width; x += 2, r0 += 8, r1 += 8)
+        {
+            y0[x] = (77 * r0[0] + 150 * r0[1] + 29 * r0[2] + 128) >> 8;
+            y0[x + 1] = (77 * r0[4] + 150 * r0[5] + 29 * r0[6] + 128) >> 8;
+            y1[x] = (77 * r1[0] + 150 * r1[1] + 29 * r1[2] + 128) >> 8;
+            y1[x + 1] = (77 * r1[4] + 150 * r1[5] + 29 * r1[6] + 128) >> 8;
+
+            r = g = b = 2;
+            for (i = 0; i < 8; i += 4)
+            {
+                r += r0[i] + r1[i];
+                g += r0[i + 1] + r1[i + 1];
+                b += r0[i + 2] + r1[i + 2];
+            }
+            r >>= 2;
+            g >>= 2;
+            b >>= 2;
+            c = (-43 * r - 85 * g + 128 * b + 32896) >> 8;
+            *u++ = c > 255 ? 255 : c;
+            c = (128 * r - 107 * g - 21 * b + 32896) >> 8;
+            *v++ = c > 255 ? 255 : c;
+        }
+    }
+}
+
+/*
+================
+Capture_WriteFrame
+================
+*/
+static void Capture_WriteFrame(capitem_t* item)
+{
+    capstream_t* s = &cap_stream;
+    char path[MAX_OSPATH + 16];
+    uint8_t *src, *dst;
+    int i, size;
+
+    if (!s->open || s->failed)
+        return;
+
+    if (item->data)
+    {
+        if (item->width != s->width || item->height != s->height)
+            return;
+
+        free(s->last);
+        s->last = NULL;
+        if (s->format == CAPFMT_Y4M)
+        {
+            // y4m wants even sizes, so an odd row or column is cropped
+            size = (s->width & ~1) * (s->height & ~1) * 3 / 2;
+            s->last = malloc(size);
+            if (s->last)
+                Capture_ToYUV(item->data, s->width * 4, s->width & ~1, s->height & ~1, s->last);
+        }
+        else
+        {
+            // the alpha gl reads back means nothing, so squeeze it out in place
+            for (i = 0, src = dst = item->data; i < s->width * s->height; i++, src += 4, dst += 3)
+            {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+            }
+            s->last = Image_EncodePNG(item->data, s->width, s->height, 24, false, &size);
+        }
+        if (!s->last)
+        {
+            s->failed = true;
+            Capture_Message("capture: out of memory, stopped writing\n");
+            return;
+        }
+        s->lastsize = size;
+    }
+    else if (!s->last)
+        return; // nothing to repeat yet
+
+    for (i = 0; i < item->copies; i++, s->frames++)
+    {
+        if (s->format == CAPFMT_Y4M)
+        {
+            if (fwrite("FRAME\n", 1, 6, s->video) == 6 && fwrite(s->last, 1, s->lastsize, s->video) == (size_t)s->lastsize)
+                continue;
+        }
+        else
+        {
+            sprintf(path, "%s_%05i.png", s->name, s->frames);
+            if (Capture_WriteFile(path, s->last, s->lastsize))
+                continue;
+        }
+        s->failed = true;
+        Capture_Message("capture: couldn't write frame %i, stopped writing\n", s->frames);
+        return;
+    }
+}
+
+/*
+================
+Capture_Process -- handles one item, on the capture thread
+================
+*/
+static void Capture_Process(capitem_t* item)
+{
+    capstream_t* s = &cap_stream;
+    char path[MAX_OSPATH + 16];
+    uint8_t* file;
+    int size;
+
+    switch (item->type)
+    {
+    case CAP_BEGIN:
+        memset(s, 0, sizeof(*s));
+        s->open = true;
+        strcpy(s->name, item->name);
+        s->format = item->format;
+        s->width = item->width;
+        s->height = item->height;
+        s->fps = item->rate;
+        if (s->format == CAPFMT_Y4M)
+        {
+            sprintf(path, "%s.y4m", s->name);
+            s->video = fopen(path, "wb");
+            if (s->video)
+                fprintf(s->video, "YUV4MPEG2 W%i H%i F%i:1 Ip A1:1 C420jpeg\n", s->width & ~1, s->height & ~1, s->fps);
+            else
+            {
+                s->failed = true;
+                Capture_Message("capture: couldn't open %s\n", COM_SkipPath(path));
+            }
+        }
+        break;
+
+    case CAP_FRAME:
+        Capture_WriteFrame(item);
+        break;
+
+    case CAP_AUDIO:
+        if (!s->open || s->failed)
+            break;
+        if (!s->audio)
+        {
+            sprintf(path, "%s.wav", s->name);
+            s->audio = fopen(path, "wb");
+            if (!s->audio)
+            {
+                s->failed = true;
+                Capture_Message("capture: couldn't open %s\n", COM_SkipPath(path));
+                break;
+            }
+            s->audiorate = item->rate;
+            Capture_WAVHeader(s->audio, s->audiorate, 0);
+        }
+        s->audiobytes += fwrite(item->data, 1, item->size, s->audio);
+        break;
+
+    case CAP_IMAGE:
+        if (item->format == CAPFMT_PNG)
+            file = Image_EncodePNG(item->data, item->width, item->height, 24, false, &size);
+        else
+            file = Image_EncodeTGA(item->data, item->width, item->height, 24, false, &size);
+        if (file && Capture_WriteFile(item->name, file, size))
+            Capture_Message("Wrote %s\n", COM_SkipPath(item->name));
+        else
+            Capture_Message("SCR_ScreenShot_f: Couldn't write %s\n", COM_SkipPath(item->name));
+        free(file);
+        break;
+
+    case CAP_END:
+        if (!s->open)
+            break;
+        if (s->video)
+            fclose(s->video);
+        if (s->audio)
+        {
+            Capture_WAVHeader(s->audio, s->audiorate, s->audiobytes);
+            fclose(s->audio);
+        }
+        free(s->last);
+        Capture_Message("capture: wrote %i frames of %s%s\n", s->frames, COM_SkipPath(s->name),
+            s->format == CAPFMT_Y4M ? ".y4m" : "_*.png");
+        memset(s, 0, sizeof(*s));
+        break;
+    }
+}
+
+/*
+================
+Capture_Thread
+================
+*/
+static int SDLCALL Capture_Thread(void* arg)
+{
+    capitem_t* item;
+
+    for (;;)
+    {
+        SDL_SemWait(cap_ready);
+
+        SDL_mutexP(cap_lock);
+        item = cap_head;
+        cap_head = item->next;
+        if (!cap_head)
+            cap_tail = NULL;
+        SDL_mutexV(cap_lock);
+
+        Capture_Process(item);
+
+        SDL_mutexP(cap_lock);
+        cap_queued--;
+        if (item->type == CAP_FRAME && item->data)
+            cap_queuedframes--;
+        SDL_mutexV(cap_lock);
+
+        free(item);
+    }
+
+    return 0;
+}
+
+//==============================================================================
+//
+//  QUEUE
+//
+//==============================================================================
+
+/*
+================
+Capture_NewItem -- with size bytes of data after it
+================
+*/
+static capitem_t* Capture_NewItem(captype_t type, int size)
+{
+    capitem_t* item;
+
+    item = malloc(sizeof(capitem_t) + size);
+    if (!item)
+        Sys_Error("Capture_NewItem: couldn't allocate %i bytes", size);
+    memset(item, 0, sizeof(capitem_t));
+    item->type = type;
+    item->size = size;
+    item->data = size ? (uint8_t*)(item + 1) : NULL;
+    return item;
+}
+
+/*
+================
+Capture_PrintMessages
+================
+*/
+static void Capture_PrintMessages(void)
+{
+    char messages[8][128];
+    int i, count;
+
+    if (cap_lock)
+        SDL_mutexP(cap_lock);
+    count = cap_nummessages;
+    memcpy(messages, cap_messages, sizeof(messages));
+    cap_nummessages = 0;
+    if (cap_lock)
+        SDL_mutexV(cap_lock);
+
+    for (i = 0; i < count; i++)
+        Con_Printf("%s", messages[i]);
+}
+
+/*
+================
+Capture_Enqueue -- with no thread the item is handled right away
+================
+*/
+static void Capture_Enqueue(capitem_t* item)
+{
+    item->next = NULL;
+
+    if (!cap_thread)
+    {
+        Capture_Process(item);
+        free(item);
+        Capture_PrintMessages();
+        return;
+    }
+
+    SDL_mutexP(cap_lock);
+    if (cap_tail)
+        cap_tail->next = item;
+    else
+        cap_head = item;
+    cap_tail = item;
+    cap_queued++;
+    if (item->type == CAP_FRAME && item->data)
+        cap_queuedframes++;
+    SDL_mutexV(cap_lock);
+
+    SDL_SemPost(cap_ready);
+}
+
+/*
+================
+Capture_Pending -- items not finished, or with frames true only frames with data
+================
+*/
+static int Capture_Pending(bool frames)
+{
+    int count;
+
+    if (!cap_thread)
+        return 0;
+
+    SDL_mutexP(cap_lock);
+    count = frames ? cap_queuedframes : cap_queued;
+    SDL_mutexV(cap_lock);
+    return count;
+}
+
+/*
+================
+Capture_Drain -- waits for the capture thread to finish everything queued, up to timeout seconds
+================
+*/
+static void Capture_Drain(double timeout)
+{
+    double start;
+
+    start = Sys_FloatTime();
+    while (Capture_Pending(false) && Sys_FloatTime() - start < timeout)
+        SDL_Delay(1);
+
+    Capture_PrintMessages();
+}
+
+//==============================================================================
+//
+//  RECORDING
+//
+//==============================================================================
+
+/*
+================
+Capture_QueueDepth
+================
+*/
+static int Capture_QueueDepth(void)
+{
+    int depth = (int)capture_queue.value;
+    return depth < 1 ? 1 : depth;
+}
+
+/*
+================
+Capture_Begin
+================
+*/
+static void Capture_Begin(const char* name, int width, int height, bool readback)
+{
+    capitem_t* item;
+    int i;
+
+    Q_strncpy(cap_name, name, sizeof(cap_name) - 1);
+    cap_width = width;
+    cap_height = height;
+    cap_fps = CLAMP(1, (int)capture_fps.value, 1000);
+    cap_time = 0;
+    cap_frames = 0;
+    cap_dropped = 0;
+    cap_pbonext = 0;
+    for (i = 0; i < CAP_PBOS; i++)
+        cap_pbocopies[i] = 0;
+    if (cap_audiolock)
+        SDL_mutexP(cap_audiolock);
+    cap_audiocount = 0; // anything from before the start
+    if (cap_audiolock)
+        SDL_mutexV(cap_audiolock);
+    cap_recording = true;
+
+    cap_usepbo = readback && gl_pbo_able;
+    if (cap_usepbo)
+    {
+        GL_GenBuffersFunc(CAP_PBOS, cap_pbos);
+        for (i = 0; i < CAP_PBOS; i++)
+        {
+            GL_BindBufferFunc(GL_PIXEL_PACK_BUFFER_ARB, cap_pbos[i]);
+            GL_BufferDataFunc(GL_PIXEL_PACK_BUFFER_ARB, width * height * 4, NULL, GL_STREAM_READ_ARB);
+        }
+        GL_BindBufferFunc(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    }
+
+    item = Capture_NewItem(CAP_BEGIN, 0);
+    sprintf(item->name, "%s/%s", com_gamedir, name);
+    item->format = Q_strcasecmp(capture_format.string, "png") ? CAPFMT_Y4M : CAPFMT_PNG;
+    item->width = width;
+    item->height = height;
+    item->rate = cap_fps;
+    Capture_Enqueue(item);
+}
+
+/*
+================
+Capture_FlushAudio -- the audio mixed since the last frame goes in ahead of it
+================
+*/
+static void Capture_FlushAudio(void)
+{
+    capitem_t* item;
+
+    item = NULL;
+    if (cap_audiolock)
+        SDL_mutexP(cap_audiolock);
+    if (cap_audiocount)
+    {
+        item = Capture_NewItem(CAP_AUDIO, cap_audiocount * 4);
+        memcpy(item->data, cap_audio, cap_audiocount * 4);
+        item->rate = cap_audiorate;
+        cap_audiocount = 0;
+    }
+    if (cap_audiolock)
+        SDL_mutexV(cap_audiolock);
+
+    if (item)
+        Capture_Enqueue(item);
+}
+
+/*
+================
+Capture_QueueFrame -- pixels as read back, bottom to top RGBA
+================
+*/
+static void Capture_QueueFrame(const void* pixels, int copies)
+{
+    capitem_t* item;
+
+    item = Capture_NewItem(CAP_FRAME, cap_width * cap_height * 4);
+    item->width = cap_width;
+    item->height = cap_height;
+    item->copies = copies;
+    if (pixels)
+        memcpy(item->data, pixels, item->size);
+    else
+        glReadPixels(glx, gly, cap_width, cap_height, GL_RGBA, GL_UNSIGNED_BYTE, item->data);
+    Capture_Enqueue(item);
+}
+
+/*
+================
+Capture_QueuePBO -- queues the frame waiting in a pixel buffer object
+================
+*/
+static void Capture_QueuePBO(int i)
+{
+    void* pixels;
+
+    if (!cap_pbocopies[i])
+        return;
+
+    GL_BindBufferFunc(GL_PIXEL_PACK_BUFFER_ARB, cap_pbos[i]);
+    pixels = GL_MapBufferFunc(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+    if (pixels)
+    {
+        Capture_QueueFrame(pixels, cap_pbocopies[i]);
+        GL_UnmapBufferFunc(GL_PIXEL_PACK_BUFFER_ARB);
+    }
+    GL_BindBufferFunc(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    cap_pbocopies[i] = 0;
+}
+
+/*
+================
+Capture_Stop
+================
+*/
+static void Capture_Stop(void)
+{
+    int i;
+
+    if (!cap_recording)
+        return;
+
+    if (cap_usepbo)
+    {
+        for (i = 0; i < CAP_PBOS; i++)
+            Capture_QueuePBO((cap_pbonext + i) % CAP_PBOS);
+        GL_DeleteBuffersFunc(CAP_PBOS, cap_pbos);
+        memset(cap_pbos, 0, sizeof(cap_pbos));
+        cap_usepbo = false;
+    }
+
+    Capture_FlushAudio();
+    Capture_Enqueue(Capture_NewItem(CAP_END, 0));
+    cap_recording = false;
+
+    Con_Printf("capture stopped: %i frames, %i dropped\n", cap_frames, cap_dropped);
+}
+
+/*
+================
+Capture_Frame
+================
+*/
+void Capture_Frame(void)
+{
+    capitem_t* item;
+    int due, i, last;
+
+    Capture_PrintMessages();
+
+    if (!cap_recording)
+        return;
+
+    if (glwidth != cap_width || glheight != cap_height)
+    {
+        Con_Printf("capture: the video size changed\n");
+        Capture_Stop();
+        return;
+    }
+
+    Capture_FlushAudio();
+
+    // output frames that fall due by now, none when the game runs faster than the capture
+    due = (int)(cap_time * cap_fps) + 1 - cap_frames;
+    cap_time += host_frametime;
+    if (due <= 0)
+        return;
+    cap_frames += due;
+
+    // no room, so this frame's slots go to the frame before it. frames in the pixel
+    // buffer objects don't count, they only move on to the queue as new ones are read
+    if (Capture_Pending(true) >= Capture_QueueDepth())
+    {
+        cap_dropped += due;
+        last = (cap_pbonext + CAP_PBOS - 1) % CAP_PBOS;
+        if (cap_usepbo && cap_pbocopies[last])
+            cap_pbocopies[last] += due;
+        else
+        {
+            item = Capture_NewItem(CAP_FRAME, 0);
+            item->copies = due;
+            Capture_Enqueue(item);
+        }
+        return;
+    }
+
+    if (!cap_usepbo)
+    {
+        Capture_QueueFrame(NULL, due);
+        return;
+    }
+
+    // the oldest pbo has had CAP_PBOS - 1 frames to finish its read, take it before reusing it
+    i = cap_pbonext;
+    Capture_QueuePBO(i);
+    GL_BindBufferFunc(GL_PIXEL_PACK_BUFFER_ARB, cap_pbos[i]);
+    glReadPixels(glx, gly, cap_width, cap_height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    GL_BindBufferFunc(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    cap_pbocopies[i] = due;
+    cap_pbonext = (i + 1) % CAP_PBOS;
+}
+
+/*
+================
+Capture_AudioActive
+================
+*/
+bool Capture_AudioActive(void)
+{
+    return cap_recording && !cap_testing && capture_audio.value;
+}
+
+/*
+================
+Capture_AddAudio -- kept until the next frame is queued
+================
+*/
+static void Capture_AddAudio(const short* samples, int count, int rate)
+{
+    short* audio;
+    int max;
+
+    if (!cap_recording || !capture_audio.value || count <= 0)
+        return;
+
+    if (cap_audiolock)
+        SDL_mutexP(cap_audiolock);
+
+    if (cap_audiocount + count > cap_audiomax)
+    {
+        max = (cap_audiocount + count) * 2;
+        audio = realloc(cap_audio, max * 4);
+        if (audio)
+        {
+            cap_audio = audio;
+            cap_audiomax = max;
+        }
+    }
+
+    // the wav can only have one rate, so nothing from a device that changed under us
+    if (cap_audiocount + count <= cap_audiomax && (!cap_audiocount || rate == cap_audiorate))
+    {
+        memcpy(cap_audio + cap_audiocount * 2, samples, count * 4);
+        cap_audiocount += count;
+        cap_audiorate = rate;
+    }
+
+    if (cap_audiolock)
+        SDL_mutexV(cap_audiolock);
+}
+
+/*
+================
+Capture_Audio -- called by the sound module as it mixes
+================
+*/
+void Capture_Audio(const short* samples, int count, int rate)
+{
+    if (Capture_AudioActive())
+        Capture_AddAudio(samples, count, rate);
+}
+
+/*
+================
+Capture_Screenshot
+================
+*/
+void Capture_Screenshot(char* name, bool png)
+{
+    capitem_t* item;
+
+    item = Capture_NewItem(CAP_IMAGE, glwidth * glheight * 3);
+    sprintf(item->name, "%s/%s", com_gamedir, name);
+    item->format = png ? CAPFMT_PNG : CAPFMT_TGA;
+    item->width = glwidth;
+    item->height = glheight;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(glx, gly, glwidth, glheight, GL_RGB, GL_UNSIGNED_BYTE, item->data);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    Capture_Enqueue(item);
+}
+
+//==============================================================================
+//
+//  COMMANDS
+//
+//==============================================================================
+
+/*
+================
+Capture_Start_f
+================
+*/
+static void Capture_Start_f(void)
+{
+    char name[MAX_OSPATH], path[MAX_OSPATH + 16];
+    FILE* f;
+    int i;
+
+    if (cls.state == ca_dedicated)
+        return;
+
+    if (cap_recording)
+    {
+        Con_Printf("already capturing %s\n", cap_name);
+        return;
+    }
+
+    if (Cmd_Argc() > 2)
+    {
+        Con_Printf("usage: capture_start [name]\n");
+        return;
+    }
+
+    if (Cmd_Argc() == 2)
+    {
+        Q_strncpy(name, Cmd_Argv(1), sizeof(name) - 1);
+        COM_StripExtension(name, name);
+    }
+    else
+    {
+        // find a name that isn't taken
+        for (i = 0; i < 10000; i++)
+        {
+            sprintf(name, "capture%04i", i);
+            sprintf(path, "%s/%s.y4m", com_gamedir, name);
+            if (!(f = fopen(path, "rb")))
+            {
+                sprintf(path, "%s/%s_00000.png", com_gamedir, name);
+                if (!(f = fopen(path, "rb")))
+                    break;
+            }
+            fclose(f);
+        }
+        if (i == 10000)
+        {
+            Con_Printf("capture_start: couldn't find an unused name\n");
+            return;
+        }
+    }
+
+    Capture_Begin(name, glwidth, glheight, true);
+    Con_Printf("capturing %s at %i fps%s\n", name, cap_fps, cap_usepbo ? "" : ", no pixel buffer objects");
+}
+
+/*
+================
+Capture_Stop_f
+================
+*/
+static void Capture_Stop_f(void)
+{
+    if (!cap_recording)
+    {
+        Con_Printf("not capturing\n");
+        return;
+    }
+
+    Capture_Stop();
+}
+
+/*
+================
+Capture_Test_f -- encodes synthetic frames and a tone without touching gl, for timing the encoder
+================
+*/
+static void Capture_Test_f(void)
+{
+    capitem_t* item;
+    short* tone;
+    double start, time;
+    int frames, width, height, rate, samples, i, x, y;
+    uint8_t* p;
+
+    if (cap_recording)
+    {
+        Con_Printf("capturetest: already capturing %s\n", cap_name);
+        return;
+    }
+
+    frames = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 60;
+    width = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 640;
+    height = Cmd_Argc() > 3 ? Q_atoi(Cmd_Argv(3)) : 480;
+    if (frames < 1 || width < 2 || height < 2 || width > 8192 || height > 8192)
+    {
+        Con_Printf("usage: capturetest [frames] [width] [height]\n");
+        return;
+    }
+
+    start = Sys_FloatTime();
+    cap_testing = true;
+    Capture_Begin("capturetest", width, height, false);
+
+    rate = 44100;
+    samples = rate / cap_fps;
+    tone = malloc(samples * 4);
+    if (!tone)
+        Sys_Error("Capture_Test_f: couldn't allocate %i bytes", samples * 4);
+
+    for (i = 0; i < frames; i++)
+    {
+        // a 440 hz tone, carried on from the last frame
+        for (x = 0; x < samples; x++)
+            tone[x * 2] = tone[x * 2 + 1] = (short)(8000 * sin(2 * M_PI * 440 * (i * samples + x) / rate));
+        Capture_AddAudio(tone, samples, rate);
+        Capture_FlushAudio();
+
+        // a scrolling gradient, with enough detail to give the encoders some work
+        item = Capture_NewItem(CAP_FRAME, width * height * 4);
+        item->width = width;
+        item->height = height;
+        item->copies = 1;
+        for (y = 0, p = item->data; y < height; y++)
+            for (x = 0; x < width; x++, p += 4)
+            {
+                p[0] = x + i * 4;
+                p[1] = y + i * 2;
+                p[2] = (x ^ y) + i;
+                p[3] = 255;
+            }
+
+        // unlike a real capture this waits for room rather than dropping frames
+        while (Capture_Pending(true) >= Capture_QueueDepth())
+            SDL_Delay(1);
+        Capture_Enqueue(item);
+        cap_frames++;
+    }
+
+    free(tone);
+    Capture_Enqueue(Capture_NewItem(CAP_END, 0));
+    cap_recording = false;
+    cap_testing = false;
+    Capture_Drain(600);
+
+    time = Sys_FloatTime() - start;
+    Con_Printf("capturetest: %i frames of %ix%i in %.2f seconds, %.2f ms per frame (%s, %s)\n",
+        frames, width, height, time, time * 1000 / frames, capture_format.string, cap_thread ? "threaded" : "inline");
+}
+
+/*
+================
+Capture_Init
+================
+*/
+void Capture_Init(void)
+{
+    Cvar_RegisterVariable(&capture_fps, NULL);
+    Cvar_RegisterVariable(&capture_format, NULL);
+    Cvar_RegisterVariable(&capture_audio, NULL);
+    Cvar_RegisterVariable(&capture_queue, NULL);
+
+    Cmd_AddCommand("capture_start", Capture_Start_f);
+    Cmd_AddCommand("capture_stop", Capture_Stop_f);
+    Cmd_AddCommand("capturetest", Capture_Test_f);
+
+    // without a thread everything is written inline, as it's queued
+    cap_audiolock = SDL_CreateMutex();
+    cap_lock = SDL_CreateMutex();
+    cap_ready = SDL_CreateSemaphore(0);
+    if (cap_lock && cap_ready)
+        cap_thread = SDL_CreateThread(Capture_Thread, NULL);
+    if (!cap_thread)
+        Con_Warning("Capture_Init: no capture thread, writing inline\n");
+}
+
+/*
+================
+Capture_Shutdown
+================
+*/
+void Capture_Shutdown(void)
+{
+    Capture_Stop();
+    Capture_Drain(10);
+}
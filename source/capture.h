@@ -0,0 +1,34 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#pragma once
+
+// capture.h -- screenshots and movie capture, encoded and written on a thread of their own
+
+void Capture_Init(void);
+void Capture_Shutdown(void); // finishes a capture and waits for the files to be written
+
+void Capture_Frame(void); // after the 2d drawing, reads back the frame when one is due
+void Capture_Screenshot(char* name, bool png); // reads back the frame and queues it to be written to com_gamedir/name
+
+// the sound module taps its mix, as stereo 16 bit sample pairs at the output rate
+bool Capture_AudioActive(void);
+void Capture_Audio(const short* samples, int count, int rate);
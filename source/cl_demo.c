@@ -36,6 +36,760 @@ read from the demo file.
 ==============================================================================
 */
 
+/*
+==============================================================================
+
+COMPRESSED DEMOS
+
+A legacy demo is the cd track line followed by the messages, each with its
+length and view angles.  With demo_compress set the same records are
+gathered into blocks of about DEMO_BLOCKSIZE bytes and LZ compressed.
+
+A block starts either with the svc_serverinfo of a level, or every
+demo_keyframe seconds with keyframe records: server messages built from
+the client state that bring a client which has seen the level's signon up
+to that point.  Normal playback skips them.  The index of the blocks at
+the end of the file lets demoseek go straight to the nearest one.
+
+==============================================================================
+*/
+
+#define DEMO_MAGIC (('Z' << 24) + ('M' << 16) + ('D' << 8) + 'Q') // "QDMZ"
+#define DEMO_INDEXMAGIC (('I' << 24) + ('M' << 16) + ('D' << 8) + 'Q') // "QDMI"
+#define DEMO_VERSION 1
+
+#define DEMO_BLOCKSIZE 65536 // raw bytes gathered before a block is written
+#define DEMO_MAXBLOCK (DEMO_BLOCKSIZE + MAX_MSGLEN + 16)
+#define DEMO_KEYFRAME 0x80000000 // set in the length of a keyframe record
+
+// demoblock_t flags
+#define DB_LEVEL 1 // starts with the svc_serverinfo of a level
+#define DB_KEYFRAME 2 // starts with keyframe records
+#define DB_STORED 4 // didn't compress, kept as is
+
+typedef struct
+{
+    int rawsize;
+    int compsize;
+    float time; // seconds since the recording started
+    int flags;
+} demoblock_t; // followed by compsize bytes
+
+typedef struct
+{
+    int offset; // of the demoblock_t, from the start of the file
+    float time;
+    int flags;
+} demoindex_t;
+
+cvar_t demo_compress = { "demo_compress", "1" };
+cvar_t demo_keyframe = { "demo_keyframe", "10" }; // seconds between keyframes
+
+static struct
+{
+    bool active;
+    uint8_t* raw; // [DEMO_MAXBLOCK]
+    uint8_t* comp;
+    int rawsize;
+    int flags;
+    float time;
+    int lztable[LZ_HASHSIZE];
+
+    demoindex_t* index;
+    int numblocks;
+    int maxblocks;
+
+    double starttime;
+    double keyframetime;
+
+    // a message is held back until it has been parsed, to know whether it
+    // started a level and to build keyframes from the state after it
+    uint8_t pending[MAX_MSGLEN];
+    int pendingsize;
+    vec3_t pendingangles;
+    int pendingserverinfos;
+    bool haspending;
+} demowrite;
+
+static struct
+{
+    bool active;
+    int base; // file position of the demo, which may be in a pak
+    int size;
+
+    demoindex_t* index;
+    int numblocks;
+
+    uint8_t* raw; // [DEMO_MAXBLOCK]
+    uint8_t* comp;
+    int rawsize;
+    int rawpos;
+    int block; // in raw, -1 for none
+    int level; // block holding the svc_serverinfo being played
+    double blockmtime; // cl.mtime[0] when block was loaded
+} demoread;
+
+static void CL_WriteDemoInt(int i)
+{
+    i = LittleLong(i);
+    fwrite(&i, 4, 1, cls.demofile);
+}
+
+static int CL_ReadDemoInt(uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static float CL_ReadDemoFloat(uint8_t* p)
+{
+    union {
+        float f;
+        int l;
+    } dat;
+
+    dat.l = CL_ReadDemoInt(p);
+    return dat.f;
+}
+
+/*
+====================
+CL_FlushDemoBlock
+
+Compresses and writes the records gathered so far
+====================
+*/
+static void CL_FlushDemoBlock(void)
+{
+    demoindex_t* index;
+    uint8_t* data;
+    int size, flags;
+    float f;
+
+    if (!demowrite.rawsize)
+        return;
+
+    flags = demowrite.flags;
+    size = LZ_Compress(demowrite.raw, demowrite.rawsize, demowrite.comp, LZ_CompressBound(DEMO_MAXBLOCK), demowrite.lztable);
+    if (size < 0 || size >= demowrite.rawsize)
+    {
+        flags |= DB_STORED;
+        data = demowrite.raw;
+        size = demowrite.rawsize;
+    }
+    else
+        data = demowrite.comp;
+
+    if (demowrite.numblocks == demowrite.maxblocks)
+    {
+        index = realloc(demowrite.index, (demowrite.maxblocks + 256) * sizeof(*index));
+        if (!index)
+            Sys_Error("CL_FlushDemoBlock: out of memory");
+        demowrite.index = index;
+        demowrite.maxblocks += 256;
+    }
+    index = &demowrite.index[demowrite.numblocks++];
+    index->offset = ftell(cls.demofile);
+    index->time = demowrite.time;
+    index->flags = flags;
+
+    CL_WriteDemoInt(demowrite.rawsize);
+    CL_WriteDemoInt(size);
+    f = LittleFloat(demowrite.time);
+    fwrite(&f, 4, 1, cls.demofile);
+    CL_WriteDemoInt(flags);
+    fwrite(data, size, 1, cls.demofile);
+    fflush(cls.demofile);
+
+    demowrite.rawsize = 0;
+    demowrite.flags = 0;
+    demowrite.time = realtime - demowrite.starttime;
+}
+
+/*
+====================
+CL_StartDemoBlock
+
+Ends the current block so the next record starts one with the given flags
+====================
+*/
+static void CL_StartDemoBlock(int flags)
+{
+    CL_FlushDemoBlock();
+    demowrite.flags = flags;
+    demowrite.time = realtime - demowrite.starttime;
+}
+
+/*
+====================
+CL_AddDemoRecord
+====================
+*/
+static void CL_AddDemoRecord(uint8_t* data, int len, vec3_t angles, bool keyframe)
+{
+    uint8_t* p;
+    int i;
+    float f;
+
+    if (demowrite.rawsize + 16 + len > DEMO_MAXBLOCK)
+        CL_FlushDemoBlock();
+
+    p = demowrite.raw + demowrite.rawsize;
+    i = LittleLong(keyframe ? (len | DEMO_KEYFRAME) : len);
+    memcpy(p, &i, 4);
+    for (i = 0; i < 3; i++)
+    {
+        f = LittleFloat(angles[i]);
+        memcpy(p + 4 + i * 4, &f, 4);
+    }
+    memcpy(p + 16, data, len);
+    demowrite.rawsize += 16 + len;
+
+    if (demowrite.rawsize >= DEMO_BLOCKSIZE)
+        CL_FlushDemoBlock();
+}
+
+/*
+====================
+CL_KeyframeEntity
+
+Writes the last received state of an entity as a fast update
+====================
+*/
+static void CL_KeyframeEntity(sizebuf_t* msg, int num, entity_t* ent)
+{
+    packedentity_t state, base;
+    int bits, i;
+
+    CL_PackBaseline(num, &base);
+
+    state.number = num;
+    for (i = 0; i < 3; i++)
+    {
+        state.origin[i] = Delta_PackCoord(ent->msg_origins[0][i]);
+        state.angles[i] = Delta_PackAngle(ent->msg_angles[0][i]);
+    }
+    state.modelindex = 0;
+    if (ent->model)
+        for (i = 1; i < MAX_MODELS && cl.model_precache[i]; i++)
+            if (cl.model_precache[i] == ent->model)
+            {
+                state.modelindex = i;
+                break;
+            }
+    state.frame = ent->frame;
+    state.colormap = 0;
+    for (i = 0; i < cl.maxclients; i++)
+        if (ent->colormap == cl.scores[i].translations)
+        {
+            state.colormap = i + 1;
+            break;
+        }
+    state.skin = ent->skinnum;
+    state.effects = ent->effects;
+    state.alpha = ent->alpha;
+    state.lerpfinish = (int)CLAMP(0, (ent->lerpfinish - ent->msgtime) * 255 + 0.5, 255); // as CL_UpdateEntity decodes it
+
+    bits = 0;
+    for (i = 0; i < 3; i++)
+    {
+        if (state.origin[i] != base.origin[i])
+            bits |= U_ORIGIN1 << i;
+    }
+    if (state.angles[0] != base.angles[0])
+        bits |= U_ANGLE1;
+    if (state.angles[1] != base.angles[1])
+        bits |= U_ANGLE2;
+    if (state.angles[2] != base.angles[2])
+        bits |= U_ANGLE3;
+    if (ent->lerpflags & LERP_MOVESTEP)
+        bits |= U_STEP;
+    if (state.colormap != base.colormap)
+        bits |= U_COLORMAP;
+    if (state.skin != base.skin)
+        bits |= U_SKIN;
+    if (state.frame != base.frame)
+        bits |= U_FRAME;
+    if (state.effects != base.effects)
+        bits |= U_EFFECTS;
+    if (state.modelindex != base.modelindex)
+        bits |= U_MODEL;
+
+    if (cl.protocol != PROTOCOL_NETQUAKE)
+    {
+        if (state.alpha != base.alpha)
+            bits |= U_ALPHA;
+        if (bits & U_FRAME && state.frame & 0xFF00)
+            bits |= U_FRAME2;
+        if (bits & U_MODEL && state.modelindex & 0xFF00)
+            bits |= U_MODEL2;
+        if (ent->lerpflags & LERP_FINISH)
+            bits |= U_LERPFINISH;
+        if (bits >= 65536)
+            bits |= U_EXTEND1;
+        if (bits >= 16777216)
+            bits |= U_EXTEND2;
+    }
+
+    if (num >= 256)
+        bits |= U_LONGENTITY;
+    if (bits >= 256)
+        bits |= U_MOREBITS;
+
+    MSG_WriteByte(msg, bits | U_SIGNAL);
+    if (bits & U_MOREBITS)
+        MSG_WriteByte(msg, bits >> 8);
+    if (bits & U_EXTEND1)
+        MSG_WriteByte(msg, bits >> 16);
+    if (bits & U_EXTEND2)
+        MSG_WriteByte(msg, bits >> 24);
+
+    if (bits & U_LONGENTITY)
+        MSG_WriteShort(msg, num);
+    else
+        MSG_WriteByte(msg, num);
+
+    if (bits & U_MODEL)
+        MSG_WriteByte(msg, state.modelindex);
+    if (bits & U_FRAME)
+        MSG_WriteByte(msg, state.frame);
+    if (bits & U_COLORMAP)
+        MSG_WriteByte(msg, state.colormap);
+    if (bits & U_SKIN)
+        MSG_WriteByte(msg, state.skin);
+    if (bits & U_EFFECTS)
+        MSG_WriteByte(msg, state.effects);
+    if (bits & U_ORIGIN1)
+        MSG_WriteShort(msg, state.origin[0]);
+    if (bits & U_ANGLE1)
+        MSG_WriteByte(msg, state.angles[0]);
+    if (bits & U_ORIGIN2)
+        MSG_WriteShort(msg, state.origin[1]);
+    if (bits & U_ANGLE2)
+        MSG_WriteByte(msg, state.angles[1]);
+    if (bits & U_ORIGIN3)
+        MSG_WriteShort(msg, state.origin[2]);
+    if (bits & U_ANGLE3)
+        MSG_WriteByte(msg, state.angles[2]);
+    if (bits & U_ALPHA)
+        MSG_WriteByte(msg, state.alpha);
+    if (bits & U_FRAME2)
+        MSG_WriteByte(msg, state.frame >> 8);
+    if (bits & U_MODEL2)
+        MSG_WriteByte(msg, state.modelindex >> 8);
+    if (bits & U_LERPFINISH)
+        MSG_WriteByte(msg, state.lerpfinish);
+}
+
+/*
+====================
+CL_KeyframeSpace
+
+Makes room in the keyframe message, starting a new record if needed
+====================
+*/
+static void CL_KeyframeSpace(sizebuf_t* msg, int size)
+{
+    if (msg->cursize + size <= msg->maxsize)
+        return;
+
+    CL_AddDemoRecord(msg->data, msg->cursize, cl.viewangles, true);
+    SZ_Clear(msg);
+}
+
+/*
+====================
+CL_WriteKeyframe
+
+Writes the client state as keyframe records.  Precaches, baselines and
+statics come from the level's signon, so only what changes during play
+is needed.
+====================
+*/
+static void CL_WriteKeyframe(void)
+{
+    static uint8_t buf[MAX_MSGLEN];
+    sizebuf_t msg;
+    packetframe_t* frame;
+    int i, seq;
+
+    msg.data = buf;
+    msg.maxsize = sizeof(buf);
+    msg.allowoverflow = false;
+    msg.overflowed = false;
+    SZ_Clear(&msg);
+
+    MSG_WriteByte(&msg, svc_setview);
+    MSG_WriteShort(&msg, cl.viewentity);
+
+    for (i = 0; i < MAX_LIGHTSTYLES; i++)
+    {
+        CL_KeyframeSpace(&msg, 2 + MAX_STYLESTRING);
+        MSG_WriteByte(&msg, svc_lightstyle);
+        MSG_WriteByte(&msg, i);
+        MSG_WriteString(&msg, cl_lightstyle[i].map);
+    }
+
+    for (i = 0; i < MAX_CL_STATS; i++)
+    {
+        CL_KeyframeSpace(&msg, 6);
+        MSG_WriteByte(&msg, svc_updatestat);
+        MSG_WriteByte(&msg, i);
+        MSG_WriteLong(&msg, cl.stats[i]);
+    }
+
+    for (i = 0; i < cl.maxclients; i++)
+    {
+        CL_KeyframeSpace(&msg, 2 + MAX_SCOREBOARDNAME + 3 + 2);
+        MSG_WriteByte(&msg, svc_updatename);
+        MSG_WriteByte(&msg, i);
+        MSG_WriteString(&msg, cl.scores[i].name);
+        MSG_WriteByte(&msg, svc_updatefrags);
+        MSG_WriteByte(&msg, i);
+        MSG_WriteShort(&msg, cl.scores[i].frags);
+        MSG_WriteByte(&msg, svc_updatecolors);
+        MSG_WriteByte(&msg, i);
+        MSG_WriteByte(&msg, cl.scores[i].colors);
+    }
+
+    if (cl.protocol == PROTOCOL_BITPACK)
+    {
+        // the server deltas from frames the recording client acked, so
+        // restore every one still in reach, entities only seen in the
+        // older ones are left with a time that keeps them hidden
+        MSG_WriteByte(&msg, svc_time);
+        MSG_WriteFloat(&msg, -1);
+        for (i = UPDATE_BACKUP - 1; i >= 0; i--)
+        {
+            seq = (cl.frameack - i) & 255;
+            frame = &cl.packetframes[seq & UPDATE_MASK];
+            if (cl.frameack < 0 || !frame->valid || frame->sequence != seq)
+                continue;
+            if (!i)
+            {
+                MSG_WriteByte(&msg, svc_time);
+                MSG_WriteFloat(&msg, cl.mtime[1]);
+                MSG_WriteByte(&msg, svc_time);
+                MSG_WriteFloat(&msg, cl.mtime[0]);
+            }
+            CL_KeyframeSpace(&msg, 3 + 4 + frame->numentities * MAX_PACKEDENTITY_SIZE);
+            MSG_WriteByte(&msg, svc_packetentities);
+            MSG_WriteByte(&msg, seq);
+            MSG_WriteByte(&msg, 0);
+            MSG_WritePacketEntities(&msg, NULL, frame, CL_PackBaseline);
+        }
+    }
+    else
+    {
+        MSG_WriteByte(&msg, svc_time);
+        MSG_WriteFloat(&msg, cl.mtime[1]);
+        MSG_WriteByte(&msg, svc_time);
+        MSG_WriteFloat(&msg, cl.mtime[0]);
+
+        // only what was in the last update is visible
+        for (i = 1; i < cl.num_entities; i++)
+        {
+            if (cl_entities[i].msgtime != cl.mtime[0])
+                continue;
+            CL_KeyframeSpace(&msg, 24);
+            CL_KeyframeEntity(&msg, i, &cl_entities[i]);
+        }
+    }
+
+    CL_AddDemoRecord(msg.data, msg.cursize, cl.viewangles, true);
+}
+
+/*
+====================
+CL_AddPendingMessage
+====================
+*/
+static void CL_AddPendingMessage(bool keyframes)
+{
+    if (!demowrite.haspending)
+        return;
+    demowrite.haspending = false;
+
+    if (cls.serverinfos != demowrite.pendingserverinfos)
+    {
+        CL_StartDemoBlock(DB_LEVEL);
+        demowrite.keyframetime = realtime;
+    }
+
+    CL_AddDemoRecord(demowrite.pending, demowrite.pendingsize, demowrite.pendingangles, false);
+
+    if (keyframes && cls.signon == SIGNONS && demo_keyframe.value > 0 && realtime - demowrite.keyframetime >= demo_keyframe.value)
+    {
+        CL_StartDemoBlock(DB_KEYFRAME);
+        CL_WriteKeyframe();
+        demowrite.keyframetime = realtime;
+    }
+}
+
+/*
+====================
+CL_FinishDemoWrite
+
+Writes the last block and the index
+====================
+*/
+static void CL_FinishDemoWrite(void)
+{
+    int i, offset;
+    float f;
+
+    CL_AddPendingMessage(false);
+    CL_FlushDemoBlock();
+
+    offset = ftell(cls.demofile);
+    CL_WriteDemoInt(demowrite.numblocks);
+    for (i = 0; i < demowrite.numblocks; i++)
+    {
+        CL_WriteDemoInt(demowrite.index[i].offset);
+        f = LittleFloat(demowrite.index[i].time);
+        fwrite(&f, 4, 1, cls.demofile);
+        CL_WriteDemoInt(demowrite.index[i].flags);
+    }
+    CL_WriteDemoInt(offset);
+    CL_WriteDemoInt(DEMO_INDEXMAGIC);
+
+    free(demowrite.raw);
+    free(demowrite.comp);
+    free(demowrite.index);
+    memset(&demowrite, 0, sizeof(demowrite));
+}
+
+/*
+====================
+CL_StartDemoWrite
+====================
+*/
+static bool CL_StartDemoWrite(void)
+{
+    memset(&demowrite, 0, sizeof(demowrite));
+    demowrite.raw = malloc(DEMO_MAXBLOCK);
+    demowrite.comp = malloc(LZ_CompressBound(DEMO_MAXBLOCK));
+    if (!demowrite.raw || !demowrite.comp)
+    {
+        free(demowrite.raw);
+        free(demowrite.comp);
+        return false;
+    }
+
+    demowrite.active = true;
+    demowrite.starttime = demowrite.keyframetime = realtime;
+
+    CL_WriteDemoInt(DEMO_MAGIC);
+    CL_WriteDemoInt(DEMO_VERSION);
+    CL_WriteDemoInt(cls.forcetrack);
+    return true;
+}
+
+/*
+====================
+CL_LoadDemoBlock
+====================
+*/
+static bool CL_LoadDemoBlock(int block)
+{
+    uint8_t header[16];
+    int rawsize, compsize, flags;
+
+    if (block < 0 || block >= demoread.numblocks)
+        return false;
+
+    fseek(cls.demofile, demoread.base + demoread.index[block].offset, SEEK_SET);
+    if (fread(header, sizeof(header), 1, cls.demofile) != 1)
+        return false;
+
+    rawsize = CL_ReadDemoInt(header);
+    compsize = CL_ReadDemoInt(header + 4);
+    flags = CL_ReadDemoInt(header + 12);
+    if (rawsize < 0 || rawsize > DEMO_MAXBLOCK || compsize < 0 || compsize > LZ_CompressBound(DEMO_MAXBLOCK))
+        return false;
+
+    if (flags & DB_STORED)
+    {
+        if (compsize != rawsize || (rawsize && fread(demoread.raw, rawsize, 1, cls.demofile) != 1))
+            return false;
+    }
+    else
+    {
+        if (fread(demoread.comp, compsize, 1, cls.demofile) != 1)
+            return false;
+        if (LZ_Decompress(demoread.comp, compsize, demoread.raw, DEMO_MAXBLOCK) != rawsize)
+            return false;
+    }
+
+    demoread.block = block;
+    demoread.rawsize = rawsize;
+    demoread.rawpos = 0;
+    demoread.blockmtime = cl.mtime[0];
+    if (flags & DB_LEVEL)
+        demoread.level = block;
+    return true;
+}
+
+/*
+====================
+CL_ReadDemoIndex
+
+Reads the index from the end of the file, or rebuilds it from the block
+headers if the recording was never stopped
+====================
+*/
+static bool CL_ReadDemoIndex(void)
+{
+    uint8_t buf[16];
+    int i, offset;
+
+    demoread.numblocks = 0;
+
+    if (demoread.size >= 20)
+    {
+        fseek(cls.demofile, demoread.base + demoread.size - 8, SEEK_SET);
+        if (fread(buf, 8, 1, cls.demofile) == 1 && CL_ReadDemoInt(buf + 4) == DEMO_INDEXMAGIC)
+        {
+            offset = CL_ReadDemoInt(buf);
+            fseek(cls.demofile, demoread.base + offset, SEEK_SET);
+            if (offset >= 12 && offset < demoread.size && fread(buf, 4, 1, cls.demofile) == 1)
+            {
+                demoread.numblocks = CL_ReadDemoInt(buf);
+                if (demoread.numblocks < 0 || demoread.numblocks > (demoread.size - offset) / 12)
+                    return false;
+                demoread.index = malloc(demoread.numblocks * sizeof(demoindex_t) + 1);
+                if (!demoread.index)
+                    return false;
+                for (i = 0; i < demoread.numblocks; i++)
+                {
+                    if (fread(buf, 12, 1, cls.demofile) != 1)
+                        return false;
+                    demoread.index[i].offset = CL_ReadDemoInt(buf);
+                    demoread.index[i].time = CL_ReadDemoFloat(buf + 4);
+                    demoread.index[i].flags = CL_ReadDemoInt(buf + 8);
+                }
+                return true;
+            }
+        }
+    }
+
+    // no index, walk the blocks
+    Con_Printf("demo has no index, scanning blocks\n");
+    offset = 12;
+    while (offset + 16 <= demoread.size)
+    {
+        fseek(cls.demofile, demoread.base + offset, SEEK_SET);
+        if (fread(buf, 16, 1, cls.demofile) != 1)
+            break;
+        i = CL_ReadDemoInt(buf + 4);
+        if (i < 0 || i > demoread.size - offset - 16)
+            break;
+
+        if (!(demoread.numblocks & 255))
+        {
+            demoindex_t* index = realloc(demoread.index, (demoread.numblocks + 256) * sizeof(demoindex_t));
+            if (!index)
+                return false;
+            demoread.index = index;
+        }
+        demoread.index[demoread.numblocks].offset = offset;
+        demoread.index[demoread.numblocks].time = CL_ReadDemoFloat(buf + 8);
+        demoread.index[demoread.numblocks].flags = CL_ReadDemoInt(buf + 12);
+        demoread.numblocks++;
+
+        offset += 16 + i;
+    }
+
+    return true;
+}
+
+/*
+====================
+CL_ReadDemoRecord
+
+Reads the next message of either format into net_message
+====================
+*/
+static bool CL_ReadDemoRecord(vec3_t angles, bool* keyframe)
+{
+    int i, len;
+    float f;
+    uint8_t* p;
+
+    *keyframe = false;
+
+    if (!demoread.active)
+    {
+        if (fread(&len, 4, 1, cls.demofile) != 1)
+            return false;
+        for (i = 0; i < 3; i++)
+        {
+            fread(&f, 4, 1, cls.demofile);
+            angles[i] = LittleFloat(f);
+        }
+
+        len = LittleLong(len);
+        if (len > MAX_MSGLEN)
+            Sys_Error("Demo message > MAX_MSGLEN");
+        if (fread(net_message.data, len, 1, cls.demofile) != 1)
+            return false;
+        net_message.cursize = len;
+        return true;
+    }
+
+    while (demoread.rawpos >= demoread.rawsize)
+        if (!CL_LoadDemoBlock(demoread.block + 1))
+            return false;
+
+    if (demoread.rawsize - demoread.rawpos < 16)
+        return false;
+
+    p = demoread.raw + demoread.rawpos;
+    len = CL_ReadDemoInt(p);
+    *keyframe = (len & DEMO_KEYFRAME) != 0;
+    len &= ~DEMO_KEYFRAME;
+    if (len > MAX_MSGLEN || len > demoread.rawsize - demoread.rawpos - 16)
+        return false;
+
+    for (i = 0; i < 3; i++)
+        angles[i] = CL_ReadDemoFloat(p + 4 + i * 4);
+    memcpy(net_message.data, p + 16, len);
+    net_message.cursize = len;
+    demoread.rawpos += 16 + len;
+    return true;
+}
+
+/*
+====================
+CL_NextDemoKeyframe
+
+Whether the next record is a keyframe record
+====================
+*/
+static bool CL_NextDemoKeyframe(void)
+{
+    while (demoread.rawpos >= demoread.rawsize)
+        if (!CL_LoadDemoBlock(demoread.block + 1))
+            return false;
+
+    if (demoread.rawsize - demoread.rawpos < 16)
+        return false;
+
+    return (CL_ReadDemoInt(demoread.raw + demoread.rawpos) & DEMO_KEYFRAME) != 0;
+}
+
+/*
+====================
+CL_FreeDemoRead
+====================
+*/
+static void CL_FreeDemoRead(void)
+{
+    free(demoread.raw);
+    free(demoread.comp);
+    free(demoread.index);
+    memset(&demoread, 0, sizeof(demoread));
+}
+
 /*
 ==============
 CL_StopPlayback
@@ -52,6 +806,7 @@ void CL_StopPlayback(void)
     cls.demoplayback = false;
     cls.demofile = NULL;
     cls.state = ca_disconnected;
+    CL_FreeDemoRead();
 
     if (cls.timedemo)
         CL_FinishTimeDemo();
@@ -70,6 +825,17 @@ void CL_WriteDemoMessage(void)
     int i;
     float f;
 
+    if (demowrite.active)
+    {
+        CL_AddPendingMessage(true);
+        memcpy(demowrite.pending, net_message.data, net_message.cursize);
+        demowrite.pendingsize = net_message.cursize;
+        VectorCopy(cl.viewangles, demowrite.pendingangles);
+        demowrite.pendingserverinfos = cls.serverinfos;
+        demowrite.haspending = true;
+        return;
+    }
+
     len = LittleLong(net_message.cursize);
     fwrite(&len, 4, 1, cls.demofile);
     for (i = 0; i < 3; i++)
@@ -90,8 +856,9 @@ Handles recording and playback of demos, on top of NET_ code
 */
 int CL_GetMessage(void)
 {
-    int r, i;
-    float f;
+    int r;
+    vec3_t angles;
+    bool keyframe;
 
     if (cls.demoplayback)
     {
@@ -114,24 +881,18 @@ int CL_GetMessage(void)
             }
         }
 
-        // get the next message
-        fread(&net_message.cursize, 4, 1, cls.demofile);
-        VectorCopy(cl.mviewangles[0], cl.mviewangles[1]);
-        for (i = 0; i < 3; i++)
+        // get the next message, keyframes are only for seeking
+        do
         {
-            r = fread(&f, 4, 1, cls.demofile);
-            cl.mviewangles[0][i] = LittleFloat(f);
-        }
+            if (!CL_ReadDemoRecord(angles, &keyframe))
+            {
+                CL_StopPlayback();
+                return 0;
+            }
+        } while (keyframe);
 
-        net_message.cursize = LittleLong(net_message.cursize);
-        if (net_message.cursize > MAX_MSGLEN)
-            Sys_Error("Demo message > MAX_MSGLEN");
-        r = fread(net_message.data, net_message.cursize, 1, cls.demofile);
-        if (r != 1)
-        {
-            CL_StopPlayback();
-            return 0;
-        }
+        VectorCopy(cl.mviewangles[0], cl.mviewangles[1]);
+        VectorCopy(angles, cl.mviewangles[0]);
 
         return 1;
     }
@@ -158,161 +919,506 @@ int CL_GetMessage(void)
 
 /*
 ====================
-CL_Stop_f
+CL_Stop_f
+
+stop recording a demo
+====================
+*/
+void CL_Stop_f(void)
+{
+    if (cmd_source != src_command)
+        return;
+
+    if (!cls.demorecording)
+    {
+        Con_Printf("Not recording a demo.\n");
+        return;
+    }
+
+    // write a disconnect message to the demo file
+    SZ_Clear(&net_message);
+    MSG_WriteByte(&net_message, svc_disconnect);
+    CL_WriteDemoMessage();
+
+    // finish up
+    if (demowrite.active)
+        CL_FinishDemoWrite();
+    fclose(cls.demofile);
+    cls.demofile = NULL;
+    cls.demorecording = false;
+    Con_Printf("Completed demo\n");
+}
+
+/*
+====================
+CL_Record_f
+
+record <demoname> <map> [cd track]
+====================
+*/
+void CL_Record_f(void)
+{
+    int c;
+    char name[MAX_OSPATH];
+    int track;
+
+    if (cmd_source != src_command)
+        return;
+
+    c = Cmd_Argc();
+    if (c != 2 && c != 3 && c != 4)
+    {
+        Con_Printf("record <demoname> [<map> [cd track]]\n");
+        return;
+    }
+
+    if (strstr(Cmd_Argv(1), ".."))
+    {
+        Con_Printf("Relative pathnames are not allowed.\n");
+        return;
+    }
+
+    if (c == 2 && cls.state == ca_connected)
+    {
+        Con_Printf("Can not record - already connected to server\nClient demo recording must be started before connecting\n");
+        return;
+    }
+
+    // write the forced cd track number, or -1
+    if (c == 4)
+    {
+        track = atoi(Cmd_Argv(3));
+        Con_Printf("Forcing CD track to %i\n", cls.forcetrack);
+    }
+    else
+        track = -1;
+
+    sprintf(name, "%s/%s", com_gamedir, Cmd_Argv(1));
+
+    //
+    // start the map up
+    //
+    if (c > 2)
+        Cmd_ExecuteString(va("map %s", Cmd_Argv(2)), src_command);
+
+    //
+    // open the demo file
+    //
+    COM_DefaultExtension(name, ".dem");
+
+    Con_Printf("recording to %s.\n", name);
+    cls.demofile = fopen(name, "wb");
+    if (!cls.demofile)
+    {
+        Con_Printf("ERROR: couldn't open.\n");
+        return;
+    }
+
+    cls.forcetrack = track;
+    if (!demo_compress.value || !CL_StartDemoWrite())
+        fprintf(cls.demofile, "%i\n", cls.forcetrack);
+
+    cls.demorecording = true;
+}
+
+/*
+====================
+CL_OpenDemo
+
+Disconnects and starts playback of a demo file
+====================
+*/
+static bool CL_OpenDemo(char* demoname)
+{
+    char name[256];
+    int c;
+    bool neg = false;
+    uint8_t header[12];
+
+    //
+    // disconnect from server
+    //
+    CL_Disconnect();
+
+    //
+    // open the demo file
+    //
+    strcpy(name, demoname);
+    COM_DefaultExtension(name, ".dem");
+
+    Con_Printf("Playing demo from %s.\n", name);
+    demoread.size = COM_FOpenFile(name, &cls.demofile);
+    if (!cls.demofile)
+    {
+        Con_Printf("ERROR: couldn't open.\n");
+        cls.demonum = -1; // stop demo loop
+        return false;
+    }
+
+    cls.demoplayback = true;
+    cls.state = ca_connected;
+    cls.forcetrack = 0;
+
+    demoread.base = ftell(cls.demofile);
+    if (fread(header, sizeof(header), 1, cls.demofile) == 1 && CL_ReadDemoInt(header) == DEMO_MAGIC)
+    {
+        if (CL_ReadDemoInt(header + 4) != DEMO_VERSION)
+        {
+            Con_Printf("ERROR: unknown demo version %i.\n", CL_ReadDemoInt(header + 4));
+            CL_StopPlayback();
+            return false;
+        }
+
+        demoread.raw = malloc(DEMO_MAXBLOCK);
+        demoread.comp = malloc(LZ_CompressBound(DEMO_MAXBLOCK));
+        if (!demoread.raw || !demoread.comp || !CL_ReadDemoIndex())
+        {
+            Con_Printf("ERROR: couldn't read %s.\n", name);
+            CL_StopPlayback();
+            return false;
+        }
+
+        demoread.active = true;
+        demoread.block = -1;
+        demoread.level = -1;
+        cls.forcetrack = CL_ReadDemoInt(header + 8);
+        return true;
+    }
+    fseek(cls.demofile, demoread.base, SEEK_SET);
+
+    while ((c = getc(cls.demofile)) != '\n')
+        if (c == '-')
+            neg = true;
+        else
+            cls.forcetrack = cls.forcetrack * 10 + (c - '0');
+
+    if (neg)
+        cls.forcetrack = -cls.forcetrack;
+    // ZOID, fscanf is evil
+    //	fscanf (cls.demofile, "%i\n", &cls.forcetrack);
+
+    return true;
+}
+
+/*
+====================
+CL_PlayDemo_f
+
+play [demoname]
+====================
+*/
+void CL_PlayDemo_f(void)
+{
+    if (cmd_source != src_command)
+        return;
+
+    if (Cmd_Argc() != 2)
+    {
+        Con_Printf("play <demoname> : plays a demo\n");
+        return;
+    }
+
+    CL_OpenDemo(Cmd_Argv(1));
+}
+
+/*
+====================
+CL_DemoTime
+
+Seconds into the recording of the message last read
+====================
+*/
+static float CL_DemoTime(void)
+{
+    if (demoread.block < 0)
+        return 0;
+    if (cl.mtime[0] < demoread.blockmtime) // a level change reset the server time
+        return demoread.index[demoread.block].time;
+    return demoread.index[demoread.block].time + (cl.mtime[0] - demoread.blockmtime);
+}
+
+/*
+====================
+CL_DemoSeek_f
 
-stop recording a demo
+demoseek <seconds>, or +/-seconds relative to the current position
 ====================
 */
-void CL_Stop_f(void)
+void CL_DemoSeek_f(void)
 {
+    char* arg;
+    float target;
+    int block, level, lo, hi, i;
+    vec3_t angles;
+    bool keyframe;
+
     if (cmd_source != src_command)
         return;
 
-    if (!cls.demorecording)
+    if (Cmd_Argc() != 2)
     {
-        Con_Printf("Not recording a demo.\n");
+        Con_Printf("demoseek <seconds> : jumps to a time in a compressed demo, +/- for relative\n");
         return;
     }
 
-    // write a disconnect message to the demo file
-    SZ_Clear(&net_message);
-    MSG_WriteByte(&net_message, svc_disconnect);
-    CL_WriteDemoMessage();
+    if (!cls.demoplayback || !demoread.active || !demoread.numblocks)
+    {
+        Con_Printf("Not playing a compressed demo.\n");
+        return;
+    }
 
-    // finish up
-    fclose(cls.demofile);
-    cls.demofile = NULL;
-    cls.demorecording = false;
-    Con_Printf("Completed demo\n");
-}
+    if (cls.timedemo)
+    {
+        Con_Printf("Can't seek during a timedemo.\n");
+        return;
+    }
 
-/*
-====================
-CL_Record_f
+    arg = Cmd_Argv(1);
+    target = atof(arg);
+    if (arg[0] == '+' || arg[0] == '-')
+        target += CL_DemoTime();
 
-record <demoname> <map> [cd track]
-====================
-*/
-void CL_Record_f(void)
-{
-    int c;
-    char name[MAX_OSPATH];
-    int track;
+    // last block starting at or before the target, then back to one we
+    // can start from
+    lo = 0;
+    hi = demoread.numblocks - 1;
+    while (lo < hi)
+    {
+        i = (lo + hi + 1) / 2;
+        if (demoread.index[i].time <= target)
+            lo = i;
+        else
+            hi = i - 1;
+    }
+    for (block = lo; block > 0 && !(demoread.index[block].flags & (DB_LEVEL | DB_KEYFRAME)); block--)
+        ;
 
-    if (cmd_source != src_command)
+    if (!(demoread.index[block].flags & DB_KEYFRAME))
+    {
+        // the start of a level, so play it from its serverinfo
+        if (!CL_LoadDemoBlock(block))
+        {
+            Con_Printf("demoseek: couldn't read block %i\n", block);
+            CL_StopPlayback();
+            return;
+        }
+        cls.signon = 0;
+        Con_Printf("demoseek: %.1f seconds\n", demoread.index[block].time);
         return;
+    }
 
-    c = Cmd_Argc();
-    if (c != 2 && c != 3 && c != 4)
+    // keyframes only restore what changes during play, so the signon of
+    // their level has to have been seen
+    for (level = block; level > 0 && !(demoread.index[level].flags & DB_LEVEL); level--)
+        ;
+    if (level != demoread.level || cls.signon != SIGNONS)
     {
-        Con_Printf("record <demoname> [<map> [cd track]]\n");
-        return;
+        if (!CL_LoadDemoBlock(level))
+        {
+            Con_Printf("demoseek: couldn't read block %i\n", level);
+            CL_StopPlayback();
+            return;
+        }
+        cls.signon = 0;
+        while (cls.signon != SIGNONS)
+        {
+            if (demoread.block >= block || !CL_ReadDemoRecord(angles, &keyframe))
+            {
+                Con_Printf("demoseek: level %i never finished its signon\n", level);
+                CL_StopPlayback();
+                return;
+            }
+            if (!keyframe)
+                CL_ParseServerMessage();
+        }
     }
 
-    if (strstr(Cmd_Argv(1), ".."))
+    if (!CL_LoadDemoBlock(block))
     {
-        Con_Printf("Relative pathnames are not allowed.\n");
+        Con_Printf("demoseek: couldn't read block %i\n", block);
+        CL_StopPlayback();
         return;
     }
 
-    if (c == 2 && cls.state == ca_connected)
+    // nothing from before the jump should lerp into the keyframe
+    for (i = 0; i < cl.num_entities; i++)
     {
-        Con_Printf("Can not record - already connected to server\nClient demo recording must be started before connecting\n");
-        return;
+        cl_entities[i].msgtime = 0;
+        cl_entities[i].lerpflags |= LERP_RESETMOVE | LERP_RESETANIM;
     }
+    memset(cl_dlights, 0, sizeof(cl_dlights));
+    memset(cl_temp_entities, 0, sizeof(cl_temp_entities));
+    memset(cl_beams, 0, sizeof(cl_beams));
+    R_ClearParticles();
 
-    // write the forced cd track number, or -1
-    if (c == 4)
+    while (CL_NextDemoKeyframe())
     {
-        track = atoi(Cmd_Argv(3));
-        Con_Printf("Forcing CD track to %i\n", cls.forcetrack);
+        if (!CL_ReadDemoRecord(angles, &keyframe))
+            break;
+        VectorCopy(angles, cl.mviewangles[0]);
+        VectorCopy(angles, cl.mviewangles[1]);
+        CL_ParseServerMessage();
     }
-    else
-        track = -1;
 
-    sprintf(name, "%s/%s", com_gamedir, Cmd_Argv(1));
+    cl.time = cl.oldtime = cl.mtime[0];
+    demoread.blockmtime = cl.mtime[0];
 
-    //
-    // start the map up
-    //
-    if (c > 2)
-        Cmd_ExecuteString(va("map %s", Cmd_Argv(2)), src_command);
+    Con_Printf("demoseek: %.1f seconds\n", demoread.index[block].time);
+}
 
-    //
-    // open the demo file
-    //
-    COM_DefaultExtension(name, ".dem");
+/*
+==============================================================================
 
-    Con_Printf("recording to %s.\n", name);
-    cls.demofile = fopen(name, "wb");
-    if (!cls.demofile)
+TIMEDEMO STATISTICS
+
+Every timed frame records how long the frame and its client phases took,
+and the percentiles are printed when the demo finishes.  benchdemo also
+skips rendering and can write the table to a .csv or .json file, so it
+can be compared between builds.
+
+==============================================================================
+*/
+
+frametimes_t cl_frametimes;
+
+static frametimes_t* td_frames;
+static int td_numframes;
+static int td_maxframes;
+static char td_statsfile[MAX_OSPATH];
+
+typedef struct
+{
+    char* name;
+    int offset;
+} tdphase_t;
+
+static tdphase_t td_phases[] = {
+    { "frame", offsetof(frametimes_t, frame) },
+    { "parse", offsetof(frametimes_t, parse) },
+    { "relink", offsetof(frametimes_t, relink) },
+    { "particles", offsetof(frametimes_t, particles) },
+    { "sound", offsetof(frametimes_t, sound) },
+};
+
+#define NUM_TDPHASES (sizeof(td_phases) / sizeof(td_phases[0]))
+
+/*
+====================
+CL_TimeDemoFrame
+
+Called at the end of every host frame while cls.timedemo is set
+====================
+*/
+void CL_TimeDemoFrame(void)
+{
+    frametimes_t* frames;
+
+    // the first frame includes the loading, like the fps figure
+    if (host_framecount > cls.td_startframe)
     {
-        Con_Printf("ERROR: couldn't open.\n");
-        return;
+        if (td_numframes == td_maxframes)
+        {
+            frames = realloc(td_frames, (td_maxframes + 4096) * sizeof(*td_frames));
+            if (frames)
+            {
+                td_frames = frames;
+                td_maxframes += 4096;
+            }
+        }
+        if (td_numframes < td_maxframes)
+            td_frames[td_numframes++] = cl_frametimes;
     }
 
-    cls.forcetrack = track;
-    fprintf(cls.demofile, "%i\n", cls.forcetrack);
+    memset(&cl_frametimes, 0, sizeof(cl_frametimes));
+}
 
-    cls.demorecording = true;
+static int CL_CompareTimes(const void* a, const void* b)
+{
+    double d = *(const double*)a - *(const double*)b;
+    return (d > 0) - (d < 0);
 }
 
 /*
 ====================
-CL_PlayDemo_f
+CL_TimeDemoStats
 
-play [demoname]
+Prints, and optionally writes out, the percentiles of each phase in ms
 ====================
 */
-void CL_PlayDemo_f(void)
+static void CL_TimeDemoStats(void)
 {
-    char name[256];
-    int c;
-    bool neg = false;
+    double* times;
+    double stats[NUM_TDPHASES][5]; // p50 p95 p99 max mean
+    double sum;
+    int i, j, n;
+    char name[MAX_OSPATH];
+    char* ext;
+    FILE* f;
 
-    if (cmd_source != src_command)
+    n = td_numframes;
+    if (!n)
         return;
 
-    if (Cmd_Argc() != 2)
-    {
-        Con_Printf("play <demoname> : plays a demo\n");
+    times = malloc(n * sizeof(*times));
+    if (!times)
         return;
+
+    for (i = 0; i < NUM_TDPHASES; i++)
+    {
+        sum = 0;
+        for (j = 0; j < n; j++)
+        {
+            times[j] = *(double*)((uint8_t*)&td_frames[j] + td_phases[i].offset) * 1000;
+            sum += times[j];
+        }
+        qsort(times, n, sizeof(*times), CL_CompareTimes);
+
+        // nearest rank
+        stats[i][0] = times[(n * 50 + 99) / 100 - 1];
+        stats[i][1] = times[(n * 95 + 99) / 100 - 1];
+        stats[i][2] = times[(n * 99 + 99) / 100 - 1];
+        stats[i][3] = times[n - 1];
+        stats[i][4] = sum / n;
     }
 
-    //
-    // disconnect from server
-    //
-    CL_Disconnect();
+    free(times);
 
-    //
-    // open the demo file
-    //
-    strcpy(name, Cmd_Argv(1));
-    COM_DefaultExtension(name, ".dem");
+    Con_Printf("phase          p50      p95      p99      max     mean (ms)\n");
+    for (i = 0; i < NUM_TDPHASES; i++)
+        Con_Printf("%-10s %8.3f %8.3f %8.3f %8.3f %8.3f\n", td_phases[i].name,
+            stats[i][0], stats[i][1], stats[i][2], stats[i][3], stats[i][4]);
 
-    Con_Printf("Playing demo from %s.\n", name);
-    COM_FOpenFile(name, &cls.demofile);
-    if (!cls.demofile)
+    if (!td_statsfile[0])
+        return;
+
+    sprintf(name, "%s/%s", com_gamedir, td_statsfile);
+    f = fopen(name, "w");
+    if (!f)
     {
-        Con_Printf("ERROR: couldn't open.\n");
-        cls.demonum = -1; // stop demo loop
+        Con_Printf("ERROR: couldn't open %s.\n", name);
         return;
     }
 
-    cls.demoplayback = true;
-    cls.state = ca_connected;
-    cls.forcetrack = 0;
-
-    while ((c = getc(cls.demofile)) != '\n')
-        if (c == '-')
-            neg = true;
-        else
-            cls.forcetrack = cls.forcetrack * 10 + (c - '0');
+    ext = strrchr(name, '.');
+    if (ext && !Q_strcasecmp(ext, ".json"))
+    {
+        fprintf(f, "{\n    \"frames\": %i,\n", n);
+        for (i = 0; i < NUM_TDPHASES; i++)
+            fprintf(f, "    \"%s\": { \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }%s\n",
+                td_phases[i].name, stats[i][0], stats[i][1], stats[i][2], stats[i][3], stats[i][4],
+                i < NUM_TDPHASES - 1 ? "," : "");
+        fprintf(f, "}\n");
+    }
+    else
+    {
+        fprintf(f, "phase,frames,p50,p95,p99,max,mean\n");
+        for (i = 0; i < NUM_TDPHASES; i++)
+            fprintf(f, "%s,%i,%.4f,%.4f,%.4f,%.4f,%.4f\n", td_phases[i].name, n,
+                stats[i][0], stats[i][1], stats[i][2], stats[i][3], stats[i][4]);
+    }
 
-    if (neg)
-        cls.forcetrack = -cls.forcetrack;
-    // ZOID, fscanf is evil
-    //	fscanf (cls.demofile, "%i\n", &cls.forcetrack);
+    fclose(f);
+    Con_Printf("Wrote %s\n", name);
 }
 
 /*
@@ -327,6 +1433,7 @@ void CL_FinishTimeDemo(void)
     float time;
 
     cls.timedemo = false;
+    cls.td_norender = false;
 
     // the first frame didn't count
     frames = (host_framecount - cls.td_startframe) - 1;
@@ -334,6 +1441,31 @@ void CL_FinishTimeDemo(void)
     if (!time)
         time = 1;
     Con_Printf("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames / time);
+
+    CL_TimeDemoStats();
+}
+
+/*
+====================
+CL_StartTimeDemo
+====================
+*/
+static void CL_StartTimeDemo(char* demoname, bool norender, char* statsfile)
+{
+    if (!CL_OpenDemo(demoname))
+        return;
+
+    // cls.td_starttime will be grabbed at the second frame of the demo, so
+    // all the loading time doesn't get counted
+
+    cls.timedemo = true;
+    cls.td_norender = norender;
+    cls.td_startframe = host_framecount;
+    cls.td_lastframe = -1; // get a new message this frame
+
+    td_numframes = 0;
+    memset(&cl_frametimes, 0, sizeof(cl_frametimes));
+    strncpy(td_statsfile, statsfile, sizeof(td_statsfile) - 1);
 }
 
 /*
@@ -354,12 +1486,168 @@ void CL_TimeDemo_f(void)
         return;
     }
 
-    CL_PlayDemo_f();
+    CL_StartTimeDemo(Cmd_Argv(1), false, "");
+}
 
-    // cls.td_starttime will be grabbed at the second frame of the demo, so
-    // all the loading time doesn't get counted
+/*
+====================
+CL_BenchDemo_f
 
-    cls.timedemo = true;
-    cls.td_startframe = host_framecount;
-    cls.td_lastframe = -1; // get a new message this frame
+benchdemo <demoname> [statsfile]
+
+timedemo without rendering, for timing the client side of the frame
+====================
+*/
+void CL_BenchDemo_f(void)
+{
+    if (cmd_source != src_command)
+        return;
+
+    if (Cmd_Argc() != 2 && Cmd_Argc() != 3)
+    {
+        Con_Printf("benchdemo <demoname> [file.csv|file.json] : gets client speeds without rendering\n");
+        return;
+    }
+
+    if (Cmd_Argc() == 3 && strstr(Cmd_Argv(2), ".."))
+    {
+        Con_Printf("Relative pathnames are not allowed.\n");
+        return;
+    }
+
+    CL_StartTimeDemo(Cmd_Argv(1), true, Cmd_Argc() == 3 ? Cmd_Argv(2) : "");
+}
+
+/*
+====================
+CL_ParseBench_f
+
+parsebench <demoname> [passes]
+
+Parses the messages of a demo in a tight loop without rendering, to time
+CL_ParseServerMessage on its own.  The first pass connects and loads the
+level and is not timed, the remaining passes replay everything after the
+signon.  Best used on single level demos, since a level change reloads
+the map on every pass.
+====================
+*/
+void CL_ParseBench_f(void)
+{
+    static uint8_t* demo; // freed on the next run if an error escapes
+    int size, maxsize, len, passes, pass, i;
+    vec3_t angles;
+    bool keyframe;
+    int messages, bytes;
+    uint8_t *p, *end, *loop;
+    double start, time;
+
+    if (cmd_source != src_command)
+        return;
+
+    if (Cmd_Argc() != 2 && Cmd_Argc() != 3)
+    {
+        Con_Printf("parsebench <demoname> [passes] : times message parsing\n");
+        return;
+    }
+
+    passes = (Cmd_Argc() == 3) ? atoi(Cmd_Argv(2)) : 10;
+    if (passes < 1)
+        passes = 1;
+
+    if (!CL_OpenDemo(Cmd_Argv(1)))
+        return;
+
+    // gather the messages into memory in the legacy layout
+    free(demo);
+    demo = NULL;
+    size = maxsize = 0;
+    while (CL_ReadDemoRecord(angles, &keyframe))
+    {
+        if (keyframe)
+            continue;
+
+        len = net_message.cursize;
+        if (size + 16 + len > maxsize)
+        {
+            maxsize = (size + 16 + len) * 2;
+            p = realloc(demo, maxsize);
+            if (!p)
+            {
+                Con_Printf("ERROR: out of memory.\n");
+                CL_StopPlayback();
+                return;
+            }
+            demo = p;
+        }
+
+        i = LittleLong(len);
+        memcpy(demo + size, &i, 4);
+        memset(demo + size + 4, 0, 12); // the angles aren't needed
+        memcpy(demo + size + 16, net_message.data, len);
+        size += 16 + len;
+    }
+
+    p = demo;
+    end = demo + size;
+
+    loop = NULL;
+    messages = bytes = 0;
+    start = 0;
+
+    for (pass = 0; pass <= passes; pass++)
+    {
+        if (pass == 1)
+        {
+            if (!loop)
+                break;
+            start = Sys_FloatTime();
+        }
+        if (pass)
+            p = loop;
+
+        // same layout CL_GetMessage reads: length, view angles, message
+        while (end - p >= 16)
+        {
+            len = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+            if (len < 0 || len > MAX_MSGLEN || len > end - p - 16)
+                break;
+
+            // a disconnect would end the game and take us with it
+            if (len && p[16] == svc_disconnect)
+                break;
+
+            if (!pass && !loop && cls.signon == SIGNONS)
+                loop = p;
+
+            memcpy(net_message.data, p + 16, len);
+            net_message.cursize = len;
+            p += 16 + len;
+
+            CL_ParseServerMessage();
+            SZ_Clear(&cls.message); // nothing is sent during playback
+
+            if (pass)
+            {
+                messages++;
+                bytes += len;
+            }
+        }
+    }
+
+    time = Sys_FloatTime() - start;
+
+    CL_StopPlayback();
+    free(demo);
+    demo = NULL;
+
+    if (!messages)
+    {
+        Con_Printf("%s has no messages after the signon\n", Cmd_Argv(1));
+        return;
+    }
+
+    if (!time)
+        time = 1;
+    Con_Printf("%i passes, %i messages, %i bytes in %.3f seconds\n", passes, messages, bytes, time);
+    Con_Printf("%.0f messages/sec, %.2f MB/sec\n", messages / time, bytes / time / (1024 * 1024));
 }
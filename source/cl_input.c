@@ -374,6 +374,10 @@ void CL_SendMove(usercmd_t* cmd)
     MSG_WriteByte(&buf, in_impulse);
     in_impulse = 0;
 
+    // acknowledge the last svc_packetentities so the server can delta from it
+    if (cl.protocol == PROTOCOL_BITPACK)
+        MSG_WriteShort(&buf, cl.frameack);
+
     //
     // deliver the message
     //
@@ -592,10 +592,14 @@ int CL_ReadFromServer(void)
     beam_t* b; //johnfitz
     dlight_t* l; //johnfitz
     int i; //johnfitz
+    double time1, time2;
 
     cl.oldtime = cl.time;
     cl.time += host_frametime;
 
+    if (cls.timedemo)
+        time1 = Sys_FloatTime();
+
     do
     {
         ret = CL_GetMessage();
@@ -611,9 +615,18 @@ int CL_ReadFromServer(void)
     if (cl_shownet.value)
         Con_Printf("\n");
 
+    if (cls.timedemo)
+        time2 = Sys_FloatTime();
+
     CL_RelinkEntities();
     CL_UpdateTEnts();
 
+    if (cls.timedemo)
+    {
+        cl_frametimes.parse = time2 - time1;
+        cl_frametimes.relink = Sys_FloatTime() - time2;
+    }
+
     //johnfitz -- devstats
 
     //visedicts
@@ -773,6 +786,10 @@ void CL_Init(void)
     Cvar_RegisterVariable(&cl_pitchspeed, NULL);
     Cvar_RegisterVariable(&cl_anglespeedkey, NULL);
     Cvar_RegisterVariable(&cl_shownet, NULL);
+    Cvar_RegisterVariable(&cl_packstats, NULL);
+    Cvar_RegisterVariable(&cl_parseprofile, NULL);
+    Cvar_RegisterVariable(&demo_compress, NULL);
+    Cvar_RegisterVariable(&demo_keyframe, NULL);
     Cvar_RegisterVariable(&cl_nolerp, NULL);
     Cvar_RegisterVariable(&lookspring, NULL);
     Cvar_RegisterVariable(&lookstrafe, NULL);
@@ -792,6 +809,11 @@ void CL_Init(void)
     Cmd_AddCommand("stop", CL_Stop_f);
     Cmd_AddCommand("playdemo", CL_PlayDemo_f);
     Cmd_AddCommand("timedemo", CL_TimeDemo_f);
+    Cmd_AddCommand("benchdemo", CL_BenchDemo_f);
+    Cmd_AddCommand("demoseek", CL_DemoSeek_f);
+    Cmd_AddCommand("packstats", CL_PackStats_f);
+    Cmd_AddCommand("parseprofile", CL_ParseProfile_f);
+    Cmd_AddCommand("parsebench", CL_ParseBench_f);
 
     Cmd_AddCommand("tracepos", CL_Tracepos_f); //johnfitz
     Cmd_AddCommand("viewpos", CL_Viewpos_f); //johnfitz
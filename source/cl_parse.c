@@ -76,19 +76,21 @@ char* svc_strings[] = {
     "svc_spawnbaseline2", //42			// support for large modelindex, large framenum, alpha, using flags
     "svc_spawnstatic2", // 43			// support for large modelindex, large framenum, alpha, using flags
     "svc_spawnstaticsound2", //	44		// [coord3] [short] samp [byte] vol [byte] aten
-    "", // 44
     "", // 45
     "", // 46
     "", // 47
     "", // 48
     "", // 49
     //johnfitz
+    "svc_packetentities", // 50		// PROTOCOL_BITPACK
 };
 
 bool warn_about_nehahra_protocol; //johnfitz
 
 extern vec3_t v_punchangles[2]; //johnfitz
 
+static void CL_PackStats_Reset(void);
+
 //=============================================================================
 
 /*
@@ -259,18 +261,24 @@ void CL_ParseServerInfo(void)
     // wipe the client_state_t struct
     //
     CL_ClearState();
+    cls.serverinfos++;
 
     // parse protocol version number
     i = MSG_ReadLong();
     //johnfitz -- support multiple protocols
-    if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE)
+    if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_BITPACK)
     {
         Con_Printf("\n"); //becuase there's no newline after serverinfo print
-        Host_Error("Server returned version %i, not %i or %i\n", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE);
+        Host_Error("Server returned version %i, not %i, %i or %i\n", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_BITPACK);
     }
     cl.protocol = i;
     //johnfitz
 
+    cl.frameack = -1;
+    if (cl.protocol == PROTOCOL_BITPACK)
+        cl.packetframes = Hunk_AllocName(UPDATE_BACKUP * sizeof(packetframe_t), "packetframes");
+    CL_PackStats_Reset();
+
     // parse maxclients
     cl.maxclients = MSG_ReadByte();
     if (cl.maxclients < 1 || cl.maxclients > MAX_SCOREBOARD)
@@ -387,24 +395,335 @@ void CL_ParseServerInfo(void)
 
 /*
 ==================
-CL_ParseUpdate
+CL_PackBaseline
 
-Parse an entity update message from the server
+Baseline callback for MSG_ReadPacketEntities
+==================
+*/
+void CL_PackBaseline(int number, packedentity_t* to)
+{
+    Delta_PackState(to, number, &CL_EntityNum(number)->baseline);
+}
+
+/*
+==================
+CL_UpdateEntity
+
+Applies a complete entity state from either update format
 If an entities model or origin changes from frame to frame, it must be
 relinked.  Other attributes can change without relinking.
 ==================
 */
-int bitcounts[16];
-
-void CL_ParseUpdate(int bits)
+static void CL_UpdateEntity(packedentity_t* state)
 {
     int i;
     model_t* model;
-    int modnum;
     bool forcelink;
     entity_t* ent;
     int num;
-    int skin;
+
+    num = state->number;
+    ent = CL_EntityNum(num);
+
+    if (ent->msgtime != cl.mtime[1])
+        forcelink = true; // no previous frame to lerp from
+    else
+        forcelink = false;
+
+    //johnfitz -- lerping
+    if (ent->msgtime + 0.2 < cl.mtime[0]) //more than 0.2 seconds since the last message (most entities think every 0.1 sec)
+        ent->lerpflags |= LERP_RESETANIM; //if we missed a think, we'd be lerping from the wrong frame
+    //johnfitz
+
+    ent->msgtime = cl.mtime[0];
+
+    if (state->modelindex >= MAX_MODELS)
+        Host_Error("CL_ParseModel: bad modnum");
+
+    ent->frame = state->frame;
+
+    i = state->colormap;
+    if (!i)
+        ent->colormap = vid.colormap;
+    else
+    {
+        if (i > cl.maxclients)
+            Sys_Error("i >= cl.maxclients");
+        ent->colormap = cl.scores[i - 1].translations;
+    }
+    if (state->skin != ent->skinnum)
+    {
+        ent->skinnum = state->skin;
+        if (num > 0 && num <= cl.maxclients)
+            R_TranslateNewPlayerSkin(num - 1); //johnfitz -- was R_TranslatePlayerSkin
+    }
+    ent->effects = state->effects;
+
+    // shift the known values for interpolation
+    VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
+    VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
+
+    // same scaling as MSG_ReadCoord and MSG_ReadAngle
+    for (i = 0; i < 3; i++)
+    {
+        ent->msg_origins[0][i] = state->origin[i] * (1.0 / 8);
+        ent->msg_angles[0][i] = (signed char)state->angles[i] * (360.0 / 256);
+    }
+
+    //johnfitz -- lerping for movetype_step entities
+    if (state->flags & PEF_STEP)
+    {
+        ent->lerpflags |= LERP_MOVESTEP;
+        ent->forcelink = true;
+    }
+    else
+        ent->lerpflags &= ~LERP_MOVESTEP;
+    //johnfitz
+
+    ent->alpha = state->alpha;
+    if (state->flags & PEF_LERPFINISH)
+    {
+        ent->lerpfinish = ent->msgtime + ((float)state->lerpfinish / 255);
+        ent->lerpflags |= LERP_FINISH;
+    }
+    else
+        ent->lerpflags &= ~LERP_FINISH;
+
+    //johnfitz -- moved here from above
+    model = cl.model_precache[state->modelindex];
+    if (model != ent->model)
+    {
+        ent->model = model;
+        // automatic animation (torches, etc) can be either all together
+        // or randomized
+        if (model)
+        {
+            if (model->synctype == ST_RAND)
+                ent->syncbase = (float)(rand() & 0x7fff) / 0x7fff;
+            else
+                ent->syncbase = 0.0;
+        }
+        else
+            forcelink = true; // hack to make null model players work
+        if (num > 0 && num <= cl.maxclients)
+            R_TranslateNewPlayerSkin(num - 1); //johnfitz -- was R_TranslatePlayerSkin
+
+        ent->lerpflags |= LERP_RESETANIM; //johnfitz -- don't lerp animation across model changes
+    }
+    //johnfitz
+
+    if (forcelink)
+    { // didn't have an update last message
+        VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
+        VectorCopy(ent->msg_origins[0], ent->origin);
+        VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
+        VectorCopy(ent->msg_angles[0], ent->angles);
+        ent->forcelink = true;
+    }
+}
+
+/*
+==============================================================================
+
+PACKET STATISTICS
+
+With cl_packstats set, every standard entity update read is also shadow
+encoded in the PROTOCOL_BITPACK format, delta coded against the previous
+message as if every frame had been acked.  Play demos with timedemo and
+use packstats to compare the sizes.
+
+==============================================================================
+*/
+
+cvar_t cl_packstats = { "cl_packstats", "0" };
+
+static struct
+{
+    int messages; // messages that carried entity updates
+    int entities;
+    int stdbytes; // standard updates, as read
+    int packedbytes; // svc_packetentities, including its header
+    int maxstd; // largest per message
+    int maxpacked;
+} packstats;
+
+static packetframe_t packstats_frames[2];
+static int packstats_current;
+static int packstats_msgbytes;
+
+/*
+==================
+CL_PackStats_Update
+
+Records one parsed standard update
+==================
+*/
+static void CL_PackStats_Update(packedentity_t* state, int bytes)
+{
+    packetframe_t* frame;
+
+    frame = &packstats_frames[packstats_current];
+    if (frame->numentities == MAX_PACKET_ENTITIES)
+        return;
+    // the delta coder needs the entities sorted, which the server already does
+    if (frame->numentities && frame->entities[frame->numentities - 1].number >= state->number)
+        return;
+    frame->entities[frame->numentities++] = *state;
+    packstats_msgbytes += bytes;
+}
+
+/*
+==================
+CL_PackStats_EndMessage
+
+Encodes the entities seen in the message just parsed
+==================
+*/
+static void CL_PackStats_EndMessage(void)
+{
+    static uint8_t buf[MAX_DATAGRAM];
+    sizebuf_t msg;
+    packetframe_t *from, *to;
+
+    to = &packstats_frames[packstats_current];
+    if (!to->numentities)
+        return;
+
+    from = &packstats_frames[packstats_current ^ 1];
+    msg.data = buf;
+    msg.maxsize = sizeof(buf);
+    msg.allowoverflow = true;
+    msg.overflowed = false;
+    SZ_Clear(&msg);
+    MSG_WritePacketEntities(&msg, from->valid ? from : NULL, to, CL_PackBaseline);
+
+    packstats.messages++;
+    packstats.entities += to->numentities;
+    packstats.stdbytes += packstats_msgbytes;
+    packstats.packedbytes += msg.cursize + 3; // svc, sequence, delta
+    if (packstats.maxstd < packstats_msgbytes)
+        packstats.maxstd = packstats_msgbytes;
+    if (packstats.maxpacked < msg.cursize + 3)
+        packstats.maxpacked = msg.cursize + 3;
+
+    to->valid = true;
+    packstats_current ^= 1;
+    packstats_frames[packstats_current].numentities = 0;
+    packstats_msgbytes = 0;
+}
+
+/*
+==================
+CL_PackStats_Reset
+
+The shadow frames do not carry across servers or demos
+==================
+*/
+static void CL_PackStats_Reset(void)
+{
+    packstats_frames[0].numentities = packstats_frames[1].numentities = 0;
+    packstats_frames[0].valid = packstats_frames[1].valid = false;
+    packstats_msgbytes = 0;
+}
+
+/*
+==================
+CL_PackStats_f
+==================
+*/
+void CL_PackStats_f(void)
+{
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "clear"))
+    {
+        memset(&packstats, 0, sizeof(packstats));
+        CL_PackStats_Reset();
+        return;
+    }
+
+    if (!packstats.messages)
+    {
+        Con_Printf("no entity updates recorded, set cl_packstats 1 and play some demos\n");
+        return;
+    }
+
+    Con_Printf("%i messages, %i entity updates\n", packstats.messages, packstats.entities);
+    Con_Printf("standard: %8i bytes, %6.1f per message, %i max\n",
+        packstats.stdbytes, (float)packstats.stdbytes / packstats.messages, packstats.maxstd);
+    Con_Printf("bitpack:  %8i bytes, %6.1f per message, %i max\n",
+        packstats.packedbytes, (float)packstats.packedbytes / packstats.messages, packstats.maxpacked);
+    Con_Printf("ratio:    %8.3f\n", (float)packstats.packedbytes / packstats.stdbytes);
+}
+
+//=============================================================================
+
+/*
+==================
+CL_UpdateSize
+
+Bytes following the entity number of an update, not counting the
+variable length nehahra fields
+==================
+*/
+static int CL_UpdateSize(int bits)
+{
+    int size;
+
+    size = 0;
+    if (bits & U_MODEL)
+        size++;
+    if (bits & U_FRAME)
+        size++;
+    if (bits & U_COLORMAP)
+        size++;
+    if (bits & U_SKIN)
+        size++;
+    if (bits & U_EFFECTS)
+        size++;
+    if (bits & U_ORIGIN1)
+        size += 2;
+    if (bits & U_ORIGIN2)
+        size += 2;
+    if (bits & U_ORIGIN3)
+        size += 2;
+    if (bits & U_ANGLE1)
+        size++;
+    if (bits & U_ANGLE2)
+        size++;
+    if (bits & U_ANGLE3)
+        size++;
+
+    if (cl.protocol != PROTOCOL_NETQUAKE)
+    {
+        if (bits & U_ALPHA)
+            size++;
+        if (bits & U_FRAME2)
+            size++;
+        if (bits & U_MODEL2)
+            size++;
+        if (bits & U_LERPFINISH)
+            size++;
+    }
+
+    return size;
+}
+
+/*
+==================
+CL_ParseUpdate
+
+Parse an entity update message from the server
+==================
+*/
+int bitcounts[16];
+
+void CL_ParseUpdate(int bits)
+{
+    int i;
+    int num;
+    int start;
+    packedentity_t state;
+
+    start = msg_readcount - 1; // include the command byte
 
     if (cls.signon == SIGNONS - 1)
     { // first update is the final signon stage
@@ -419,7 +738,7 @@ void CL_ParseUpdate(int bits)
     }
 
     //johnfitz -- PROTOCOL_FITZQUAKE
-    if (cl.protocol == PROTOCOL_FITZQUAKE)
+    if (cl.protocol != PROTOCOL_NETQUAKE)
     {
         if (bits & U_EXTEND1)
             bits |= MSG_ReadByte() << 16;
@@ -433,126 +752,62 @@ void CL_ParseUpdate(int bits)
     else
         num = MSG_ReadByte();
 
-    ent = CL_EntityNum(num);
-
     for (i = 0; i < 16; i++)
         if (bits & (1 << i))
             bitcounts[i]++;
 
-    if (ent->msgtime != cl.mtime[1])
-        forcelink = true; // no previous frame to lerp from
-    else
-        forcelink = false;
-
-    //johnfitz -- lerping
-    if (ent->msgtime + 0.2 < cl.mtime[0]) //more than 0.2 seconds since the last message (most entities think every 0.1 sec)
-        ent->lerpflags |= LERP_RESETANIM; //if we missed a think, we'd be lerping from the wrong frame
-    //johnfitz
+    // start from the baseline and overwrite whatever was sent
+    CL_PackBaseline(num, &state);
 
-    ent->msgtime = cl.mtime[0];
+    // everything but the nehahra fields is fixed size, so check it once
+    if (!MSG_CheckRead(CL_UpdateSize(bits)))
+        return;
 
     if (bits & U_MODEL)
-    {
-        modnum = MSG_ReadByte();
-        if (modnum >= MAX_MODELS)
-            Host_Error("CL_ParseModel: bad modnum");
-    }
-    else
-        modnum = ent->baseline.modelindex;
-
+        state.modelindex = MSG_NextByte();
     if (bits & U_FRAME)
-        ent->frame = MSG_ReadByte();
-    else
-        ent->frame = ent->baseline.frame;
-
+        state.frame = MSG_NextByte();
     if (bits & U_COLORMAP)
-        i = MSG_ReadByte();
-    else
-        i = ent->baseline.colormap;
-    if (!i)
-        ent->colormap = vid.colormap;
-    else
-    {
-        if (i > cl.maxclients)
-            Sys_Error("i >= cl.maxclients");
-        ent->colormap = cl.scores[i - 1].translations;
-    }
+        state.colormap = MSG_NextByte();
     if (bits & U_SKIN)
-        skin = MSG_ReadByte();
-    else
-        skin = ent->baseline.skin;
-    if (skin != ent->skinnum)
-    {
-        ent->skinnum = skin;
-        if (num > 0 && num <= cl.maxclients)
-            R_TranslateNewPlayerSkin(num - 1); //johnfitz -- was R_TranslatePlayerSkin
-    }
+        state.skin = MSG_NextByte();
     if (bits & U_EFFECTS)
-        ent->effects = MSG_ReadByte();
-    else
-        ent->effects = ent->baseline.effects;
-
-    // shift the known values for interpolation
-    VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
-    VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
+        state.effects = MSG_NextByte();
 
+    // the wire formats of MSG_WriteCoord and MSG_WriteAngle are already
+    // the packed representation
     if (bits & U_ORIGIN1)
-        ent->msg_origins[0][0] = MSG_ReadCoord();
-    else
-        ent->msg_origins[0][0] = ent->baseline.origin[0];
+        state.origin[0] = MSG_NextShort();
     if (bits & U_ANGLE1)
-        ent->msg_angles[0][0] = MSG_ReadAngle();
-    else
-        ent->msg_angles[0][0] = ent->baseline.angles[0];
-
+        state.angles[0] = MSG_NextByte();
     if (bits & U_ORIGIN2)
-        ent->msg_origins[0][1] = MSG_ReadCoord();
-    else
-        ent->msg_origins[0][1] = ent->baseline.origin[1];
+        state.origin[1] = MSG_NextShort();
     if (bits & U_ANGLE2)
-        ent->msg_angles[0][1] = MSG_ReadAngle();
-    else
-        ent->msg_angles[0][1] = ent->baseline.angles[1];
-
+        state.angles[1] = MSG_NextByte();
     if (bits & U_ORIGIN3)
-        ent->msg_origins[0][2] = MSG_ReadCoord();
-    else
-        ent->msg_origins[0][2] = ent->baseline.origin[2];
+        state.origin[2] = MSG_NextShort();
     if (bits & U_ANGLE3)
-        ent->msg_angles[0][2] = MSG_ReadAngle();
-    else
-        ent->msg_angles[0][2] = ent->baseline.angles[2];
+        state.angles[2] = MSG_NextByte();
 
-    //johnfitz -- lerping for movetype_step entities
     if (bits & U_STEP)
-    {
-        ent->lerpflags |= LERP_MOVESTEP;
-        ent->forcelink = true;
-    }
-    else
-        ent->lerpflags &= ~LERP_MOVESTEP;
-    //johnfitz
+        state.flags |= PEF_STEP;
 
     //johnfitz -- PROTOCOL_FITZQUAKE and PROTOCOL_NEHAHRA
-    if (cl.protocol == PROTOCOL_FITZQUAKE)
+    if (cl.protocol != PROTOCOL_NETQUAKE)
     {
         if (bits & U_ALPHA)
-            ent->alpha = MSG_ReadByte();
-        else
-            ent->alpha = ent->baseline.alpha;
+            state.alpha = MSG_NextByte();
         if (bits & U_FRAME2)
-            ent->frame = (ent->frame & 0x00FF) | (MSG_ReadByte() << 8);
+            state.frame = (state.frame & 0x00FF) | (MSG_NextByte() << 8);
         if (bits & U_MODEL2)
-            modnum = (modnum & 0x00FF) | (MSG_ReadByte() << 8);
+            state.modelindex = (state.modelindex & 0x00FF) | (MSG_NextByte() << 8);
         if (bits & U_LERPFINISH)
         {
-            ent->lerpfinish = ent->msgtime + ((float)(MSG_ReadByte()) / 255);
-            ent->lerpflags |= LERP_FINISH;
+            state.lerpfinish = MSG_NextByte();
+            state.flags |= PEF_LERPFINISH;
         }
-        else
-            ent->lerpflags &= ~LERP_FINISH;
     }
-    else if (cl.protocol == PROTOCOL_NETQUAKE)
+    else
     {
         //HACK: if this bit is set, assume this is PROTOCOL_NEHAHRA
         if (bits & U_TRANS)
@@ -569,44 +824,72 @@ void CL_ParseUpdate(int bits)
             b = MSG_ReadFloat(); //alpha
             if (a == 2)
                 MSG_ReadFloat(); //fullbright (not using this yet)
-            ent->alpha = ENTALPHA_ENCODE(b);
+            state.alpha = ENTALPHA_ENCODE(b);
         }
-        else
-            ent->alpha = ent->baseline.alpha;
     }
     //johnfitz
 
-    //johnfitz -- moved here from above
-    model = cl.model_precache[modnum];
-    if (model != ent->model)
-    {
-        ent->model = model;
-        // automatic animation (torches, etc) can be either all together
-        // or randomized
-        if (model)
-        {
-            if (model->synctype == ST_RAND)
-                ent->syncbase = (float)(rand() & 0x7fff) / 0x7fff;
-            else
-                ent->syncbase = 0.0;
-        }
-        else
-            forcelink = true; // hack to make null model players work
-        if (num > 0 && num <= cl.maxclients)
-            R_TranslateNewPlayerSkin(num - 1); //johnfitz -- was R_TranslatePlayerSkin
+    if (cl_packstats.value)
+        CL_PackStats_Update(&state, msg_readcount - start);
 
-        ent->lerpflags |= LERP_RESETANIM; //johnfitz -- don't lerp animation across model changes
+    CL_UpdateEntity(&state);
+}
+
+/*
+==================
+CL_ParsePacketEntities
+
+PROTOCOL_BITPACK replacement for a message full of standard updates
+==================
+*/
+void CL_ParsePacketEntities(void)
+{
+    packetframe_t *from, *to, *last;
+    int sequence, delta;
+    int i;
+
+    if (!cl.packetframes)
+        Host_Error("CL_ParsePacketEntities: svc_packetentities without PROTOCOL_BITPACK");
+
+    if (cls.signon == SIGNONS - 1)
+    { // first update is the final signon stage
+        cls.signon = SIGNONS;
+        CL_SignonReply();
     }
-    //johnfitz
 
-    if (forcelink)
-    { // didn't have an update last message
-        VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
-        VectorCopy(ent->msg_origins[0], ent->origin);
-        VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
-        VectorCopy(ent->msg_angles[0], ent->angles);
-        ent->forcelink = true;
+    sequence = MSG_ReadByte();
+    delta = MSG_ReadByte();
+
+    from = NULL;
+    if (delta)
+    {
+        from = &cl.packetframes[(sequence - delta) & UPDATE_MASK];
+        if (!from->valid || from->sequence != ((sequence - delta) & 255))
+            from = NULL;
     }
+
+    to = &cl.packetframes[sequence & UPDATE_MASK];
+    MSG_ReadPacketEntities(from, to, CL_PackBaseline);
+    to->sequence = sequence;
+    to->valid = (!delta || from);
+
+    if (!to->valid)
+    {
+        // the reference frame is gone, which only happens when a demo
+        // starts mid stream. the last good frame is applied again so its
+        // entities stay put until the server falls back to the baselines,
+        // rather than going stale and disappearing
+        Con_DPrintf("CL_ParsePacketEntities: delta from invalid frame %i\n", (sequence - delta) & 255);
+        last = cl.frameack < 0 ? NULL : &cl.packetframes[cl.frameack & UPDATE_MASK];
+        if (last && last->valid && last->sequence == cl.frameack)
+            for (i = 0; i < last->numentities; i++)
+                CL_UpdateEntity(&last->entities[i]);
+        return;
+    }
+
+    cl.frameack = sequence;
+    for (i = 0; i < to->numentities; i++)
+        CL_UpdateEntity(&to->entities[i]);
 }
 
 /*
@@ -902,6 +1185,84 @@ void CL_ParseStaticSound(int version) //johnfitz -- added argument
     if (cl_shownet.value == 2) \
         Con_Printf("%3i:%s\n", msg_readcount - 1, x);
 
+/*
+==============================================================================
+
+PARSE PROFILE
+
+With cl_parseprofile set, the time and bytes spent in each server command
+are accumulated, with all fast updates counted under one slot.  The
+parseprofile command prints the totals.
+
+==============================================================================
+*/
+
+cvar_t cl_parseprofile = { "cl_parseprofile", "0" };
+
+#define PROFILE_FASTUPDATE U_SIGNAL // slot for all fast updates
+
+static struct
+{
+    double time;
+    int count;
+    int bytes;
+} parseprofile[PROFILE_FASTUPDATE + 1];
+
+/*
+==================
+CL_ParseProfile_f
+==================
+*/
+void CL_ParseProfile_f(void)
+{
+    int i, j, best;
+    bool done[PROFILE_FASTUPDATE + 1];
+    double total;
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "clear"))
+    {
+        memset(parseprofile, 0, sizeof(parseprofile));
+        return;
+    }
+
+    total = 0;
+    for (i = 0; i <= PROFILE_FASTUPDATE; i++)
+    {
+        total += parseprofile[i].time;
+        done[i] = !parseprofile[i].count;
+    }
+
+    if (!total)
+    {
+        Con_Printf("nothing profiled, set cl_parseprofile 1 and play a demo\n");
+        return;
+    }
+
+    Con_Printf("command                  count      bytes       ms  ns/cmd     %%\n");
+
+    // most expensive first
+    for (i = 0; i <= PROFILE_FASTUPDATE; i++)
+    {
+        best = -1;
+        for (j = 0; j <= PROFILE_FASTUPDATE; j++)
+            if (!done[j] && (best == -1 || parseprofile[j].time > parseprofile[best].time))
+                best = j;
+        if (best == -1)
+            break;
+        done[best] = true;
+
+        Con_Printf("%-22s %7i %10i %8.2f %7.0f %5.1f\n",
+            best == PROFILE_FASTUPDATE ? "fast update" : svc_strings[best],
+            parseprofile[best].count,
+            parseprofile[best].bytes,
+            parseprofile[best].time * 1000,
+            parseprofile[best].time * 1000000000 / parseprofile[best].count,
+            parseprofile[best].time * 100 / total);
+    }
+
+    Con_Printf("total %.2f ms\n", total * 1000);
+}
+
 /*
 =====================
 CL_ParseServerMessage
@@ -917,6 +1278,8 @@ void CL_ParseServerMessage(void)
     int i;
     char* str; //johnfitz
     int total, j, lastcmd; //johnfitz
+    int profcmd, profstart;
+    double proftime;
 
     //
     // if recording demos, copy the message out
@@ -932,19 +1295,43 @@ void CL_ParseServerMessage(void)
     //
     MSG_BeginReading();
 
+    profcmd = -1;
+    profstart = 0;
+    proftime = 0;
+
     while (1)
     {
+        // every command ends up back here, so charge the last one
+        if (profcmd != -1)
+        {
+            parseprofile[profcmd].time += Sys_FloatTime() - proftime;
+            parseprofile[profcmd].bytes += msg_readcount - profstart;
+            parseprofile[profcmd].count++;
+            profcmd = -1;
+        }
+
         if (msg_badread)
             Host_Error("CL_ParseServerMessage: Bad server message");
 
+        if (cl_parseprofile.value)
+        {
+            proftime = Sys_FloatTime();
+            profstart = msg_readcount;
+        }
+
         cmd = MSG_ReadByte();
 
         if (cmd == -1)
         {
             SHOWNET("END OF MESSAGE");
+            if (cl_packstats.value)
+                CL_PackStats_EndMessage();
             return; // end of message
         }
 
+        if (cl_parseprofile.value)
+            profcmd = (cmd & U_SIGNAL) ? PROFILE_FASTUPDATE : cmd;
+
         // if the high bit of the command byte is set, it is a fast update
         if (cmd & U_SIGNAL) //johnfitz -- was 128, changed for clarity
         {
@@ -978,8 +1365,8 @@ void CL_ParseServerMessage(void)
         case svc_version:
             i = MSG_ReadLong();
             //johnfitz -- support multiple protocols
-            if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE)
-                Host_Error("Server returned version %i, not %i or %i\n", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE);
+            if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_BITPACK)
+                Host_Error("Server returned version %i, not %i, %i or %i\n", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_BITPACK);
             cl.protocol = i;
             //johnfitz
             break;
@@ -1217,6 +1604,10 @@ void CL_ParseServerMessage(void)
             CL_ParseStaticSound(2);
             break;
             //johnfitz
+
+        case svc_packetentities: //PROTOCOL_BITPACK
+            CL_ParsePacketEntities();
+            break;
         }
 
         lastcmd = cmd; //johnfitz
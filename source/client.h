@@ -126,6 +126,8 @@ typedef struct
     int td_lastframe; // to meter out one message a frame
     int td_startframe; // host_framecount at start
     float td_starttime; // realtime at second frame of timedemo
+    bool td_norender; // benchdemo, skip SCR_UpdateScreen
+    int serverinfos; // svc_serverinfo messages parsed, marks level starts in demos
 
     // connection information
     int signon; // 0 to SIGNONS
@@ -221,8 +223,23 @@ typedef struct
     scoreboard_t* scores; // [cl.maxclients]
 
     unsigned protocol; //johnfitz
+
+    packetframe_t* packetframes; // [UPDATE_BACKUP], only for PROTOCOL_BITPACK
+    int frameack; // last packetentities sequence received, -1 for none
 } client_state_t;
 
+// per frame timings in seconds, collected while cls.timedemo is set
+typedef struct
+{
+    double frame;
+    double parse; // CL_GetMessage and CL_ParseServerMessage
+    double relink; // CL_RelinkEntities and CL_UpdateTEnts
+    double particles;
+    double sound; // S_Update
+} frametimes_t;
+
+extern frametimes_t cl_frametimes;
+
 //
 // cvars
 //
@@ -244,6 +261,10 @@ extern cvar_t cl_anglespeedkey;
 extern cvar_t cl_autofire;
 
 extern cvar_t cl_shownet;
+extern cvar_t cl_packstats;
+extern cvar_t cl_parseprofile;
+extern cvar_t demo_compress;
+extern cvar_t demo_keyframe;
 extern cvar_t cl_nolerp;
 
 extern cvar_t cl_pitchdriftspeed;
@@ -334,11 +355,18 @@ void CL_Stop_f(void);
 void CL_Record_f(void);
 void CL_PlayDemo_f(void);
 void CL_TimeDemo_f(void);
+void CL_DemoSeek_f(void);
+void CL_BenchDemo_f(void);
+void CL_TimeDemoFrame(void);
+void CL_ParseBench_f(void);
 
 //
 // cl_parse.c
 //
 void CL_ParseServerMessage(void);
+void CL_PackStats_f(void);
+void CL_ParseProfile_f(void);
+void CL_PackBaseline(int number, packedentity_t* to);
 void CL_NewTranslation(int slot);
 
 //
@@ -605,16 +605,63 @@ void MSG_WriteAngle16(sizebuf_t* sb, float f)
 }
 //johnfitz
 
+/*
+==================
+MSG_WriteBits
+
+Appends the low bits of value, least significant bit first.  Consecutive
+calls share bytes; any byte oriented write starts on a fresh byte again.
+==================
+*/
+void MSG_WriteBits(sizebuf_t* sb, unsigned int value, int bits)
+{
+    uint8_t* buf;
+    int bitpos, n;
+
+#ifdef PARANOID
+    if (bits < 1 || bits > 32)
+        Sys_Error("MSG_WriteBits: bad bit count %i", bits);
+#endif
+
+    bitpos = sb->cursize ? sb->bitpos : 0;
+
+    while (bits > 0)
+    {
+        if (!bitpos)
+        {
+            buf = SZ_GetSpace(sb, 1);
+            buf[0] = 0;
+        }
+        else
+            buf = sb->data + sb->cursize - 1;
+
+        n = 8 - bitpos;
+        if (n > bits)
+            n = bits;
+
+        buf[0] |= (value & ((1 << n) - 1)) << bitpos;
+        value >>= n;
+        bits -= n;
+        bitpos = (bitpos + n) & 7;
+    }
+
+    sb->bitpos = bitpos;
+}
+
 //
 // reading functions
 //
 int msg_readcount;
 bool msg_badread;
 
+static int msg_readbit; // bits of net_message.data[msg_readcount - 1] used by MSG_ReadBits
+static int msg_readbitcount; // msg_readcount when msg_readbit was last set
+
 void MSG_BeginReading(void)
 {
     msg_readcount = 0;
     msg_badread = false;
+    msg_readbit = 0;
 }
 
 // returns -1 and sets msg_badread if no more characters are available
@@ -691,18 +738,22 @@ int MSG_ReadLong(void)
 float MSG_ReadFloat(void)
 {
     union {
-        uint8_t b[4];
         float f;
         int l;
     } dat;
 
-    dat.b[0] = net_message.data[msg_readcount];
-    dat.b[1] = net_message.data[msg_readcount + 1];
-    dat.b[2] = net_message.data[msg_readcount + 2];
-    dat.b[3] = net_message.data[msg_readcount + 3];
-    msg_readcount += 4;
+    if (msg_readcount + 4 > net_message.cursize)
+    {
+        msg_badread = true;
+        return -1;
+    }
 
-    dat.l = LittleLong(dat.l);
+    // assemble the little endian value directly instead of calling LittleLong
+    dat.l = net_message.data[msg_readcount]
+        + (net_message.data[msg_readcount + 1] << 8)
+        + (net_message.data[msg_readcount + 2] << 16)
+        + (net_message.data[msg_readcount + 3] << 24);
+    msg_readcount += 4;
 
     return dat.f;
 }
@@ -762,6 +813,52 @@ float MSG_ReadAngle16(void)
 }
 //johnfitz
 
+/*
+==================
+MSG_ReadBits
+
+Counterpart of MSG_WriteBits; a byte oriented read in between moves on to
+the next whole byte
+==================
+*/
+unsigned int MSG_ReadBits(int bits)
+{
+    unsigned int value;
+    int shift, n, c;
+
+    if (msg_readbitcount != msg_readcount)
+        msg_readbit = 0;
+
+    value = 0;
+    shift = 0;
+
+    while (bits > 0)
+    {
+        if (!msg_readbit)
+        {
+            if (msg_readcount + 1 > net_message.cursize)
+            {
+                msg_badread = true;
+                return 0;
+            }
+            msg_readcount++;
+        }
+
+        c = net_message.data[msg_readcount - 1] >> msg_readbit;
+        n = 8 - msg_readbit;
+        if (n > bits)
+            n = bits;
+
+        value |= (unsigned int)(c & ((1 << n) - 1)) << shift;
+        shift += n;
+        bits -= n;
+        msg_readbit = (msg_readbit + n) & 7;
+    }
+
+    msg_readbitcount = msg_readcount;
+    return value;
+}
+
 //===========================================================================
 
 void SZ_Alloc(sizebuf_t* buf, int startsize)
@@ -771,6 +868,7 @@ void SZ_Alloc(sizebuf_t* buf, int startsize)
     buf->data = Hunk_AllocName(startsize, "sizebuf");
     buf->maxsize = startsize;
     buf->cursize = 0;
+    buf->bitpos = 0;
 }
 
 void SZ_Free(sizebuf_t* buf)
@@ -784,6 +882,7 @@ void SZ_Free(sizebuf_t* buf)
 void SZ_Clear(sizebuf_t* buf)
 {
     buf->cursize = 0;
+    buf->bitpos = 0;
 }
 
 void* SZ_GetSpace(sizebuf_t* buf, int length)
@@ -805,6 +904,7 @@ void* SZ_GetSpace(sizebuf_t* buf, int length)
 
     data = buf->data + buf->cursize;
     buf->cursize += length;
+    buf->bitpos = 0;
 
     return data;
 }
@@ -1254,6 +1354,28 @@ typedef struct searchpath_s
 
 searchpath_t* com_searchpaths;
 
+/*
+============
+COM_PackFileName -- the name of file number index across all the pak files in the search path,
+NULL past the last one. for commands that go over everything the game ships with
+============
+*/
+const char* COM_PackFileName(int index)
+{
+    searchpath_t* search;
+
+    for (search = com_searchpaths; search; search = search->next)
+    {
+        if (!search->pack)
+            continue;
+        if (index < search->pack->numfiles)
+            return search->pack->files[index].name;
+        index -= search->pack->numfiles;
+    }
+
+    return NULL;
+}
+
 /*
 ============
 COM_Path_f
@@ -1560,6 +1682,8 @@ uint8_t* COM_LoadFile(const char* path, int usehunk)
         else
             buf = loadbuf;
     }
+    else if (usehunk == 5)
+        buf = malloc(len + 1);
     else
         Sys_Error("COM_LoadFile: bad usehunk");
 
@@ -1591,6 +1715,12 @@ void COM_LoadCacheFile(const char* path, struct cache_user_s* cu)
     COM_LoadFile(path, 3);
 }
 
+// off the hunk, so several can be held while the hunk is in use; free it when done
+uint8_t* COM_LoadMallocFile(const char* path)
+{
+    return COM_LoadFile(path, 5);
+}
+
 // uses temp hunk if larger than bufsize
 uint8_t* COM_LoadStackFile(const char* path, void* buffer, int bufsize)
 {
@@ -33,6 +33,7 @@ typedef struct sizebuf_s
     uint8_t* data;
     int maxsize;
     int cursize;
+    int bitpos; // bits used in the last byte by MSG_WriteBits, 0 if byte aligned
 } sizebuf_t;
 
 void SZ_Alloc(sizebuf_t* buf, int startsize);
@@ -99,6 +100,7 @@ void MSG_WriteString(sizebuf_t* sb, char* s);
 void MSG_WriteCoord(sizebuf_t* sb, float f);
 void MSG_WriteAngle(sizebuf_t* sb, float f);
 void MSG_WriteAngle16(sizebuf_t* sb, float f); //johnfitz
+void MSG_WriteBits(sizebuf_t* sb, unsigned int value, int bits); // lsb first, packed until the next byte write
 
 extern int msg_readcount;
 extern bool msg_badread; // set if a read goes beyond end of message
@@ -114,6 +116,36 @@ char* MSG_ReadString(void);
 float MSG_ReadCoord(void);
 float MSG_ReadAngle(void);
 float MSG_ReadAngle16(void); //johnfitz
+unsigned int MSG_ReadBits(int bits);
+
+// unchecked readers for parsing fixed size records, the caller checks the
+// whole record once with MSG_CheckRead and then decodes straight from the
+// little endian message bytes
+extern sizebuf_t net_message;
+
+static inline bool MSG_CheckRead(int size)
+{
+    if (msg_readcount + size > net_message.cursize)
+    {
+        msg_badread = true;
+        return false;
+    }
+    return true;
+}
+
+static inline int MSG_NextByte(void)
+{
+    return net_message.data[msg_readcount++];
+}
+
+static inline int MSG_NextShort(void)
+{
+    int c;
+
+    c = (short)(net_message.data[msg_readcount] | (net_message.data[msg_readcount + 1] << 8));
+    msg_readcount += 2;
+    return c;
+}
 
 //============================================================================
 
@@ -168,6 +200,7 @@ int COM_OpenFile(const char* filename, int* hndl);
 int COM_FOpenFile(const char* filename, FILE** file);
 void COM_CloseFile(int h);
 void COM_CreatePath(const char* path);
+const char* COM_PackFileName(int index);
 
 // load a file to a buffer on the stack
 uint8_t* COM_LoadStackFile(const char* path, void* buffer, int bufsize);
@@ -178,6 +211,9 @@ uint8_t* COM_LoadTempFile(const char* path);
 // load a file and allocate a hunk for it
 uint8_t* COM_LoadHunkFile(const char* path);
 
+// load a file into malloc'd memory
+uint8_t* COM_LoadMallocFile(const char* path);
+
 // load a file into the cache ?
 void COM_LoadCacheFile(const char* path, struct cache_user_s* cu);
 
@@ -0,0 +1,243 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/* deflate.c */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "deflate.h"
+
+// one final block of fixed huffman codes.  literals cost 8 or 9 bits, so the
+// worst case is a little over 9/8 of the input.  the chain depth is kept low,
+// frames go through here at video rates.
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MINMATCH 3
+#define DEFLATE_MAXMATCH 258
+#define DEFLATE_HASHBITS 15
+#define DEFLATE_CHAIN 16 // match candidates tried per position
+#define DEFLATE_GOODMATCH 32 // stop looking once a match is this long
+
+static const unsigned short deflate_lengthbase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t deflate_lengthextra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short deflate_distbase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t deflate_distextra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+typedef struct
+{
+    uint8_t* out;
+    unsigned int bits; // pending bits, lsb first
+    int count; // number of pending bits
+} bitwriter_t;
+
+int Deflate_Bound(int size)
+{
+    return size + size / 8 + 64;
+}
+
+static void Deflate_PutBits(bitwriter_t* w, unsigned int value, int count)
+{
+    w->bits |= value << w->count;
+    w->count += count;
+    while (w->count >= 8)
+    {
+        *w->out++ = w->bits & 255;
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+// huffman codes go out most significant bit first
+static void Deflate_PutCode(bitwriter_t* w, unsigned int code, int count)
+{
+    unsigned int reversed;
+    int i;
+
+    for (i = 0, reversed = 0; i < count; i++, code >>= 1)
+        reversed = (reversed << 1) | (code & 1);
+    Deflate_PutBits(w, reversed, count);
+}
+
+static void Deflate_PutSymbol(bitwriter_t* w, int symbol)
+{
+    if (symbol < 144)
+        Deflate_PutCode(w, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        Deflate_PutCode(w, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        Deflate_PutCode(w, symbol - 256, 7);
+    else
+        Deflate_PutCode(w, 0xc0 + symbol - 280, 8);
+}
+
+static void Deflate_PutMatch(bitwriter_t* w, int length, int distance)
+{
+    int code;
+
+    for (code = 28; deflate_lengthbase[code] > length; code--)
+        ;
+    Deflate_PutSymbol(w, 257 + code);
+    Deflate_PutBits(w, length - deflate_lengthbase[code], deflate_lengthextra[code]);
+
+    for (code = 29; deflate_distbase[code] > distance; code--)
+        ;
+    Deflate_PutCode(w, code, 5);
+    Deflate_PutBits(w, distance - deflate_distbase[code], deflate_distextra[code]);
+}
+
+static unsigned int Deflate_Hash(const uint8_t* p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - DEFLATE_HASHBITS);
+}
+
+static unsigned int Deflate_Adler32(const uint8_t* in, int size)
+{
+    unsigned int a = 1, b = 0;
+    int n;
+
+    // 5552 bytes is the most that can be summed before b overflows
+    while (size > 0)
+    {
+        n = size < 5552 ? size : 5552;
+        size -= n;
+        while (n--)
+        {
+            a += *in++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+int Deflate_Compress(const uint8_t* in, int insize, uint8_t* out, int outsize)
+{
+    int *head, *prev;
+    const uint8_t* ref;
+    bitwriter_t w;
+    unsigned int adler;
+    int pos, candidate, chain, length, best, bestdist, limit, i;
+
+    if (outsize < Deflate_Bound(insize))
+        return -1;
+
+    head = malloc((1 << DEFLATE_HASHBITS) * sizeof(int));
+    prev = malloc(DEFLATE_WINDOW * sizeof(int));
+    if (!head || !prev)
+    {
+        free(head);
+        free(prev);
+        return -1;
+    }
+    memset(head, 0xff, (1 << DEFLATE_HASHBITS) * sizeof(int));
+
+    w.out = out;
+    w.bits = 0;
+    w.count = 0;
+
+    // zlib header: deflate with a 32k window, no dictionary, check bits
+    *w.out++ = 0x78;
+    *w.out++ = 0x01;
+
+    Deflate_PutBits(&w, 1, 1); // final block
+    Deflate_PutBits(&w, 1, 2); // fixed huffman codes
+
+    for (pos = 0; pos < insize;)
+    {
+        best = 0;
+        bestdist = 0;
+
+        if (insize - pos >= DEFLATE_MINMATCH)
+        {
+            i = Deflate_Hash(in + pos);
+            candidate = head[i];
+            head[i] = pos;
+            prev[pos & (DEFLATE_WINDOW - 1)] = candidate;
+
+            limit = insize - pos < DEFLATE_MAXMATCH ? insize - pos : DEFLATE_MAXMATCH;
+            for (chain = 0; chain < DEFLATE_CHAIN && candidate >= 0 && pos - candidate < DEFLATE_WINDOW; chain++)
+            {
+                ref = in + candidate;
+                if (ref[best] == in[pos + best])
+                {
+                    for (length = 0; length < limit && ref[length] == in[pos + length]; length++)
+                        ;
+                    if (length > best)
+                    {
+                        best = length;
+                        bestdist = pos - candidate;
+                        if (best >= DEFLATE_GOODMATCH || best == limit)
+                            break;
+                    }
+                }
+                candidate = prev[candidate & (DEFLATE_WINDOW - 1)];
+            }
+        }
+
+        if (best < DEFLATE_MINMATCH)
+        {
+            Deflate_PutSymbol(&w, in[pos]);
+            pos++;
+            continue;
+        }
+
+        Deflate_PutMatch(&w, best, bestdist);
+
+        // the skipped positions still go in the hash, so later matches can find them
+        for (i = 1; i < best && pos + i + DEFLATE_MINMATCH <= insize; i++)
+        {
+            length = Deflate_Hash(in + pos + i);
+            prev[(pos + i) & (DEFLATE_WINDOW - 1)] = head[length];
+            head[length] = pos + i;
+        }
+        pos += best;
+    }
+
+    Deflate_PutSymbol(&w, 256); // end of block
+    if (w.count)
+        Deflate_PutBits(&w, 0, 8 - w.count);
+
+    adler = Deflate_Adler32(in, insize);
+    *w.out++ = adler >> 24;
+    *w.out++ = (adler >> 16) & 255;
+    *w.out++ = (adler >> 8) & 255;
+    *w.out++ = adler & 255;
+
+    free(head);
+    free(prev);
+
+    return w.out - out;
+}
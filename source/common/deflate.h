@@ -0,0 +1,32 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/* deflate.h */
+
+#pragma once
+
+#include <stdint.h>
+
+// zlib streams (RFC 1950 around RFC 1951) with the fixed huffman codes and
+// hash chained LZ77 matches.  compresses only, it's for writing png files
+
+int Deflate_Bound(int size); // worst case output size for size bytes of input
+int Deflate_Compress(const uint8_t* in, int insize, uint8_t* out, int outsize); // returns the compressed size, -1 if outsize is below Deflate_Bound or out of memory
@@ -0,0 +1,450 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// delta.c -- bit packed entity updates for PROTOCOL_BITPACK
+
+#include "../quakedef.h"
+
+/*
+svc_packetentities is a single bit stream.  Each entity is coded against
+its state in the reference snapshot, or its baseline if it wasn't in it:
+
+	number		2 bit size class, then 3/6/10/15 bits of delta from the
+				previous entity number; a delta of 0 ends the list
+	changed		1 bit, nothing else follows if clear
+	bits		8 bits of PE_* flags
+	more		7 bits of PE_* flags, if PE_MORE
+
+followed by the fields in flag order.  Origins are coded as 5/9/13 bit
+deltas or a 16 bit absolute value, angles as a 4 bit delta or a full byte,
+and frames as +1, a 4 bit delta, or an 8/16 bit absolute value.
+*/
+
+#define PE_ORIGIN1 (1 << 0)
+#define PE_ORIGIN2 (1 << 1)
+#define PE_ORIGIN3 (1 << 2)
+#define PE_ANGLE1 (1 << 3)
+#define PE_ANGLE2 (1 << 4)
+#define PE_ANGLE3 (1 << 5)
+#define PE_FRAME (1 << 6)
+#define PE_MORE (1 << 7)
+
+#define PE_MODEL (1 << 0)
+#define PE_COLORMAP (1 << 1)
+#define PE_SKIN (1 << 2)
+#define PE_EFFECTS (1 << 3)
+#define PE_ALPHA (1 << 4)
+#define PE_LERPFINISH (1 << 5)
+#define PE_FLAGS (1 << 6)
+
+short Delta_PackCoord(float f)
+{
+    return Q_rint(f * 8);
+}
+
+uint8_t Delta_PackAngle(float f)
+{
+    return Q_rint(f * 256.0 / 360.0) & 255;
+}
+
+/*
+==================
+Delta_PackState
+
+Quantizes a baseline the same way the signon messages do
+==================
+*/
+void Delta_PackState(packedentity_t* to, int number, entity_state_t* state)
+{
+    int i;
+
+    to->number = number;
+    for (i = 0; i < 3; i++)
+    {
+        to->origin[i] = Delta_PackCoord(state->origin[i]);
+        to->angles[i] = Delta_PackAngle(state->angles[i]);
+    }
+    to->flags = 0;
+    to->modelindex = state->modelindex;
+    to->frame = state->frame;
+    to->colormap = state->colormap;
+    to->skin = state->skin;
+    to->effects = state->effects;
+    to->alpha = state->alpha;
+    to->lerpfinish = 0;
+}
+
+//============================================================================
+
+static int Delta_ReadSigned(int bits)
+{
+    int value;
+
+    value = MSG_ReadBits(bits);
+    if (value & (1 << (bits - 1)))
+        value -= 1 << bits;
+    return value;
+}
+
+static void Delta_WriteNumber(sizebuf_t* msg, int delta)
+{
+    if (delta < 8)
+    {
+        MSG_WriteBits(msg, 0, 2);
+        MSG_WriteBits(msg, delta, 3);
+    }
+    else if (delta < 64)
+    {
+        MSG_WriteBits(msg, 1, 2);
+        MSG_WriteBits(msg, delta, 6);
+    }
+    else if (delta < 1024)
+    {
+        MSG_WriteBits(msg, 2, 2);
+        MSG_WriteBits(msg, delta, 10);
+    }
+    else
+    {
+        MSG_WriteBits(msg, 3, 2);
+        MSG_WriteBits(msg, delta, 15);
+    }
+}
+
+static int Delta_ReadNumber(void)
+{
+    static const int widths[4] = { 3, 6, 10, 15 };
+
+    return MSG_ReadBits(widths[MSG_ReadBits(2)]);
+}
+
+static void Delta_WriteCoord(sizebuf_t* msg, int from, int to)
+{
+    int delta;
+
+    delta = to - from;
+    if (delta >= -16 && delta < 16)
+    {
+        MSG_WriteBits(msg, 0, 2);
+        MSG_WriteBits(msg, delta, 5);
+    }
+    else if (delta >= -256 && delta < 256)
+    {
+        MSG_WriteBits(msg, 1, 2);
+        MSG_WriteBits(msg, delta, 9);
+    }
+    else if (delta >= -4096 && delta < 4096)
+    {
+        MSG_WriteBits(msg, 2, 2);
+        MSG_WriteBits(msg, delta, 13);
+    }
+    else
+    {
+        MSG_WriteBits(msg, 3, 2);
+        MSG_WriteBits(msg, (unsigned short)to, 16);
+    }
+}
+
+static short Delta_ReadCoord(int from)
+{
+    switch (MSG_ReadBits(2))
+    {
+    case 0:
+        return from + Delta_ReadSigned(5);
+    case 1:
+        return from + Delta_ReadSigned(9);
+    case 2:
+        return from + Delta_ReadSigned(13);
+    default:
+        return (short)MSG_ReadBits(16);
+    }
+}
+
+static void Delta_WriteAngle(sizebuf_t* msg, int from, int to)
+{
+    int delta;
+
+    delta = ((to - from + 128) & 255) - 128;
+    if (delta >= -8 && delta < 8)
+    {
+        MSG_WriteBits(msg, 0, 1);
+        MSG_WriteBits(msg, delta, 4);
+    }
+    else
+    {
+        MSG_WriteBits(msg, 1, 1);
+        MSG_WriteBits(msg, to, 8);
+    }
+}
+
+static uint8_t Delta_ReadAngle(int from)
+{
+    if (!MSG_ReadBits(1))
+        return (from + Delta_ReadSigned(4)) & 255;
+    return MSG_ReadBits(8);
+}
+
+static void Delta_WriteFrame(sizebuf_t* msg, int from, int to)
+{
+    int delta;
+
+    delta = to - from;
+    if (delta == 1)
+        MSG_WriteBits(msg, 0, 2);
+    else if (delta >= -8 && delta < 8)
+    {
+        MSG_WriteBits(msg, 1, 2);
+        MSG_WriteBits(msg, delta, 4);
+    }
+    else if (to < 256)
+    {
+        MSG_WriteBits(msg, 2, 2);
+        MSG_WriteBits(msg, to, 8);
+    }
+    else
+    {
+        MSG_WriteBits(msg, 3, 2);
+        MSG_WriteBits(msg, to, 16);
+    }
+}
+
+static unsigned short Delta_ReadFrame(int from)
+{
+    switch (MSG_ReadBits(2))
+    {
+    case 0:
+        return from + 1;
+    case 1:
+        return from + Delta_ReadSigned(4);
+    case 2:
+        return MSG_ReadBits(8);
+    default:
+        return MSG_ReadBits(16);
+    }
+}
+
+/*
+==================
+Delta_WriteEntity
+==================
+*/
+static void Delta_WriteEntity(sizebuf_t* msg, packedentity_t* from, packedentity_t* to)
+{
+    int bits, more;
+    int i;
+
+    bits = 0;
+    for (i = 0; i < 3; i++)
+    {
+        if (to->origin[i] != from->origin[i])
+            bits |= PE_ORIGIN1 << i;
+        if (to->angles[i] != from->angles[i])
+            bits |= PE_ANGLE1 << i;
+    }
+    if (to->frame != from->frame)
+        bits |= PE_FRAME;
+
+    more = 0;
+    if (to->modelindex != from->modelindex)
+        more |= PE_MODEL;
+    if (to->colormap != from->colormap)
+        more |= PE_COLORMAP;
+    if (to->skin != from->skin)
+        more |= PE_SKIN;
+    if (to->effects != from->effects)
+        more |= PE_EFFECTS;
+    if (to->alpha != from->alpha)
+        more |= PE_ALPHA;
+    if (to->lerpfinish != from->lerpfinish)
+        more |= PE_LERPFINISH;
+    if (to->flags != from->flags)
+        more |= PE_FLAGS;
+    if (more)
+        bits |= PE_MORE;
+
+    if (!bits)
+    {
+        MSG_WriteBits(msg, 0, 1);
+        return;
+    }
+
+    MSG_WriteBits(msg, 1, 1);
+    MSG_WriteBits(msg, bits, 8);
+    if (bits & PE_MORE)
+        MSG_WriteBits(msg, more, 7);
+
+    for (i = 0; i < 3; i++)
+        if (bits & (PE_ORIGIN1 << i))
+            Delta_WriteCoord(msg, from->origin[i], to->origin[i]);
+    for (i = 0; i < 3; i++)
+        if (bits & (PE_ANGLE1 << i))
+            Delta_WriteAngle(msg, from->angles[i], to->angles[i]);
+    if (bits & PE_FRAME)
+        Delta_WriteFrame(msg, from->frame, to->frame);
+
+    if (more & PE_MODEL)
+    {
+        MSG_WriteBits(msg, to->modelindex >= 256, 1);
+        MSG_WriteBits(msg, to->modelindex, to->modelindex >= 256 ? 16 : 8);
+    }
+    if (more & PE_COLORMAP)
+        MSG_WriteBits(msg, to->colormap, 8);
+    if (more & PE_SKIN)
+        MSG_WriteBits(msg, to->skin, 8);
+    if (more & PE_EFFECTS)
+        MSG_WriteBits(msg, to->effects, 8);
+    if (more & PE_ALPHA)
+        MSG_WriteBits(msg, to->alpha, 8);
+    if (more & PE_LERPFINISH)
+        MSG_WriteBits(msg, to->lerpfinish, 8);
+    if (more & PE_FLAGS)
+        MSG_WriteBits(msg, to->flags, 2);
+}
+
+/*
+==================
+Delta_ReadEntity
+==================
+*/
+static void Delta_ReadEntity(packedentity_t* from, packedentity_t* to)
+{
+    int bits, more;
+    int i;
+
+    *to = *from;
+
+    if (!MSG_ReadBits(1))
+        return;
+
+    bits = MSG_ReadBits(8);
+    more = (bits & PE_MORE) ? MSG_ReadBits(7) : 0;
+
+    for (i = 0; i < 3; i++)
+        if (bits & (PE_ORIGIN1 << i))
+            to->origin[i] = Delta_ReadCoord(from->origin[i]);
+    for (i = 0; i < 3; i++)
+        if (bits & (PE_ANGLE1 << i))
+            to->angles[i] = Delta_ReadAngle(from->angles[i]);
+    if (bits & PE_FRAME)
+        to->frame = Delta_ReadFrame(from->frame);
+
+    if (more & PE_MODEL)
+        to->modelindex = MSG_ReadBits(MSG_ReadBits(1) ? 16 : 8);
+    if (more & PE_COLORMAP)
+        to->colormap = MSG_ReadBits(8);
+    if (more & PE_SKIN)
+        to->skin = MSG_ReadBits(8);
+    if (more & PE_EFFECTS)
+        to->effects = MSG_ReadBits(8);
+    if (more & PE_ALPHA)
+        to->alpha = MSG_ReadBits(8);
+    if (more & PE_LERPFINISH)
+        to->lerpfinish = MSG_ReadBits(8);
+    if (more & PE_FLAGS)
+        to->flags = MSG_ReadBits(2);
+}
+
+//============================================================================
+
+/*
+==================
+Delta_FindReference
+
+from is walked in step with the caller's ascending entity numbers, so
+*index only ever moves forward
+==================
+*/
+static packedentity_t* Delta_FindReference(packetframe_t* from, int* index, int number, packedentity_t* base, void (*baseline)(int number, packedentity_t* to))
+{
+    if (from)
+    {
+        while (*index < from->numentities && from->entities[*index].number < number)
+            (*index)++;
+        if (*index < from->numentities && from->entities[*index].number == number)
+            return &from->entities[*index];
+    }
+
+    baseline(number, base);
+    return base;
+}
+
+/*
+==================
+MSG_WritePacketEntities
+==================
+*/
+void MSG_WritePacketEntities(sizebuf_t* msg, packetframe_t* from, packetframe_t* to, void (*baseline)(int number, packedentity_t* to))
+{
+    packedentity_t base;
+    packedentity_t* ref;
+    int i, index, last;
+
+    index = 0;
+    last = 0;
+    for (i = 0; i < to->numentities; i++)
+    {
+        // leave room for the biggest possible update plus the terminator
+        if (msg->cursize + MAX_PACKEDENTITY_SIZE + 1 > msg->maxsize)
+        {
+            to->numentities = i;
+            break;
+        }
+
+        ref = Delta_FindReference(from, &index, to->entities[i].number, &base, baseline);
+
+        Delta_WriteNumber(msg, to->entities[i].number - last);
+        last = to->entities[i].number;
+        Delta_WriteEntity(msg, ref, &to->entities[i]);
+    }
+
+    Delta_WriteNumber(msg, 0);
+}
+
+/*
+==================
+MSG_ReadPacketEntities
+==================
+*/
+void MSG_ReadPacketEntities(packetframe_t* from, packetframe_t* to, void (*baseline)(int number, packedentity_t* to))
+{
+    packedentity_t base;
+    packedentity_t* ref;
+    int index, number, delta;
+
+    index = 0;
+    number = 0;
+    to->numentities = 0;
+
+    while (1)
+    {
+        delta = Delta_ReadNumber();
+        if (!delta || msg_badread)
+            break;
+
+        number += delta;
+        if (to->numentities == MAX_PACKET_ENTITIES)
+            Host_Error("MSG_ReadPacketEntities: more than %i entities", MAX_PACKET_ENTITIES);
+
+        ref = Delta_FindReference(from, &index, number, &base, baseline);
+
+        Delta_ReadEntity(ref, &to->entities[to->numentities]);
+        to->entities[to->numentities].number = number;
+        to->numentities++;
+    }
+}
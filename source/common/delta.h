@@ -0,0 +1,69 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+#pragma once
+
+// delta.h -- bit packed entity updates for PROTOCOL_BITPACK
+
+#define UPDATE_BACKUP 16 // snapshots kept for delta reference, must be a power of two
+#define UPDATE_MASK (UPDATE_BACKUP - 1)
+
+#define MAX_PACKET_ENTITIES 1024 // per snapshot
+
+// largest possible encoding of one entity, in bytes
+#define MAX_PACKEDENTITY_SIZE 26
+
+// packedentity_t flags
+#define PEF_STEP (1 << 0) // MOVETYPE_STEP, same meaning as U_STEP
+#define PEF_LERPFINISH (1 << 1) // lerpfinish is valid, same meaning as U_LERPFINISH
+
+// entity state exactly as the client sees it, so both ends can delta
+// against an identical copy
+typedef struct
+{
+    unsigned short number;
+    short origin[3]; // 13.3 fixed point, as MSG_WriteCoord
+    uint8_t angles[3]; // 256 per turn, as MSG_WriteAngle
+    uint8_t flags;
+    unsigned short modelindex;
+    unsigned short frame;
+    uint8_t colormap;
+    uint8_t skin;
+    uint8_t effects;
+    uint8_t alpha;
+    uint8_t lerpfinish;
+} packedentity_t;
+
+typedef struct
+{
+    int sequence; // the low 8 bits go over the wire
+    bool valid;
+    int numentities;
+    packedentity_t entities[MAX_PACKET_ENTITIES]; // sorted by number
+} packetframe_t;
+
+short Delta_PackCoord(float f);
+uint8_t Delta_PackAngle(float f);
+void Delta_PackState(packedentity_t* to, int number, entity_state_t* state);
+
+void MSG_WritePacketEntities(sizebuf_t* msg, packetframe_t* from, packetframe_t* to, void (*baseline)(int number, packedentity_t* to));
+void MSG_ReadPacketEntities(packetframe_t* from, packetframe_t* to, void (*baseline)(int number, packedentity_t* to));
+// from is NULL to delta everything against the baselines
+// entities that do not fit in msg are dropped from the end of to
@@ -0,0 +1,185 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/* lz.c */
+
+#include <string.h>
+
+#include "lz.h"
+
+// each sequence is a token byte holding the literal count in the high
+// nibble and the match length - LZ_MINMATCH in the low nibble, a nibble of
+// 15 continuing in extra bytes of 255 until one is smaller.  then come the
+// literals and a little endian offset back to the match.  the last
+// sequence has only literals and ends the block.
+
+#define LZ_MINMATCH 4
+#define LZ_MAXOFFSET 65535
+#define LZ_HASHBITS 13 // LZ_HASHSIZE is 1 << LZ_HASHBITS
+
+int LZ_CompressBound(int size)
+{
+    return size + size / 255 + 16;
+}
+
+static unsigned int LZ_Hash(const uint8_t* p)
+{
+    unsigned int v;
+
+    v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    return (v * 2654435761u) >> (32 - LZ_HASHBITS);
+}
+
+static uint8_t* LZ_WriteToken(uint8_t* op, int literals, int match)
+{
+    *op++ = ((literals < 15 ? literals : 15) << 4) | (match < 15 ? match : 15);
+    return op;
+}
+
+static uint8_t* LZ_WriteLength(uint8_t* op, int length)
+{
+    if (length < 15)
+        return op;
+
+    for (length -= 15; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = length;
+    return op;
+}
+
+int LZ_Compress(const uint8_t* in, int insize, uint8_t* out, int outsize, int* table)
+{
+    const uint8_t *ip, *anchor, *end, *ref;
+    uint8_t* op;
+    unsigned int h;
+    int literals, match, offset;
+
+    if (outsize < LZ_CompressBound(insize))
+        return -1;
+
+    memset(table, 0xff, LZ_HASHSIZE * sizeof(int)); // last position of each hash
+
+    ip = anchor = in;
+    end = in + insize;
+    op = out;
+
+    // greedy parse, taking the first match the hash finds
+    while (end - ip >= LZ_MINMATCH)
+    {
+        h = LZ_Hash(ip);
+        offset = table[h] < 0 ? 0 : (int)(ip - in) - table[h];
+        table[h] = ip - in;
+
+        ref = ip - offset;
+        if (!offset || offset > LZ_MAXOFFSET || memcmp(ref, ip, LZ_MINMATCH))
+        {
+            ip++;
+            continue;
+        }
+
+        for (match = LZ_MINMATCH; ip + match < end && ref[match] == ip[match]; match++)
+            ;
+
+        literals = ip - anchor;
+        op = LZ_WriteToken(op, literals, match - LZ_MINMATCH);
+        op = LZ_WriteLength(op, literals);
+        memcpy(op, anchor, literals);
+        op += literals;
+        *op++ = offset & 255;
+        *op++ = offset >> 8;
+        op = LZ_WriteLength(op, match - LZ_MINMATCH);
+
+        ip += match;
+        anchor = ip;
+    }
+
+    literals = end - anchor;
+    op = LZ_WriteToken(op, literals, 0);
+    op = LZ_WriteLength(op, literals);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - out;
+}
+
+static int LZ_ReadLength(const uint8_t** ip, const uint8_t* end, int length)
+{
+    int b;
+
+    if (length < 15)
+        return length;
+
+    do
+    {
+        if (*ip >= end)
+            return -1;
+        b = *(*ip)++;
+        length += b;
+    } while (b == 255);
+
+    return length;
+}
+
+int LZ_Decompress(const uint8_t* in, int insize, uint8_t* out, int outsize)
+{
+    const uint8_t *ip, *end, *ref;
+    uint8_t *op, *oend;
+    int token, length, offset;
+
+    ip = in;
+    end = in + insize;
+    op = out;
+    oend = out + outsize;
+
+    while (ip < end)
+    {
+        token = *ip++;
+
+        length = LZ_ReadLength(&ip, end, token >> 4);
+        if (length < 0 || length > end - ip || length > oend - op)
+            return -1;
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+
+        if (ip == end)
+            break; // the last sequence has no match
+
+        if (end - ip < 2)
+            return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > op - out)
+            return -1;
+
+        length = LZ_ReadLength(&ip, end, token & 15);
+        if (length < 0)
+            return -1;
+        length += LZ_MINMATCH;
+        if (length > oend - op)
+            return -1;
+
+        // byte at a time, the match may overlap the output
+        for (ref = op - offset; length; length--)
+            *op++ = *ref++;
+    }
+
+    return op - out;
+}
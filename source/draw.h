@@ -29,6 +29,7 @@ void Draw_Init(void);
 void Draw_Character(int x, int y, int num);
 void Draw_DebugChar(char num);
 void Draw_Pic(int x, int y, qpic_t* pic);
+void Draw_PicAlpha(int x, int y, qpic_t* pic, float alpha);
 void Draw_TransPicTranslate(int x, int y, qpic_t* pic, int top, int bottom); //johnfitz -- more parameters
 void Draw_ConsoleBackground(void); //johnfitz -- removed parameter int lines
 void Draw_BeginDisc(void);
@@ -38,5 +39,6 @@ void Draw_FadeScreen(void);
 void Draw_String(int x, int y, char* str);
 qpic_t* Draw_PicFromWad(char* name);
 qpic_t* Draw_CachePic(char* path);
+void Draw_Flush(void);
 
 void GL_SetCanvas(int canvastype); //johnfitz
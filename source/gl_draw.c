@@ -31,6 +31,8 @@ qpic_t* draw_disc;
 qpic_t* draw_backtile;
 
 gltexture_t* char_texture; //johnfitz
+float char_sl, char_tl; // where conchars landed in the scrap
+float fill_sl, fill_tl; // 16*16 block holding one texel of each palette index, for Draw_Fill
 qpic_t *pic_ovr, *pic_ins; //johnfitz -- new cursor handling
 qpic_t* pic_nul; //johnfitz -- for missing gfx, don't crash
 
@@ -194,7 +196,7 @@ void Scrap_Upload(void)
     {
         sprintf(name, "scrap%i", i);
         scrap_textures[i] = TexMgr_LoadImage(NULL, name, BLOCK_WIDTH, BLOCK_HEIGHT, SRC_INDEXED, scrap_texels[i],
-            "", (unsigned)scrap_texels[i], TEXPREF_ALPHA | TEXPREF_OVERWRITE | TEXPREF_NOPICMIP);
+            "", (unsigned)scrap_texels[i], TEXPREF_ALPHA | TEXPREF_NEAREST | TEXPREF_OVERWRITE | TEXPREF_NOPICMIP);
     }
 
     scrap_dirty = false;
@@ -337,19 +339,40 @@ qpic_t* Draw_MakePic(char* name, int width, int height, uint8_t* data)
 /*
 ===============
 Draw_LoadPics -- johnfitz
+
+conchars and the fill palette go into the scrap ahead of the sbar icons,
+so that text, icons and fills all come from one texture and batch together
 ===============
 */
 void Draw_LoadPics(void)
 {
-    uint8_t* data;
-    unsigned offset;
+    uint8_t *data, *dst;
+    int texnum, x, y, i, j;
 
     data = W_GetLumpName("conchars");
     if (!data)
         Sys_Error("Draw_LoadPics: couldn't load conchars");
-    offset = (unsigned)data - (unsigned)wad_base;
-    char_texture = TexMgr_LoadImage(NULL, WADFILENAME ":conchars", 128, 128, SRC_INDEXED, data,
-        WADFILENAME, offset, TEXPREF_ALPHA | TEXPREF_NEAREST | TEXPREF_NOPICMIP | TEXPREF_CONCHARS);
+
+    // conchars uses 0 as well as 255 for transparent, the scrap only 255
+    texnum = Scrap_AllocBlock(128, 128, &x, &y);
+    for (i = 0; i < 128; i++)
+    {
+        dst = &scrap_texels[texnum][(y + i) * BLOCK_WIDTH + x];
+        for (j = 0; j < 128; j++, data++)
+            dst[j] = *data ? *data : 255;
+    }
+    char_texture = scrap_textures[texnum];
+    char_sl = x / (float)BLOCK_WIDTH;
+    char_tl = y / (float)BLOCK_HEIGHT;
+
+    // fills have to share the scrap too, or every fill breaks the batch
+    if (Scrap_AllocBlock(16, 16, &x, &y) != texnum)
+        Sys_Error("Draw_LoadPics: fill palette not in the conchars scrap");
+    for (i = 0; i < 256; i++)
+        scrap_texels[texnum][(y + (i >> 4)) * BLOCK_WIDTH + x + (i & 15)] = i;
+    fill_sl = (x + 0.5) / (float)BLOCK_WIDTH;
+    fill_tl = (y + 0.5) / (float)BLOCK_HEIGHT;
+    scrap_dirty = true;
 
     draw_disc = Draw_PicFromWad("disc");
     draw_backtile = Draw_PicFromWad("backtile");
@@ -411,12 +434,153 @@ void Draw_Init(void)
     Draw_LoadPics();
 }
 
+//==============================================================================
+//
+//  2D DRAW LIST
+//
+//==============================================================================
+
+// quads are queued and drawn in submission order, one glDrawArrays for each
+// run that shares a texture and blend state.  anything that changes the
+// projection or gl state underneath the 2d drawing must Draw_Flush first.
+
+#define MAX_DRAWQUADS 2048
+
+typedef struct
+{
+    float xy[2];
+    float st[2];
+    uint8_t color[4];
+} drawvert_t;
+
+typedef struct
+{
+    gltexture_t* texture; // NULL for untextured
+    bool blend;
+    int firstquad, numquads;
+} drawbatch_t;
+
+static drawvert_t drawverts[MAX_DRAWQUADS * 4];
+static drawbatch_t drawbatches[MAX_DRAWQUADS];
+static int numdrawquads, numdrawbatches;
+
+int rs_2ddraws, rs_2dquads; // for r_speeds, counted up to the end of the last frame
+
+/*
+================
+Draw_Flush -- draws everything queued since the last flush
+================
+*/
+void Draw_Flush(void)
+{
+    drawbatch_t* batch;
+    int i;
+
+    if (!numdrawquads)
+        return;
+
+    if (scrap_dirty)
+        Scrap_Upload();
+
+    glVertexPointer(2, GL_FLOAT, sizeof(drawvert_t), drawverts[0].xy);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(drawvert_t), drawverts[0].st);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(drawvert_t), drawverts[0].color);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+    for (i = 0, batch = drawbatches; i < numdrawbatches; i++, batch++)
+    {
+        if (batch->texture)
+            GL_Bind(batch->texture);
+        else
+            glDisable(GL_TEXTURE_2D);
+        if (batch->blend)
+        {
+            glEnable(GL_BLEND);
+            glDisable(GL_ALPHA_TEST);
+        }
+
+        glDrawArrays(GL_QUADS, batch->firstquad * 4, batch->numquads * 4);
+
+        if (batch->blend)
+        {
+            glEnable(GL_ALPHA_TEST);
+            glDisable(GL_BLEND);
+        }
+        if (!batch->texture)
+            glEnable(GL_TEXTURE_2D);
+    }
+
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glColor4f(1, 1, 1, 1); // the color array leaves the current color undefined
+
+    rs_2ddraws += numdrawbatches;
+    rs_2dquads += numdrawquads;
+    numdrawquads = numdrawbatches = 0;
+}
+
+/*
+================
+Draw_AddQuad -- queues one quad, starting a new batch if the state changed
+================
+*/
+static void Draw_AddQuad(gltexture_t* texture, float x, float y, float w, float h,
+    float sl, float tl, float sh, float th, const uint8_t* color)
+{
+    drawbatch_t* batch;
+    drawvert_t* v;
+    bool blend;
+    int i;
+
+    if (numdrawquads == MAX_DRAWQUADS)
+        Draw_Flush();
+
+    blend = color[3] < 255;
+    batch = numdrawbatches ? &drawbatches[numdrawbatches - 1] : NULL;
+    if (!batch || batch->texture != texture || batch->blend != blend)
+    {
+        batch = &drawbatches[numdrawbatches++];
+        batch->texture = texture;
+        batch->blend = blend;
+        batch->firstquad = numdrawquads;
+        batch->numquads = 0;
+    }
+    batch->numquads++;
+
+    v = &drawverts[numdrawquads++ * 4];
+    v[0].xy[0] = x;
+    v[0].xy[1] = y;
+    v[0].st[0] = sl;
+    v[0].st[1] = tl;
+    v[1].xy[0] = x + w;
+    v[1].xy[1] = y;
+    v[1].st[0] = sh;
+    v[1].st[1] = tl;
+    v[2].xy[0] = x + w;
+    v[2].xy[1] = y + h;
+    v[2].st[0] = sh;
+    v[2].st[1] = th;
+    v[3].xy[0] = x;
+    v[3].xy[1] = y + h;
+    v[3].st[0] = sl;
+    v[3].st[1] = th;
+    for (i = 0; i < 4; i++)
+        memcpy(v[i].color, color, 4);
+}
+
 //==============================================================================
 //
 //  2D DRAWING
 //
 //==============================================================================
 
+static const uint8_t draw_white[4] = { 255, 255, 255, 255 };
+
 /*
 ================
 Draw_CharacterQuad -- johnfitz -- seperate function to spit out verts
@@ -424,24 +588,13 @@ Draw_CharacterQuad -- johnfitz -- seperate function to spit out verts
 */
 void Draw_CharacterQuad(int x, int y, char num)
 {
-    int row, col;
     float frow, fcol, size;
 
-    row = num >> 4;
-    col = num & 15;
-
-    frow = row * 0.0625;
-    fcol = col * 0.0625;
-    size = 0.0625;
-
-    glTexCoord2f(fcol, frow);
-    glVertex2f(x, y);
-    glTexCoord2f(fcol + size, frow);
-    glVertex2f(x + 8, y);
-    glTexCoord2f(fcol + size, frow + size);
-    glVertex2f(x + 8, y + 8);
-    glTexCoord2f(fcol, frow + size);
-    glVertex2f(x, y + 8);
+    size = 0.0625 * 128 / BLOCK_WIDTH;
+    frow = char_tl + (((uint8_t)num) >> 4) * size;
+    fcol = char_sl + (num & 15) * size;
+
+    Draw_AddQuad(char_texture, x, y, 8, 8, fcol, frow, fcol + size, frow + size, draw_white);
 }
 
 /*
@@ -459,12 +612,7 @@ void Draw_Character(int x, int y, int num)
     if (num == 32)
         return; //don't waste verts on spaces
 
-    GL_Bind(char_texture);
-    glBegin(GL_QUADS);
-
     Draw_CharacterQuad(x, y, (char)num);
-
-    glEnd();
 }
 
 /*
@@ -477,9 +625,6 @@ void Draw_String(int x, int y, char* str)
     if (y <= -8)
         return; // totally off screen
 
-    GL_Bind(char_texture);
-    glBegin(GL_QUADS);
-
     while (*str)
     {
         if (*str != 32) //don't waste verts on spaces
@@ -487,34 +632,34 @@ void Draw_String(int x, int y, char* str)
         str++;
         x += 8;
     }
-
-    glEnd();
 }
 
 /*
 =============
-Draw_Pic -- johnfitz -- modified
+Draw_PicAlpha
 =============
 */
-void Draw_Pic(int x, int y, qpic_t* pic)
+void Draw_PicAlpha(int x, int y, qpic_t* pic, float alpha)
 {
     assert(pic);
     glpic_t* gl;
+    uint8_t color[4] = { 255, 255, 255, 255 };
+
+    if (alpha < 1)
+        color[3] = alpha > 0 ? (uint8_t)(alpha * 255) : 0;
 
-    if (scrap_dirty)
-        Scrap_Upload();
     gl = (glpic_t*)pic->data;
-    GL_Bind(gl->gltexture);
-    glBegin(GL_QUADS);
-    glTexCoord2f(gl->sl, gl->tl);
-    glVertex2f(x, y);
-    glTexCoord2f(gl->sh, gl->tl);
-    glVertex2f(x + pic->width, y);
-    glTexCoord2f(gl->sh, gl->th);
-    glVertex2f(x + pic->width, y + pic->height);
-    glTexCoord2f(gl->sl, gl->th);
-    glVertex2f(x, y + pic->height);
-    glEnd();
+    Draw_AddQuad(gl->gltexture, x, y, pic->width, pic->height, gl->sl, gl->tl, gl->sh, gl->th, color);
+}
+
+/*
+=============
+Draw_Pic -- johnfitz -- modified
+=============
+*/
+void Draw_Pic(int x, int y, qpic_t* pic)
+{
+    Draw_PicAlpha(x, y, pic, 1);
 }
 
 /*
@@ -535,6 +680,7 @@ void Draw_TransPicTranslate(int x, int y, qpic_t* pic, int top, int bottom)
         oldtop = top;
         oldbottom = bottom;
         glt = ((glpic_t*)pic->data)->gltexture;
+        Draw_Flush(); // queued quads would pick up the new colors
         TexMgr_ReloadImage(glt, top, bottom);
     }
     Draw_Pic(x, y, pic);
@@ -559,25 +705,7 @@ void Draw_ConsoleBackground(void)
     //	GL_SetCanvas (CANVAS_CONSOLE); //in case this is called from weird places
 
     if (alpha > 0.0)
-    {
-        if (alpha < 1.0)
-        {
-            glEnable(GL_BLEND);
-            glColor4f(1, 1, 1, alpha);
-            glDisable(GL_ALPHA_TEST);
-            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-        }
-
-        Draw_Pic(0, 0, pic);
-
-        if (alpha < 1.0)
-        {
-            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-            glEnable(GL_ALPHA_TEST);
-            glDisable(GL_BLEND);
-            glColor4f(1, 1, 1, 1);
-        }
-    }
+        Draw_PicAlpha(0, 0, pic, alpha);
 }
 
 /*
@@ -594,47 +722,37 @@ void Draw_TileClear(int x, int y, int w, int h)
 
     gl = (glpic_t*)draw_backtile->data;
 
-    glColor3f(1, 1, 1);
-    GL_Bind(gl->gltexture);
-    glBegin(GL_QUADS);
-    glTexCoord2f(x / 64.0, y / 64.0);
-    glVertex2f(x, y);
-    glTexCoord2f((x + w) / 64.0, y / 64.0);
-    glVertex2f(x + w, y);
-    glTexCoord2f((x + w) / 64.0, (y + h) / 64.0);
-    glVertex2f(x + w, y + h);
-    glTexCoord2f(x / 64.0, (y + h) / 64.0);
-    glVertex2f(x, y + h);
-    glEnd();
+    Draw_AddQuad(gl->gltexture, x, y, w, h, x / 64.0, y / 64.0, (x + w) / 64.0, (y + h) / 64.0, draw_white);
 }
 
 /*
 =============
 Draw_Fill
 
-Fills a box of pixels with a single color
+Fills a box of pixels with a single color, sampled from the palette block
+in the scrap so it batches with the text around it
 =============
 */
 void Draw_Fill(int x, int y, int w, int h, int c, float alpha) //johnfitz -- added alpha
 {
     uint8_t* pal = (uint8_t*)d_8to24table; //johnfitz -- use d_8to24table instead of host_basepal
+    uint8_t color[4] = { 255, 255, 255, 255 };
+    float s, t;
 
-    glDisable(GL_TEXTURE_2D);
-    glEnable(GL_BLEND); //johnfitz -- for alpha
-    glDisable(GL_ALPHA_TEST); //johnfitz -- for alpha
-    glColor4f(pal[c * 4] / 255.0, pal[c * 4 + 1] / 255.0, pal[c * 4 + 2] / 255.0, alpha); //johnfitz -- added alpha
-
-    glBegin(GL_QUADS);
-    glVertex2f(x, y);
-    glVertex2f(x + w, y);
-    glVertex2f(x + w, y + h);
-    glVertex2f(x, y + h);
-    glEnd();
-
-    glColor3f(1, 1, 1);
-    glDisable(GL_BLEND); //johnfitz -- for alpha
-    glEnable(GL_ALPHA_TEST); //johnfitz -- for alpha
-    glEnable(GL_TEXTURE_2D);
+    c &= 255;
+    if (alpha < 1)
+        color[3] = alpha > 0 ? (uint8_t)(alpha * 255) : 0;
+
+    if (c == 255) // transparent in the scrap, so draw it untextured
+    {
+        memcpy(color, &pal[c * 4], 3);
+        Draw_AddQuad(NULL, x, y, w, h, 0, 0, 0, 0, color);
+        return;
+    }
+
+    s = fill_sl + (c & 15) / (float)BLOCK_WIDTH;
+    t = fill_tl + (c >> 4) / (float)BLOCK_HEIGHT;
+    Draw_AddQuad(char_texture, x, y, w, h, s, t, s, t, color);
 }
 
 /*
@@ -646,22 +764,7 @@ void Draw_FadeScreen(void)
 {
     GL_SetCanvas(CANVAS_DEFAULT);
 
-    glEnable(GL_BLEND);
-    glDisable(GL_ALPHA_TEST);
-    glDisable(GL_TEXTURE_2D);
-    glColor4f(0, 0, 0, 0.5);
-    glBegin(GL_QUADS);
-
-    glVertex2f(0, 0);
-    glVertex2f(glwidth, 0);
-    glVertex2f(glwidth, glheight);
-    glVertex2f(0, glheight);
-
-    glEnd();
-    glColor4f(1, 1, 1, 1);
-    glEnable(GL_TEXTURE_2D);
-    glEnable(GL_ALPHA_TEST);
-    glDisable(GL_BLEND);
+    Draw_Fill(0, 0, glwidth, glheight, 0, 0.5);
 
     Sbar_Changed();
 }
@@ -687,6 +790,8 @@ void Draw_BeginDisc(void)
         return;
     //johnfitz
 
+    Draw_Flush(); // anything queued belongs to the current canvas
+
     //johnfitz -- canvas and matrix stuff
     glGetIntegerv(GL_VIEWPORT, viewport);
     glMatrixMode(GL_PROJECTION);
@@ -700,6 +805,7 @@ void Draw_BeginDisc(void)
 
     glDrawBuffer(GL_FRONT);
     Draw_Pic(320 - 24, 0, draw_disc);
+    Draw_Flush();
     glDrawBuffer(GL_BACK);
 
     //johnfitz -- restore everything so that 3d rendering isn't fucked up
@@ -725,6 +831,8 @@ void GL_SetCanvas(canvastype newcanvas)
     if (newcanvas == currentcanvas)
         return;
 
+    Draw_Flush(); // queued quads were positioned for the old canvas
+
     currentcanvas = newcanvas;
 
     glMatrixMode(GL_PROJECTION);
@@ -799,6 +907,8 @@ GL_Set2D -- johnfitz -- rewritten
 */
 void GL_Set2D(void)
 {
+    rs_2ddraws = rs_2dquads = 0;
+
     currentcanvas = -1;
     GL_SetCanvas(CANVAS_DEFAULT);
 
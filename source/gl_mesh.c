@@ -30,6 +30,8 @@ ALIAS MODEL DISPLAY LIST GENERATION
 =================================================================
 */
 
+cvar_t gl_alwaysmesh = { "gl_alwaysmesh", "0" }; // build meshes every time rather than reading the .ms3 files in glquake/
+
 static model_t* aliasmodel;
 static aliashdr_t* paliashdr;
 
@@ -45,12 +47,99 @@ static int numcommands;
 static int vertexorder[8192];
 static int numorder;
 
+// the command list again as a triangle list, with the vertexes the strips and fans
+// share welded together and the triangles in vertex cache order
+static unsigned short aliasindexes[MAXALIASTRIS * 3];
+static int numaliasindexes;
+
 static int allverts, alltris;
 
 static int stripverts[128];
 static int striptris[128];
 static int stripcount;
 
+// every directed edge of every triangle, so StripLength and FanLength find the next
+// triangle of a strip without looking through all the triangles after it
+#define EDGEHASH_SIZE 4096
+
+typedef struct
+{
+    int v0, v1; // in the winding order of the triangle
+    int tri, k; // vertindex[k] is v0
+    int next;
+} meshedge_t;
+
+static meshedge_t meshedges[MAXALIASTRIS * 3];
+static int edgehash[EDGEHASH_SIZE], edgetail[EDGEHASH_SIZE];
+
+/*
+================
+EdgeHash
+================
+*/
+static int EdgeHash(int v0, int v1)
+{
+    return ((unsigned)v0 * 73856093u ^ (unsigned)v1 * 19349663u) & (EDGEHASH_SIZE - 1);
+}
+
+/*
+================
+BuildEdges
+
+edges go on the end of their chains in triangle and corner order,
+so the first match FindEdge sees is the one a search from the
+start of the triangles would find
+================
+*/
+static void BuildEdges(void)
+{
+    meshedge_t* e;
+    int i, k, h;
+
+    memset(edgehash, -1, sizeof(edgehash));
+    for (i = 0, e = meshedges; i < pheader->numtris; i++)
+    {
+        for (k = 0; k < 3; k++, e++)
+        {
+            e->v0 = triangles[i].vertindex[k];
+            e->v1 = triangles[i].vertindex[(k + 1) % 3];
+            e->tri = i;
+            e->k = k;
+            e->next = -1;
+
+            h = EdgeHash(e->v0, e->v1);
+            if (edgehash[h] == -1)
+                edgehash[h] = e - meshedges;
+            else
+                meshedges[edgetail[h]].next = e - meshedges;
+            edgetail[h] = e - meshedges;
+        }
+    }
+}
+
+/*
+================
+FindEdge -- the first triangle after tri facing the same way with the edge v0 to v1, or -1
+================
+*/
+static int FindEdge(int v0, int v1, int facesfront, int tri, int* k)
+{
+    meshedge_t* e;
+    int i;
+
+    for (i = edgehash[EdgeHash(v0, v1)]; i != -1; i = e->next)
+    {
+        e = &meshedges[i];
+        if (e->tri > tri && e->v0 == v0 && e->v1 == v1 && triangles[e->tri].facesfront == facesfront)
+        {
+            *k = e->k;
+            return e->tri;
+        }
+    }
+
+    return -1;
+}
+
 /*
 ================
 StripLength
@@ -77,45 +166,33 @@ int StripLength(int starttri, int startv)
     m1 = last->vertindex[(startv + 2) % 3];
     m2 = last->vertindex[(startv + 1) % 3];
 
-// look for a matching triangle
-nexttri:
-    for (j = starttri + 1, check = &triangles[starttri + 1]; j < pheader->numtris; j++, check++)
+    // look for a matching triangle
+    while ((j = FindEdge(m1, m2, last->facesfront, starttri, &k)) != -1)
     {
-        if (check->facesfront != last->facesfront)
-            continue;
-        for (k = 0; k < 3; k++)
-        {
-            if (check->vertindex[k] != m1)
-                continue;
-            if (check->vertindex[(k + 1) % 3] != m2)
-                continue;
+        check = &triangles[j];
 
-            // this is the next part of the fan
+        // this is the next part of the fan
 
-            // if we can't use this triangle, this tristrip is done
-            if (used[j])
-                goto done;
+        // if we can't use this triangle, this tristrip is done
+        if (used[j])
+            break;
 
-            // the new edge
-            if (stripcount & 1)
-                m2 = check->vertindex[(k + 2) % 3];
-            else
-                m1 = check->vertindex[(k + 2) % 3];
+        // the new edge
+        if (stripcount & 1)
+            m2 = check->vertindex[(k + 2) % 3];
+        else
+            m1 = check->vertindex[(k + 2) % 3];
 
-            stripverts[stripcount + 2] = check->vertindex[(k + 2) % 3];
-            striptris[stripcount] = j;
-            stripcount++;
+        stripverts[stripcount + 2] = check->vertindex[(k + 2) % 3];
+        striptris[stripcount] = j;
+        stripcount++;
 
-            used[j] = 2;
-            goto nexttri;
-        }
+        used[j] = 2;
     }
-done:
 
     // clear the temp used flags
-    for (j = starttri + 1; j < pheader->numtris; j++)
-        if (used[j] == 2)
-            used[j] = 0;
+    for (j = 1; j < stripcount; j++)
+        used[striptris[j]] = 0;
 
     return stripcount;
 }
@@ -146,42 +223,30 @@ int FanLength(int starttri, int startv)
     m1 = last->vertindex[(startv + 0) % 3];
     m2 = last->vertindex[(startv + 2) % 3];
 
-// look for a matching triangle
-nexttri:
-    for (j = starttri + 1, check = &triangles[starttri + 1]; j < pheader->numtris; j++, check++)
+    // look for a matching triangle
+    while ((j = FindEdge(m1, m2, last->facesfront, starttri, &k)) != -1)
     {
-        if (check->facesfront != last->facesfront)
-            continue;
-        for (k = 0; k < 3; k++)
-        {
-            if (check->vertindex[k] != m1)
-                continue;
-            if (check->vertindex[(k + 1) % 3] != m2)
-                continue;
+        check = &triangles[j];
 
-            // this is the next part of the fan
+        // this is the next part of the fan
 
-            // if we can't use this triangle, this tristrip is done
-            if (used[j])
-                goto done;
+        // if we can't use this triangle, this tristrip is done
+        if (used[j])
+            break;
 
-            // the new edge
-            m2 = check->vertindex[(k + 2) % 3];
+        // the new edge
+        m2 = check->vertindex[(k + 2) % 3];
 
-            stripverts[stripcount + 2] = m2;
-            striptris[stripcount] = j;
-            stripcount++;
+        stripverts[stripcount + 2] = m2;
+        striptris[stripcount] = j;
+        stripcount++;
 
-            used[j] = 2;
-            goto nexttri;
-        }
+        used[j] = 2;
     }
-done:
 
     // clear the temp used flags
-    for (j = starttri + 1; j < pheader->numtris; j++)
-        if (used[j] == 2)
-            used[j] = 0;
+    for (j = 1; j < stripcount; j++)
+        used[striptris[j]] = 0;
 
     return stripcount;
 }
@@ -210,6 +275,7 @@ void BuildTris(void)
     numorder = 0;
     numcommands = 0;
     memset(used, 0, sizeof(used));
+    BuildEdges();
     for (i = 0; i < pheader->numtris; i++)
     {
         // pick an unused triangle and start the trifan
@@ -274,90 +340,535 @@ void BuildTris(void)
     alltris += pheader->numtris;
 }
 
+/*
+=================================================================
+
+VERTEX CACHE ORDER
+
+=================================================================
+*/
+
+// tom forsyth's linear speed vertex cache optimisation: triangles are added greedily by a
+// score that favours vertexes recently used and vertexes with few triangles left, which
+// finishes off areas rather than leaving stragglers to miss the cache later
+#define VCACHE_SIZE 32 // the cache forsyth's scores model
+#define VCACHE_VALENCE 32 // valence scores past this are all the same
+
+static float vcache_posscore[VCACHE_SIZE];
+static float vcache_valencescore[VCACHE_VALENCE];
+
+static int vtxremaining[8192]; // triangles not added yet
+static int vtxfirst[8192]; // into vtxtris
+static int vtxtris[MAXALIASTRIS * 3]; // the triangles of each vertex, the remaining ones first
+static int vtxcachepos[8192];
+static float vtxscore[8192];
+static float triscore[MAXALIASTRIS];
+static uint8_t triadded[MAXALIASTRIS];
+
 /*
 ================
-GL_MakeAliasModelDisplayLists
+VCache_InitScores
 ================
 */
-void GL_MakeAliasModelDisplayLists(model_t* m, aliashdr_t* hdr)
+static void VCache_InitScores(void)
 {
-    int i, j;
-    int* cmds;
-    trivertx_t* verts;
-    float hscale, vscale; //johnfitz -- padded skins
-    int count; //johnfitz -- precompute texcoords for padded skins
-    int* loadcmds; //johnfitz
+    int i;
 
-    //johnfitz -- padded skins
-    hscale = (float)hdr->skinwidth / (float)TexMgr_PadConditional(hdr->skinwidth);
-    vscale = (float)hdr->skinheight / (float)TexMgr_PadConditional(hdr->skinheight);
-    //johnfitz
+    if (vcache_posscore[0])
+        return;
 
-    aliasmodel = m;
-    paliashdr = hdr; // (aliashdr_t *)Mod_Extradata (m);
+    for (i = 0; i < VCACHE_SIZE; i++)
+    {
+        if (i < 3)
+            vcache_posscore[i] = 0.75; // the last triangle's, deliberately less than the next ones so it doesn't repeat
+        else
+            vcache_posscore[i] = pow(1.0 - (i - 3) / (float)(VCACHE_SIZE - 3), 1.5);
+    }
+
+    for (i = 1; i < VCACHE_VALENCE; i++)
+        vcache_valencescore[i] = 2.0 * pow(i, -0.5);
+}
 
-//johnfitz -- generate meshes
+/*
+================
+VCache_VertexScore
+================
+*/
+static float VCache_VertexScore(int v)
+{
+    float score;
 
-#if 1 //always regenerate meshes
+    if (!vtxremaining[v])
+        return -1;
 
-    Con_DPrintf("meshing %s...\n", m->name);
-    BuildTris();
+    score = vtxcachepos[v] < 0 ? 0 : vcache_posscore[vtxcachepos[v]];
+    return score + vcache_valencescore[vtxremaining[v] < VCACHE_VALENCE ? vtxremaining[v] : VCACHE_VALENCE - 1];
+}
 
-#else //conditional regeneration
+/*
+================
+VCache_Optimize -- reorders the triangles of indexes over numverts vertexes in place
+================
+*/
+static void VCache_Optimize(unsigned short* indexes, int numindexes, int numverts)
+{
+    static unsigned short sorted[MAXALIASTRIS * 3];
+    int cache[VCACHE_SIZE + 3], newcache[VCACHE_SIZE + 3];
+    int numtris, cached, newcached, best, added, i, j, k, t, v;
+    float bestscore;
+    const unsigned short* tri;
+
+    VCache_InitScores();
+
+    numtris = numindexes / 3;
+    memset(vtxremaining, 0, numverts * sizeof(vtxremaining[0]));
+    for (i = 0; i < numindexes; i++)
+        vtxremaining[indexes[i]]++;
+    for (v = 0, j = 0; v < numverts; v++)
+    {
+        vtxfirst[v] = j;
+        j += vtxremaining[v];
+        vtxremaining[v] = 0;
+        vtxcachepos[v] = -1;
+    }
+    for (i = 0; i < numindexes; i++)
+    {
+        v = indexes[i];
+        vtxtris[vtxfirst[v] + vtxremaining[v]++] = i / 3;
+    }
+    for (v = 0; v < numverts; v++)
+        vtxscore[v] = VCache_VertexScore(v);
 
-    if (gl_alwaysmesh.value) // build it from scratch, and don't bother saving it to disk
+    best = -1;
+    bestscore = -1;
+    for (t = 0; t < numtris; t++)
     {
-        Con_DPrintf("meshing %s...\n", m->name);
-        BuildTris();
+        tri = indexes + t * 3;
+        triscore[t] = vtxscore[tri[0]] + vtxscore[tri[1]] + vtxscore[tri[2]];
+        triadded[t] = 0;
+        if (triscore[t] > bestscore)
+        {
+            bestscore = triscore[t];
+            best = t;
+        }
     }
-    else // check disk cache, and rebuild it and save to disk if necessary
+
+    cached = 0;
+    for (added = 0; added < numtris; added++)
     {
+        // nothing in the cache has triangles left, so start again from the best of the rest
+        if (best == -1)
+        {
+            bestscore = -1;
+            for (t = 0; t < numtris; t++)
+                if (!triadded[t] && triscore[t] > bestscore)
+                {
+                    bestscore = triscore[t];
+                    best = t;
+                }
+        }
 
-        //create directories
-        sprintf(gldir, "%s/glquake", com_gamedir);
-        Sys_mkdir(com_gamedir);
-        Sys_mkdir(gldir);
+        tri = indexes + best * 3;
+        memcpy(sorted + added * 3, tri, 3 * sizeof(sorted[0]));
+        triadded[best] = 1;
 
-        //
-        // look for a cached version
-        //
-        strcpy(cache, "glquake/");
-        COM_StripExtension(m->name + strlen("progs/"), cache + strlen("glquake/"));
-        strcat(cache, ".ms2");
+        // take it off its vertexes' lists, which keep the remaining triangles first
+        for (k = 0; k < 3; k++)
+        {
+            v = tri[k];
+            for (j = vtxfirst[v]; vtxtris[j] != best; j++)
+                ;
+            vtxtris[j] = vtxtris[vtxfirst[v] + vtxremaining[v] - 1];
+            vtxtris[vtxfirst[v] + vtxremaining[v] - 1] = best;
+            vtxremaining[v]--;
+        }
 
-        COM_FOpenFile(cache, &f);
-        if (f)
+        // its vertexes go to the front of the cache, in order
+        newcached = 0;
+        for (k = 0; k < 3; k++)
+            newcache[newcached++] = tri[k];
+        for (i = 0; i < cached; i++)
         {
-            fread(&numcommands, 4, 1, f);
-            fread(&numorder, 4, 1, f);
-            fread(&commands, numcommands * sizeof(commands[0]), 1, f);
-            fread(&vertexorder, numorder * sizeof(vertexorder[0]), 1, f);
-            fclose(f);
+            v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newcache[newcached++] = v;
         }
-        else
+        for (i = VCACHE_SIZE; i < newcached; i++)
         {
-            //
-            // build it from scratch
-            //
-            Con_Printf("meshing %s...\n", m->name);
-            BuildTris();
+            v = newcache[i];
+            vtxcachepos[v] = -1; // pushed out
+            vtxscore[v] = VCache_VertexScore(v);
+        }
+        cached = newcached < VCACHE_SIZE ? newcached : VCACHE_SIZE;
+        for (i = 0; i < cached; i++)
+        {
+            v = cache[i] = newcache[i];
+            vtxcachepos[v] = i;
+            vtxscore[v] = VCache_VertexScore(v);
+        }
+
+        // rescore the triangles the cache touches and pick the next from them
+        best = -1;
+        bestscore = -1;
+        for (i = 0; i < cached; i++)
+        {
+            v = cache[i];
+            for (j = vtxfirst[v]; j < vtxfirst[v] + vtxremaining[v]; j++)
+            {
+                t = vtxtris[j];
+                tri = indexes + t * 3;
+                triscore[t] = vtxscore[tri[0]] + vtxscore[tri[1]] + vtxscore[tri[2]];
+                if (triscore[t] > bestscore)
+                {
+                    bestscore = triscore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    memcpy(indexes, sorted, numindexes * sizeof(indexes[0]));
+}
+
+/*
+================
+VCache_MissRatio -- misses per triangle drawing indexes through a first in first out cache
+of cachesize vertexes, the way post transform caches work. 0.5 is the best a mesh gets
+================
+*/
+static float VCache_MissRatio(const unsigned short* indexes, int numindexes, int cachesize)
+{
+    int fifo[64];
+    int i, j, next, count, misses;
+
+    if (numindexes < 3)
+        return 0;
+
+    next = count = misses = 0;
+    for (i = 0; i < numindexes; i++)
+    {
+        for (j = 0; j < count; j++)
+            if (fifo[j] == indexes[i])
+                break;
+        if (j < count)
+            continue;
 
-            //
-            // save out the cached version
-            //
-            sprintf(fullpath, "%s/%s", com_gamedir, cache);
-            f = fopen(fullpath, "wb");
-            if (f)
+        misses++;
+        fifo[next] = indexes[i];
+        next = (next + 1) % cachesize;
+        if (count < cachesize)
+            count++;
+    }
+
+    return misses / (numindexes / 3.0f);
+}
+
+/*
+================
+BuildIndexes
+
+the command list as a triangle list. the vertexes of the strips
+and fans are all separate, but where two have the same model
+vertex and s/t the triangle list uses the first for both, so the
+vertex cache can share it
+================
+*/
+static void BuildIndexes(bool optimize)
+{
+    static int weldhash[16384];
+    static int orderst[8192][2]; // s/t of each vertex of the command list, as they are stored
+    static unsigned short weld[8192];
+    int* cmds;
+    int i, j, h, count, firstvert;
+    bool fan;
+
+    memset(weldhash, -1, sizeof(weldhash));
+    for (cmds = commands, i = 0; (count = *cmds++);)
+    {
+        if (count < 0)
+            count = -count;
+
+        for (j = 0; j < count; j++, i++, cmds += 2)
+        {
+            orderst[i][0] = cmds[0];
+            orderst[i][1] = cmds[1];
+            weld[i] = i;
+            if (!optimize)
+                continue;
+
+            h = ((unsigned)vertexorder[i] * 2654435761u ^ (unsigned)cmds[0] * 40503u ^ (unsigned)cmds[1]) & 16383;
+            for (; weldhash[h] != -1; h = (h + 1) & 16383)
+                if (vertexorder[weldhash[h]] == vertexorder[i] && orderst[weldhash[h]][0] == cmds[0] && orderst[weldhash[h]][1] == cmds[1])
+                    break;
+            if (weldhash[h] == -1)
+                weldhash[h] = i;
+            else
+                weld[i] = weldhash[h];
+        }
+    }
+
+    numaliasindexes = 0;
+    firstvert = 0;
+    for (cmds = commands; (count = *cmds++);)
+    {
+        fan = count < 0;
+        if (fan)
+            count = -count;
+
+        for (j = 2; j < count; j++)
+        {
+            if (fan)
+            {
+                aliasindexes[numaliasindexes++] = weld[firstvert];
+                aliasindexes[numaliasindexes++] = weld[firstvert + j - 1];
+            }
+            else if (j & 1) // odd strip triangles are wound the other way
+            {
+                aliasindexes[numaliasindexes++] = weld[firstvert + j - 1];
+                aliasindexes[numaliasindexes++] = weld[firstvert + j - 2];
+            }
+            else
             {
-                fwrite(&numcommands, 4, 1, f);
-                fwrite(&numorder, 4, 1, f);
-                fwrite(&commands, numcommands * sizeof(commands[0]), 1, f);
-                fwrite(&vertexorder, numorder * sizeof(vertexorder[0]), 1, f);
-                fclose(f);
+                aliasindexes[numaliasindexes++] = weld[firstvert + j - 2];
+                aliasindexes[numaliasindexes++] = weld[firstvert + j - 1];
             }
+            aliasindexes[numaliasindexes++] = weld[firstvert + j];
         }
+
+        cmds += count * 2;
+        firstvert += count;
+    }
+
+    if (optimize)
+        VCache_Optimize(aliasindexes, numaliasindexes, numorder);
+}
+
+/*
+=================================================================
+
+MESH CACHE
+
+=================================================================
+*/
+
+// the command list, vertex order and triangle list of each model are saved in glquake/
+// the way the original glquake saved its .ms2 files. the header holds a crc of the
+// triangles and s/t they came from, so a model that changes is meshed again
+
+#define MESHFILE_VERSION 1
+
+typedef struct
+{
+    char magic[4]; // "QMSH"
+    int version;
+    unsigned crc;
+    int numverts, numtris, skinwidth, skinheight; // of the model
+    int numcommands, numorder, numindexes;
+} meshfile_t;
+
+static int meshcache_hits, meshcache_misses;
+
+/*
+================
+GL_MeshCRC -- of what the mesh is built from
+================
+*/
+static unsigned GL_MeshCRC(void)
+{
+    return ((unsigned)CRC_Block((uint8_t*)stverts, pheader->numverts * sizeof(stverts[0])) << 16)
+        | CRC_Block((uint8_t*)triangles, pheader->numtris * sizeof(triangles[0]));
+}
+
+/*
+================
+GL_MeshPath -- glquake/ and the model name without progs/, as glquake had it
+================
+*/
+static void GL_MeshPath(const char* modelname, char* path)
+{
+    static char madedir[MAX_OSPATH];
+    char name[MAX_QPATH];
+    char* c;
+
+    if (!Q_strncmp(modelname, "progs/", 6))
+        modelname += 6;
+    COM_StripExtension(modelname, name);
+    for (c = name; *c; c++)
+        if (*c == '/')
+            *c = '_';
+
+    if (strcmp(madedir, com_gamedir))
+    {
+        Sys_mkdir(va("%s/glquake", com_gamedir));
+        strcpy(madedir, com_gamedir);
+    }
+    sprintf(path, "%s/glquake/%s.ms3", com_gamedir, name);
+}
+
+/*
+================
+GL_MeshHeader -- what the header of the current model's file should say, less the sizes
+================
+*/
+static void GL_MeshHeader(meshfile_t* header)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, "QMSH", 4);
+    header->version = MESHFILE_VERSION;
+    header->crc = GL_MeshCRC();
+    header->numverts = pheader->numverts;
+    header->numtris = pheader->numtris;
+    header->skinwidth = pheader->skinwidth;
+    header->skinheight = pheader->skinheight;
+}
+
+/*
+================
+GL_CheckMesh -- so a damaged file can't send the loader off the end of the arrays
+================
+*/
+static bool GL_CheckMesh(void)
+{
+    int i, count, maxcount, verts;
+
+    for (i = verts = 0; i < numcommands - 1; i += 1 + count * 2)
+    {
+        maxcount = (numcommands - 2 - i) / 2; // what fits before the terminating 0
+        if (commands[i] < -maxcount || commands[i] > maxcount) // before negating it, which could overflow
+            return false;
+        count = commands[i] < 0 ? -commands[i] : commands[i];
+        if (count < 3)
+            return false;
+        verts += count;
+    }
+    if (i != numcommands - 1 || commands[i] != 0 || verts != numorder)
+        return false;
+
+    for (i = 0; i < numorder; i++)
+        if (vertexorder[i] < 0 || vertexorder[i] >= pheader->numverts)
+            return false;
+
+    for (i = 0; i < numaliasindexes; i++)
+        if (aliasindexes[i] >= numorder)
+            return false;
+
+    return true;
+}
+
+/*
+================
+GL_ReadMesh -- false if there's no file for the current model, or it's for another version of it
+================
+*/
+static bool GL_ReadMesh(const char* path)
+{
+    meshfile_t header, expected;
+    FILE* f;
+    bool ok;
+
+    f = fopen(path, "rb");
+    if (!f)
+    {
+        meshcache_misses++;
+        return false;
+    }
+
+    GL_MeshHeader(&expected);
+    ok = fread(&header, sizeof(header), 1, f) == 1
+        && !memcmp(&header, &expected, offsetof(meshfile_t, numcommands))
+        && header.numcommands > 0 && header.numcommands <= (int)(sizeof(commands) / sizeof(commands[0]))
+        && header.numorder > 0 && header.numorder <= (int)(sizeof(vertexorder) / sizeof(vertexorder[0]))
+        && header.numindexes == pheader->numtris * 3;
+    if (ok)
+    {
+        numcommands = header.numcommands;
+        numorder = header.numorder;
+        numaliasindexes = header.numindexes;
+        ok = fread(commands, numcommands * sizeof(commands[0]), 1, f) == 1
+            && fread(vertexorder, numorder * sizeof(vertexorder[0]), 1, f) == 1
+            && fread(aliasindexes, numaliasindexes * sizeof(aliasindexes[0]), 1, f) == 1
+            && GL_CheckMesh();
+    }
+    fclose(f);
+
+    if (ok)
+        meshcache_hits++;
+    else
+        meshcache_misses++;
+    return ok;
+}
+
+/*
+================
+GL_WriteMesh -- under a temporary name first so a reader never sees half a file
+================
+*/
+static void GL_WriteMesh(const char* path)
+{
+    char temp[MAX_OSPATH + 16];
+    meshfile_t header;
+    FILE* f;
+
+    sprintf(temp, "%s.tmp", path);
+    f = fopen(temp, "wb");
+    if (!f)
+        return;
+
+    GL_MeshHeader(&header);
+    header.numcommands = numcommands;
+    header.numorder = numorder;
+    header.numindexes = numaliasindexes;
+    if (fwrite(&header, sizeof(header), 1, f) != 1
+        || fwrite(commands, numcommands * sizeof(commands[0]), 1, f) != 1
+        || fwrite(vertexorder, numorder * sizeof(vertexorder[0]), 1, f) != 1
+        || fwrite(aliasindexes, numaliasindexes * sizeof(aliasindexes[0]), 1, f) != 1)
+    {
+        fclose(f);
+        remove(temp);
+        return;
+    }
+    fclose(f);
+
+    remove(path);
+    if (rename(temp, path))
+        remove(temp);
+}
+
+/*
+================
+GL_MakeAliasModelDisplayLists
+================
+*/
+void GL_MakeAliasModelDisplayLists(model_t* m, aliashdr_t* hdr)
+{
+    int i, j;
+    int* cmds;
+    trivertx_t* verts;
+    float hscale, vscale; //johnfitz -- padded skins
+    int count; //johnfitz -- precompute texcoords for padded skins
+    int* loadcmds; //johnfitz
+    float* texcoords;
+    unsigned short* indexes;
+    char path[MAX_OSPATH];
+
+    //johnfitz -- padded skins
+    hscale = (float)hdr->skinwidth / (float)TexMgr_PadConditional(hdr->skinwidth);
+    vscale = (float)hdr->skinheight / (float)TexMgr_PadConditional(hdr->skinheight);
+    //johnfitz
+
+    aliasmodel = m;
+    paliashdr = hdr; // (aliashdr_t *)Mod_Extradata (m);
+
+//johnfitz -- generate meshes, or read them from glquake/
+    GL_MeshPath(m->name, path);
+    if (gl_alwaysmesh.value || !GL_ReadMesh(path))
+    {
+        Con_DPrintf("meshing %s...\n", m->name);
+        BuildTris();
+        BuildIndexes(true);
+        if (!gl_alwaysmesh.value)
+            GL_WriteMesh(path);
     }
-#endif
     //johnfitz
 
     // save the data out
@@ -392,4 +903,235 @@ void GL_MakeAliasModelDisplayLists(model_t* m, aliashdr_t* hdr)
     for (i = 0; i < paliashdr->numposes; i++)
         for (j = 0; j < numorder; j++)
             *verts++ = poseverts[i][vertexorder[j]];
+
+    // the same strips and fans as one indexed triangle list, so a pose can be drawn with a single call
+    texcoords = Hunk_Alloc(numorder * 2 * sizeof(float));
+    paliashdr->texcoords = (uint8_t*)texcoords - (uint8_t*)paliashdr;
+    cmds = (int*)((uint8_t*)paliashdr + paliashdr->commands);
+    for (i = 0; (count = *cmds++);)
+    {
+        if (count < 0)
+            count = -count;
+        for (j = 0; j < count; j++, i++, cmds += 2)
+        {
+            texcoords[i * 2 + 0] = ((float*)cmds)[0];
+            texcoords[i * 2 + 1] = ((float*)cmds)[1];
+        }
+    }
+
+    indexes = Hunk_Alloc(numaliasindexes * sizeof(unsigned short));
+    paliashdr->indexes = (uint8_t*)indexes - (uint8_t*)paliashdr;
+    memcpy(indexes, aliasindexes, numaliasindexes * sizeof(unsigned short));
+    paliashdr->numindexes = numaliasindexes;
+}
+
+/*
+================
+GL_UploadAliasMesh -- copies the texcoords and indexes of an alias model into static
+vertex buffers the first time it is drawn. they don't change with the pose. every load
+of the model frees them with GL_FreeAliasMesh, since a game change can put another
+model under the same name
+================
+*/
+void GL_UploadAliasMesh(model_t* m, aliashdr_t* hdr)
+{
+    if (m->meshvbo)
+        return;
+
+    GL_GenBuffersFunc(1, &m->meshvbo);
+    GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, m->meshvbo);
+    GL_BufferDataFunc(GL_ARRAY_BUFFER_ARB, hdr->poseverts * 2 * sizeof(float), (uint8_t*)hdr + hdr->texcoords, GL_STATIC_DRAW_ARB);
+    GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, 0);
+
+    GL_GenBuffersFunc(1, &m->meshibo);
+    GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, m->meshibo);
+    GL_BufferDataFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, hdr->numindexes * sizeof(unsigned short), (uint8_t*)hdr + hdr->indexes, GL_STATIC_DRAW_ARB);
+    GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+}
+
+/*
+================
+GL_FreeAliasMesh -- drops the buffers of GL_UploadAliasMesh, so the next draw uploads the model just loaded
+================
+*/
+void GL_FreeAliasMesh(model_t* m)
+{
+    if (m->meshvbo)
+        GL_DeleteBuffersFunc(1, &m->meshvbo);
+    if (m->meshibo)
+        GL_DeleteBuffersFunc(1, &m->meshibo);
+    m->meshvbo = m->meshibo = 0;
+}
+
+/*
+=================================================================
+
+MESH BENCHMARK
+
+=================================================================
+*/
+
+/*
+================
+GL_MeshBenchMDL -- the s/t and triangles of a model file into the loader's arrays, false if
+it isn't one the loader would take
+================
+*/
+static bool GL_MeshBenchMDL(uint8_t* file, aliashdr_t* hdr)
+{
+    mdl_t* header = (mdl_t*)file;
+    daliasskintype_t* pskintype;
+    stvert_t* pinstverts;
+    dtriangle_t* pintriangles;
+    int i, j, groupskins, skinsize;
+
+    if (LittleLong(header->ident) != IDPOLYHEADER || LittleLong(header->version) != ALIAS_VERSION)
+        return false;
+
+    hdr->numverts = LittleLong(header->numverts);
+    hdr->numtris = LittleLong(header->numtris);
+    hdr->skinwidth = LittleLong(header->skinwidth);
+    hdr->skinheight = LittleLong(header->skinheight);
+    if (hdr->numverts <= 0 || hdr->numverts > MAXALIASVERTS || hdr->numtris <= 0 || hdr->numtris > MAXALIASTRIS)
+        return false;
+
+    // past the skins
+    skinsize = hdr->skinwidth * hdr->skinheight;
+    pskintype = (daliasskintype_t*)(header + 1);
+    for (i = 0; i < LittleLong(header->numskins); i++)
+    {
+        if (LittleLong(pskintype->type) == ALIAS_SKIN_SINGLE)
+            pskintype = (daliasskintype_t*)((uint8_t*)(pskintype + 1) + skinsize);
+        else
+        {
+            groupskins = LittleLong(((daliasskingroup_t*)(pskintype + 1))->numskins);
+            pskintype = (daliasskintype_t*)((daliasskininterval_t*)((daliasskingroup_t*)(pskintype + 1) + 1) + groupskins);
+            pskintype = (daliasskintype_t*)((uint8_t*)pskintype + groupskins * skinsize);
+        }
+    }
+
+    pinstverts = (stvert_t*)pskintype;
+    for (i = 0; i < hdr->numverts; i++)
+    {
+        stverts[i].onseam = LittleLong(pinstverts[i].onseam);
+        stverts[i].s = LittleLong(pinstverts[i].s);
+        stverts[i].t = LittleLong(pinstverts[i].t);
+    }
+
+    pintriangles = (dtriangle_t*)&pinstverts[hdr->numverts];
+    for (i = 0; i < hdr->numtris; i++)
+    {
+        triangles[i].facesfront = LittleLong(pintriangles[i].facesfront);
+        for (j = 0; j < 3; j++)
+        {
+            triangles[i].vertindex[j] = LittleLong(pintriangles[i].vertindex[j]);
+            if (triangles[i].vertindex[j] < 0 || triangles[i].vertindex[j] >= hdr->numverts)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+================
+GL_MeshBench_f -- meshes every model in the pak files, from scratch and from glquake/,
+without touching the loaded models, and reports the times and the vertex cache misses
+per triangle of the triangle list as it was and in cache order. the files written are
+real cache entries, so it also fills the cache ahead of time
+
+meshbench [passes]
+================
+*/
+void GL_MeshBench_f(void)
+{
+    static aliashdr_t benchhdr;
+    aliashdr_t* oldheader;
+    const char* filename;
+    char path[MAX_OSPATH];
+    uint8_t* file;
+    int i, pass, passes, mark, len, strips, models, tris;
+    double start, mesh, order, cached, totalmesh, totalorder, totalcached;
+    float before, after, before32, after32;
+    float totalbefore, totalafter, totalbefore32, totalafter32;
+    bool ok;
+
+    passes = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 3;
+    if (passes < 1)
+        passes = 1;
+
+    oldheader = pheader;
+    pheader = &benchhdr;
+
+    models = tris = 0;
+    totalmesh = totalorder = totalcached = 0;
+    totalbefore = totalafter = totalbefore32 = totalafter32 = 0;
+    Con_Printf("model                      tris strips  mesh ms order ms cache ms  misses 16    misses 32\n");
+    for (i = 0; (filename = COM_PackFileName(i)); i++)
+    {
+        len = strlen(filename);
+        if (len < 4 || Q_strcasecmp(filename + len - 4, ".mdl"))
+            continue;
+
+        mark = Hunk_LowMark();
+        file = COM_LoadHunkFile(filename);
+        ok = file && GL_MeshBenchMDL(file, &benchhdr);
+        Hunk_FreeToLowMark(mark);
+        if (!ok)
+            continue;
+
+        // the strips and fans, then the triangle list as it was drawn before cache ordering
+        start = Sys_FloatTime();
+        for (pass = 0; pass < passes; pass++)
+            BuildTris();
+        mesh = (Sys_FloatTime() - start) / passes;
+
+        BuildIndexes(false);
+        before = VCache_MissRatio(aliasindexes, numaliasindexes, 16);
+        before32 = VCache_MissRatio(aliasindexes, numaliasindexes, 32);
+
+        start = Sys_FloatTime();
+        for (pass = 0; pass < passes; pass++)
+            BuildIndexes(true);
+        order = (Sys_FloatTime() - start) / passes;
+        after = VCache_MissRatio(aliasindexes, numaliasindexes, 16);
+        after32 = VCache_MissRatio(aliasindexes, numaliasindexes, 32);
+
+        for (strips = 0, len = 0; commands[len]; len += 1 + abs(commands[len]) * 2)
+            strips++;
+
+        // and back from the file, which is how every load after the first gets it
+        GL_MeshPath(filename, path);
+        GL_WriteMesh(path);
+        start = Sys_FloatTime();
+        for (pass = 0; pass < passes; pass++)
+            ok = GL_ReadMesh(path);
+        cached = (Sys_FloatTime() - start) / passes;
+
+        Con_Printf("%-25s %5i %6i %8.3f %8.3f %8.3f  %4.2f > %4.2f  %4.2f > %4.2f%s\n", filename, benchhdr.numtris, strips,
+            mesh * 1000, order * 1000, cached * 1000, before, after, before32, after32, ok ? "" : " not cached");
+
+        models++;
+        tris += benchhdr.numtris;
+        totalmesh += mesh;
+        totalorder += order;
+        totalcached += cached;
+        totalbefore += before * benchhdr.numtris;
+        totalafter += after * benchhdr.numtris;
+        totalbefore32 += before32 * benchhdr.numtris;
+        totalafter32 += after32 * benchhdr.numtris;
+    }
+
+    pheader = oldheader;
+
+    if (!models)
+    {
+        Con_Printf("meshbench: no models in the pak files\n");
+        return;
+    }
+
+    Con_Printf("%i models, %i triangles: %.2f ms meshing, %.2f ms ordering, %.2f ms from glquake/\n",
+        models, tris, totalmesh * 1000, totalorder * 1000, totalcached * 1000);
+    Con_Printf("vertex cache misses per triangle, 16 entries %.3f > %.3f, 32 entries %.3f > %.3f\n",
+        totalbefore / tris, totalafter / tris, totalbefore32 / tris, totalafter32 / tris);
 }
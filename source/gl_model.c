@@ -375,6 +375,7 @@ void Mod_LoadTextures(lump_t* l)
     int mark, fwidth, fheight;
     char filename[MAX_OSPATH], filename2[MAX_OSPATH], mapname[MAX_OSPATH];
     uint8_t* data;
+    unsigned* warpdata;
     extern uint8_t* hunk_base;
     //johnfitz
 
@@ -395,6 +396,7 @@ void Mod_LoadTextures(lump_t* l)
     loadmodel->numtextures = nummiptex + 2; //johnfitz -- need 2 dummy texture chains for missing textures
     loadmodel->textures = Hunk_AllocName(loadmodel->numtextures * sizeof(*loadmodel->textures), loadname);
 
+    TexMgr_BeginBatch(); // prepared across the worker threads at the end
     for (i = 0; i < nummiptex; i++)
     {
         m->dataofs[i] = LittleLong(m->dataofs[i]);
@@ -422,6 +424,7 @@ void Mod_LoadTextures(lump_t* l)
 
         tx->update_warp = false; //johnfitz
         tx->warpimage = NULL; //johnfitz
+        tx->warppixels = NULL;
         tx->fullbright = NULL; //johnfitz
 
         //johnfitz -- lots of changes
@@ -457,6 +460,14 @@ void Mod_LoadTextures(lump_t* l)
                         SRC_INDEXED, (uint8_t*)(tx + 1), loadmodel->name, offset, TEXPREF_NONE);
                 }
 
+                //the external image goes with the hunk below, keep it for the cpu warp
+                warpdata = NULL;
+                if (data)
+                {
+                    warpdata = (unsigned*)malloc(fwidth * fheight * 4);
+                    memcpy(warpdata, data, fwidth * fheight * 4);
+                }
+
                 //now create the warpimage, using dummy data from the hunk to create the initial image
                 Hunk_Alloc(gl_warpimagesize * gl_warpimagesize * 4); //make sure hunk is big enough so we don't reach an illegal address
                 Hunk_FreeToLowMark(mark);
@@ -464,6 +475,8 @@ void Mod_LoadTextures(lump_t* l)
                 tx->warpimage = TexMgr_LoadImage(loadmodel, texturename, gl_warpimagesize,
                     gl_warpimagesize, SRC_RGBA, hunk_base, "", (unsigned)hunk_base, TEXPREF_NOPICMIP | TEXPREF_WARPIMAGE);
                 tx->update_warp = true;
+                R_InitWarpTexture(tx, warpdata, fwidth, fheight);
+                free(warpdata);
             }
             else //regular texture
             {
@@ -519,6 +532,7 @@ void Mod_LoadTextures(lump_t* l)
         }
         //johnfitz
     }
+    TexMgr_EndBatch();
 
     //johnfitz -- last 2 slots in array should be filled with dummy textures
     loadmodel->textures[loadmodel->numtextures - 2] = r_notexture_mip; //for lightmapped surfs
@@ -1026,7 +1040,7 @@ void Mod_LoadFaces(lump_t* l)
         {
             out->flags |= (SURF_DRAWTURB | SURF_DRAWTILED);
             Mod_PolyForUnlitSurface(out);
-            GL_SubdivideSurface(out);
+            GL_SubdivideSurface(out); // old water draws the pieces, and r_oldwater can be turned on at any time
         }
         else if (out->texinfo->flags & TEX_MISSING) // texture is missing from bsp
         {
@@ -1809,6 +1823,7 @@ void* Mod_LoadAllSkins(int numskins, daliasskintype_t* pskintype)
 
     size = pheader->skinwidth * pheader->skinheight;
 
+    TexMgr_BeginBatch();
     for (i = 0; i < numskins; i++)
     {
         if (pskintype->type == ALIAS_SKIN_SINGLE)
@@ -1890,6 +1905,7 @@ void* Mod_LoadAllSkins(int numskins, daliasskintype_t* pskintype)
                 pheader->gltextures[i][j & 3] = pheader->gltextures[i][j - k];
         }
     }
+    TexMgr_EndBatch();
 
     return (void*)pskintype;
 }
@@ -2007,6 +2023,8 @@ void Mod_LoadAliasModel(model_t* mod, void* buffer)
 
     start = Hunk_LowMark();
 
+    GL_FreeAliasMesh(mod); // the file may not be the one the buffers were made from
+
     pinmodel = (mdl_t*)buffer;
     mod_base = (uint8_t*)buffer; //johnfitz
 
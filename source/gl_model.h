@@ -66,6 +66,8 @@ typedef struct texture_s
     struct gltexture_s* fullbright; //johnfitz -- fullbright mask texture
     struct gltexture_s* warpimage; //johnfitz -- for water animation
     bool update_warp; //johnfitz -- update warp this frame
+    unsigned* warppixels; // RGBA source for the cpu warp, see R_InitWarpTexture
+    int warpwidth, warpheight;
     struct msurface_s* texturechain; // for texture chains
     int anim_total; // total tenths in sequence ( 0 = no)
     int anim_min, anim_max; // time for this frame min <=time< max
@@ -112,6 +114,7 @@ typedef struct msurface_s
 {
     int visframe; // should be drawn when node is crossed
     bool culled; // johnfitz -- for frustum culling
+    int occlusionframe; // in an unoccluded leaf if current
     float mins[3]; // johnfitz -- for frustum culling
     float maxs[3]; // johnfitz -- for frustum culling
 
@@ -139,6 +142,9 @@ typedef struct msurface_s
     uint8_t styles[MAXLIGHTMAPS];
     int cached_light[MAXLIGHTMAPS]; // values currently used in lightmap
     bool cached_dlight; // true if dynamic light in cache
+    int lightmapframe; // r_framecount of the last lightmap rebuild
+    bool stylesdirty; // one of its lightstyles changed since the last rebuild
+    int vbo_firstvert; // offset of polys->verts in gl_bmodel_vbo
     uint8_t* samples; // [numstyles*surfsize]
 } msurface_t;
 
@@ -304,6 +310,9 @@ typedef struct
     int poseverts;
     int posedata; // numposes*poseverts trivert_t
     int commands; // gl command list with embedded s/t
+    int texcoords; // poseverts s/t pairs, in the same order as each pose
+    int indexes; // numindexes unsigned shorts, the command list as a triangle list
+    int numindexes;
     struct gltexture_s* gltextures[MAX_SKINS][4]; //johnfitz
     struct gltexture_s* fbtextures[MAX_SKINS][4]; //johnfitz
     int texels[MAX_SKINS]; // only for player skins
@@ -420,6 +429,11 @@ typedef struct model_s
     //
     cache_user_t cache; // only access through Mod_Extradata
 
+    //
+    // alias model texcoords and indexes in static vertex buffers, 0 until first drawn
+    //
+    unsigned int meshvbo, meshibo;
+
 } model_t;
 
 //============================================================================
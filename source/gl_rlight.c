@@ -33,7 +33,7 @@ R_AnimateLight
 */
 void R_AnimateLight(void)
 {
-    int i, j, k;
+    int i, j, k, value;
 
     //
     // light animations
@@ -42,22 +42,29 @@ void R_AnimateLight(void)
     for (j = 0; j < MAX_LIGHTSTYLES; j++)
     {
         if (!cl_lightstyle[j].length)
-        {
-            d_lightstylevalue[j] = 256;
-            continue;
-        }
+            value = 256;
         //johnfitz -- r_flatlightstyles
-        if (r_flatlightstyles.value == 2)
-            k = cl_lightstyle[j].peak - 'a';
-        else if (r_flatlightstyles.value == 1)
-            k = cl_lightstyle[j].average - 'a';
         else
         {
-            k = i % cl_lightstyle[j].length;
-            k = cl_lightstyle[j].map[k] - 'a';
+            if (r_flatlightstyles.value == 2)
+                k = cl_lightstyle[j].peak - 'a';
+            else if (r_flatlightstyles.value == 1)
+                k = cl_lightstyle[j].average - 'a';
+            else
+            {
+                k = i % cl_lightstyle[j].length;
+                k = cl_lightstyle[j].map[k] - 'a';
+            }
+            value = k * 22;
         }
-        d_lightstylevalue[j] = k * 22;
         //johnfitz
+
+        // only the surfaces using a style that changed need their lightmaps rebuilt
+        if (d_lightstylevalue[j] != value)
+        {
+            d_lightstylevalue[j] = value;
+            R_DirtyLightStyle(j);
+        }
     }
 }
 
@@ -235,6 +242,9 @@ start:
         R_MarkLights(light, bit, node->children[1]);
 }
 
+dlight_t* r_livedlights[MAX_DLIGHTS]; // the lights R_PushDlights found alive this scene
+int r_numlivedlights;
+
 /*
 =============
 R_PushDlights
@@ -245,18 +255,19 @@ void R_PushDlights(void)
     int i;
     dlight_t* l;
 
-    if (gl_flashblend.value)
-        return;
-
-    r_dlightframecount = r_framecount + 1; // because the count hasn't
+    if (!gl_flashblend.value)
+        r_dlightframecount = r_framecount + 1; // because the count hasn't
     //  advanced yet for this frame
     l = cl_dlights;
 
+    r_numlivedlights = 0;
     for (i = 0; i < MAX_DLIGHTS; i++, l++)
     {
         if (l->die < cl.time || !l->radius)
             continue;
-        R_MarkLights(l, 1 << i, cl.worldmodel->nodes);
+        r_livedlights[r_numlivedlights++] = l; // for R_LightEntity, even with flashblend
+        if (!gl_flashblend.value)
+            R_MarkLights(l, 1 << i, cl.worldmodel->nodes);
     }
 }
 
@@ -386,20 +397,54 @@ R_LightPoint -- johnfitz -- replaced entire function for lit support via lordhav
 =============
 */
 int R_LightPoint(vec3_t p)
+{
+    R_LightPointColor(p, lightcolor);
+    return ((lightcolor[0] + lightcolor[1] + lightcolor[2]) * (1.0f / 3.0f));
+}
+
+/*
+=============
+R_LightPointColor -- R_LightPoint into color instead of lightcolor, for the scene prep thread
+=============
+*/
+void R_LightPointColor(vec3_t p, vec3_t color)
 {
     vec3_t end;
 
     if (!cl.worldmodel->lightdata)
     {
-        lightcolor[0] = lightcolor[1] = lightcolor[2] = 255;
-        return 255;
+        color[0] = color[1] = color[2] = 255;
+        return;
     }
 
     end[0] = p[0];
     end[1] = p[1];
     end[2] = p[2] - 8192; //johnfitz -- was 2048
 
-    lightcolor[0] = lightcolor[1] = lightcolor[2] = 0;
-    RecursiveLightPoint(lightcolor, cl.worldmodel->nodes, p, end);
-    return ((lightcolor[0] + lightcolor[1] + lightcolor[2]) * (1.0f / 3.0f));
+    color[0] = color[1] = color[2] = 0;
+    RecursiveLightPoint(color, cl.worldmodel->nodes, p, end);
+}
+
+/*
+=============
+R_LightEntity -- the light on an entity at p: the light grid, or R_LightPointColor where the
+grid can't tell, plus the dynamic lights
+=============
+*/
+void R_LightEntity(vec3_t p, vec3_t color)
+{
+    vec3_t dist;
+    float add;
+    int i;
+
+    if (!r_lightgrid.value || !R_LightGridPoint(p, color))
+        R_LightPointColor(p, color);
+
+    for (i = 0; i < r_numlivedlights; i++)
+    {
+        VectorSubtract(p, r_livedlights[i]->origin, dist);
+        add = r_livedlights[i]->radius - Length(dist);
+        if (add > 0)
+            VectorMA(color, add, r_livedlights[i]->color, color);
+    }
 }
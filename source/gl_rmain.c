@@ -22,6 +22,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
 
 void R_AnimateLight(void);
 void V_CalcBlend(void);
@@ -56,6 +60,7 @@ mplane_t frustum[4];
 //johnfitz -- rendering statistics
 int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+int rs_lightmapchecks, rs_lightmaprebuilds;
 float rs_megatexels;
 
 bool envmap; // true during envmap command capture
@@ -91,6 +96,7 @@ cvar_t r_lightmap = { "r_lightmap", "0" };
 cvar_t r_shadows = { "r_shadows", "0" };
 cvar_t r_wateralpha = { "r_wateralpha", "1" };
 cvar_t r_dynamic = { "r_dynamic", "1" };
+cvar_t gl_vbo = { "gl_vbo", "1" };
 cvar_t r_novis = { "r_novis", "0" };
 
 cvar_t gl_finish = { "gl_finish", "0" };
@@ -118,6 +124,8 @@ cvar_t r_drawworld = { "r_drawworld", "1" };
 cvar_t r_showtris = { "r_showtris", "0" };
 cvar_t r_showbboxes = { "r_showbboxes", "0" };
 cvar_t r_lerpmodels = { "r_lerpmodels", "1" };
+cvar_t r_aliasarrays = { "r_aliasarrays", "1" };
+cvar_t r_pipeline = { "r_pipeline", "1" }; // set up the entities and particles on the background thread while the world is drawn
 cvar_t r_lerpmove = { "r_lerpmove", "1" };
 cvar_t r_nolerp_list = { "r_nolerp_list", "progs/flame.mdl,progs/flame2.mdl,progs/braztall.mdl,progs/brazshrt.mdl,progs/longtrch.mdl,progs/flame_pyre.mdl,progs/v_saw.mdl,progs/v_xfist.mdl,progs/h2stuff/newfire.mdl" };
 //johnfitz
@@ -175,15 +183,73 @@ bool R_CullBox(vec3_t emins, vec3_t emaxs)
     }
     return false;
 }
+/*
+=================
+R_CullSurfaceBoxes -- R_CullBox for up to 8 surfaces at once. returns a mask with bit i
+set if the bounds of surfs[i] are completely outside the frustum
+=================
+*/
+int R_CullSurfaceBoxes(msurface_t** surfs, int count)
+{
+    int i, mask;
+
+#ifdef USE_SSE2
+    float box[6][8]; // mins then maxs, one row per axis
+    __m128 mins[3], maxs[3], x, y, z, d, culled;
+    mplane_t* p;
+    int half, j;
+
+    // fill the unused lanes with the last box, they get masked off at the end
+    for (i = 0; i < 8; i++)
+    {
+        msurface_t* s = surfs[i < count ? i : count - 1];
+        for (j = 0; j < 3; j++)
+        {
+            box[j][i] = s->mins[j];
+            box[j + 3][i] = s->maxs[j];
+        }
+    }
+
+    mask = 0;
+    for (half = 0; half < 8; half += 4)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            mins[j] = _mm_loadu_ps(&box[j][half]);
+            maxs[j] = _mm_loadu_ps(&box[j + 3][half]);
+        }
+
+        culled = _mm_setzero_ps();
+        for (i = 0; i < 4; i++)
+        {
+            // the corner furthest along the plane normal, as picked by the signbits cases in R_CullBox
+            p = frustum + i;
+            x = (p->signbits & 1) ? mins[0] : maxs[0];
+            y = (p->signbits & 2) ? mins[1] : maxs[1];
+            z = (p->signbits & 4) ? mins[2] : maxs[2];
+            d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p->normal[0]), x), _mm_mul_ps(_mm_set1_ps(p->normal[1]), y)), _mm_mul_ps(_mm_set1_ps(p->normal[2]), z));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(d, _mm_set1_ps(p->dist)));
+        }
+        mask |= _mm_movemask_ps(culled) << half;
+    }
+
+    return mask & ((1 << count) - 1);
+#else
+    mask = 0;
+    for (i = 0; i < count; i++)
+        if (R_CullBox(surfs[i]->mins, surfs[i]->maxs))
+            mask |= 1 << i;
+    return mask;
+#endif
+}
+
 /*
 ===============
-R_CullModelForEntity -- johnfitz -- uses correct bounds based on rotation
+R_EntityBounds -- johnfitz -- uses correct bounds based on rotation
 ===============
 */
-bool R_CullModelForEntity(entity_t* e)
+void R_EntityBounds(entity_t* e, vec3_t mins, vec3_t maxs)
 {
-    vec3_t mins, maxs;
-
     if (e->angles[0] || e->angles[2]) //pitch or roll
     {
         VectorAdd(e->origin, e->model->rmins, mins);
@@ -199,8 +265,34 @@ bool R_CullModelForEntity(entity_t* e)
         VectorAdd(e->origin, e->model->mins, mins);
         VectorAdd(e->origin, e->model->maxs, maxs);
     }
+}
+
+/*
+===============
+R_CullModelForEntity -- johnfitz -- count is for the main entity pass, so an entity the
+other passes cull again is only counted and shown as occluded once a frame
+===============
+*/
+bool R_CullModelForEntity(entity_t* e, bool count)
+{
+    vec3_t mins, maxs;
+
+    R_EntityBounds(e, mins, maxs);
+
+    if (R_CullBox(mins, maxs))
+        return true;
+
+    if (e != &cl.viewent && R_OccludedBox(mins, maxs))
+    {
+        if (count)
+        {
+            rs_occludedents++;
+            R_OcclusionShow(mins, maxs, true);
+        }
+        return true;
+    }
 
-    return R_CullBox(mins, maxs);
+    return false;
 }
 
 /*
@@ -400,6 +492,7 @@ void R_SetupScene(void)
 {
     R_PushDlights();
     R_AnimateLight();
+    R_PollLightGrid();
     r_framecount++;
     R_SetupGL();
 }
@@ -447,6 +540,10 @@ void R_SetupView(void)
 
     R_CullSurfaces(); //johnfitz -- do after R_SetFrustum and R_MarkSurfaces
 
+    R_BuildOcclusion(); // from the surfaces that survived R_CullSurfaces
+
+    R_OccludeWorld();
+
     R_UpdateWarpTextures(); //johnfitz -- do this before R_Clear
 
     R_Clear();
@@ -475,6 +572,164 @@ void R_SetupView(void)
 //
 //==============================================================================
 
+/*
+=============
+R_ViewModelVisible
+=============
+*/
+static bool R_ViewModelVisible(void)
+{
+    if (!r_drawviewmodel.value || !r_drawentities.value || chase_active.value || envmap)
+        return false;
+
+    if (cl.items & IT_INVISIBILITY || cl.stats[STAT_HEALTH] <= 0)
+        return false;
+
+    //johnfitz -- this fixes a crash
+    return cl.viewent.model && cl.viewent.model->type == mod_alias;
+}
+
+//==============================================================================
+//
+// SCENE PREP
+//
+//==============================================================================
+
+// what the scene prep thread builds for one R_RenderScene while the main thread draws the
+// sky and the world: every alias entity set up for drawing, with its frame lerped and lit,
+// and the particle vertexes. the prep only reads what the world draw doesn't write, and
+// nothing after the world reads the entities until R_FinishScenePrep has joined it.
+// the model headers are looked up before it starts, since one the cache has thrown out
+// is loaded again, and that is main thread work
+typedef struct
+{
+    aliashdr_t* headers[MAX_VISEDICTS]; // by cl_visedicts index, for the alias models among them
+    aliashdr_t* viewheader;
+    aliasprep_t alias[MAX_VISEDICTS]; // by cl_visedicts index, for the alias models among them
+    aliasprep_t viewmodel;
+    bool hasviewmodel;
+    bool active; // the entity draws of this scene read from here
+    double prepstart, prepend; // on the prep thread
+} framepacket_t;
+
+static framepacket_t r_packet;
+
+// Sys_PerfTime stamps of the last frame, for r_speeds 3
+static double r_stagebegin; // R_RenderView
+static double r_stagekick; // R_BeginScenePrep, the end of the view setup
+static double r_stageworld, r_stageworldend; // the sky and world draw
+static double r_stagejoin; // the prep thread is done, the rest of the scene is drawn
+static double r_stageend;
+
+/*
+=============
+R_PrepareScene -- runs on the background thread, see framepacket_t
+=============
+*/
+static void R_PrepareScene(int index, int thread, void* data)
+{
+    framepacket_t* packet = (framepacket_t*)data;
+    entity_t* e;
+    int i;
+
+    packet->prepstart = Sys_PerfTime();
+
+    R_ResetAliasPrep();
+    if (r_drawentities.value)
+    {
+        for (i = 0; i < cl_numvisedicts; i++)
+        {
+            e = cl_visedicts[i];
+            if (e->model->type != mod_alias)
+                continue;
+
+            //johnfitz -- chasecam
+            if (e == &cl_entities[cl.viewentity])
+                e->angles[0] *= 0.3f;
+            //johnfitz
+
+            R_PrepareAliasModel(e, packet->headers[i], &packet->alias[i], true);
+        }
+    }
+
+    if (packet->hasviewmodel)
+        R_PrepareAliasModel(&cl.viewent, packet->viewheader, &packet->viewmodel, true);
+
+    R_PrepareParticles();
+
+    packet->prepend = Sys_PerfTime();
+}
+
+/*
+=============
+R_SceneHeaders -- the model headers for R_PrepareScene. loading one model can throw
+another out of the cache, so they are looked up twice, and the scene is drawn without
+the prep thread if anything moved in between
+=============
+*/
+static bool R_SceneHeaders(framepacket_t* packet)
+{
+    int i, pass;
+    aliashdr_t* hdr;
+    bool moved;
+
+    packet->hasviewmodel = R_ViewModelVisible();
+    for (pass = 0, moved = false; pass < 2; pass++)
+    {
+        if (r_drawentities.value)
+        {
+            for (i = 0; i < cl_numvisedicts; i++)
+            {
+                if (cl_visedicts[i]->model->type != mod_alias)
+                    continue;
+                hdr = (aliashdr_t*)Mod_Extradata(cl_visedicts[i]->model);
+                moved |= pass && hdr != packet->headers[i];
+                packet->headers[i] = hdr;
+            }
+        }
+
+        if (packet->hasviewmodel)
+        {
+            hdr = (aliashdr_t*)Mod_Extradata(cl.viewent.model);
+            moved |= pass && hdr != packet->viewheader;
+            packet->viewheader = hdr;
+        }
+    }
+
+    return !moved;
+}
+
+/*
+=============
+R_BeginScenePrep -- starts building the entities and particles of this scene on the background
+thread. the main thread can draw the sky and the world until R_FinishScenePrep
+=============
+*/
+static void R_BeginScenePrep(void)
+{
+    r_stagekick = Sys_PerfTime();
+    r_packet.prepstart = r_packet.prepend = r_stagekick;
+    r_packet.active = r_pipeline.value != 0 && Tasks_Done(); // not while the light grid is built
+    if (r_packet.active)
+        r_packet.active = R_SceneHeaders(&r_packet);
+    if (r_packet.active)
+        Tasks_Begin(R_PrepareScene, &r_packet);
+    r_stageworld = Sys_PerfTime();
+}
+
+/*
+=============
+R_FinishScenePrep
+=============
+*/
+static void R_FinishScenePrep(void)
+{
+    r_stageworldend = Sys_PerfTime();
+    if (r_packet.active) // not a light grid build that is still running
+        Tasks_Join();
+    r_stagejoin = Sys_PerfTime();
+}
+
 /*
 =============
 R_DrawEntitiesOnList
@@ -499,14 +754,17 @@ static void R_DrawEntitiesOnList(bool alphapass) //johnfitz -- added parameter
             continue;
 
         //johnfitz -- chasecam
-        if (currententity == &cl_entities[cl.viewentity])
+        if (currententity == &cl_entities[cl.viewentity] && !(r_packet.active && currententity->model->type == mod_alias)) // the prep did it
             currententity->angles[0] *= 0.3f;
         //johnfitz
 
         switch (currententity->model->type)
         {
         case mod_alias:
-            R_DrawAliasModel(currententity);
+            if (r_packet.active)
+                R_DrawPreparedAliasModel(&r_packet.alias[i]);
+            else
+                R_DrawAliasModel(currententity);
             break;
         case mod_brush:
             R_DrawBrushModel(currententity);
@@ -525,24 +783,17 @@ R_DrawViewModel -- johnfitz -- gutted
 */
 static void R_DrawViewModel(void)
 {
-    if (!r_drawviewmodel.value || !r_drawentities.value || chase_active.value || envmap)
-        return;
-
-    if (cl.items & IT_INVISIBILITY || cl.stats[STAT_HEALTH] <= 0)
+    if (r_packet.active ? !r_packet.hasviewmodel : !R_ViewModelVisible())
         return;
 
     currententity = &cl.viewent;
-    if (!currententity->model)
-        return;
-
-    //johnfitz -- this fixes a crash
-    if (currententity->model->type != mod_alias)
-        return;
-    //johnfitz
 
     // hack the depth range to prevent view model from poking into walls
     glDepthRange(0, 0.3);
-    R_DrawAliasModel(currententity);
+    if (r_packet.active)
+        R_DrawPreparedAliasModel(&r_packet.viewmodel);
+    else
+        R_DrawAliasModel(currententity);
     glDepthRange(0, 1);
 }
 
@@ -570,7 +821,7 @@ static void R_EmitWirePoint(vec3_t origin)
 R_EmitWireBox -- johnfitz -- draws one axis aligned bounding box
 ================
 */
-static void R_EmitWireBox(vec3_t mins, vec3_t maxs)
+void R_EmitWireBox(vec3_t mins, vec3_t maxs)
 {
     glBegin(GL_QUAD_STRIP);
     glVertex3f(mins[0], mins[1], mins[2]);
@@ -763,12 +1014,16 @@ void R_RenderScene(void)
 {
     R_SetupScene(); //johnfitz -- this does everything that should be done once per call to RenderScene
 
+    R_BeginScenePrep(); // entities and particles, while the world is drawn
+
     Fog_EnableGFog(); //johnfitz
 
     Sky_DrawSky(); //johnfitz
 
     R_DrawWorld();
 
+    R_FinishScenePrep();
+
     S_ExtraUpdate(); // don't let sound get messed up if going slow
 
     R_DrawShadows(); //johnfitz -- render entity shadows
@@ -787,9 +1042,14 @@ void R_RenderScene(void)
 
     R_DrawViewModel(); //johnfitz -- moved here from R_RenderView
 
+    r_packet.active = false;
+    r_stageend = Sys_PerfTime();
+
     R_ShowTris(); //johnfitz
 
     R_ShowBoundingBoxes(); //johnfitz
+
+    R_ShowOcclusion();
 }
 
 /*
@@ -817,9 +1077,14 @@ void R_RenderView(void)
         rs_fogpolys = 0;
         rs_megatexels = 0;
         rs_dynamiclightmaps = 0;
+        rs_lightmapchecks = 0;
+        rs_lightmaprebuilds = 0;
         rs_aliaspasses = 0;
         rs_skypasses = 0;
         rs_brushpasses = 0;
+        rs_occluders = 0;
+        rs_occludedleafs = 0;
+        rs_occludedents = 0;
     }
     else {
         if (gl_finish.value) {
@@ -829,6 +1094,7 @@ void R_RenderView(void)
 
     // bracket for frame time statistics
     double time1 = Sys_FloatTime();
+    r_stagebegin = Sys_PerfTime();
     {
         R_SetupView();
         R_RenderScene();
@@ -836,16 +1102,38 @@ void R_RenderView(void)
     double time2 = Sys_FloatTime();
 
     if (r_speeds.value == 2)
-        Con_Printf("%3i ms  %4i/%4i wpoly %4i/%4i epoly %3i lmap %4i/%4i sky %1.1f mtex\n",
+        Con_Printf("%3i ms  %4i/%4i wpoly %4i/%4i epoly %3i lmap %4i/%4i lsurf %4i/%4i sky %1.1f mtex %3i/%4i/%3i occl %3i/%4i 2d\n",
             (int)((time2 - time1) * 1000),
             rs_brushpolys,
             rs_brushpasses,
             rs_aliaspolys,
             rs_aliaspasses,
             rs_dynamiclightmaps,
+            rs_lightmaprebuilds,
+            rs_lightmapchecks,
             rs_skypolys,
             rs_skypasses,
-            TexMgr_FrameUsage());
+            TexMgr_FrameUsage(),
+            rs_occluders,
+            rs_occludedleafs,
+            rs_occludedents,
+            rs_2ddraws,
+            rs_2dquads);
+    else if (r_speeds.value == 3)
+    {
+        // the stages of the frame, and how much of the scene prep was hidden behind the world draw
+        double prep = r_packet.prepend - r_packet.prepstart;
+        double overlap = (r_packet.prepend < r_stageworldend ? r_packet.prepend : r_stageworldend)
+            - (r_packet.prepstart > r_stageworld ? r_packet.prepstart : r_stageworld);
+
+        Con_Printf("%6.2f setup %6.2f world %6.2f prep %6.2f wait %6.2f draw ms %3i%% overlap\n",
+            (r_stagekick - r_stagebegin) * 1000,
+            (r_stageworldend - r_stageworld) * 1000,
+            prep * 1000,
+            (r_stagejoin - r_stageworldend) * 1000,
+            (r_stageend - r_stagejoin) * 1000,
+            prep > 0 && overlap > 0 ? (int)(overlap * 100 / prep) : 0);
+    }
     else if (r_speeds.value)
         Con_Printf("%3i ms  %4i wpoly %4i epoly %3i lmap\n",
             (int)((time2 - time1) * 1000),
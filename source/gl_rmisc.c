@@ -35,13 +35,17 @@ extern cvar_t gl_overbright_models;
 extern cvar_t r_waterquality;
 extern cvar_t r_oldwater;
 extern cvar_t r_waterwarp;
+extern cvar_t r_warpcpu;
 extern cvar_t r_oldskyleaf;
 extern cvar_t r_drawworld;
 extern cvar_t r_showtris;
 extern cvar_t r_showbboxes;
 extern cvar_t r_lerpmodels;
+extern cvar_t r_aliasarrays;
+extern cvar_t r_pipeline;
 extern cvar_t r_lerpmove;
 extern cvar_t r_nolerp_list;
+extern cvar_t gl_alwaysmesh;
 //johnfitz
 
 extern float load_subdivide_size; //johnfitz -- remember what subdivide_size value was when this map was loaded
@@ -188,6 +192,14 @@ void R_Init(void)
     Cmd_AddCommand("timerefresh", R_TimeRefresh_f);
     Cmd_AddCommand("envmap", R_Envmap_f);
     Cmd_AddCommand("pointfile", R_ReadPointFile_f);
+    Cmd_AddCommand("lightmapbench", R_LightmapBench_f);
+    Cmd_AddCommand("lightmapinfo", GL_LightmapInfo_f);
+    Cmd_AddCommand("crowdbench", R_CrowdBench_f);
+    Cmd_AddCommand("cullbench", R_CullBench_f);
+    Cmd_AddCommand("occlusionbench", R_OcclusionBench_f);
+    Cmd_AddCommand("lightgridbench", R_LightGridBench_f);
+    Cmd_AddCommand("warpbench", R_WarpBench_f);
+    Cmd_AddCommand("meshbench", GL_MeshBench_f);
 
     Cvar_RegisterVariable(&r_norefresh, NULL);
     Cvar_RegisterVariable(&r_lightmap, NULL);
@@ -197,6 +209,13 @@ void R_Init(void)
     Cvar_RegisterVariable(&r_shadows, NULL);
     Cvar_RegisterVariable(&r_wateralpha, NULL);
     Cvar_RegisterVariable(&r_dynamic, NULL);
+    Cvar_RegisterVariable(&r_lightmapthreads, NULL);
+    Cvar_RegisterVariable(&r_cullthreads, NULL);
+    Cvar_RegisterVariable(&r_occlusion, NULL);
+    Cvar_RegisterVariable(&r_occlusion_minarea, NULL);
+    Cvar_RegisterVariable(&r_lightgrid, NULL);
+    Cvar_RegisterVariable(&gl_lightmap_size, NULL);
+    Cvar_RegisterVariable(&gl_vbo, NULL);
     Cvar_RegisterVariable(&r_novis, R_Novis_f);
     Cvar_RegisterVariable(&r_speeds, NULL);
 
@@ -217,22 +236,27 @@ void R_Init(void)
     Cvar_RegisterVariable(&r_waterquality, NULL);
     Cvar_RegisterVariable(&r_oldwater, NULL);
     Cvar_RegisterVariable(&r_waterwarp, NULL);
+    Cvar_RegisterVariable(&r_warpcpu, NULL);
     Cvar_RegisterVariable(&r_drawflat, NULL);
     Cvar_RegisterVariable(&r_flatlightstyles, NULL);
     Cvar_RegisterVariable(&r_oldskyleaf, R_OldSkyLeaf_f);
     Cvar_RegisterVariable(&r_drawworld, NULL);
     Cvar_RegisterVariable(&r_showtris, NULL);
     Cvar_RegisterVariable(&r_showbboxes, NULL);
+    Cvar_RegisterVariable(&r_showocclusion, NULL);
     Cvar_RegisterVariable(&gl_farclip, NULL);
     Cvar_RegisterVariable(&gl_fullbrights, GL_Fullbrights_f);
     Cvar_RegisterVariable(&gl_overbright, GL_Overbright_f);
     Cvar_RegisterVariable(&gl_overbright_models, NULL);
     Cvar_RegisterVariable(&r_lerpmodels, NULL);
+    Cvar_RegisterVariable(&r_aliasarrays, NULL);
+    Cvar_RegisterVariable(&r_pipeline, NULL);
     Cvar_RegisterVariable(&r_lerpmove, NULL);
     Cvar_RegisterVariable(&r_nolerp_list, R_NoLerpList_f);
     //johnfitz
 
     Cvar_RegisterVariable(&gl_subdivide_size, NULL); //johnfitz -- moved here from gl_model.c
+    Cvar_RegisterVariable(&gl_alwaysmesh, NULL);
 
     R_InitParticles();
     R_SetClearColor_f(); //johnfitz
@@ -353,6 +377,11 @@ void R_NewMap(void)
     R_ClearParticles();
 
     GL_BuildLightmaps();
+    GL_BuildVertexBuffer();
+    R_InitWorldBatches();
+    R_InitWorldCull();
+    R_InitOcclusion();
+    R_InitLightGrid();
 
     r_framecount = 0; //johnfitz -- paranoid?
     r_visframecount = 0; //johnfitz -- paranoid?
@@ -360,6 +389,8 @@ void R_NewMap(void)
     Sky_NewMap(); //johnfitz -- skybox in worldspawn
     Fog_NewMap(); //johnfitz -- global fog in worldspawn
 
+    TexMgr_FlushPool(); // names the last map's textures left over that this one didn't reuse
+
     load_subdivide_size = gl_subdivide_size.value; //johnfitz -- is this the right place to set this?
 }
 
@@ -396,4 +427,5 @@ void R_TimeRefresh_f(void)
 
 void D_FlushCaches(void)
 {
+    R_FreeLightGrid(); // before the world it was built from goes away
 }
@@ -56,6 +56,7 @@ cvar_t scr_showturtle = { "showturtle", "0" };
 cvar_t scr_showpause = { "showpause", "1" };
 cvar_t scr_printspeed = { "scr_printspeed", "8" };
 cvar_t gl_triplebuffer = { "gl_triplebuffer", "1", true };
+cvar_t scr_screenshotformat = { "scr_screenshotformat", "tga", true }; // tga or png
 
 extern cvar_t crosshair;
 
@@ -335,6 +336,7 @@ void SCR_Init(void)
     Cvar_RegisterVariable(&scr_crosshaircale, NULL);
     Cvar_RegisterVariable(&scr_showfps, NULL);
     Cvar_RegisterVariable(&scr_clock, NULL);
+    Cvar_RegisterVariable(&scr_screenshotformat, NULL);
     //johnfitz
 
     Cvar_RegisterVariable(&scr_fov, NULL);
@@ -711,20 +713,25 @@ void SCR_DrawConsole(void)
 /*
 ==================
 SCR_ScreenShot_f -- johnfitz -- rewritten to use Image_WriteTGA
+
+the frame is read back here, then encoded and written on the capture thread
 ==================
 */
 void SCR_ScreenShot_f(void)
 {
-    uint8_t* buffer;
-    char tganame[16]; //johnfitz -- was [80]
+    static int lastshot; // names below it are taken, no need to look at them again
+    char name[16]; //johnfitz -- was [80]
     char checkname[MAX_OSPATH];
+    const char* ext;
     int i;
 
+    ext = Q_strcasecmp(scr_screenshotformat.string, "png") ? "tga" : "png";
+
     // find a file name to save it to
-    for (i = 0; i < 10000; i++)
+    for (i = lastshot; i < 10000; i++)
     {
-        sprintf(tganame, "fitz%04i.tga", i);
-        sprintf(checkname, "%s/%s", com_gamedir, tganame);
+        sprintf(name, "fitz%04i.%s", i, ext);
+        sprintf(checkname, "%s/%s", com_gamedir, name);
         if (Sys_FileTime(checkname) == -1)
             break; // file doesn't exist
     }
@@ -733,18 +740,9 @@ void SCR_ScreenShot_f(void)
         Con_Printf("SCR_ScreenShot_f: Couldn't find an unused filename\n");
         return;
     }
+    lastshot = i + 1;
 
-    //get data
-    buffer = malloc(glwidth * glheight * 3);
-    glReadPixels(glx, gly, glwidth, glheight, GL_RGB, GL_UNSIGNED_BYTE, buffer);
-
-    // now write the file
-    if (Image_WriteTGA(tganame, buffer, glwidth, glheight, 24, false))
-        Con_Printf("Wrote %s\n", tganame);
-    else
-        Con_Printf("SCR_ScreenShot_f: Couldn't create a TGA file\n");
-
-    free(buffer);
+    Capture_Screenshot(name, ext[0] == 'p');
 }
 
 //=============================================================================
@@ -1039,5 +1037,9 @@ void SCR_UpdateScreen(void)
 
     V_UpdateBlend(); //johnfitz -- V_UpdatePalette cleaned up and renamed
 
+    Draw_Flush();
+
+    Capture_Frame();
+
     GL_EndRendering();
 }
@@ -26,6 +26,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 float Fog_GetDensity(void);
 float* Fog_GetColor(void);
+void Sky_Bench_f(void);
 
 extern model_t* loadmodel;
 extern int rs_skypolys; //for r_speeds readout
@@ -43,6 +44,7 @@ cvar_t r_fastsky = { "r_fastsky", "0" };
 cvar_t r_sky_quality = { "r_sky_quality", "12" };
 cvar_t r_skyalpha = { "r_skyalpha", "1" };
 cvar_t r_skyfog = { "r_skyfog", "0.5" };
+cvar_t r_skyclip = { "r_skyclip", "0" };
 
 int skytexorder[6] = { 0, 2, 1, 3, 4, 5 }; //for skybox
 
@@ -137,6 +139,29 @@ void Sky_LoadTexture(texture_t* mt)
     skyflatcolor[2] = (float)b / (count * 255);
 }
 
+typedef struct
+{
+    uint8_t* file;
+    int filesize;
+    imageformat_t format;
+    int width, height;
+    uint8_t* data; // NULL if the face is missing or not an image we can read
+    bool damaged;
+} skyface_t;
+
+/*
+==================
+Sky_DecodeTask -- Tasks_ParallelFor callback, one face of the skybox
+==================
+*/
+static void Sky_DecodeTask(int index, int thread, void* data)
+{
+    skyface_t* face = (skyface_t*)data + index;
+
+    if (face->data)
+        face->damaged = !Image_Decode(face->file, face->filesize, face->format, face->data);
+}
+
 /*
 ==================
 Sky_LoadSkyBox
@@ -145,9 +170,9 @@ Sky_LoadSkyBox
 char* suf[6] = { "rt", "bk", "lf", "ft", "up", "dn" };
 void Sky_LoadSkyBox(char* name)
 {
-    int i, mark, width, height;
-    char filename[MAX_OSPATH];
-    uint8_t* data;
+    int i;
+    char filename[6][MAX_OSPATH];
+    skyface_t faces[6], *face;
     bool nonefound = true;
 
     if (strcmp(skybox_name, name) == 0)
@@ -168,23 +193,35 @@ void Sky_LoadSkyBox(char* name)
         return;
     }
 
+    //read the files, then decode all six faces at once on the worker threads
+    memset(faces, 0, sizeof(faces));
+    for (i = 0, face = faces; i < 6; i++, face++)
+    {
+        sprintf(filename[i], "gfx/env/%s%s", name, suf[i]);
+        face->file = Image_LoadFile(filename[i], &face->format, &face->filesize);
+        if (face->file && Image_Info(face->file, face->filesize, face->format, &face->width, &face->height))
+            face->data = calloc(face->width * face->height, 4);
+    }
+
+    Tasks_ParallelFor(6, Sky_DecodeTask, faces);
+
     //load textures
-    for (i = 0; i < 6; i++)
+    for (i = 0, face = faces; i < 6; i++, face++)
     {
-        mark = Hunk_LowMark();
-        sprintf(filename, "gfx/env/%s%s", name, suf[i]);
-        data = Image_LoadImage(filename, &width, &height);
-        if (data)
+        if (face->data)
         {
-            skybox_textures[i] = TexMgr_LoadImage(cl.worldmodel, filename, width, height, SRC_RGBA, data, filename, 0, TEXPREF_NONE);
+            if (face->damaged)
+                Con_Warning("%s is damaged, part of it is missing\n", filename[i]);
+            skybox_textures[i] = TexMgr_LoadImage(cl.worldmodel, filename[i], face->width, face->height, SRC_RGBA, face->data, filename[i], 0, TEXPREF_NONE);
             nonefound = false;
         }
         else
         {
-            Con_Printf("Couldn't load %s\n", filename);
+            Con_Printf("Couldn't load %s\n", filename[i]);
             skybox_textures[i] = notexture;
         }
-        Hunk_FreeToLowMark(mark);
+        free(face->data);
+        free(face->file);
     }
 
     if (nonefound) // go back to scrolling sky if skybox is totally missing
@@ -296,8 +333,10 @@ void Sky_Init(void)
     Cvar_RegisterVariable(&r_sky_quality, NULL);
     Cvar_RegisterVariable(&r_skyalpha, NULL);
     Cvar_RegisterVariable(&r_skyfog, NULL);
+    Cvar_RegisterVariable(&r_skyclip, NULL);
 
     Cmd_AddCommand("sky", Sky_SkyCommand_f);
+    Cmd_AddCommand("skybench", Sky_Bench_f);
 
     for (i = 0; i < 6; i++)
         skybox_textures[i] = NULL;
@@ -496,8 +535,8 @@ void Sky_ProcessPoly(glpoly_t* p)
     DrawGLPoly(p);
     rs_brushpasses++;
 
-    //update sky bounds
-    if (!r_fastsky.value)
+    //update sky bounds, only needed when the sky is clipped on the cpu
+    if (!r_fastsky.value && r_skyclip.value)
     {
         for (i = 0; i < p->numverts; i++)
             VectorSubtract(p->verts[i], r_origin, verts[i]);
@@ -557,12 +596,21 @@ void Sky_ProcessEntities(void)
         if (e->model->type != mod_brush)
             continue;
 
-        if (R_CullModelForEntity(e))
+        if (R_CullModelForEntity(e, false))
             continue;
 
         if (e->alpha == ENTALPHA_ZERO)
             continue;
 
+        //without cpu clipping the polys only lay down depth, so let gl do the transform
+        if (!r_skyclip.value)
+        {
+            glPushMatrix();
+            e->angles[0] = -e->angles[0]; // stupid quake bug
+            R_RotateForEntity(e->origin, e->angles);
+            e->angles[0] = -e->angles[0]; // stupid quake bug
+        }
+
         VectorSubtract(r_refdef.vieworg, e->origin, modelorg);
         if (e->angles[0] || e->angles[1] || e->angles[2])
         {
@@ -585,6 +633,13 @@ void Sky_ProcessEntities(void)
                 dot = DotProduct(modelorg, s->plane->normal) - s->plane->dist;
                 if (((s->flags & SURF_PLANEBACK) && (dot < -BACKFACE_EPSILON)) || (!(s->flags & SURF_PLANEBACK) && (dot > BACKFACE_EPSILON)))
                 {
+                    if (!r_skyclip.value)
+                    {
+                        DrawGLPoly(s->polys);
+                        rs_brushpasses++;
+                        continue;
+                    }
+
                     //copy the polygon and translate manually, since Sky_ProcessPoly needs it to be in world space
                     mark = Hunk_LowMark();
                     p = Hunk_Alloc(sizeof(*s->polys)); //FIXME: don't allocate for each poly
@@ -611,6 +666,9 @@ void Sky_ProcessEntities(void)
                 }
             }
         }
+
+        if (!r_skyclip.value)
+            glPopMatrix();
     }
 }
 
@@ -671,7 +729,8 @@ void Sky_DrawSkyBox(void)
 {
     for (int i = 0; i < 6; i++)
     {
-        if (skymins[0][i] >= skymaxs[0][i] || skymins[1][i] >= skymaxs[1][i])
+        // unclipped, every face is drawn and the depth test keeps it to the sky
+        if (r_skyclip.value && (skymins[0][i] >= skymaxs[0][i] || skymins[1][i] >= skymaxs[1][i]))
             continue;
 
         GL_Bind(skybox_textures[skytexorder[i]]);
@@ -725,17 +784,17 @@ void Sky_DrawSkyBox(void)
 
 /*
 ==============
-Sky_SetBoxVert
+Sky_BoxDir -- point on a face of the unit box around the eye
 ==============
 */
-void Sky_SetBoxVert(float s, float t, int axis, vec3_t v)
+void Sky_BoxDir(float s, float t, int axis, vec3_t v)
 {
     vec3_t b;
     int j, k;
 
-    b[0] = s * gl_farclip.value / sqrt(3.0);
-    b[1] = t * gl_farclip.value / sqrt(3.0);
-    b[2] = gl_farclip.value / sqrt(3.0);
+    b[0] = s;
+    b[1] = t;
+    b[2] = 1;
 
     for (j = 0; j < 3; j++)
     {
@@ -744,10 +803,20 @@ void Sky_SetBoxVert(float s, float t, int axis, vec3_t v)
             v[j] = -b[-k - 1];
         else
             v[j] = b[k - 1];
-        v[j] += r_origin[j];
     }
 }
 
+/*
+==============
+Sky_SetBoxVert
+==============
+*/
+void Sky_SetBoxVert(float s, float t, int axis, vec3_t v)
+{
+    Sky_BoxDir(s, t, axis, v);
+    VectorMA(r_origin, gl_farclip.value / sqrt(3.0), v, v);
+}
+
 /*
 =============
 Sky_GetTexCoord
@@ -944,6 +1013,196 @@ void Sky_DrawSkyLayers(void)
         glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 }
 
+//==============================================================================
+//
+//  RENDER SKY CUBE
+//
+//==============================================================================
+
+// without r_skyclip the cloud layers are one box around the eye, drawn over
+// the depth the sky surfaces laid down.  the texcoords only depend on the
+// direction from the eye, so the box is built once and the scroll goes in
+// the texture matrix.
+
+typedef struct
+{
+    float xyz[3];
+    float st[2];
+} skyvert_t;
+
+static skyvert_t* skycube;
+static int skycubeverts, skycubequality;
+
+/*
+==============
+Sky_BuildCube -- the faces subdivided as Sky_DrawFace does, with the texcoords of Sky_GetTexCoord
+==============
+*/
+static void Sky_BuildCube(int quality)
+{
+    static const int corners[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+    skyvert_t* v;
+    vec3_t dir;
+    float length;
+    int axis, i, j, k, di, dj;
+
+    skycubeverts = 0;
+    for (axis = 0; axis < 6; axis++)
+        skycubeverts += quality * ((axis < 4) ? quality * 2 : quality) * 4;
+    free(skycube);
+    skycube = malloc(skycubeverts * sizeof(skyvert_t));
+    if (!skycube)
+        Sys_Error("Sky_BuildCube: out of memory");
+    skycubequality = quality;
+
+    v = skycube;
+    for (axis = 0; axis < 6; axis++)
+    {
+        di = quality;
+        dj = (axis < 4) ? di * 2 : di; //subdivide vertically more than horizontally on skybox sides
+
+        for (i = 0; i < di; i++)
+        {
+            for (j = 0; j < dj; j++)
+            {
+                for (k = 0; k < 4; k++, v++)
+                {
+                    Sky_BoxDir((i + corners[k][0]) * 2.0 / di - 1, (j + corners[k][1]) * 2.0 / dj - 1, axis, v->xyz);
+
+                    VectorCopy(v->xyz, dir);
+                    dir[2] *= 3; // flatten the sphere
+                    length = 6 * 63 / sqrt(DotProduct(dir, dir));
+                    v->st[0] = dir[0] * length * (1.0 / 128);
+                    v->st[1] = dir[1] * length * (1.0 / 128);
+                }
+            }
+        }
+    }
+}
+
+/*
+==============
+Sky_ScrollTexture -- texture matrix for the active tmu
+==============
+*/
+static void Sky_ScrollTexture(float speed)
+{
+    float scroll;
+
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    if (speed)
+    {
+        scroll = cl.time * speed;
+        scroll -= (int)scroll & ~127;
+        glTranslatef(scroll * (1.0 / 128), scroll * (1.0 / 128), 0);
+    }
+    glMatrixMode(GL_MODELVIEW);
+}
+
+/*
+==============
+Sky_DrawCube
+
+draws the old-style scrolling cloud layers without clipping anything on the cpu
+==============
+*/
+void Sky_DrawCube(void)
+{
+    float scale;
+    int quality;
+
+    quality = (int)r_sky_quality.value;
+    if (quality < 1)
+        quality = 1;
+    if (quality != skycubequality)
+        Sky_BuildCube(quality);
+
+    scale = gl_farclip.value / sqrt(3.0);
+    glPushMatrix();
+    glTranslatef(r_origin[0], r_origin[1], r_origin[2]);
+    glScalef(scale, scale, scale);
+
+    glVertexPointer(3, GL_FLOAT, sizeof(skyvert_t), skycube[0].xyz);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(skyvert_t), skycube[0].st);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    if (gl_mtexable && GL_ClientActiveTextureFunc && r_skyalpha.value >= 1.0)
+    {
+        GL_Bind(solidskytexture);
+        Sky_ScrollTexture(8);
+        GL_EnableMultitexture();
+        GL_Bind(alphaskytexture);
+        glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
+        Sky_ScrollTexture(16);
+        GL_ClientActiveTextureFunc(TEXTURE1);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(skyvert_t), skycube[0].st);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+        glDrawArrays(GL_QUADS, 0, skycubeverts);
+
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        GL_ClientActiveTextureFunc(TEXTURE0);
+        Sky_ScrollTexture(0);
+        GL_DisableMultitexture();
+
+        rs_skypasses++;
+    }
+    else
+    {
+        if (r_skyalpha.value < 1.0)
+        {
+            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+            glColor3f(1, 1, 1);
+        }
+
+        GL_Bind(solidskytexture);
+        Sky_ScrollTexture(8);
+        glDrawArrays(GL_QUADS, 0, skycubeverts);
+
+        GL_Bind(alphaskytexture);
+        Sky_ScrollTexture(16);
+        glEnable(GL_BLEND);
+        if (r_skyalpha.value < 1.0)
+            glColor4f(1, 1, 1, r_skyalpha.value);
+        glDrawArrays(GL_QUADS, 0, skycubeverts);
+        glDisable(GL_BLEND);
+
+        if (r_skyalpha.value < 1.0)
+        {
+            glColor3f(1, 1, 1);
+            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+        }
+
+        rs_skypasses += 2;
+    }
+    Sky_ScrollTexture(0);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    rs_skypolys += skycubeverts / 4;
+
+    if (Fog_GetDensity() > 0 && r_skyfog.value > 0)
+    {
+        float* c;
+
+        c = Fog_GetColor();
+        glEnable(GL_BLEND);
+        glDisable(GL_TEXTURE_2D);
+        glColor4f(c[0], c[1], c[2], CLAMP(0.0, r_skyfog.value, 1.0));
+
+        glDrawArrays(GL_QUADS, 0, skycubeverts);
+
+        glColor3f(1, 1, 1);
+        glEnable(GL_TEXTURE_2D);
+        glDisable(GL_BLEND);
+
+        rs_skypasses++;
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPopMatrix();
+}
+
 /*
 ==============
 Sky_DrawSky
@@ -992,12 +1251,64 @@ void Sky_DrawSky(void)
 
         if (skybox_name[0])
             Sky_DrawSkyBox();
-        else
+        else if (r_skyclip.value)
             Sky_DrawSkyLayers();
+        else
+            Sky_DrawCube();
 
         glDepthMask(1);
         glDepthFunc(GL_LEQUAL);
     }
 
     Fog_EnableGFog();
-}
\ No newline at end of file
+}
+
+/*
+=============
+Sky_Bench_f -- times Sky_DrawSky with and without clipping the sky polys on the cpu
+
+skybench [frames]
+=============
+*/
+void Sky_Bench_f(void)
+{
+    float saved;
+    int frames, frame, pass;
+    double start, cpu[2], total[2];
+
+    if (!cl.worldmodel)
+    {
+        Con_Printf("skybench: no map loaded\n");
+        return;
+    }
+
+    frames = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 100;
+    if (frames < 1)
+        frames = 1;
+
+    // render once for the texture chains and view, then redraw just the sky
+    saved = r_skyclip.value;
+    glDrawBuffer(GL_FRONT);
+    R_RenderView();
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        Cvar_SetValue("r_skyclip", !pass);
+        glFinish();
+
+        start = Sys_FloatTime();
+        for (frame = 0; frame < frames; frame++)
+            Sky_DrawSky();
+        cpu[pass] = (Sys_FloatTime() - start) * 1000.0 / frames;
+        glFinish();
+        total[pass] = (Sys_FloatTime() - start) * 1000.0 / frames;
+    }
+
+    Cvar_SetValue("r_skyclip", saved);
+    glDrawBuffer(GL_BACK);
+    GL_EndRendering();
+
+    Con_Printf("skybench: %s, %i frames\n", skybox_name[0] ? skybox_name : "cloud layers", frames);
+    Con_Printf("cpu clipped: %6.3f ms cpu %6.3f ms total per frame\n", cpu[0], total[0]);
+    Con_Printf("unclipped:   %6.3f ms cpu %6.3f ms total per frame\n", cpu[1], total[1]);
+}
@@ -22,17 +22,35 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 cvar_t gl_texture_anisotropy = { "gl_texture_anisotropy", "1", true };
 cvar_t gl_max_size = { "gl_max_size", "0" };
 cvar_t gl_picmip = { "gl_picmip", "0" };
+cvar_t gl_texcache = { "gl_texcache", "32" }; // megabytes for the texture cache, 0 turns it off
+cvar_t gl_texcompress = { "gl_texcompress", "0", true }; // block compress mipmapped textures, cached on disk
 int gl_hardware_maxsize;
 const int gl_solid_format = 3;
 const int gl_alpha_format = 4;
 
-#define MAX_GLTEXTURES 2048
+#define MAX_GLTEXTURES 4096
 gltexture_t *active_gltextures, *free_gltextures;
 int numgltextures;
 
+#define TEXHASH_SIZE 1024 // (owner, name) lookup
+#define TEXOWNER_SIZE 64 // per-owner lists, bucketed by owner
+static gltexture_t* texhash[TEXHASH_SIZE];
+static gltexture_t* texowners[TEXOWNER_SIZE];
+
+// gl texture names of freed textures, handed out again before asking the driver for more
+#define TEXPOOL_CHUNK 64
+static GLuint texpool[MAX_GLTEXTURES + TEXPOOL_CHUNK];
+static int texpoolsize;
+static int texpool_gens, texpool_reuses;
+
 /*
 ================================================================================
 
@@ -282,6 +300,79 @@ float TexMgr_FrameUsage(void)
 ================================================================================
 */
 
+/*
+================
+TexMgr_HashName -- bucket for an (owner, name) pair
+================
+*/
+static unsigned TexMgr_HashName(model_t* owner, const char* name)
+{
+    unsigned hash = (unsigned)((uintptr_t)owner >> 4) * 2654435761u;
+
+    while (*name)
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+
+    return (hash ^ (hash >> 16)) & (TEXHASH_SIZE - 1);
+}
+
+/*
+================
+TexMgr_HashOwner -- bucket for an owner's texture list
+================
+*/
+static unsigned TexMgr_HashOwner(model_t* owner)
+{
+    unsigned hash = (unsigned)((uintptr_t)owner >> 4) * 2654435761u;
+
+    return (hash >> 16) & (TEXOWNER_SIZE - 1);
+}
+
+/*
+================
+TexMgr_LinkTexture -- add a texture to the name hash and its owner's list. the owner and
+name must be set already
+================
+*/
+static void TexMgr_LinkTexture(gltexture_t* glt)
+{
+    gltexture_t** bucket;
+
+    bucket = &texhash[TexMgr_HashName(glt->owner, glt->name)];
+    glt->hashnext = *bucket;
+    *bucket = glt;
+
+    bucket = &texowners[TexMgr_HashOwner(glt->owner)];
+    glt->ownerprev = NULL;
+    glt->ownernext = *bucket;
+    if (*bucket)
+        (*bucket)->ownerprev = glt;
+    *bucket = glt;
+}
+
+/*
+================
+TexMgr_UnlinkTexture
+================
+*/
+static void TexMgr_UnlinkTexture(gltexture_t* glt)
+{
+    gltexture_t** link;
+
+    for (link = &texhash[TexMgr_HashName(glt->owner, glt->name)]; *link; link = &(*link)->hashnext)
+        if (*link == glt)
+        {
+            *link = glt->hashnext;
+            break;
+        }
+
+    if (glt->ownerprev)
+        glt->ownerprev->ownernext = glt->ownernext;
+    else
+        texowners[TexMgr_HashOwner(glt->owner)] = glt->ownernext;
+    if (glt->ownernext)
+        glt->ownernext->ownerprev = glt->ownerprev;
+}
+
 /*
 ================
 TexMgr_FindTexture
@@ -291,7 +382,7 @@ gltexture_t* TexMgr_FindTexture(model_t* owner, char* name)
 {
     if (name)
     {
-        for (gltexture_t* glt = active_gltextures; glt; glt = glt->next)
+        for (gltexture_t* glt = texhash[TexMgr_HashName(owner, name)]; glt; glt = glt->hashnext)
             if (glt->owner == owner && !strcmp(glt->name, name))
                 return glt;
     }
@@ -300,7 +391,7 @@ gltexture_t* TexMgr_FindTexture(model_t* owner, char* name)
 
 /*
 ================
-TexMgr_NewTexture
+TexMgr_NewTexture -- the texture isn't findable until TexMgr_LoadImage names it
 ================
 */
 gltexture_t* TexMgr_NewTexture(void)
@@ -310,17 +401,34 @@ gltexture_t* TexMgr_NewTexture(void)
 
     gltexture_t* glt = free_gltextures;
     free_gltextures = glt->next;
+    glt->prev = NULL;
     glt->next = active_gltextures;
+    if (active_gltextures)
+        active_gltextures->prev = glt;
     active_gltextures = glt;
+    glt->owner = NULL;
+    glt->name[0] = 0;
+    glt->hashnext = glt->ownernext = glt->ownerprev = NULL;
+    glt->linked = false;
+
+    if (!texpoolsize)
+    {
+        glGenTextures(TEXPOOL_CHUNK, texpool);
+        texpoolsize = TEXPOOL_CHUNK;
+        texpool_gens++;
+    }
+    else
+        texpool_reuses++;
+    glt->texnum = texpool[--texpoolsize];
 
-    glGenTextures(1, &glt->texnum);
     numgltextures++;
     return glt;
 }
 
 /*
 ================
-TexMgr_FreeTexture
+TexMgr_FreeTexture -- the gl texture name goes back to the pool, its old image is replaced
+when it's handed out again
 ================
 */
 void TexMgr_FreeTexture(gltexture_t* kill)
@@ -331,30 +439,43 @@ void TexMgr_FreeTexture(gltexture_t* kill)
         return;
     }
 
-    if (active_gltextures == kill)
+    if (!kill->texnum)
     {
-        active_gltextures = kill->next;
-        kill->next = free_gltextures;
-        free_gltextures = kill;
-
-        glDeleteTextures(1, &kill->texnum);
-        numgltextures--;
+        Con_Printf("TexMgr_FreeTexture: not found\n");
         return;
     }
 
-    for (gltexture_t* glt = active_gltextures; glt; glt = glt->next)
-        if (glt->next == kill)
-        {
-            glt->next = kill->next;
-            kill->next = free_gltextures;
-            free_gltextures = kill;
+    if (kill->linked)
+        TexMgr_UnlinkTexture(kill);
 
-            glDeleteTextures(1, &kill->texnum);
-            numgltextures--;
-            return;
-        }
+    if (kill->prev)
+        kill->prev->next = kill->next;
+    else
+        active_gltextures = kill->next;
+    if (kill->next)
+        kill->next->prev = kill->prev;
+    kill->next = free_gltextures;
+    free_gltextures = kill;
+
+    if (texpoolsize < (int)(sizeof(texpool) / sizeof(texpool[0])))
+        texpool[texpoolsize++] = kill->texnum;
+    else
+        glDeleteTextures(1, &kill->texnum);
+    kill->texnum = 0;
+    numgltextures--;
+}
 
-    Con_Printf("TexMgr_FreeTexture: not found\n");
+/*
+================
+TexMgr_FlushPool -- gives the pooled gl texture names back to the driver, with the memory
+their old images still hold
+================
+*/
+void TexMgr_FlushPool(void)
+{
+    if (texpoolsize)
+        glDeleteTextures(texpoolsize, texpool);
+    texpoolsize = 0;
 }
 
 /*
@@ -383,10 +504,10 @@ TexMgr_FreeTexturesForOwner
 void TexMgr_FreeTexturesForOwner(model_t* owner)
 {
     gltexture_t* next = NULL;
-    for (gltexture_t* glt = active_gltextures; glt; glt = next)
+    for (gltexture_t* glt = texowners[TexMgr_HashOwner(owner)]; glt; glt = next)
     {
-        next = glt->next;
-        if (glt && glt->owner == owner)
+        next = glt->ownernext;
+        if (glt->owner == owner)
             TexMgr_FreeTexture(glt);
     }
 }
@@ -474,6 +595,8 @@ TexMgr_NewGame
 void TexMgr_NewGame(void)
 {
     TexMgr_FreeTextures(0, TEXPREF_PERSIST); //deletes all textures where TEXPREF_PERSIST is unset
+    TexMgr_FlushPool();
+    TexMgr_CacheFlush(); // the files may have changed with the game directory
     TexMgr_LoadPalette();
 }
 
@@ -550,11 +673,18 @@ void TexMgr_Init(void)
 
     Cvar_RegisterVariable(&gl_max_size, NULL);
     Cvar_RegisterVariable(&gl_picmip, NULL);
+    Cvar_RegisterVariable(&gl_texcache, NULL);
+    Cvar_RegisterVariable(&gl_texcompress, NULL);
     Cvar_RegisterVariable(&gl_texture_anisotropy, &TexMgr_Anisotropy_f);
     Cmd_AddCommand("gl_texturemode", &TexMgr_TextureMode_f);
     Cmd_AddCommand("gl_describetexturemodes", &TexMgr_DescribeTextureModes_f);
     Cmd_AddCommand("imagelist", &TexMgr_Imagelist_f);
     Cmd_AddCommand("imagedump", &TexMgr_Imagedump_f);
+    Cmd_AddCommand("texturebench", &TexMgr_TextureBench_f);
+    Cmd_AddCommand("skincachebench", &TexMgr_SkinCacheBench_f);
+    Cmd_AddCommand("texmgrbench", &TexMgr_ManagerBench_f);
+    Cmd_AddCommand("texcompresstest", &TexMgr_CompressTest_f);
+    Cmd_AddCommand("imagebench", &Image_Bench_f);
 
     // poll max size from hardware
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &gl_hardware_maxsize);
@@ -619,110 +749,192 @@ int TexMgr_PadConditional(int s)
         return s;
 }
 
+/*
+================================================================================
+
+	IMAGE PREPARATION
+
+TexMgr_PrepareImage turns the source pixels into the finished mip levels. it only touches its
+job and the job's texture and allocates with malloc, not on the hunk, so it can run on the
+worker threads. TexMgr_UploadImage makes the gl calls on the main thread.
+
+between TexMgr_BeginBatch and TexMgr_EndBatch, TexMgr_LoadImage copies the source pixels and
+queues the texture instead, and TexMgr_EndBatch prepares the whole queue across the workers
+before uploading it in order. the model loaders batch their textures and skins that way
+================================================================================
+*/
+
+typedef struct
+{
+    gltexture_t* glt;
+    uint8_t* data; // source pixels
+    bool owndata; // data is a copy, freed once prepared
+    unsigned* pixels; // every mip level one after the other, from TexMgr_PrepareImage
+    int numpixels;
+    bool cache; // put the source pixels in the texture cache
+    uint8_t* cachedata; // compressed by TexMgr_PrepareTask, stored by TexMgr_EndBatch
+    int cachesize;
+    bool compress; // go through the block compressed cache
+    unsigned bchash, bcflags; // its key, see TexMgr_BCKey
+    uint8_t* blocks; // compressed levels instead of pixels
+    int blocksize;
+    bool failed; // out of memory while preparing, see TexMgr_CheckJob
+} texjob_t;
+
+static texjob_t texjobs[MAX_GLTEXTURES];
+static int numtexjobs;
+static bool texbatching;
+
 /*
 ================
-TexMgr_MipMapW
+TexMgr_Alloc -- malloc that doesn't return NULL, for the main thread only
 ================
 */
-unsigned* TexMgr_MipMapW(unsigned* data, int width, int height)
+static void* TexMgr_Alloc(int size)
 {
-    int i, size;
-    uint8_t *out, *in;
-
-    out = in = (uint8_t*)data;
-    size = (width * height) >> 1;
-
-    for (i = 0; i < size; i++, out += 4, in += 8)
-    {
-        out[0] = (in[0] + in[4]) >> 1;
-        out[1] = (in[1] + in[5]) >> 1;
-        out[2] = (in[2] + in[6]) >> 1;
-        out[3] = (in[3] + in[7]) >> 1;
-    }
+    void* data = malloc(size);
 
+    if (!data)
+        Sys_Error("TexMgr_Alloc: out of memory (%i bytes)", size);
     return data;
 }
 
 /*
 ================
-TexMgr_MipMapH
+TexMgr_TryAlloc -- malloc for the preparation, which runs on the worker threads. a NULL is
+passed up to the job's failed flag, and the main thread reports it in TexMgr_CheckJob
 ================
 */
-unsigned* TexMgr_MipMapH(unsigned* data, int width, int height)
+static void* TexMgr_TryAlloc(int size)
 {
-    int i, j;
-    uint8_t *out, *in;
+    return malloc(size);
+}
 
-    out = in = (uint8_t*)data;
-    height >>= 1;
-    width <<= 2;
+/*
+================
+TexMgr_MipMap -- 2x2 box filter from width x height down to outwidth x outheight, where each of
+those is the same or half. out may be the same as data
+================
+*/
+static void TexMgr_MipMap(const uint8_t* data, uint8_t* out, int width, int height, int outwidth, int outheight)
+{
+    const uint8_t *row0, *row1;
+    int x, y, c, pitch;
+#ifdef USE_SSE2
+    __m128i a, b, even, odd;
+#endif
+
+    pitch = width * 4;
+    for (y = 0; y < outheight; y++)
+    {
+        row0 = data + (outheight < height ? y * 2 : y) * pitch;
+        row1 = outheight < height ? row0 + pitch : row0;
+        x = 0;
 
-    for (i = 0; i < height; i++, in += width)
-        for (j = 0; j < width; j += 4, out += 4, in += 4)
+        if (outwidth < width)
         {
-            out[0] = (in[0] + in[width + 0]) >> 1;
-            out[1] = (in[1] + in[width + 1]) >> 1;
-            out[2] = (in[2] + in[width + 2]) >> 1;
-            out[3] = (in[3] + in[width + 3]) >> 1;
+#ifdef USE_SSE2
+            // 8 pixels of each row down to 4. _mm_avg_epu8 rounds up, and so does the tail
+            for (; x + 4 <= outwidth; x += 4, out += 16)
+            {
+                a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + x * 8)), _mm_loadu_si128((const __m128i*)(row1 + x * 8)));
+                b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16)), _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16)));
+                even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+                odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+                _mm_storeu_si128((__m128i*)out, _mm_avg_epu8(even, odd));
+            }
+#endif
+            for (; x < outwidth; x++, out += 4)
+                for (c = 0; c < 4; c++)
+                    out[c] = (((row0[x * 8 + c] + row1[x * 8 + c] + 1) >> 1) + ((row0[x * 8 + 4 + c] + row1[x * 8 + 4 + c] + 1) >> 1) + 1) >> 1;
         }
-
-    return data;
+        else
+        {
+#ifdef USE_SSE2
+            for (; x + 4 <= outwidth; x += 4, out += 16)
+                _mm_storeu_si128((__m128i*)out, _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + x * 4)), _mm_loadu_si128((const __m128i*)(row1 + x * 4))));
+#endif
+            for (; x < outwidth; x++, out += 4)
+                for (c = 0; c < 4; c++)
+                    out[c] = (row0[x * 4 + c] + row1[x * 4 + c] + 1) >> 1;
+        }
+    }
 }
 
 /*
 ================
-TexMgr_ResampleTexture -- bilinear resample
+TexMgr_ResampleTexture -- bilinear resample up to power of two sizes, into a new buffer. NULL if
+the image is already a power of two
 ================
 */
-unsigned* TexMgr_ResampleTexture(unsigned* in, int inwidth, int inheight, bool alpha)
+static unsigned* TexMgr_ResampleTexture(unsigned* in, int inwidth, int inheight, bool alpha)
 {
-    uint8_t *nwpx, *nepx, *swpx, *sepx, *dest;
-    unsigned xfrac, yfrac, x, y, modx, mody, imodx, imody, injump, outjump;
-    unsigned* out;
-    int i, j, outwidth, outheight;
+    unsigned xfrac, yfrac, x, y, modx, mody;
+    unsigned *out, *dest, *row0, *row1, *nw, *sw;
+    int i, j, east, outwidth, outheight;
+#ifdef USE_SSE2
+    __m128i zero, n, s, v, wy0, wy1;
+#else
+    uint8_t *pnw, *pne, *psw, *pse;
+    int c, v0, v1;
+#endif
 
     if (inwidth == TexMgr_Pad(inwidth) && inheight == TexMgr_Pad(inheight))
-        return in;
+        return NULL;
 
     outwidth = TexMgr_Pad(inwidth);
     outheight = TexMgr_Pad(inheight);
-    out = Hunk_Alloc(outwidth * outheight * 4);
+    out = dest = (unsigned*)TexMgr_TryAlloc(outwidth * outheight * 4);
+    if (!out)
+        return NULL;
 
-    xfrac = ((inwidth - 1) << 16) / (outwidth - 1);
-    yfrac = ((inheight - 1) << 16) / (outheight - 1);
-    y = outjump = 0;
+    xfrac = outwidth > 1 ? ((inwidth - 1) << 16) / (outwidth - 1) : 0;
+    yfrac = outheight > 1 ? ((inheight - 1) << 16) / (outheight - 1) : 0;
+#ifdef USE_SSE2
+    zero = _mm_setzero_si128();
+#endif
 
-    for (i = 0; i < outheight; i++)
+    // down the columns, then across the rows, each in 8 bit fractions. the last row and
+    // column don't read past the image
+    for (i = 0, y = 0; i < outheight; i++, y += yfrac)
     {
         mody = (y >> 8) & 0xFF;
-        imody = 256 - mody;
-        injump = (y >> 16) * inwidth;
-        x = 0;
-
-        for (j = 0; j < outwidth; j++)
+        row0 = in + (y >> 16) * inwidth;
+        row1 = (int)(y >> 16) < inheight - 1 ? row0 + inwidth : row0;
+#ifdef USE_SSE2
+        wy0 = _mm_set1_epi16(256 - mody);
+        wy1 = _mm_set1_epi16(mody);
+#endif
+
+        for (j = 0, x = 0; j < outwidth; j++, x += xfrac, dest++)
         {
             modx = (x >> 8) & 0xFF;
-            imodx = 256 - modx;
-
-            nwpx = (uint8_t*)(in + (x >> 16) + injump);
-            nepx = nwpx + 4;
-            swpx = nwpx + inwidth * 4;
-            sepx = swpx + 4;
-
-            dest = (uint8_t*)(out + outjump + j);
-
-            dest[0] = (nwpx[0] * imodx * imody + nepx[0] * modx * imody + swpx[0] * imodx * mody + sepx[0] * modx * mody) >> 16;
-            dest[1] = (nwpx[1] * imodx * imody + nepx[1] * modx * imody + swpx[1] * imodx * mody + sepx[1] * modx * mody) >> 16;
-            dest[2] = (nwpx[2] * imodx * imody + nepx[2] * modx * imody + swpx[2] * imodx * mody + sepx[2] * modx * mody) >> 16;
-            if (alpha)
-                dest[3] = (nwpx[3] * imodx * imody + nepx[3] * modx * imody + swpx[3] * imodx * mody + sepx[3] * modx * mody) >> 16;
-            else
-                dest[3] = 255;
-
-            x += xfrac;
+            nw = row0 + (x >> 16);
+            sw = row1 + (x >> 16);
+            east = (int)(x >> 16) < inwidth - 1;
+#ifdef USE_SSE2
+            // west and east pixels side by side in 16 bit lanes
+            n = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(nw[0]), _mm_cvtsi32_si128(nw[east])), zero);
+            s = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(sw[0]), _mm_cvtsi32_si128(sw[east])), zero);
+            v = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(n, wy0), _mm_mullo_epi16(s, wy1)), 8);
+            v = _mm_mullo_epi16(v, _mm_setr_epi16(256 - modx, 256 - modx, 256 - modx, 256 - modx, modx, modx, modx, modx));
+            v = _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_si128(v, 8)), 8);
+            *dest = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+#else
+            pnw = (uint8_t*)nw;
+            pne = (uint8_t*)(nw + east);
+            psw = (uint8_t*)sw;
+            pse = (uint8_t*)(sw + east);
+            for (c = 0; c < 4; c++)
+            {
+                v0 = (pnw[c] * (256 - mody) + psw[c] * mody) >> 8;
+                v1 = (pne[c] * (256 - mody) + pse[c] * mody) >> 8;
+                ((uint8_t*)dest)[c] = (v0 * (256 - modx) + v1 * modx) >> 8;
+            }
+#endif
+            if (!alpha)
+                ((uint8_t*)dest)[3] = 255;
         }
-        outjump += outwidth;
-        y += yfrac;
     }
 
     return out;
@@ -912,153 +1124,276 @@ void TexMgr_PadEdgeFixH(uint8_t* data, int width, int height)
     }
 }
 
+/*
+================================================================================
+
+	TEXTURE CACHE
+
+recoloring a player skin, vid_restart and gl_fullbrights all reload textures from their source.
+for a texture from a .bsp, .mdl or .wad that used to mean reading the whole file again. the
+cache keeps the 8bit source pixels of those textures, and the prepared mip levels of every skin
+recolor, LZ compressed. a color change seen before is a lookup and an upload. it holds
+gl_texcache megabytes, and the least recently used entries are dropped past that
+================================================================================
+*/
+
+#define TEXCACHE_HASH 256
+
+typedef struct texcache_s
+{
+    struct texcache_s *prev, *next; // most recently used first
+    struct texcache_s* hashnext;
+    char source_file[MAX_QPATH];
+    unsigned source_offset;
+    unsigned short source_crc;
+    int shirt, pants; // -1 for source pixels, else these are prepared pixels
+    unsigned flags; // the texture's flags when it was prepared
+    int settings; // TexMgr_Settings when it was prepared
+    unsigned outflags; // and what preparing left them at
+    int width, height; // of the source, or of the top mip level
+    int size; // uncompressed
+    int datasize; // below size if data is compressed
+    uint8_t* data;
+} texcache_t;
+
+static texcache_t* texcache_hash[TEXCACHE_HASH];
+static texcache_t texcache_lru = { &texcache_lru, &texcache_lru };
+static int texcache_bytes;
+static int texcache_hits, texcache_misses;
+
 /*
 ================
-TexMgr_8to32
+TexMgr_Settings -- the cvars that change how an image is prepared
 ================
 */
-unsigned* TexMgr_8to32(uint8_t* in, int pixels, unsigned int* usepal)
+static int TexMgr_Settings(void)
 {
-    int i;
-    unsigned *out, *data;
+    extern cvar_t gl_fullbrights;
 
-    out = data = Hunk_Alloc(pixels * 4);
+    return ((int)gl_picmip.value & 255) | (((int)gl_max_size.value & 0xffff) << 8) | ((gl_fullbrights.value != 0) << 24);
+}
 
-    for (i = 0; i < pixels; i++)
-        *out++ = usepal[*in++];
+/*
+================
+TexMgr_CacheCompress -- returns a malloc'd copy of data, compressed if that makes it smaller, NULL if
+out of memory. thread is the Tasks_ParallelFor thread calling it, 0 on the main thread
+================
+*/
+static uint8_t* TexMgr_CacheCompress(const uint8_t* data, int size, int* datasize, int thread)
+{
+    static int lztables[MAX_TASK_THREADS][LZ_HASHSIZE];
+    uint8_t *out, *shrunk;
+    int len;
+
+    out = (uint8_t*)TexMgr_TryAlloc(LZ_CompressBound(size));
+    if (!out)
+        return NULL; // it just isn't cached
+    len = LZ_Compress(data, size, out, LZ_CompressBound(size), lztables[thread]);
+    if (len < 0 || len >= size)
+    {
+        memcpy(out, data, size);
+        len = size;
+    }
 
-    return data;
+    shrunk = (uint8_t*)realloc(out, len);
+    *datasize = len;
+    return shrunk ? shrunk : out;
 }
 
 /*
 ================
-TexMgr_PadImageW -- return image with width padded up to power-of-two dimentions
+TexMgr_CacheLoad -- decompresses an entry into out, which holds entry->size bytes
 ================
 */
-uint8_t* TexMgr_PadImageW(uint8_t* in, int width, int height, uint8_t padbyte)
+static void TexMgr_CacheLoad(texcache_t* entry, uint8_t* out)
 {
-    int i, j, outwidth;
-    uint8_t *out, *data;
+    if (entry->datasize == entry->size)
+        memcpy(out, entry->data, entry->size);
+    else if (LZ_Decompress(entry->data, entry->datasize, out, entry->size) != entry->size)
+        Sys_Error("TexMgr_CacheLoad: %s is corrupt", entry->source_file);
+}
 
-    if (width == TexMgr_Pad(width))
-        return in;
+/*
+================
+TexMgr_CacheHash
+================
+*/
+static texcache_t** TexMgr_CacheHash(const char* source_file, unsigned source_offset)
+{
+    unsigned hash = source_offset;
 
-    outwidth = TexMgr_Pad(width);
+    while (*source_file)
+        hash = hash * 31 + (uint8_t)*source_file++;
+    return &texcache_hash[hash % TEXCACHE_HASH];
+}
 
-    out = data = Hunk_Alloc(outwidth * height);
+/*
+================
+TexMgr_CacheLookup -- the entry for glt's source, or for glt recolored to shirt and pants
+================
+*/
+static texcache_t* TexMgr_CacheLookup(gltexture_t* glt, int shirt, int pants, int settings)
+{
+    texcache_t* entry;
 
-    for (i = 0; i < height; i++)
-    {
-        for (j = 0; j < width; j++)
-            *out++ = *in++;
-        for (; j < outwidth; j++)
-            *out++ = padbyte;
-    }
+    for (entry = *TexMgr_CacheHash(glt->source_file, glt->source_offset); entry; entry = entry->hashnext)
+        if (entry->source_offset == glt->source_offset && entry->source_crc == glt->source_crc && entry->shirt == shirt && entry->pants == pants && (shirt < 0 || ((entry->flags == glt->flags || entry->outflags == glt->flags) && entry->settings == settings)) && !strcmp(entry->source_file, glt->source_file))
+            return entry;
 
-    return data;
+    return NULL;
 }
 
 /*
 ================
-TexMgr_PadImageH -- return image with height padded up to power-of-two dimentions
+TexMgr_CacheFree
 ================
 */
-uint8_t* TexMgr_PadImageH(uint8_t* in, int width, int height, uint8_t padbyte)
+static void TexMgr_CacheFree(texcache_t* entry)
 {
-    int i, srcpix, dstpix;
-    uint8_t *data, *out;
-
-    if (height == TexMgr_Pad(height))
-        return in;
-
-    srcpix = width * height;
-    dstpix = width * TexMgr_Pad(height);
+    texcache_t** link;
 
-    out = data = Hunk_Alloc(dstpix);
+    for (link = TexMgr_CacheHash(entry->source_file, entry->source_offset); *link != entry; link = &(*link)->hashnext)
+        ;
+    *link = entry->hashnext;
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
 
-    for (i = 0; i < srcpix; i++)
-        *out++ = *in++;
-    for (; i < dstpix; i++)
-        *out++ = padbyte;
+    texcache_bytes -= entry->datasize + sizeof(texcache_t);
+    free(entry->data);
+    free(entry);
+}
 
-    return data;
+/*
+================
+TexMgr_CacheFlush
+================
+*/
+void TexMgr_CacheFlush(void)
+{
+    while (texcache_lru.next != &texcache_lru)
+        TexMgr_CacheFree(texcache_lru.next);
+    texcache_hits = texcache_misses = 0;
 }
 
 /*
 ================
-TexMgr_LoadImage32 -- handles 32bit source data
+TexMgr_CacheFind -- TexMgr_CacheLookup that counts as a use
 ================
 */
-void TexMgr_LoadImage32(gltexture_t* glt, unsigned* data)
+static texcache_t* TexMgr_CacheFind(gltexture_t* glt, int shirt, int pants, int settings)
 {
-    int internalformat, miplevel, mipwidth, mipheight, picmip;
+    texcache_t* entry;
 
-    // resample up
-    data = TexMgr_ResampleTexture(data, glt->width, glt->height, glt->flags & TEXPREF_ALPHA);
-    glt->width = TexMgr_Pad(glt->width);
-    glt->height = TexMgr_Pad(glt->height);
+    if (gl_texcache.value <= 0 || !glt->source_file[0])
+        return NULL;
 
-    // mipmap down
-    picmip = (glt->flags & TEXPREF_NOPICMIP) ? 0 : max((int)gl_picmip.value, 0);
-    mipwidth = TexMgr_SafeTextureSize(glt->width >> picmip);
-    mipheight = TexMgr_SafeTextureSize(glt->height >> picmip);
-    while ((int)glt->width > mipwidth)
+    entry = TexMgr_CacheLookup(glt, shirt, pants, settings);
+    if (!entry)
     {
-        TexMgr_MipMapW(data, glt->width, glt->height);
-        glt->width >>= 1;
-        if (glt->flags & TEXPREF_ALPHA)
-            TexMgr_AlphaEdgeFix((uint8_t*)data, glt->width, glt->height);
+        texcache_misses++;
+        return NULL;
     }
-    while ((int)glt->height > mipheight)
+
+    // to the front
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = texcache_lru.next;
+    entry->prev = &texcache_lru;
+    entry->next->prev = entry;
+    texcache_lru.next = entry;
+
+    texcache_hits++;
+    return entry;
+}
+
+/*
+================
+TexMgr_CacheStore -- takes data, from TexMgr_CacheCompress, into the cache
+================
+*/
+static void TexMgr_CacheStore(gltexture_t* glt, int shirt, int pants, int settings, unsigned flags,
+    int width, int height, uint8_t* data, int datasize, int size)
+{
+    texcache_t *entry, **link;
+    int budget;
+
+    budget = (int)(gl_texcache.value * 1024 * 1024);
+    if (datasize > budget / 4 || TexMgr_CacheLookup(glt, shirt, pants, settings))
     {
-        TexMgr_MipMapH(data, glt->width, glt->height);
-        glt->height >>= 1;
-        if (glt->flags & TEXPREF_ALPHA)
-            TexMgr_AlphaEdgeFix((uint8_t*)data, glt->width, glt->height);
+        free(data); // too big to be worth it, or already there
+        return;
     }
 
-    // upload
-    GL_Bind(glt);
-    internalformat = (glt->flags & TEXPREF_ALPHA) ? gl_alpha_format : gl_solid_format;
-    glTexImage2D(GL_TEXTURE_2D, 0, internalformat, glt->width, glt->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    entry = (texcache_t*)TexMgr_Alloc(sizeof(texcache_t));
+    strncpy(entry->source_file, glt->source_file, sizeof(entry->source_file) - 1);
+    entry->source_file[sizeof(entry->source_file) - 1] = 0;
+    entry->source_offset = glt->source_offset;
+    entry->source_crc = glt->source_crc;
+    entry->shirt = shirt;
+    entry->pants = pants;
+    entry->flags = flags;
+    entry->settings = settings;
+    entry->outflags = glt->flags;
+    entry->width = width;
+    entry->height = height;
+    entry->size = size;
+    entry->datasize = datasize;
+    entry->data = data;
+
+    link = TexMgr_CacheHash(entry->source_file, entry->source_offset);
+    entry->hashnext = *link;
+    *link = entry;
+    entry->next = texcache_lru.next;
+    entry->prev = &texcache_lru;
+    entry->next->prev = entry;
+    texcache_lru.next = entry;
+    texcache_bytes += datasize + sizeof(texcache_t);
+
+    while (texcache_bytes > budget)
+        TexMgr_CacheFree(texcache_lru.prev);
+}
 
-    // upload mipmaps
-    if (glt->flags & TEXPREF_MIPMAP)
-    {
-        mipwidth = glt->width;
-        mipheight = glt->height;
+/*
+================
+TexMgr_CacheSource -- keeps the source pixels of an 8bit texture from a file
+================
+*/
+static void TexMgr_CacheSource(gltexture_t* glt, uint8_t* data)
+{
+    uint8_t* compressed;
+    int size, datasize;
 
-        for (miplevel = 1; mipwidth > 1 || mipheight > 1; miplevel++)
-        {
-            if (mipwidth > 1)
-            {
-                TexMgr_MipMapW(data, mipwidth, mipheight);
-                mipwidth >>= 1;
-            }
-            if (mipheight > 1)
-            {
-                TexMgr_MipMapH(data, mipwidth, mipheight);
-                mipheight >>= 1;
-            }
-            glTexImage2D(GL_TEXTURE_2D, miplevel, internalformat, mipwidth, mipheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-    }
+    if (gl_texcache.value <= 0 || TexMgr_CacheLookup(glt, -1, -1, 0))
+        return;
 
-    // set filter modes
-    TexMgr_SetFilterModes(glt);
+    size = glt->source_width * glt->source_height;
+    compressed = TexMgr_CacheCompress(data, size, &datasize, 0);
+    if (compressed)
+        TexMgr_CacheStore(glt, -1, -1, 0, 0, glt->source_width, glt->source_height, compressed, datasize, size);
 }
 
 /*
 ================
-TexMgr_LoadImage8 -- handles 8bit source data, then passes it to LoadImage32
+TexMgr_Cacheable -- textures whose source pixels are worth keeping: 8bit, from a lump inside a file
 ================
 */
-void TexMgr_LoadImage8(gltexture_t* glt, uint8_t* data)
+static bool TexMgr_Cacheable(gltexture_t* glt)
+{
+    return glt->source_format == SRC_INDEXED && glt->source_file[0] && glt->source_offset;
+}
+
+/*
+================
+TexMgr_PrepareImage8 -- palette conversion and padding of 8bit source data, into a new 32bit image
+================
+*/
+static unsigned* TexMgr_PrepareImage8(gltexture_t* glt, uint8_t* data)
 {
     extern cvar_t gl_fullbrights;
     bool padw = false, padh = false;
     uint8_t padbyte;
-    unsigned int* usepal;
+    unsigned int *usepal, *out, *dest, padcolor;
+    int x, y, width, height;
 
     // HACK HACK HACK -- taken from tomazquake
     if (strstr(glt->name, "shot1sid") && glt->width == 32 && glt->height == 32 && CRC_Block(data, 1024) == 65393)
@@ -1072,11 +1407,7 @@ void TexMgr_LoadImage8(gltexture_t* glt, uint8_t* data)
     // detect false alpha cases
     if (glt->flags & TEXPREF_ALPHA && !(glt->flags & TEXPREF_CONCHARS))
     {
-        uint32_t i = 0;
-        for (; i < glt->width * glt->height; i++)
-            if (data[i] == 255) //transparent index
-                break;
-        if (i == (glt->width * glt->height))
+        if (!memchr(data, 255, glt->width * glt->height)) //transparent index
             glt->flags -= TEXPREF_ALPHA;
     }
 
@@ -1103,86 +1434,627 @@ void TexMgr_LoadImage8(gltexture_t* glt, uint8_t* data)
     }
 
     // pad each dimention, but only if it's not going to be downsampled later
+    width = glt->width;
+    height = glt->height;
     if (glt->flags & TEXPREF_PAD)
     {
         if ((int32_t)glt->width < TexMgr_SafeTextureSize(glt->width))
         {
-            data = TexMgr_PadImageW(data, glt->width, glt->height, padbyte);
             glt->width = TexMgr_Pad(glt->width);
             padw = true;
         }
         if ((int32_t)glt->height < TexMgr_SafeTextureSize(glt->height))
         {
-            data = TexMgr_PadImageH(data, glt->width, glt->height, padbyte);
             glt->height = TexMgr_Pad(glt->height);
             padh = true;
         }
     }
 
-    // convert to 32bit
-    data = (uint8_t*)TexMgr_8to32(data, glt->width * glt->height, usepal);
+    // convert to 32bit and pad in one pass
+    padcolor = usepal[padbyte];
+    out = dest = (unsigned*)TexMgr_TryAlloc(glt->width * glt->height * 4);
+    if (!out)
+        return NULL;
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+            *dest++ = usepal[*data++];
+        for (; x < (int)glt->width; x++)
+            *dest++ = padcolor;
+    }
+    for (; y < (int)glt->height; y++)
+        for (x = 0; x < (int)glt->width; x++)
+            *dest++ = padcolor;
 
     // fix edges
     if (glt->flags & TEXPREF_ALPHA)
-        TexMgr_AlphaEdgeFix(data, glt->width, glt->height);
+        TexMgr_AlphaEdgeFix((uint8_t*)out, glt->width, glt->height);
     else
     {
         if (padw)
-            TexMgr_PadEdgeFixW(data, glt->source_width, glt->source_height);
+            TexMgr_PadEdgeFixW((uint8_t*)out, glt->source_width, glt->source_height);
         if (padh)
-            TexMgr_PadEdgeFixH(data, glt->source_width, glt->source_height);
+            TexMgr_PadEdgeFixH((uint8_t*)out, glt->source_width, glt->source_height);
     }
 
-    // upload it
-    TexMgr_LoadImage32(glt, (unsigned*)data);
+    return out;
 }
 
 /*
 ================
-TexMgr_LoadLightmap -- handles lightmap data
+TexMgr_PrepareImage32 -- resamples 32bit data up to powers of two, applies picmip and builds the
+mip levels, into a new buffer. data itself is left alone
 ================
 */
-void TexMgr_LoadLightmap(gltexture_t* glt, uint8_t* data)
+static unsigned* TexMgr_PrepareImage32(gltexture_t* glt, unsigned* data, int* numpixels)
 {
-    extern int gl_lightmap_format, lightmap_bytes;
-
-    // upload it
-    GL_Bind(glt);
-    glTexImage2D(GL_TEXTURE_2D, 0, lightmap_bytes, glt->width, glt->height, 0, gl_lightmap_format, GL_UNSIGNED_BYTE, data);
-
-    // set filter modes
-    TexMgr_SetFilterModes(glt);
-}
+    unsigned *resampled, *out, *level;
+    int picmip, mipwidth, mipheight, width, height, size;
 
-/*
-================
-TexMgr_LoadImage -- the one entry point for loading all textures
-================
-*/
-gltexture_t* TexMgr_LoadImage(model_t* owner, char* name, int width, int height, enum srcformat format,
-    uint8_t* data, char* source_file, unsigned source_offset, unsigned flags)
-{
-    extern int lightmap_bytes;
-    unsigned short crc;
-    gltexture_t* glt;
-    int mark;
+    // resample up
+    resampled = TexMgr_ResampleTexture(data, glt->width, glt->height, glt->flags & TEXPREF_ALPHA);
+    if (resampled)
+        data = resampled;
+    else if ((int)glt->width != TexMgr_Pad(glt->width) || (int)glt->height != TexMgr_Pad(glt->height))
+        return NULL; // out of memory
+    glt->width = TexMgr_Pad(glt->width);
+    glt->height = TexMgr_Pad(glt->height);
 
-    if (isDedicated)
+    // size of the levels that get uploaded
+    picmip = (glt->flags & TEXPREF_NOPICMIP) ? 0 : max((int)gl_picmip.value, 0);
+    mipwidth = TexMgr_SafeTextureSize(glt->width >> picmip);
+    mipheight = TexMgr_SafeTextureSize(glt->height >> picmip);
+    mipwidth = min(mipwidth, (int)glt->width);
+    mipheight = min(mipheight, (int)glt->height);
+    size = mipwidth * mipheight;
+    if (glt->flags & TEXPREF_MIPMAP)
+        for (width = mipwidth, height = mipheight; width > 1 || height > 1;)
+        {
+            width = width > 1 ? width >> 1 : 1;
+            height = height > 1 ? height >> 1 : 1;
+            size += width * height;
+        }
+    // with picmip, the first step down may be bigger than all of that
+    width = (int)glt->width > mipwidth ? glt->width >> 1 : glt->width;
+    height = (int)glt->height > mipheight ? glt->height >> 1 : glt->height;
+    out = (unsigned*)TexMgr_TryAlloc(max(size, width * height) * 4);
+    if (!out)
+    {
+        free(resampled);
         return NULL;
+    }
 
-    // cache check
-    switch (format)
+    // mipmap down to the top level, the first step out of data and the rest in place
+    if ((int)glt->width == mipwidth && (int)glt->height == mipheight)
+        memcpy(out, data, mipwidth * mipheight * 4);
+    else
     {
-    case SRC_INDEXED:
-        crc = CRC_Block(data, width * height);
-        break;
-    case SRC_LIGHTMAP:
-        crc = CRC_Block(data, width * height * lightmap_bytes);
-        break;
-    case SRC_RGBA:
-        crc = CRC_Block(data, width * height * 4);
-        break;
+        level = data;
+        while ((int)glt->width > mipwidth || (int)glt->height > mipheight)
+        {
+            width = (int)glt->width > mipwidth ? glt->width >> 1 : glt->width;
+            height = (int)glt->height > mipheight ? glt->height >> 1 : glt->height;
+            TexMgr_MipMap((uint8_t*)level, (uint8_t*)out, glt->width, glt->height, width, height);
+            level = out;
+            glt->width = width;
+            glt->height = height;
+            if (glt->flags & TEXPREF_ALPHA)
+                TexMgr_AlphaEdgeFix((uint8_t*)out, glt->width, glt->height);
+        }
     }
+    free(resampled);
+
+    // the mip levels, each right after the one it is made from
+    if (glt->flags & TEXPREF_MIPMAP)
+    {
+        level = out;
+        width = mipwidth;
+        height = mipheight;
+        while (width > 1 || height > 1)
+        {
+            mipwidth = width > 1 ? width >> 1 : 1;
+            mipheight = height > 1 ? height >> 1 : 1;
+            TexMgr_MipMap((uint8_t*)level, (uint8_t*)(level + width * height), width, height, mipwidth, mipheight);
+            level += width * height;
+            width = mipwidth;
+            height = mipheight;
+        }
+    }
+
+    *numpixels = size;
+    return out;
+}
+
+/*
+================================================================================
+
+	BLOCK COMPRESSED CACHE
+
+with gl_texcompress on and s3tc in the driver, mipmapped textures are uploaded as BC1, or BC3
+with alpha, from files under <gamedir>/texcache. the first load prepares the mip levels as
+usual, compresses them and writes the file; later loads read it and skip the preparation.
+the file name holds the key: the crc TexMgr_LoadImage computed, a second hash of the source
+pixels, the source size, the flags and TexMgr_Settings. all of this runs on the workers
+================================================================================
+*/
+
+#define BCFILE_VERSION 1
+
+typedef struct
+{
+    char magic[4]; // "QBCT"
+    int version;
+    int width, height; // of the top level
+    unsigned flags; // what preparing left the flags at
+    int datasize; // every level, one after the other
+} bcfile_t;
+
+static int bccache_hits, bccache_misses;
+
+/*
+================
+TexMgr_BCPath -- false if the name doesn't fit in MAX_OSPATH, which is treated as a cache miss
+================
+*/
+static bool TexMgr_BCPath(texjob_t* job, char* path)
+{
+    gltexture_t* glt = job->glt;
+    int len;
+
+    len = snprintf(path, MAX_OSPATH, "%s/texcache/%04x%08x_%ix%i_%x_%x.bct", com_gamedir, glt->source_crc, job->bchash,
+        glt->source_width, glt->source_height, job->bcflags, TexMgr_Settings());
+    return len >= 0 && len < MAX_OSPATH;
+}
+
+/*
+================
+TexMgr_BCChainSize -- bytes of a compressed image and, if mipmapped, its mip levels
+================
+*/
+static int TexMgr_BCChainSize(int width, int height, unsigned flags)
+{
+    int size;
+
+    size = Image_BCSize(width, height, flags & TEXPREF_ALPHA);
+    if (flags & TEXPREF_MIPMAP)
+        while (width > 1 || height > 1)
+        {
+            width = width > 1 ? width >> 1 : 1;
+            height = height > 1 ? height >> 1 : 1;
+            size += Image_BCSize(width, height, flags & TEXPREF_ALPHA);
+        }
+    return size;
+}
+
+/*
+================
+TexMgr_BCKey -- called before preparing, which changes the flags
+================
+*/
+static void TexMgr_BCKey(texjob_t* job)
+{
+    gltexture_t* glt = job->glt;
+    unsigned hash = 2166136261u;
+    int i, size;
+
+    size = glt->source_width * glt->source_height * (glt->source_format == SRC_RGBA ? 4 : 1);
+    for (i = 0; i < size; i++)
+        hash = (hash ^ job->data[i]) * 16777619u;
+    job->bchash = hash;
+    job->bcflags = glt->flags;
+}
+
+/*
+================
+TexMgr_LoadBC -- reads the compressed levels from the cache. false if they aren't there
+================
+*/
+static bool TexMgr_LoadBC(texjob_t* job)
+{
+    gltexture_t* glt = job->glt;
+    char path[MAX_OSPATH];
+    bcfile_t header;
+    FILE* f;
+
+    f = TexMgr_BCPath(job, path) ? fopen(path, "rb") : NULL;
+    if (!f)
+    {
+        bccache_misses++;
+        return false;
+    }
+
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "QBCT", 4) || header.version != BCFILE_VERSION
+        || header.width < 1 || header.height < 1 || header.datasize != TexMgr_BCChainSize(header.width, header.height, header.flags))
+    {
+        fclose(f);
+        bccache_misses++;
+        return false;
+    }
+
+    job->blocks = (uint8_t*)TexMgr_TryAlloc(header.datasize);
+    if (!job->blocks || fread(job->blocks, header.datasize, 1, f) != 1)
+    {
+        fclose(f);
+        free(job->blocks);
+        job->blocks = NULL;
+        bccache_misses++;
+        return false;
+    }
+    fclose(f);
+
+    glt->width = header.width;
+    glt->height = header.height;
+    glt->flags = header.flags;
+    job->blocksize = header.datasize;
+    bccache_hits++;
+    return true;
+}
+
+/*
+================
+TexMgr_CompressBC -- compresses the prepared levels into job->blocks, which is left NULL if
+there's no memory for them
+================
+*/
+static void TexMgr_CompressBC(texjob_t* job)
+{
+    gltexture_t* glt = job->glt;
+    bool alpha = glt->flags & TEXPREF_ALPHA;
+    unsigned* level = job->pixels;
+    uint8_t* out;
+    int width, height;
+
+    job->blocksize = TexMgr_BCChainSize(glt->width, glt->height, glt->flags);
+    job->blocks = out = (uint8_t*)TexMgr_TryAlloc(job->blocksize);
+    if (!out)
+        return;
+
+    width = glt->width;
+    height = glt->height;
+    for (;;)
+    {
+        Image_CompressBC((uint8_t*)level, width, height, alpha, out);
+        if (!(glt->flags & TEXPREF_MIPMAP) || (width == 1 && height == 1))
+            break;
+        out += Image_BCSize(width, height, alpha);
+        level += width * height;
+        width = width > 1 ? width >> 1 : 1;
+        height = height > 1 ? height >> 1 : 1;
+    }
+}
+
+/*
+================
+TexMgr_SaveBC -- writes job->blocks to the cache, under a temporary name first so a reader
+never sees half a file
+================
+*/
+static void TexMgr_SaveBC(texjob_t* job)
+{
+    gltexture_t* glt = job->glt;
+    char path[MAX_OSPATH], temp[MAX_OSPATH + 16];
+    bcfile_t header;
+    FILE* f;
+
+    if (!TexMgr_BCPath(job, path))
+        return;
+    sprintf(temp, "%s.%x", path, (unsigned)(uintptr_t)job);
+    f = fopen(temp, "wb");
+    if (!f)
+        return;
+
+    memcpy(header.magic, "QBCT", 4);
+    header.version = BCFILE_VERSION;
+    header.width = glt->width;
+    header.height = glt->height;
+    header.flags = glt->flags;
+    header.datasize = job->blocksize;
+    if (fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(job->blocks, job->blocksize, 1, f) != 1)
+    {
+        fclose(f);
+        remove(temp);
+        return;
+    }
+    fclose(f);
+
+    remove(path);
+    if (rename(temp, path))
+        remove(temp);
+}
+
+/*
+================
+TexMgr_Compressible -- whether TexMgr_LoadImage should load this one through the cache
+================
+*/
+static bool TexMgr_Compressible(gltexture_t* glt)
+{
+    static char madedir[MAX_OSPATH];
+
+    if (!gl_texcompress.value || !gl_texture_s3tc_able || !(glt->flags & TEXPREF_MIPMAP) || glt->source_format == SRC_LIGHTMAP)
+        return false;
+
+    if (strcmp(madedir, com_gamedir))
+    {
+        Sys_mkdir(va("%s/texcache", com_gamedir));
+        strcpy(madedir, com_gamedir);
+    }
+    return true;
+}
+
+/*
+================
+TexMgr_PrepareImage
+================
+*/
+static void TexMgr_PrepareImage(texjob_t* job)
+{
+    gltexture_t* glt = job->glt;
+    unsigned* rgba;
+
+    job->blocks = NULL;
+    job->pixels = NULL;
+    job->failed = false;
+    if (job->compress)
+    {
+        TexMgr_BCKey(job);
+        if (TexMgr_LoadBC(job))
+        {
+            if (job->owndata)
+            {
+                free(job->data);
+                job->data = NULL;
+                job->owndata = false;
+            }
+            return;
+        }
+    }
+
+    switch (glt->source_format)
+    {
+    case SRC_INDEXED:
+        rgba = TexMgr_PrepareImage8(glt, job->data);
+        if (rgba)
+            job->pixels = TexMgr_PrepareImage32(glt, rgba, &job->numpixels);
+        free(rgba);
+        break;
+    case SRC_RGBA:
+        job->pixels = TexMgr_PrepareImage32(glt, (unsigned*)job->data, &job->numpixels);
+        break;
+    case SRC_LIGHTMAP:
+        break; // uploaded as it is
+    }
+
+    if (glt->source_format != SRC_LIGHTMAP && !job->pixels)
+        job->failed = true;
+
+    if (job->compress && job->pixels)
+    {
+        TexMgr_CompressBC(job);
+        if (job->blocks) // or it goes up uncompressed
+        {
+            TexMgr_SaveBC(job);
+            free(job->pixels);
+            job->pixels = NULL;
+        }
+    }
+
+    if (job->owndata)
+    {
+        free(job->data);
+        job->data = NULL;
+        job->owndata = false;
+    }
+}
+
+/*
+================
+TexMgr_CheckJob -- reports a TexMgr_PrepareImage that ran out of memory, from the main thread
+================
+*/
+static void TexMgr_CheckJob(texjob_t* job)
+{
+    if (job->failed)
+        Sys_Error("TexMgr_PrepareImage: out of memory preparing %s", job->glt->name);
+}
+
+/*
+================
+TexMgr_PrepareTask -- Tasks_ParallelFor callback over texjobs
+================
+*/
+static void TexMgr_PrepareTask(int index, int thread, void* data)
+{
+    texjob_t* job = (texjob_t*)data + index;
+
+    if (job->cache)
+        job->cachedata = TexMgr_CacheCompress(job->data, job->glt->source_width * job->glt->source_height, &job->cachesize, thread);
+    TexMgr_PrepareImage(job);
+}
+
+/*
+================
+TexMgr_UploadBC -- TexMgr_UploadImage for compressed levels
+================
+*/
+static void TexMgr_UploadBC(texjob_t* job)
+{
+    gltexture_t* glt = job->glt;
+    bool alpha = glt->flags & TEXPREF_ALPHA;
+    GLenum format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    uint8_t* level = job->blocks;
+    int miplevel, mipwidth, mipheight;
+
+    GL_Bind(glt);
+    mipwidth = glt->width;
+    mipheight = glt->height;
+    for (miplevel = 0;; miplevel++)
+    {
+        GL_CompressedTexImage2DFunc(GL_TEXTURE_2D, miplevel, format, mipwidth, mipheight, 0, Image_BCSize(mipwidth, mipheight, alpha), level);
+        if (!(glt->flags & TEXPREF_MIPMAP) || (mipwidth == 1 && mipheight == 1))
+            break;
+        level += Image_BCSize(mipwidth, mipheight, alpha);
+        mipwidth = mipwidth > 1 ? mipwidth >> 1 : 1;
+        mipheight = mipheight > 1 ? mipheight >> 1 : 1;
+    }
+
+    TexMgr_SetFilterModes(glt);
+
+    free(job->blocks);
+    job->blocks = NULL;
+}
+
+/*
+================
+TexMgr_UploadImage -- the gl half of loading a prepared image
+================
+*/
+static void TexMgr_UploadImage(texjob_t* job)
+{
+    gltexture_t* glt = job->glt;
+    unsigned* level = job->pixels;
+    int internalformat, miplevel, mipwidth, mipheight;
+
+    if (job->blocks)
+    {
+        TexMgr_UploadBC(job);
+        return;
+    }
+
+    // upload
+    GL_Bind(glt);
+    internalformat = (glt->flags & TEXPREF_ALPHA) ? gl_alpha_format : gl_solid_format;
+    mipwidth = glt->width;
+    mipheight = glt->height;
+    glTexImage2D(GL_TEXTURE_2D, 0, internalformat, mipwidth, mipheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+
+    // upload mipmaps
+    if (glt->flags & TEXPREF_MIPMAP)
+    {
+        for (miplevel = 1; mipwidth > 1 || mipheight > 1; miplevel++)
+        {
+            level += mipwidth * mipheight;
+            mipwidth = mipwidth > 1 ? mipwidth >> 1 : 1;
+            mipheight = mipheight > 1 ? mipheight >> 1 : 1;
+            glTexImage2D(GL_TEXTURE_2D, miplevel, internalformat, mipwidth, mipheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+        }
+    }
+
+    // set filter modes
+    TexMgr_SetFilterModes(glt);
+
+    free(job->pixels);
+    job->pixels = NULL;
+}
+
+/*
+================
+TexMgr_LoadLightmap -- handles lightmap data
+================
+*/
+static void TexMgr_LoadLightmap(gltexture_t* glt, uint8_t* data)
+{
+    extern int gl_lightmap_format, lightmap_bytes;
+
+    // upload it
+    GL_Bind(glt);
+    glTexImage2D(GL_TEXTURE_2D, 0, lightmap_bytes, glt->width, glt->height, 0, gl_lightmap_format, GL_UNSIGNED_BYTE, data);
+
+    // set filter modes
+    TexMgr_SetFilterModes(glt);
+}
+
+/*
+================
+TexMgr_LoadImageData -- prepares and uploads the image at once
+================
+*/
+static void TexMgr_LoadImageData(gltexture_t* glt, uint8_t* data)
+{
+    texjob_t job;
+
+    if (glt->source_format == SRC_LIGHTMAP)
+    {
+        TexMgr_LoadLightmap(glt, data);
+        return;
+    }
+
+    job.glt = glt;
+    job.data = data;
+    job.owndata = false;
+    job.cache = false;
+    job.compress = TexMgr_Compressible(glt);
+    TexMgr_PrepareImage(&job);
+    TexMgr_CheckJob(&job);
+    TexMgr_UploadImage(&job);
+}
+
+/*
+================
+TexMgr_BeginBatch -- TexMgr_LoadImage queues images from here on, see IMAGE PREPARATION
+================
+*/
+void TexMgr_BeginBatch(void)
+{
+    TexMgr_EndBatch(); // anything left over by an error in the last one
+    texbatching = true;
+}
+
+/*
+================
+TexMgr_EndBatch -- prepares and uploads everything queued since TexMgr_BeginBatch
+================
+*/
+void TexMgr_EndBatch(void)
+{
+    int i;
+
+    texbatching = false;
+
+    Tasks_ParallelFor(numtexjobs, TexMgr_PrepareTask, texjobs);
+    for (i = 0; i < numtexjobs; i++)
+    {
+        TexMgr_CheckJob(&texjobs[i]);
+        if (texjobs[i].cachedata)
+            TexMgr_CacheStore(texjobs[i].glt, -1, -1, 0, 0, texjobs[i].glt->source_width, texjobs[i].glt->source_height,
+                texjobs[i].cachedata, texjobs[i].cachesize, texjobs[i].glt->source_width * texjobs[i].glt->source_height);
+        TexMgr_UploadImage(&texjobs[i]);
+    }
+    numtexjobs = 0;
+}
+
+/*
+================
+TexMgr_LoadImage -- the one entry point for loading all textures
+================
+*/
+gltexture_t* TexMgr_LoadImage(model_t* owner, char* name, int width, int height, enum srcformat format,
+    uint8_t* data, char* source_file, unsigned source_offset, unsigned flags)
+{
+    extern int lightmap_bytes;
+    unsigned short crc;
+    gltexture_t* glt;
+    texjob_t* job;
+    int size;
+
+    if (isDedicated)
+        return NULL;
+
+    // cache check
+    switch (format)
+    {
+    case SRC_INDEXED:
+        size = width * height;
+        break;
+    case SRC_LIGHTMAP:
+        size = width * height * lightmap_bytes;
+        break;
+    case SRC_RGBA:
+    default:
+        size = width * height * 4;
+        break;
+    }
+    crc = CRC_Block(data, size);
     if ((flags & TEXPREF_OVERWRITE) && (glt = TexMgr_FindTexture(owner, name)))
     {
         if (glt->source_crc == crc)
@@ -1205,28 +2077,458 @@ gltexture_t* TexMgr_LoadImage(model_t* owner, char* name, int width, int height,
     glt->source_width = width;
     glt->source_height = height;
     glt->source_crc = crc;
+    if (!glt->linked)
+    {
+        TexMgr_LinkTexture(glt);
+        glt->linked = true;
+    }
 
-    //upload it
-    mark = Hunk_LowMark();
-
-    switch (glt->source_format)
+    //upload it, or queue a copy for TexMgr_EndBatch
+    if (!texbatching || format == SRC_LIGHTMAP)
     {
-    case SRC_INDEXED:
-        TexMgr_LoadImage8(glt, data);
-        break;
-    case SRC_LIGHTMAP:
-        TexMgr_LoadLightmap(glt, data);
-        break;
-    case SRC_RGBA:
-        TexMgr_LoadImage32(glt, (unsigned*)data);
-        break;
+        if (TexMgr_Cacheable(glt))
+            TexMgr_CacheSource(glt, data);
+        TexMgr_LoadImageData(glt, data);
+        return glt;
     }
 
-    Hunk_FreeToLowMark(mark);
+    if (numtexjobs == MAX_GLTEXTURES)
+    {
+        TexMgr_EndBatch();
+        texbatching = true;
+    }
+    job = &texjobs[numtexjobs++];
+    job->glt = glt;
+    job->data = (uint8_t*)TexMgr_Alloc(size);
+    memcpy(job->data, data, size);
+    job->owndata = true;
+    job->pixels = NULL;
+    job->cache = TexMgr_Cacheable(glt) && gl_texcache.value > 0 && !TexMgr_CacheLookup(glt, -1, -1, 0);
+    job->cachedata = NULL;
+    job->compress = TexMgr_Compressible(glt);
 
     return glt;
 }
 
+typedef struct // a texture for TexMgr_TextureBench_f, outside the texture list
+{
+    gltexture_t glt;
+    texjob_t job;
+    uint8_t* data;
+} benchtexture_t;
+
+static benchtexture_t* benchtextures;
+static int numbenchtextures, maxbenchtextures;
+
+/*
+================
+TexMgr_BenchAdd -- copies the source pixels of one texture
+================
+*/
+static void TexMgr_BenchAdd(const char* name, uint8_t* data, int width, int height, unsigned flags)
+{
+    benchtexture_t* bt;
+
+    if (width <= 0 || height <= 0 || width > 4096 || height > 4096)
+        return;
+
+    if (numbenchtextures == maxbenchtextures)
+    {
+        maxbenchtextures = maxbenchtextures ? maxbenchtextures * 2 : 256;
+        benchtextures = (benchtexture_t*)realloc(benchtextures, maxbenchtextures * sizeof(benchtexture_t));
+        if (!benchtextures)
+            Sys_Error("TexMgr_BenchAdd: out of memory");
+    }
+
+    bt = &benchtextures[numbenchtextures++];
+    memset(bt, 0, sizeof(*bt));
+    strncpy(bt->glt.name, name, sizeof(bt->glt.name) - 1);
+    bt->glt.source_format = SRC_INDEXED;
+    bt->glt.source_width = bt->glt.width = width;
+    bt->glt.source_height = bt->glt.height = height;
+    bt->glt.flags = flags;
+    bt->glt.source_crc = CRC_Block(data, width * height);
+    bt->data = (uint8_t*)TexMgr_Alloc(width * height);
+    memcpy(bt->data, data, width * height);
+}
+
+/*
+================
+TexMgr_BenchReset -- puts every texture back the way it was loaded
+================
+*/
+static void TexMgr_BenchReset(void)
+{
+    benchtexture_t* bt;
+    int i;
+
+    for (i = 0, bt = benchtextures; i < numbenchtextures; i++, bt++)
+    {
+        bt->glt.width = bt->glt.source_width;
+        bt->glt.height = bt->glt.source_height;
+        bt->job.glt = &bt->glt;
+        bt->job.data = bt->data;
+        bt->job.owndata = false;
+        bt->job.pixels = NULL;
+        bt->job.compress = false;
+    }
+}
+
+/*
+================
+TexMgr_BenchTask
+================
+*/
+static void TexMgr_BenchTask(int index, int thread, void* data)
+{
+    benchtexture_t* bt = benchtextures + index;
+
+    TexMgr_PrepareImage(&bt->job);
+    free(bt->job.pixels);
+    bt->job.pixels = NULL;
+}
+
+/*
+================
+TexMgr_BenchBSP -- the miptex lump of a map
+================
+*/
+static void TexMgr_BenchBSP(const char* filename, uint8_t* file)
+{
+    dheader_t* header = (dheader_t*)file;
+    dmiptexlump_t* lump;
+    miptex_t* mt;
+    char name[MAX_QPATH + 32];
+    int i, ofs;
+
+    if (LittleLong(header->version) != BSPVERSION || !LittleLong(header->lumps[LUMP_TEXTURES].filelen))
+        return;
+
+    lump = (dmiptexlump_t*)(file + LittleLong(header->lumps[LUMP_TEXTURES].fileofs));
+    for (i = 0; i < LittleLong(lump->nummiptex); i++)
+    {
+        ofs = LittleLong(lump->dataofs[i]);
+        if (ofs == -1)
+            continue;
+        mt = (miptex_t*)((uint8_t*)lump + ofs);
+        sprintf(name, "%s:%.16s", filename, (char*)mt->name);
+        TexMgr_BenchAdd(name, (uint8_t*)(mt + 1), LittleLong(mt->width), LittleLong(mt->height),
+            mt->name[0] == '*' ? TEXPREF_NONE : TEXPREF_MIPMAP);
+    }
+}
+
+/*
+================
+TexMgr_BenchMDL -- the skins of an alias model
+================
+*/
+static void TexMgr_BenchMDL(const char* filename, uint8_t* file)
+{
+    mdl_t* header = (mdl_t*)file;
+    daliasskintype_t* pskintype;
+    int i, j, groupskins, width, height;
+    char name[MAX_QPATH + 32];
+
+    if (LittleLong(header->ident) != IDPOLYHEADER || LittleLong(header->version) != ALIAS_VERSION)
+        return;
+
+    width = LittleLong(header->skinwidth);
+    height = LittleLong(header->skinheight);
+    pskintype = (daliasskintype_t*)(header + 1);
+    for (i = 0; i < LittleLong(header->numskins); i++)
+    {
+        if (LittleLong(pskintype->type) == ALIAS_SKIN_SINGLE)
+        {
+            sprintf(name, "%s:frame%i", filename, i);
+            TexMgr_BenchAdd(name, (uint8_t*)(pskintype + 1), width, height, TEXPREF_PAD);
+            pskintype = (daliasskintype_t*)((uint8_t*)(pskintype + 1) + width * height);
+        }
+        else
+        {
+            groupskins = LittleLong(((daliasskingroup_t*)(pskintype + 1))->numskins);
+            pskintype = (daliasskintype_t*)((daliasskininterval_t*)((daliasskingroup_t*)(pskintype + 1) + 1) + groupskins);
+            for (j = 0; j < groupskins; j++)
+            {
+                sprintf(name, "%s:frame%i_%i", filename, i, j);
+                TexMgr_BenchAdd(name, (uint8_t*)pskintype, width, height, TEXPREF_PAD);
+                pskintype = (daliasskintype_t*)((uint8_t*)pskintype + width * height);
+            }
+        }
+    }
+}
+
+/*
+================
+TexMgr_BenchGather -- every texture and skin of the maps and models in the pak files
+================
+*/
+static void TexMgr_BenchGather(void)
+{
+    const char* filename;
+    uint8_t* file;
+    int i, mark, len;
+
+    for (i = 0; (filename = COM_PackFileName(i)); i++)
+    {
+        len = strlen(filename);
+        if (len < 4 || (Q_strcasecmp(filename + len - 4, ".bsp") && Q_strcasecmp(filename + len - 4, ".mdl")))
+            continue;
+
+        mark = Hunk_LowMark();
+        file = COM_LoadHunkFile(filename);
+        if (file)
+        {
+            if (!Q_strcasecmp(filename + len - 4, ".bsp"))
+                TexMgr_BenchBSP(filename, file);
+            else
+                TexMgr_BenchMDL(filename, file);
+        }
+        Hunk_FreeToLowMark(mark);
+    }
+}
+
+/*
+================
+TexMgr_BenchFree
+================
+*/
+static void TexMgr_BenchFree(void)
+{
+    for (int i = 0; i < numbenchtextures; i++)
+        free(benchtextures[i].data);
+    free(benchtextures);
+    benchtextures = NULL;
+    numbenchtextures = maxbenchtextures = 0;
+}
+
+/*
+================
+TexMgr_TextureBench_f -- prepares the textures of every map and the skins of every model in the
+pak files on one thread and then on all of them, without uploading anything, and reports the
+speed. the first pass also pulls everything into the cache
+
+texturebench [passes]
+================
+*/
+void TexMgr_TextureBench_f(void)
+{
+    int i, passes, pass;
+    double start, srcbytes, outbytes, serial, parallel;
+    benchtexture_t* bt;
+
+    passes = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 3;
+    if (passes < 1)
+        passes = 1;
+
+    TexMgr_BenchGather();
+    if (!numbenchtextures)
+    {
+        Con_Printf("texturebench: no maps or models in the pak files\n");
+        return;
+    }
+
+    // the size of what goes through, from a first serial pass
+    srcbytes = outbytes = 0;
+    TexMgr_BenchReset();
+    for (i = 0, bt = benchtextures; i < numbenchtextures; i++, bt++)
+    {
+        srcbytes += bt->glt.source_width * bt->glt.source_height;
+        TexMgr_PrepareImage(&bt->job);
+        TexMgr_CheckJob(&bt->job);
+        outbytes += bt->glt.width * bt->glt.height * 4 * ((bt->glt.flags & TEXPREF_MIPMAP) ? 4.0 / 3.0 : 1.0);
+        free(bt->job.pixels);
+    }
+
+    serial = parallel = 0;
+    for (pass = 0; pass < passes; pass++)
+    {
+        TexMgr_BenchReset();
+        start = Sys_FloatTime();
+        for (i = 0; i < numbenchtextures; i++)
+            TexMgr_BenchTask(i, 0, NULL);
+        serial += Sys_FloatTime() - start;
+
+        TexMgr_BenchReset();
+        start = Sys_FloatTime();
+        Tasks_ParallelFor(numbenchtextures, TexMgr_BenchTask, NULL);
+        parallel += Sys_FloatTime() - start;
+    }
+    serial /= passes;
+    parallel /= passes;
+
+    Con_Printf("texturebench: %i textures, %.1f MB of 8 bit source, %.1f MB of mip levels\n",
+        numbenchtextures, srcbytes / (1024 * 1024), outbytes / (1024 * 1024));
+    Con_Printf("1 thread:   %7.1f ms, %7.1f MB/s\n", serial * 1000.0, outbytes / (1024 * 1024) / serial);
+    Con_Printf("%2i threads: %7.1f ms, %7.1f MB/s\n", task_numthreads, parallel * 1000.0, outbytes / (1024 * 1024) / parallel);
+
+    TexMgr_BenchFree();
+}
+
+/*
+================
+TexMgr_CompressTest_f -- runs every texture in the pak files through the block compressed cache
+without touching gl: prepares it, compresses it, writes the cache file, reads it back and
+checks the blocks and sizes match, then decodes the top level to measure the error. the files
+written are real cache entries, so it also fills the cache ahead of time
+
+texcompresstest
+================
+*/
+void TexMgr_CompressTest_f(void)
+{
+    benchtexture_t* bt;
+    texjob_t* job;
+    uint8_t *blocks, *decoded;
+    int i, j, d, width, height, failed;
+    unsigned flags;
+    double start, prepare, compress, load, srcbytes, rawbytes, bcbytes, error, samples;
+
+    TexMgr_BenchGather();
+    if (!numbenchtextures)
+    {
+        Con_Printf("texcompresstest: no maps or models in the pak files\n");
+        return;
+    }
+    Sys_mkdir(va("%s/texcache", com_gamedir));
+
+    bccache_hits = bccache_misses = 0;
+    prepare = compress = load = 0;
+    srcbytes = rawbytes = bcbytes = error = samples = 0;
+    failed = 0;
+    TexMgr_BenchReset();
+    for (i = 0, bt = benchtextures; i < numbenchtextures; i++, bt++)
+    {
+        job = &bt->job;
+        flags = bt->glt.flags;
+        TexMgr_BCKey(job);
+
+        start = Sys_FloatTime();
+        TexMgr_PrepareImage(job);
+        prepare += Sys_FloatTime() - start;
+        TexMgr_CheckJob(job);
+        width = bt->glt.width;
+        height = bt->glt.height;
+
+        start = Sys_FloatTime();
+        TexMgr_CompressBC(job);
+        compress += Sys_FloatTime() - start;
+        if (!job->blocks)
+            Sys_Error("texcompresstest: out of memory compressing %s", bt->glt.name);
+        TexMgr_SaveBC(job);
+
+        srcbytes += bt->glt.source_width * bt->glt.source_height;
+        rawbytes += job->numpixels * 4;
+        bcbytes += job->blocksize;
+
+        // the top level against what was compressed
+        decoded = (uint8_t*)TexMgr_Alloc(width * height * 4);
+        Image_DecompressBC(job->blocks, width, height, bt->glt.flags & TEXPREF_ALPHA, decoded);
+        for (j = 0; j < width * height * 4; j++)
+        {
+            d = decoded[j] - ((uint8_t*)job->pixels)[j];
+            error += d * d;
+        }
+        samples += width * height * 4;
+        free(decoded);
+        free(job->pixels);
+        job->pixels = NULL;
+
+        // and back out of the cache
+        blocks = job->blocks;
+        d = job->blocksize;
+        job->blocks = NULL;
+        bt->glt.width = bt->glt.height = 0;
+        start = Sys_FloatTime();
+        if (!TexMgr_LoadBC(job) || job->blocksize != d || memcmp(job->blocks, blocks, d)
+            || (int)bt->glt.width != width || (int)bt->glt.height != height)
+        {
+            if (failed++ < 8)
+                Con_Printf("texcompresstest: %s didn't come back the same\n", bt->glt.name);
+        }
+        load += Sys_FloatTime() - start;
+        free(blocks);
+        free(job->blocks);
+        job->blocks = NULL;
+        bt->glt.flags = flags;
+    }
+
+    Con_Printf("texcompresstest: %i textures, %i round trips failed\n", numbenchtextures, failed);
+    Con_Printf("%.1f MB of 8 bit source, %.1f MB of RGBA mip levels, %.1f MB compressed (%.1fx)\n",
+        srcbytes / (1024 * 1024), rawbytes / (1024 * 1024), bcbytes / (1024 * 1024), rawbytes / max(bcbytes, 1));
+    Con_Printf("prepare:  %7.1f ms\ncompress: %7.1f ms\nload:     %7.1f ms from the cache\n",
+        prepare * 1000.0, compress * 1000.0, load * 1000.0);
+    Con_Printf("error:    %.2f rms per channel, %.1f dB psnr\n", sqrt(error / samples),
+        error > 0 ? 10.0 * log10(255.0 * 255.0 * samples / error) : 99.0);
+
+    TexMgr_BenchFree();
+}
+
+/*
+================
+TexMgr_SkinCacheBench_f -- a server full of players all changing colors: recolors 16 copies of
+the player skin, cycling each through a few colors, with and without the texture cache, and
+reports the time per recolor including the upload
+
+skincachebench [rounds]
+================
+*/
+void TexMgr_SkinCacheBench_f(void)
+{
+    gltexture_t* skins[16];
+    aliashdr_t* paliashdr;
+    model_t* mod;
+    char name[32];
+    int rounds, round, pass, i, hits, misses;
+    float saved;
+    double start, time[2];
+
+    mod = Mod_ForName("progs/player.mdl", false);
+    if (!mod || mod->type != mod_alias)
+    {
+        Con_Printf("skincachebench: couldn't load progs/player.mdl\n");
+        return;
+    }
+
+    rounds = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 20;
+    if (rounds < 1)
+        rounds = 1;
+
+    // the way R_TranslateNewPlayerSkin sets them up
+    paliashdr = (aliashdr_t*)Mod_Extradata(mod);
+    for (i = 0; i < 16; i++)
+    {
+        sprintf(name, "skincachebench_%i", i);
+        skins[i] = TexMgr_LoadImage(NULL, name, paliashdr->skinwidth, paliashdr->skinheight, SRC_INDEXED,
+            (uint8_t*)paliashdr + paliashdr->texels[0], paliashdr->gltextures[0][0]->source_file,
+            paliashdr->gltextures[0][0]->source_offset, TEXPREF_PAD | TEXPREF_OVERWRITE);
+    }
+
+    saved = gl_texcache.value;
+    hits = misses = 0;
+    for (pass = 0; pass < 2; pass++)
+    {
+        Cvar_SetValue("gl_texcache", pass ? (saved > 0 ? saved : 32) : 0);
+        texcache_hits = texcache_misses = 0;
+        glFinish();
+        start = Sys_FloatTime();
+        for (round = 0; round < rounds; round++)
+            for (i = 0; i < 16; i++)
+                TexMgr_ReloadImage(skins[i], (i + round % 4) % 14, (i * 3 + round % 3) % 14);
+        glFinish();
+        time[pass] = (Sys_FloatTime() - start) * 1000.0 / (rounds * 16);
+        hits = texcache_hits;
+        misses = texcache_misses;
+    }
+    Cvar_SetValue("gl_texcache", saved);
+
+    for (i = 0; i < 16; i++)
+        TexMgr_FreeTexture(skins[i]);
+
+    Con_Printf("skincachebench: 16 players, %i rounds of color changes\n", rounds);
+    Con_Printf("no cache: %6.3f ms per recolor\n", time[0]);
+    Con_Printf("cache:    %6.3f ms per recolor, %i hits, %i misses, %i kb held\n", time[1], hits, misses, texcache_bytes / 1024);
+}
+
 /*
 ================================================================================
 
@@ -1235,6 +2537,88 @@ gltexture_t* TexMgr_LoadImage(model_t* owner, char* name, int width, int height,
 ================================================================================
 */
 
+/*
+================
+TexMgr_ManagerBench_f -- times what a map load does to the texture manager with a map pack's
+worth of textures: creating them with overwrite checks, looking them up by name (against
+the old walk of the whole texture list), freeing them by owner, and creating them again from
+pooled gl texture names
+
+texmgrbench [count]
+================
+*/
+void TexMgr_ManagerBench_f(void)
+{
+    static uint8_t data[16] = { 255, 255, 255, 255, 0, 0, 0, 255, 0, 0, 0, 255, 255, 255, 255, 255 };
+    static model_t owner;
+    char(*names)[32];
+    int count, i, pass, found, gens, reuses;
+    double start, load, reload, hashed, walked, freed;
+
+    count = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 2000;
+    if (count > MAX_GLTEXTURES - numgltextures)
+        count = MAX_GLTEXTURES - numgltextures;
+    if (count < 1)
+    {
+        Con_Printf("texmgrbench: no free textures\n");
+        return;
+    }
+
+    names = (char(*)[32])malloc(count * sizeof(*names));
+    for (i = 0; i < count; i++)
+        sprintf(names[i], "*texmgrbench_%i", i);
+
+    gens = texpool_gens;
+    reuses = texpool_reuses;
+    glFinish();
+    start = Sys_FloatTime();
+    for (i = 0; i < count; i++)
+        TexMgr_LoadImage(&owner, names[i], 2, 2, SRC_RGBA, data, "", (unsigned)data, TEXPREF_NEAREST | TEXPREF_NOPICMIP | TEXPREF_OVERWRITE);
+    glFinish();
+    load = Sys_FloatTime() - start;
+    gens = texpool_gens - gens;
+    reuses = texpool_reuses - reuses;
+
+    found = 0;
+    start = Sys_FloatTime();
+    for (pass = 0; pass < 10; pass++)
+        for (i = 0; i < count; i++)
+            found += TexMgr_FindTexture(&owner, names[i]) != NULL;
+    hashed = Sys_FloatTime() - start;
+
+    start = Sys_FloatTime();
+    for (pass = 0; pass < 10; pass++)
+        for (i = 0; i < count; i++)
+            for (gltexture_t* glt = active_gltextures; glt; glt = glt->next)
+                if (glt->owner == &owner && !strcmp(glt->name, names[i]))
+                {
+                    found++;
+                    break;
+                }
+    walked = Sys_FloatTime() - start;
+
+    start = Sys_FloatTime();
+    TexMgr_FreeTexturesForOwner(&owner);
+    freed = Sys_FloatTime() - start;
+
+    glFinish();
+    start = Sys_FloatTime();
+    for (i = 0; i < count; i++)
+        TexMgr_LoadImage(&owner, names[i], 2, 2, SRC_RGBA, data, "", (unsigned)data, TEXPREF_NEAREST | TEXPREF_NOPICMIP | TEXPREF_OVERWRITE);
+    glFinish();
+    reload = Sys_FloatTime() - start;
+    TexMgr_FreeTexturesForOwner(&owner);
+
+    free(names);
+
+    Con_Printf("texmgrbench: %i textures, %i others loaded\n", count, numgltextures);
+    Con_Printf("load:    %7.2f ms, %i glGenTextures calls, %i pooled names\n", load * 1000.0, gens, reuses);
+    Con_Printf("reload:  %7.2f ms from pooled names\n", reload * 1000.0);
+    Con_Printf("find:    %7.3f us hashed, %7.3f us walking the list (%i found)\n",
+        hashed * 1e6 / (count * 10), walked * 1e6 / (count * 10), found);
+    Con_Printf("free:    %7.3f ms for the owner\n", freed * 1000.0);
+}
+
 /*
 ================
 TexMgr_ReloadImage -- reloads a texture, and colormaps it if needed
@@ -1243,20 +2627,62 @@ TexMgr_ReloadImage -- reloads a texture, and colormaps it if needed
 void TexMgr_ReloadImage(gltexture_t* glt, int shirt, int pants)
 {
     uint8_t translation[256];
-    uint8_t *src, *dst, *data = NULL, *translated;
-    int mark, size, i;
+    uint8_t *src, *dst, *data = NULL, *translated = NULL;
+    texcache_t* cached;
+    texjob_t job;
+    unsigned flags;
+    int mark, size, i, settings;
+    //
+    // apply shirt and pants colors
+    //
+    // if shirt and pants are -1,-1, use existing shirt and pants colors
+    // if existing shirt and pants colors are -1,-1, don't bother colormapping
+    if (shirt > -1 && pants > -1)
+    {
+        if (glt->source_format == SRC_INDEXED)
+        {
+            glt->shirt = shirt;
+            glt->pants = pants;
+        }
+        else
+            Con_Printf("TexMgr_ReloadImage: can't colormap a non SRC_INDEXED texture: %s\n", glt->name);
+    }
+    //
+    // a recolor that is cached already only needs uploading
+    //
+    settings = TexMgr_Settings();
+    if (glt->shirt > -1 && glt->pants > -1 && (cached = TexMgr_CacheFind(glt, glt->shirt, glt->pants, settings)))
+    {
+        job.glt = glt;
+        job.blocks = NULL;
+        job.pixels = (unsigned*)TexMgr_Alloc(cached->size);
+        TexMgr_CacheLoad(cached, (uint8_t*)job.pixels);
+        glt->width = cached->width;
+        glt->height = cached->height;
+        glt->flags = cached->outflags;
+        TexMgr_UploadImage(&job);
+        return;
+    }
     //
     // get source data
     //
     mark = Hunk_LowMark();
 
-    if (glt->source_file[0] && glt->source_offset)
+    if (TexMgr_Cacheable(glt) && (cached = TexMgr_CacheFind(glt, -1, -1, 0)))
+    {
+        //lump inside file, kept by the cache
+        data = Hunk_Alloc(cached->size);
+        TexMgr_CacheLoad(cached, data);
+    }
+    else if (glt->source_file[0] && glt->source_offset)
     {
         //lump inside file
         data = COM_LoadHunkFile(glt->source_file);
         if (!data)
             goto invalid;
         data += glt->source_offset;
+        if (TexMgr_Cacheable(glt))
+            TexMgr_CacheSource(glt, data);
     }
     else if (glt->source_file[0] && !glt->source_offset)
         data = Image_LoadImage(glt->source_file, &glt->source_width, &glt->source_height); //simple file
@@ -1273,21 +2699,6 @@ void TexMgr_ReloadImage(gltexture_t* glt, int shirt, int pants)
 
     glt->width = glt->source_width;
     glt->height = glt->source_height;
-    //
-    // apply shirt and pants colors
-    //
-    // if shirt and pants are -1,-1, use existing shirt and pants colors
-    // if existing shirt and pants colors are -1,-1, don't bother colormapping
-    if (shirt > -1 && pants > -1)
-    {
-        if (glt->source_format == SRC_INDEXED)
-        {
-            glt->shirt = shirt;
-            glt->pants = pants;
-        }
-        else
-            Con_Printf("TexMgr_ReloadImage: can't colormap a non SRC_INDEXED texture: %s\n", glt->name);
-    }
     if (glt->shirt > -1 && glt->pants > -1)
     {
         //create new translation table
@@ -1321,20 +2732,25 @@ void TexMgr_ReloadImage(gltexture_t* glt, int shirt, int pants)
         data = translated;
     }
     //
-    // upload it
+    // upload it, and keep the prepared pixels of a recolor
     //
-    switch (glt->source_format)
+    if (translated && glt->source_file[0] && gl_texcache.value > 0)
     {
-    case SRC_INDEXED:
-        TexMgr_LoadImage8(glt, data);
-        break;
-    case SRC_LIGHTMAP:
-        TexMgr_LoadLightmap(glt, data);
-        break;
-    case SRC_RGBA:
-        TexMgr_LoadImage32(glt, (unsigned*)data);
-        break;
+        flags = glt->flags;
+        job.glt = glt;
+        job.data = data;
+        job.owndata = false;
+        job.cache = false;
+        job.compress = false;
+        TexMgr_PrepareImage(&job);
+        TexMgr_CheckJob(&job);
+        src = TexMgr_CacheCompress((uint8_t*)job.pixels, job.numpixels * 4, &size, 0);
+        if (src)
+            TexMgr_CacheStore(glt, glt->shirt, glt->pants, settings, flags, glt->width, glt->height, src, size, job.numpixels * 4);
+        TexMgr_UploadImage(&job);
     }
+    else
+        TexMgr_LoadImageData(glt, data);
 
     Hunk_FreeToLowMark(mark);
 }
@@ -1348,6 +2764,8 @@ void TexMgr_ReloadImages(void)
 {
     gltexture_t* glt;
 
+    texpoolsize = 0; // those names went with the old context
+
     for (glt = active_gltextures; glt; glt = glt->next)
     {
         glGenTextures(1, &glt->texnum);
@@ -47,6 +47,11 @@ typedef struct gltexture_s
     //managed by texture manager
     unsigned int texnum;
     struct gltexture_s* next;
+    struct gltexture_s* prev;
+    struct gltexture_s* hashnext; //next in the (owner, name) hash bucket
+    struct gltexture_s* ownernext; //textures with owners in the same bucket
+    struct gltexture_s* ownerprev;
+    bool linked; //in the hash and owner lists
     model_t* owner;
     //managed by image loading
     char name[64];
@@ -83,6 +88,7 @@ gltexture_t* TexMgr_NewTexture(void);
 void TexMgr_FreeTexture(gltexture_t* kill);
 void TexMgr_FreeTextures(int flags, int mask);
 void TexMgr_FreeTexturesForOwner(model_t* owner);
+void TexMgr_FlushPool(void);
 void TexMgr_NewGame(void);
 void TexMgr_Init(void);
 
@@ -92,6 +98,13 @@ gltexture_t* TexMgr_LoadImage(model_t* owner, char* name, int width, int height,
 void TexMgr_ReloadImage(gltexture_t* glt, int shirt, int pants);
 void TexMgr_ReloadImages(void);
 void TexMgr_ReloadNobrightImages(void);
+void TexMgr_BeginBatch(void);
+void TexMgr_EndBatch(void);
+void TexMgr_TextureBench_f(void);
+void TexMgr_SkinCacheBench_f(void);
+void TexMgr_ManagerBench_f(void);
+void TexMgr_CompressTest_f(void);
+void TexMgr_CacheFlush(void);
 
 int TexMgr_Pad(int s);
 int TexMgr_SafeTextureSize(int s);
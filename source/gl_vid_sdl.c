@@ -135,6 +135,16 @@ typedef void(APIENTRY* lp3DFXFUNC)(int, int, int, int, int, const void*);
 extern MTEXCOORDFUNC GL_MTexCoord2fFunc = NULL; //johnfitz
 extern SELECTTEXFUNC GL_SelectTextureFunc = NULL; //johnfitz
 
+GENBUFFERSFUNC GL_GenBuffersFunc = NULL;
+DELETEBUFFERSFUNC GL_DeleteBuffersFunc = NULL;
+BINDBUFFERFUNC GL_BindBufferFunc = NULL;
+BUFFERDATAFUNC GL_BufferDataFunc = NULL;
+MULTIDRAWELEMENTSFUNC GL_MultiDrawElementsFunc = NULL;
+CLIENTACTIVETEXTUREFUNC GL_ClientActiveTextureFunc = NULL;
+COMPRESSEDTEXIMAGE2DFUNC GL_CompressedTexImage2DFunc = NULL;
+MAPBUFFERFUNC GL_MapBufferFunc = NULL;
+UNMAPBUFFERFUNC GL_UnmapBufferFunc = NULL;
+
 typedef BOOL(APIENTRY* SETSWAPFUNC)(int); //johnfitz
 typedef int(APIENTRY* GETSWAPFUNC)(void); //johnfitz
 SETSWAPFUNC wglSwapIntervalEXT = NULL; //johnfitz
@@ -145,6 +155,9 @@ bool isIntelVideo = false; //johnfitz -- intel video workarounds from Baker
 bool gl_mtexable = false;
 bool gl_texture_env_combine = false; //johnfitz
 bool gl_texture_env_add = false; //johnfitz
+bool gl_vbo_able = false;
+bool gl_texture_s3tc_able = false;
+bool gl_pbo_able = false;
 bool gl_swap_control = false; //johnfitz
 bool gl_anisotropy_able = false; //johnfitz
 float gl_max_anisotropy; //johnfitz
@@ -687,6 +700,73 @@ GL_CheckExtensions -- johnfitz
 */
 static void GL_CheckExtensions(void)
 {
+    //
+    // vertex buffer objects
+    //
+    if (COM_CheckParm("-novbo"))
+        Con_Warning("vertex buffer objects disabled at command line\n");
+    else if (strstr(gl_extensions, "GL_ARB_vertex_buffer_object"))
+    {
+        GL_GenBuffersFunc = (GENBUFFERSFUNC)wglGetProcAddress("glGenBuffersARB");
+        GL_DeleteBuffersFunc = (DELETEBUFFERSFUNC)wglGetProcAddress("glDeleteBuffersARB");
+        GL_BindBufferFunc = (BINDBUFFERFUNC)wglGetProcAddress("glBindBufferARB");
+        GL_BufferDataFunc = (BUFFERDATAFUNC)wglGetProcAddress("glBufferDataARB");
+        if (GL_GenBuffersFunc && GL_DeleteBuffersFunc && GL_BindBufferFunc && GL_BufferDataFunc)
+        {
+            Con_Printf("FOUND: ARB_vertex_buffer_object\n");
+            gl_vbo_able = true;
+        }
+        else
+            Con_Warning("vertex buffer objects not supported (wglGetProcAddress failed)\n");
+
+        // both optional, the world renderer works around either one missing
+        if (strstr(gl_extensions, "GL_EXT_multi_draw_arrays"))
+            GL_MultiDrawElementsFunc = (MULTIDRAWELEMENTSFUNC)wglGetProcAddress("glMultiDrawElementsEXT");
+        if (strstr(gl_extensions, "GL_ARB_multitexture"))
+            GL_ClientActiveTextureFunc = (CLIENTACTIVETEXTUREFUNC)wglGetProcAddress("glClientActiveTextureARB");
+    }
+    else
+        Con_Warning("vertex buffer objects not supported (extension not found)\n");
+
+    //
+    // block compressed textures
+    //
+    if (COM_CheckParm("-nos3tc"))
+        Con_Warning("texture compression disabled at command line\n");
+    else if (strstr(gl_extensions, "GL_ARB_texture_compression") && strstr(gl_extensions, "GL_EXT_texture_compression_s3tc"))
+    {
+        GL_CompressedTexImage2DFunc = (COMPRESSEDTEXIMAGE2DFUNC)wglGetProcAddress("glCompressedTexImage2DARB");
+        if (GL_CompressedTexImage2DFunc)
+        {
+            Con_Printf("FOUND: EXT_texture_compression_s3tc\n");
+            gl_texture_s3tc_able = true;
+        }
+        else
+            Con_Warning("texture compression not supported (wglGetProcAddress failed)\n");
+    }
+    else
+        Con_Warning("texture compression not supported (extension not found)\n");
+
+    //
+    // pixel buffer objects
+    //
+    if (COM_CheckParm("-nopbo"))
+        Con_Warning("pixel buffer objects disabled at command line\n");
+    else if (gl_vbo_able && strstr(gl_extensions, "GL_ARB_pixel_buffer_object"))
+    {
+        GL_MapBufferFunc = (MAPBUFFERFUNC)wglGetProcAddress("glMapBufferARB");
+        GL_UnmapBufferFunc = (UNMAPBUFFERFUNC)wglGetProcAddress("glUnmapBufferARB");
+        if (GL_MapBufferFunc && GL_UnmapBufferFunc)
+        {
+            Con_Printf("FOUND: ARB_pixel_buffer_object\n");
+            gl_pbo_able = true;
+        }
+        else
+            Con_Warning("pixel buffer objects not supported (wglGetProcAddress failed)\n");
+    }
+    else
+        Con_Warning("pixel buffer objects not supported (extension not found)\n");
+
 #if 0  // disable for now
     //
     // multitexture
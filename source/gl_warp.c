@@ -21,11 +21,17 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 extern cvar_t r_drawflat;
 
 cvar_t r_oldwater = { "r_oldwater", "1" };
 cvar_t r_waterquality = { "r_waterquality", "8" };
 cvar_t r_waterwarp = { "r_waterwarp", "1" };
+cvar_t r_warpcpu = { "r_warpcpu", "1" }; // warp water textures on the cpu, 0 renders them into the back buffer
 
 float load_subdivide_size; //johnfitz -- remember what subdivide_size value was when this map was loaded
 
@@ -234,12 +240,314 @@ void DrawWaterPoly(glpoly_t* p)
     }
 }
 
+//==============================================================================
+//
+//  CPU WATER
+//
+//==============================================================================
+
+/*
+the warp R_RenderWarpTexture draws is separable: the s offset of a point depends only on its
+t, and the t offset only on its s. so each row of the warped image is a straight run through
+the source offset by a row constant, and each column a run offset by a column constant. the
+cpu path walks those runs in 16.16 fixed point with bilinear filtering and uploads the result,
+instead of drawing into the back buffer and copying it out. the image is two source tiles
+across, at one texel per source texel up to gl_warpimagesize, and the rows are split into
+bands across the worker threads
+*/
+
+#define WARP_BANDS 8
+#define WARP_MAXSIZE 1024
+
+typedef struct
+{
+    texture_t* tx;
+    int width, height; // of the warped image
+    unsigned* pixels;
+} warpjob_t;
+
+extern const int gl_solid_format;
+
+static warpjob_t* warpjobs;
+static int numwarpjobs, maxwarpjobs;
+static unsigned* warppixels;
+static int warppixelsize;
+
+/*
+================
+R_InitWarpTexture -- keeps the pixels of a water texture for the cpu warp. data is RGBA, or
+NULL for the texture's own 8 bit pixels
+================
+*/
+void R_InitWarpTexture(texture_t* tx, unsigned* data, int width, int height)
+{
+    uint8_t* indexed;
+    int i;
+
+    if (!data)
+    {
+        width = tx->width;
+        height = tx->height;
+    }
+    if (width < 1 || height < 1 || width > 4096 || height > 4096) // 16.16 texel positions run to about four widths
+    {
+        tx->warppixels = NULL;
+        return;
+    }
+
+    tx->warppixels = (unsigned*)Hunk_Alloc(width * height * 4);
+    tx->warpwidth = width;
+    tx->warpheight = height;
+    if (data)
+        memcpy(tx->warppixels, data, width * height * 4);
+    else
+    {
+        indexed = (uint8_t*)(tx + 1);
+        for (i = 0; i < width * height; i++)
+            tx->warppixels[i] = d_8to24table[indexed[i]];
+    }
+}
+
+/*
+================
+R_WarpTexel -- bilinear blend of four texels with 7 bit weights, two channels at a time
+================
+*/
+static unsigned R_WarpTexel(unsigned t00, unsigned t10, unsigned t01, unsigned t11, unsigned wx, unsigned wy)
+{
+    unsigned rb0, ga0, rb1, ga1;
+
+    rb0 = (((t00 & 0x00ff00ff) * (128 - wx) + (t10 & 0x00ff00ff) * wx) >> 7) & 0x00ff00ff;
+    ga0 = ((((t00 >> 8) & 0x00ff00ff) * (128 - wx) + ((t10 >> 8) & 0x00ff00ff) * wx) >> 7) & 0x00ff00ff;
+    rb1 = (((t01 & 0x00ff00ff) * (128 - wx) + (t11 & 0x00ff00ff) * wx) >> 7) & 0x00ff00ff;
+    ga1 = ((((t01 >> 8) & 0x00ff00ff) * (128 - wx) + ((t11 >> 8) & 0x00ff00ff) * wx) >> 7) & 0x00ff00ff;
+    rb0 = ((rb0 * (128 - wy) + rb1 * wy) >> 7) & 0x00ff00ff;
+    ga0 = ((ga0 * (128 - wy) + ga1 * wy) >> 7) & 0x00ff00ff;
+    return rb0 | (ga0 << 8);
+}
+
+/*
+================
+R_WarpRows -- rows y0 up to y1 of a warped image
+================
+*/
+static void R_WarpRows(warpjob_t* job, int y0, int y1)
+{
+    texture_t* tx = job->tx;
+    const unsigned* src = tx->warppixels;
+    int srcw = tx->warpwidth, srch = tx->warpheight;
+    int umask = (srcw & (srcw - 1)) ? 0 : srcw - 1; // wrap with a mask when the size allows
+    int vmask = (srch & (srch - 1)) ? 0 : srch - 1;
+    int colv[WARP_MAXSIZE];
+    int x, y, u, v, du, rowv, ui, vi, ui1, vi1;
+    double phase, sx, sy;
+    unsigned* out;
+
+    phase = cl.time * (128.0 / M_PI);
+    sx = 128.0 / job->width; // canvas units per pixel, see R_RenderWarpTexture
+    sy = 128.0 / job->height;
+
+    // texels, biased by two tiles so they stay positive, in 16.16
+    du = (int)(sx * srcw / 64.0 * 65536.0);
+    for (x = 0; x < job->width; x++)
+        colv[x] = (int)((turbsin[(int)(((x + 0.5) * sx) * 2 + phase) & 255] * srch / 64.0 + 2 * srch - 0.5) * 65536.0);
+
+    for (y = y0; y < y1; y++)
+    {
+        out = job->pixels + y * job->width;
+        u = (int)(((0.5 * sx + turbsin[(int)(((y + 0.5) * sy) * 2 + phase) & 255]) * srcw / 64.0 + 2 * srcw - 0.5) * 65536.0);
+        rowv = (int)((y + 0.5) * sy * srch / 64.0 * 65536.0);
+
+        x = 0;
+#ifdef USE_SSE2
+        for (; x + 4 <= job->width; x += 4)
+        {
+            unsigned t00[4], t10[4], t01[4], t11[4];
+            __m128i a, b, c, d, wx, wy, iwx, iwy, h0, h1, lo, hi, zero = _mm_setzero_si128();
+            int wxs[4], wys[4], i;
+
+            for (i = 0; i < 4; i++, u += du)
+            {
+                v = colv[x + i] + rowv;
+                ui = u >> 16;
+                vi = v >> 16;
+                ui = umask ? ui & umask : ui % srcw;
+                vi = vmask ? vi & vmask : vi % srch;
+                ui1 = ui + 1 == srcw ? 0 : ui + 1;
+                vi1 = vi + 1 == srch ? 0 : vi + 1;
+                t00[i] = src[vi * srcw + ui];
+                t10[i] = src[vi * srcw + ui1];
+                t01[i] = src[vi1 * srcw + ui];
+                t11[i] = src[vi1 * srcw + ui1];
+                wxs[i] = (u >> 9) & 127;
+                wys[i] = (v >> 9) & 127;
+            }
+
+            a = _mm_loadu_si128((__m128i*)t00);
+            b = _mm_loadu_si128((__m128i*)t10);
+            c = _mm_loadu_si128((__m128i*)t01);
+            d = _mm_loadu_si128((__m128i*)t11);
+
+            // pixels 0 and 1
+            wx = _mm_set_epi16(wxs[1], wxs[1], wxs[1], wxs[1], wxs[0], wxs[0], wxs[0], wxs[0]);
+            wy = _mm_set_epi16(wys[1], wys[1], wys[1], wys[1], wys[0], wys[0], wys[0], wys[0]);
+            iwx = _mm_sub_epi16(_mm_set1_epi16(128), wx);
+            iwy = _mm_sub_epi16(_mm_set1_epi16(128), wy);
+            h0 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), iwx), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wx)), 7);
+            h1 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), iwx), _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), wx)), 7);
+            lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(h0, iwy), _mm_mullo_epi16(h1, wy)), 7);
+
+            // pixels 2 and 3
+            wx = _mm_set_epi16(wxs[3], wxs[3], wxs[3], wxs[3], wxs[2], wxs[2], wxs[2], wxs[2]);
+            wy = _mm_set_epi16(wys[3], wys[3], wys[3], wys[3], wys[2], wys[2], wys[2], wys[2]);
+            iwx = _mm_sub_epi16(_mm_set1_epi16(128), wx);
+            iwy = _mm_sub_epi16(_mm_set1_epi16(128), wy);
+            h0 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), iwx), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wx)), 7);
+            h1 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), iwx), _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), wx)), 7);
+            hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(h0, iwy), _mm_mullo_epi16(h1, wy)), 7);
+
+            _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; x < job->width; x++, u += du)
+        {
+            v = colv[x] + rowv;
+            ui = u >> 16;
+            vi = v >> 16;
+            ui = umask ? ui & umask : ui % srcw;
+            vi = vmask ? vi & vmask : vi % srch;
+            ui1 = ui + 1 == srcw ? 0 : ui + 1;
+            vi1 = vi + 1 == srch ? 0 : vi + 1;
+            out[x] = R_WarpTexel(src[vi * srcw + ui], src[vi * srcw + ui1], src[vi1 * srcw + ui], src[vi1 * srcw + ui1],
+                (u >> 9) & 127, (v >> 9) & 127);
+        }
+    }
+}
+
+/*
+================
+R_WarpTask -- Tasks_ParallelFor callback, one band of one image
+================
+*/
+static void R_WarpTask(int index, int thread, void* data)
+{
+    warpjob_t* job = &warpjobs[index / WARP_BANDS];
+    int band = index % WARP_BANDS;
+
+    R_WarpRows(job, job->height * band / WARP_BANDS, job->height * (band + 1) / WARP_BANDS);
+}
+
+/*
+================
+R_WarpTexturesCPU -- warps every texture that needs it and has pixels kept, and uploads the results
+================
+*/
+static void R_WarpTexturesCPU(void)
+{
+    texture_t* tx;
+    gltexture_t* glt;
+    warpjob_t* job;
+    int i, size, maxsize;
+
+    maxsize = gl_warpimagesize < WARP_MAXSIZE ? gl_warpimagesize : WARP_MAXSIZE;
+    numwarpjobs = 0;
+    size = 0;
+    for (i = 0; i < cl.worldmodel->numtextures; i++)
+    {
+        if (!(tx = cl.worldmodel->textures[i]) || !tx->update_warp || !tx->warppixels)
+            continue;
+
+        if (numwarpjobs == maxwarpjobs)
+        {
+            maxwarpjobs = maxwarpjobs ? maxwarpjobs * 2 : 16;
+            warpjobs = (warpjob_t*)realloc(warpjobs, maxwarpjobs * sizeof(warpjob_t));
+        }
+        job = &warpjobs[numwarpjobs++];
+        job->tx = tx;
+        job->width = TexMgr_Pad(tx->warpwidth * 2);
+        job->height = TexMgr_Pad(tx->warpheight * 2);
+        if (job->width > maxsize)
+            job->width = maxsize;
+        if (job->height > maxsize)
+            job->height = maxsize;
+        size += job->width * job->height;
+    }
+    if (!numwarpjobs)
+        return;
+
+    if (size > warppixelsize)
+    {
+        free(warppixels);
+        warppixels = (unsigned*)malloc(size * 4);
+        warppixelsize = size;
+    }
+    for (i = 0, size = 0; i < numwarpjobs; i++)
+    {
+        warpjobs[i].pixels = warppixels + size;
+        size += warpjobs[i].width * warpjobs[i].height;
+    }
+
+    Tasks_ParallelFor(numwarpjobs * WARP_BANDS, R_WarpTask, NULL);
+
+    for (i = 0, job = warpjobs; i < numwarpjobs; i++, job++)
+    {
+        glt = job->tx->warpimage;
+        GL_Bind(glt);
+        if ((int)glt->width != job->width || (int)glt->height != job->height)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, gl_solid_format, job->width, job->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, job->pixels);
+            glt->width = job->width;
+            glt->height = job->height;
+        }
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, job->width, job->height, GL_RGBA, GL_UNSIGNED_BYTE, job->pixels);
+        job->tx->update_warp = false;
+    }
+}
+
 //==============================================================================
 //
 //  RENDER-TO-FRAMEBUFFER WATER
 //
 //==============================================================================
 
+/*
+=============
+R_RenderWarpTexture -- draws the warped texture into the back buffer and copies it out
+=============
+*/
+static void R_RenderWarpTexture(texture_t* tx, float warptess)
+{
+    float x, y, x2;
+
+    //render warp
+    GL_SetCanvas(CANVAS_WARPIMAGE);
+    GL_Bind(tx->gltexture);
+    for (x = 0.0; x < 128.0; x = x2)
+    {
+        x2 = x + warptess;
+        glBegin(GL_TRIANGLE_STRIP);
+        for (y = 0.0; y < 128.01; y += warptess) // .01 for rounding errors
+        {
+            glTexCoord2f(WARPCALC(x, y), WARPCALC(y, x));
+            glVertex2f(x, y);
+            glTexCoord2f(WARPCALC(x2, y), WARPCALC(y, x2));
+            glVertex2f(x2, y);
+        }
+        glEnd();
+    }
+
+    //copy to texture, giving it back its full size if the cpu path shrank it
+    GL_Bind(tx->warpimage);
+    if ((int)tx->warpimage->width != gl_warpimagesize || (int)tx->warpimage->height != gl_warpimagesize)
+    {
+        glCopyTexImage2D(GL_TEXTURE_2D, 0, gl_solid_format, glx, gly + glheight - gl_warpimagesize, gl_warpimagesize, gl_warpimagesize, 0);
+        tx->warpimage->width = tx->warpimage->height = gl_warpimagesize;
+    }
+    else
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, glx, gly + glheight - gl_warpimagesize, gl_warpimagesize, gl_warpimagesize);
+}
+
 /*
 =============
 R_UpdateWarpTextures -- johnfitz -- each frame, update warping textures
@@ -249,13 +557,18 @@ void R_UpdateWarpTextures(void)
 {
     texture_t* tx;
     int i;
-    float x, y, x2, warptess;
+    float warptess;
+    bool rendered;
 
     if (r_oldwater.value || cl.paused || r_drawflat_cheatsafe || r_lightmap_cheatsafe)
         return;
 
+    if (r_warpcpu.value)
+        R_WarpTexturesCPU(); // the ones R_InitWarpTexture kept no pixels for are left to the gl path
+
     warptess = 128.0 / CLAMP(3.0, floor(r_waterquality.value), 64.0);
 
+    rendered = false;
     for (i = 0; i < cl.worldmodel->numtextures; i++)
     {
         if (!(tx = cl.worldmodel->textures[i]))
@@ -264,30 +577,14 @@ void R_UpdateWarpTextures(void)
         if (!tx->update_warp)
             continue;
 
-        //render warp
-        GL_SetCanvas(CANVAS_WARPIMAGE);
-        GL_Bind(tx->gltexture);
-        for (x = 0.0; x < 128.0; x = x2)
-        {
-            x2 = x + warptess;
-            glBegin(GL_TRIANGLE_STRIP);
-            for (y = 0.0; y < 128.01; y += warptess) // .01 for rounding errors
-            {
-                glTexCoord2f(WARPCALC(x, y), WARPCALC(y, x));
-                glVertex2f(x, y);
-                glTexCoord2f(WARPCALC(x2, y), WARPCALC(y, x2));
-                glVertex2f(x2, y);
-            }
-            glEnd();
-        }
-
-        //copy to texture
-        GL_Bind(tx->warpimage);
-        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, glx, gly + glheight - gl_warpimagesize, gl_warpimagesize, gl_warpimagesize);
-
+        R_RenderWarpTexture(tx, warptess);
         tx->update_warp = false;
+        rendered = true;
     }
 
+    if (r_warpcpu.value && !rendered) // the back buffer wasn't touched
+        return;
+
     //if warp render went down into sbar territory, we need to be sure to refresh it next frame
     if (gl_warpimagesize + sb_lines > glheight)
         Sbar_Changed();
@@ -295,3 +592,57 @@ void R_UpdateWarpTextures(void)
     //if viewsize is less than 100, we need to redraw the frame around the viewport
     scr_tileclear_updates = 0;
 }
+
+/*
+=============
+R_WarpBench_f -- times updating every water texture of the map with each warp path
+
+warpbench [frames]
+=============
+*/
+void R_WarpBench_f(void)
+{
+    texture_t* tx;
+    float savedcpu, savedold;
+    int frames, frame, pass, i, count;
+    double start, time[2];
+
+    if (!cl.worldmodel)
+    {
+        Con_Printf("warpbench: no map loaded\n");
+        return;
+    }
+
+    frames = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 100;
+    if (frames < 1)
+        frames = 1;
+
+    savedcpu = r_warpcpu.value;
+    savedold = r_oldwater.value;
+    Cvar_SetValue("r_oldwater", 0);
+    count = 0;
+    for (pass = 0; pass < 2; pass++)
+    {
+        Cvar_SetValue("r_warpcpu", pass);
+        glFinish();
+        start = Sys_FloatTime();
+        for (frame = 0; frame < frames; frame++)
+        {
+            for (i = 0, count = 0; i < cl.worldmodel->numtextures; i++)
+                if ((tx = cl.worldmodel->textures[i]) && tx->warpimage)
+                {
+                    tx->update_warp = true;
+                    count++;
+                }
+            R_UpdateWarpTextures();
+            glFinish();
+        }
+        time[pass] = (Sys_FloatTime() - start) * 1000.0 / frames;
+    }
+    Cvar_SetValue("r_warpcpu", savedcpu);
+    Cvar_SetValue("r_oldwater", savedold);
+
+    Con_Printf("warpbench: %i water textures, %i frames\n", count, frames);
+    Con_Printf("render and copy: %6.3f ms per frame\n", time[0]);
+    Con_Printf("cpu and upload:  %6.3f ms per frame, %i threads\n", time[1], task_numthreads);
+}
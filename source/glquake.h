@@ -75,7 +75,79 @@ extern PROC glVertexPointerEXT;
 
 void R_TimeRefresh_f(void);
 void R_ReadPointFile_f(void);
+void R_LightmapBench_f(void);
+void GL_LightmapInfo_f(void);
+void R_CrowdBench_f(void);
+void R_CullBench_f(void);
+void R_OcclusionBench_f(void);
+void R_DirtyLightStyle(int style);
 texture_t* R_TextureAnimation(texture_t* base, int frame);
+bool R_CullBox(vec3_t emins, vec3_t emaxs);
+void R_RotateForEntity(vec3_t origin, vec3_t angles);
+int R_CullSurfaceBoxes(msurface_t** surfs, int count);
+void R_EmitWireBox(vec3_t mins, vec3_t maxs);
+
+// r_occlusion.c
+extern bool r_occlusionready;
+void R_InitOcclusion(void);
+void R_BuildOcclusion(void);
+bool R_OccludedBox(vec3_t mins, vec3_t maxs);
+void R_OcclusionShow(vec3_t mins, vec3_t maxs, bool entity);
+void R_ShowOcclusion(void);
+void R_OccludeWorld(void);
+
+// r_lightgrid.c
+void R_InitLightGrid(void);
+void R_FreeLightGrid(void);
+void R_PollLightGrid(void);
+bool R_LightGridPoint(vec3_t p, vec3_t color);
+void R_LightGridBench_f(void);
+
+// gl_warp.c
+void R_InitWarpTexture(texture_t* tx, unsigned* data, int width, int height);
+void R_WarpBench_f(void);
+
+// gl_rlight.c
+extern dlight_t* r_livedlights[MAX_DLIGHTS];
+extern int r_numlivedlights;
+int R_LightPoint(vec3_t p);
+void R_LightPointColor(vec3_t p, vec3_t color);
+void R_LightEntity(vec3_t p, vec3_t color);
+
+//johnfitz -- struct for passing lerp information to drawing functions
+typedef struct
+{
+    short pose1;
+    short pose2;
+    float blend;
+    vec3_t origin;
+    vec3_t angles;
+} lerpdata_t;
+//johnfitz
+
+// an alias entity set up for drawing: everything R_DrawAliasModel works out before its
+// first gl call. built by the scene prep thread while the world is drawn
+typedef struct
+{
+    entity_t* entity;
+    aliashdr_t* paliashdr;
+    lerpdata_t lerpdata;
+    bool culled;
+    bool occluded; // counted and shown when the draw gets to it
+    vec3_t mins, maxs; // what was culled
+    float entalpha;
+    bool overbright;
+    vec3_t lightcolor;
+    const float* shadedots;
+    struct aliasvert_s* verts; // lerped and lit already, or NULL to do it at draw time
+} aliasprep_t;
+
+void R_EntityBounds(entity_t* e, vec3_t mins, vec3_t maxs);
+bool R_CullModelForEntity(entity_t* e, bool count);
+void R_ResetAliasPrep(void);
+void R_PrepareAliasModel(entity_t* e, aliashdr_t* paliashdr, aliasprep_t* prep, bool lerpverts);
+void R_DrawPreparedAliasModel(aliasprep_t* prep);
+void R_PrepareParticles(void);
 
 typedef struct surfcache_s
 {
@@ -114,15 +186,13 @@ typedef enum {
     pt_blob,
     pt_blob2
 } ptype_t;
+#define NUM_PARTICLE_TYPES (pt_blob2 + 1)
 
-// !!! if this is changed, it must be changed in d_ifacea.h too !!!
-typedef struct particle_s
+// a particle being spawned. R_AddParticle copies it into the arrays of the pool for its type
+typedef struct
 {
-    // driver-usable fields
     vec3_t org;
-    float color;
-    // drivers never touch the following fields
-    struct particle_s* next;
+    int color;
     vec3_t vel;
     float ramp;
     float die;
@@ -166,6 +236,13 @@ extern cvar_t r_lightmap;
 extern cvar_t r_shadows;
 extern cvar_t r_wateralpha;
 extern cvar_t r_dynamic;
+extern cvar_t r_lightmapthreads;
+extern cvar_t r_cullthreads;
+extern cvar_t r_occlusion;
+extern cvar_t r_occlusion_minarea;
+extern cvar_t r_showocclusion;
+extern cvar_t r_lightgrid;
+extern cvar_t gl_lightmap_size; // lightmap page size, takes effect on the next map
 extern cvar_t r_novis;
 
 extern cvar_t gl_clear;
@@ -207,6 +284,52 @@ extern SELECTTEXFUNC GL_SelectTextureFunc;
 extern GLenum TEXTURE0, TEXTURE1;
 //johnfitz
 
+//vertex buffer objects (ARB_vertex_buffer_object)
+#define GL_ARRAY_BUFFER_ARB 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER_ARB 0x8893
+#define GL_STATIC_DRAW_ARB 0x88E4
+#define GL_DYNAMIC_DRAW_ARB 0x88E8
+#define GL_STREAM_DRAW_ARB 0x88E0
+typedef void(APIENTRY* GENBUFFERSFUNC)(GLsizei, GLuint*);
+typedef void(APIENTRY* DELETEBUFFERSFUNC)(GLsizei, const GLuint*);
+typedef void(APIENTRY* BINDBUFFERFUNC)(GLenum, GLuint);
+typedef void(APIENTRY* BUFFERDATAFUNC)(GLenum, ptrdiff_t, const void*, GLenum);
+typedef void(APIENTRY* MULTIDRAWELEMENTSFUNC)(GLenum, const GLsizei*, GLenum, const void**, GLsizei);
+typedef void(APIENTRY* CLIENTACTIVETEXTUREFUNC)(GLenum);
+extern GENBUFFERSFUNC GL_GenBuffersFunc;
+extern DELETEBUFFERSFUNC GL_DeleteBuffersFunc;
+extern BINDBUFFERFUNC GL_BindBufferFunc;
+extern BUFFERDATAFUNC GL_BufferDataFunc;
+extern MULTIDRAWELEMENTSFUNC GL_MultiDrawElementsFunc; // optional, NULL means one glDrawElements per range
+extern CLIENTACTIVETEXTUREFUNC GL_ClientActiveTextureFunc; // optional, needed for multitextured arrays
+extern bool gl_vbo_able;
+
+extern GLuint gl_bmodel_vbo; // every brush model vertex, VERTEXSIZE floats each
+extern cvar_t gl_vbo;
+void GL_BuildVertexBuffer(void);
+void R_InitWorldBatches(void);
+void R_InitWorldCull(void);
+void GL_UploadAliasMesh(model_t* m, aliashdr_t* hdr);
+void GL_FreeAliasMesh(model_t* m);
+void GL_MeshBench_f(void);
+
+//block compressed textures (ARB_texture_compression, EXT_texture_compression_s3tc)
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+typedef void(APIENTRY* COMPRESSEDTEXIMAGE2DFUNC)(GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const void*);
+extern COMPRESSEDTEXIMAGE2DFUNC GL_CompressedTexImage2DFunc;
+extern bool gl_texture_s3tc_able;
+
+//asynchronous readback (ARB_pixel_buffer_object), on top of the vbo functions
+#define GL_PIXEL_PACK_BUFFER_ARB 0x88EB
+#define GL_STREAM_READ_ARB 0x88E1
+#define GL_READ_ONLY_ARB 0x88B8
+typedef void*(APIENTRY* MAPBUFFERFUNC)(GLenum, GLenum);
+typedef GLboolean(APIENTRY* UNMAPBUFFERFUNC)(GLenum);
+extern MAPBUFFERFUNC GL_MapBufferFunc;
+extern UNMAPBUFFERFUNC GL_UnmapBufferFunc;
+extern bool gl_pbo_able;
+
 //johnfitz -- anisotropic filtering
 #define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
 #define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
@@ -244,7 +367,10 @@ extern bool isIntelVideo; //johnfitz -- intel video workarounds from Baker
 //johnfitz -- rendering statistics
 extern int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 extern int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+extern int rs_lightmapchecks, rs_lightmaprebuilds; // surfaces tested vs rebuilt
+extern int rs_occluders, rs_occludedleafs, rs_occludedents;
 extern float rs_megatexels;
+extern int rs_2ddraws, rs_2dquads; // 2d batches and quads drawn last frame
 //johnfitz
 
 //johnfitz -- track developer statistics that vary every frame
@@ -649,7 +649,9 @@ void _Host_Frame(float time)
     static double time1 = 0;
     static double time2 = 0;
     static double time3 = 0;
+    static int copybytes = 0;
     int pass1, pass2, pass3;
+    double framestart, phase = 0;
 
     if (setjmp(host_abortserver))
         return; // something bad happened, or the server disconnected
@@ -661,6 +663,8 @@ void _Host_Frame(float time)
     if (!Host_FilterTime(time))
         return; // don't run too fast, or packets will flood out
 
+    framestart = cls.timedemo ? Sys_FloatTime() : 0;
+
     // get new key events
     Sys_PumpEvents();
 
@@ -711,13 +715,29 @@ void _Host_Frame(float time)
     if (host_speeds.value)
         time1 = Sys_FloatTime();
 
-    SCR_UpdateScreen();
+    if (!cls.td_norender)
+        SCR_UpdateScreen();
+    else if (cls.signon == SIGNONS)
+    {
+        // no refdef without rendering, so place the listener at the view entity
+        VectorCopy(cl_entities[cl.viewentity].origin, r_origin);
+        AngleVectors(cl.viewangles, vpn, vright, vup);
+    }
+
+    if (cls.timedemo)
+        phase = Sys_FloatTime();
 
     CL_RunParticles(); //johnfitz -- seperated from rendering
 
     if (host_speeds.value)
         time2 = Sys_FloatTime();
 
+    if (cls.timedemo)
+    {
+        cl_frametimes.particles = Sys_FloatTime() - phase;
+        phase += cl_frametimes.particles;
+    }
+
     // update audio
     if (cls.signon == SIGNONS)
     {
@@ -727,6 +747,9 @@ void _Host_Frame(float time)
     else
         S_Update(vec3_origin, vec3_origin, vec3_origin, vec3_origin);
 
+    if (cls.timedemo)
+        cl_frametimes.sound = Sys_FloatTime() - phase;
+
     CDAudio_Update();
 
     if (host_speeds.value)
@@ -735,8 +758,15 @@ void _Host_Frame(float time)
         time3 = Sys_FloatTime();
         pass2 = (time2 - time1) * 1000;
         pass3 = (time3 - time2) * 1000;
-        Con_Printf("%3i tot %3i server %3i gfx %3i snd\n",
-            pass1 + pass2 + pass3, pass1, pass2, pass3);
+        Con_Printf("%3i tot %3i server %3i gfx %3i snd %5i netcopy\n",
+            pass1 + pass2 + pass3, pass1, pass2, pass3, net_copybytes - copybytes);
+        copybytes = net_copybytes;
+    }
+
+    if (cls.timedemo)
+    {
+        cl_frametimes.frame = Sys_FloatTime() - framestart;
+        CL_TimeDemoFrame();
     }
 
     host_framecount++;
@@ -819,6 +849,8 @@ void Host_Init(quakeparms_t* parms)
     SV_Init();
     ExtraMaps_Init(); //johnfitz
     Modlist_Init(); //johnfitz
+    Tasks_Init();
+    Capture_Init();
 
     Con_Printf("Exe: "__TIME__
                " "__DATE__
@@ -886,6 +918,7 @@ void Host_Shutdown(void)
 
     Host_WriteConfiguration();
 
+    Capture_Shutdown();
     CDAudio_Shutdown();
     NET_Shutdown();
     S_Shutdown();
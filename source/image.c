@@ -35,62 +35,103 @@ TODO: search order: tga png jpg pcx lmp
 */
 uint8_t* Image_LoadImage(char* name, int* width, int* height)
 {
-    FILE* f;
+    imageformat_t format;
+    uint8_t *file, *data;
+    int filesize;
 
-    sprintf(loadfilename, "%s.tga", name);
-    COM_FOpenFile(loadfilename, &f);
-    if (f)
-        return Image_LoadTGA(f, width, height);
+    file = Image_LoadFile(name, &format, &filesize);
+    if (!file)
+        return NULL;
 
-    sprintf(loadfilename, "%s.pcx", name);
-    COM_FOpenFile(loadfilename, &f);
-    if (f)
-        return Image_LoadPCX(f, width, height);
+    data = NULL;
+    if (Image_Info(file, filesize, format, width, height))
+    {
+        data = Hunk_Alloc(*width * *height * 4);
+        if (!Image_Decode(file, filesize, format, data))
+            Con_Warning("%s is damaged, part of it is missing\n", loadfilename);
+    }
+    else
+        Con_Warning("%s is not a supported %s image\n", loadfilename, format == IMAGE_TGA ? "type 2 or 10, 24 or 32 bit targa" : "version 5, 8 bit pcx");
 
-    return NULL;
+    free(file);
+    return data;
 }
 
-//==============================================================================
-//
-//  TGA
-//
-//==============================================================================
-
-typedef struct targaheader_s
+/*
+============
+Image_LoadFile -- name.tga or name.pcx, read whole into malloc'd memory
+============
+*/
+uint8_t* Image_LoadFile(const char* name, imageformat_t* format, int* filesize)
 {
-    unsigned char id_length, colormap_type, image_type;
-    unsigned short colormap_index, colormap_length;
-    unsigned char colormap_size;
-    unsigned short x_origin, y_origin, width, height;
-    unsigned char pixel_size, attributes;
-} targaheader_t;
+    uint8_t* file;
 
-#define TARGAHEADERSIZE 18 //size on disk
+    sprintf(loadfilename, "%s.tga", name);
+    *format = IMAGE_TGA;
+    file = COM_LoadMallocFile(loadfilename);
+    if (!file)
+    {
+        sprintf(loadfilename, "%s.pcx", name);
+        *format = IMAGE_PCX;
+        file = COM_LoadMallocFile(loadfilename);
+    }
 
-targaheader_t targa_header;
+    *filesize = file ? com_filesize : 0;
+    return file;
+}
 
-int fgetLittleShort(FILE* f)
+/*
+============
+Image_Info
+============
+*/
+bool Image_Info(const uint8_t* file, int filesize, imageformat_t format, int* width, int* height)
 {
-    uint8_t b1, b2;
-
-    b1 = fgetc(f);
-    b2 = fgetc(f);
+    if (format == IMAGE_PCX)
+        return Image_PCXInfo(file, filesize, width, height);
+    return Image_TGAInfo(file, filesize, width, height);
+}
 
-    return (short)(b1 + b2 * 256);
+/*
+============
+Image_Decode
+============
+*/
+bool Image_Decode(const uint8_t* file, int filesize, imageformat_t format, uint8_t* out)
+{
+    if (format == IMAGE_PCX)
+        return Image_DecodePCX(file, filesize, out);
+    return Image_DecodeTGA(file, filesize, out);
 }
 
-int fgetLittleLong(FILE* f)
+/*
+============
+Image_FillPixels -- count copies of one RGBA pixel, doubling what's been written each copy
+============
+*/
+static void Image_FillPixels(uint8_t* out, const uint8_t* pixel, int count)
 {
-    uint8_t b1, b2, b3, b4;
+    int done, n;
 
-    b1 = fgetc(f);
-    b2 = fgetc(f);
-    b3 = fgetc(f);
-    b4 = fgetc(f);
+    if (count <= 0)
+        return;
 
-    return b1 + (b2 << 8) + (b3 << 16) + (b4 << 24);
+    memcpy(out, pixel, 4);
+    for (done = 1; done < count; done += n)
+    {
+        n = done < count - done ? done : count - done;
+        memcpy(out + done * 4, out, n * 4);
+    }
 }
 
+//==============================================================================
+//
+//  TGA
+//
+//==============================================================================
+
+#define TARGAHEADERSIZE 18 //size on disk
+
 /*
 ============
 Image_WriteTGA -- writes RGB or RGBA data to a TGA file
@@ -141,284 +182,1056 @@ bool Image_WriteTGA(char* name, uint8_t* data, int width, int height, int bpp, b
 
 /*
 =============
-Image_LoadTGA
+Image_TGAInfo -- only uncompressed or run length encoded 24 and 32 bit truecolor
+=============
+*/
+bool Image_TGAInfo(const uint8_t* file, int filesize, int* width, int* height)
+{
+    if (filesize < TARGAHEADERSIZE)
+        return false;
+    if (file[2] != 2 && file[2] != 10) // image type
+        return false;
+    if (file[1] != 0 || (file[16] != 24 && file[16] != 32)) // color map type, pixel size
+        return false;
+
+    *width = file[12] + file[13] * 256;
+    *height = file[14] + file[15] * 256;
+    return *width > 0 && *height > 0;
+}
+
+/*
+=============
+Image_TGAPixels -- count BGR or BGRA pixels to RGBA
+=============
+*/
+static void Image_TGAPixels(const uint8_t* in, int bytes, uint8_t* out, int count)
+{
+    int i;
+
+    if (bytes == 3)
+    {
+        for (i = 0; i < count; i++, in += 3, out += 4)
+        {
+            out[0] = in[2];
+            out[1] = in[1];
+            out[2] = in[0];
+            out[3] = 255;
+        }
+    }
+    else
+    {
+        for (i = 0; i < count; i++, in += 4, out += 4)
+        {
+            out[0] = in[2];
+            out[1] = in[1];
+            out[2] = in[0];
+            out[3] = in[3];
+        }
+    }
+}
+
+/*
+=============
+Image_DecodeTGA -- returns false if the file ends early, what was there is decoded
 =============
 */
-uint8_t* Image_LoadTGA(FILE* fin, int* width, int* height)
+bool Image_DecodeTGA(const uint8_t* file, int filesize, uint8_t* out)
 {
-    int columns, rows, numPixels;
-    uint8_t* pixbuf;
-    int row, column;
-    uint8_t* targa_rgba;
-    int realrow; //johnfitz -- fix for upside-down targas
-    bool upside_down; //johnfitz -- fix for upside-down targas
-
-    targa_header.id_length = fgetc(fin);
-    targa_header.colormap_type = fgetc(fin);
-    targa_header.image_type = fgetc(fin);
-
-    targa_header.colormap_index = fgetLittleShort(fin);
-    targa_header.colormap_length = fgetLittleShort(fin);
-    targa_header.colormap_size = fgetc(fin);
-    targa_header.x_origin = fgetLittleShort(fin);
-    targa_header.y_origin = fgetLittleShort(fin);
-    targa_header.width = fgetLittleShort(fin);
-    targa_header.height = fgetLittleShort(fin);
-    targa_header.pixel_size = fgetc(fin);
-    targa_header.attributes = fgetc(fin);
-
-    if (targa_header.image_type != 2 && targa_header.image_type != 10)
-        Sys_Error("Image_LoadTGA: %s is not a type 2 or type 10 targa\n", loadfilename);
-
-    if (targa_header.colormap_type != 0 || (targa_header.pixel_size != 32 && targa_header.pixel_size != 24))
-        Sys_Error("Image_LoadTGA: %s is not a 24bit or 32bit targa\n", loadfilename);
-
-    columns = targa_header.width;
-    rows = targa_header.height;
-    numPixels = columns * rows;
-    upside_down = !(targa_header.attributes & 0x20); //johnfitz -- fix for upside-down targas
-
-    targa_rgba = Hunk_Alloc(numPixels * 4);
-
-    if (targa_header.id_length != 0)
-        fseek(fin, targa_header.id_length, SEEK_CUR); // skip TARGA image comment
-
-    if (targa_header.image_type == 2) // Uncompressed, RGB images
-    {
-        for (row = rows - 1; row >= 0; row--)
+    const uint8_t *in, *end;
+    uint8_t pixel[4];
+    uint8_t* row;
+    int width, height, bytes, x, y, count, n;
+    bool rle, run, topdown;
+
+    if (!Image_TGAInfo(file, filesize, &width, &height))
+        return false;
+
+    bytes = file[16] / 8;
+    rle = file[2] == 10;
+    topdown = (file[17] & 0x20) != 0; //johnfitz -- fix for upside-down targas
+    in = file + TARGAHEADERSIZE + file[0]; // skip TARGA image comment
+    end = file + filesize;
+    if (in > end)
+        return false;
+
+    run = false;
+    row = out + (topdown ? 0 : height - 1) * width * 4;
+    for (x = y = 0; y < height;)
+    {
+        if (rle)
         {
-            //johnfitz -- fix for upside-down targas
-            realrow = upside_down ? row : rows - 1 - row;
-            pixbuf = targa_rgba + realrow * columns * 4;
-            //johnfitz
-            for (column = 0; column < columns; column++)
+            if (in == end)
+                return false;
+            count = (*in & 0x7f) + 1;
+            run = (*in++ & 0x80) != 0;
+            if (run)
             {
-                unsigned char red, green, blue, alphabyte;
-                switch (targa_header.pixel_size)
-                {
-                case 24:
-                    blue = getc(fin);
-                    green = getc(fin);
-                    red = getc(fin);
-                    *pixbuf++ = red;
-                    *pixbuf++ = green;
-                    *pixbuf++ = blue;
-                    *pixbuf++ = 255;
-                    break;
-                case 32:
-                    blue = getc(fin);
-                    green = getc(fin);
-                    red = getc(fin);
-                    alphabyte = getc(fin);
-                    *pixbuf++ = red;
-                    *pixbuf++ = green;
-                    *pixbuf++ = blue;
-                    *pixbuf++ = alphabyte;
-                    break;
-                }
+                if (end - in < bytes)
+                    return false;
+                Image_TGAPixels(in, bytes, pixel, 1);
+                in += bytes;
+            }
+        }
+        else
+            count = width;
+
+        // packets can carry on into the next row
+        while (count && y < height)
+        {
+            n = width - x < count ? width - x : count;
+            if (run)
+                Image_FillPixels(row + x * 4, pixel, n);
+            else
+            {
+                if (end - in < n * bytes)
+                    return false;
+                Image_TGAPixels(in, bytes, row + x * 4, n);
+                in += n * bytes;
+            }
+            x += n;
+            count -= n;
+
+            if (x == width)
+            {
+                x = 0;
+                y++;
+                row = out + (topdown ? y : height - 1 - y) * width * 4;
             }
         }
     }
-    else if (targa_header.image_type == 10) // Runlength encoded RGB images
+
+    return true;
+}
+
+//==============================================================================
+//
+//  PCX
+//
+//==============================================================================
+
+#define PCXHEADERSIZE 128 //size on disk
+
+/*
+============
+Image_PCXInfo -- only version 5, 8 bit, with the 256 color palette on the end
+============
+*/
+bool Image_PCXInfo(const uint8_t* file, int filesize, int* width, int* height)
+{
+    if (filesize < PCXHEADERSIZE + 768)
+        return false;
+    if (file[0] != 0x0A || file[1] != 5) // signature, version
+        return false;
+    if (file[2] != 1 || file[3] != 8 || file[65] != 1) // encoding, bits per pixel, color planes
+        return false;
+
+    *width = file[8] + file[9] * 256 - (file[4] + file[5] * 256) + 1; // xmax - xmin + 1
+    *height = file[10] + file[11] * 256 - (file[6] + file[7] * 256) + 1; // ymax - ymin + 1
+    return *width > 0 && *height > 0 && file[66] + file[67] * 256 >= *width; // bytes per line
+}
+
+/*
+============
+Image_DecodePCX -- returns false if the file ends early, what was there is decoded
+============
+*/
+bool Image_DecodePCX(const uint8_t* file, int filesize, uint8_t* out)
+{
+    const uint8_t *in, *end, *palette;
+    uint8_t colors[256][4];
+    uint8_t* row;
+    int width, height, linebytes, x, y, c, n;
+
+    if (!Image_PCXInfo(file, filesize, &width, &height))
+        return false;
+
+    linebytes = file[66] + file[67] * 256;
+    in = file + PCXHEADERSIZE;
+    end = file + filesize - 768;
+    palette = end;
+
+    for (c = 0; c < 256; c++)
     {
-        unsigned char red, green, blue, alphabyte, packetHeader, packetSize, j;
-        for (row = rows - 1; row >= 0; row--)
+        colors[c][0] = palette[c * 3];
+        colors[c][1] = palette[c * 3 + 1];
+        colors[c][2] = palette[c * 3 + 2];
+        colors[c][3] = 255;
+    }
+
+    for (y = 0, row = out; y < height; y++, row += width * 4)
+    {
+        for (x = 0; x < linebytes; x += n) // the line can be padded past the width
         {
-            //johnfitz -- fix for upside-down targas
-            realrow = upside_down ? row : rows - 1 - row;
-            pixbuf = targa_rgba + realrow * columns * 4;
-            //johnfitz
-            for (column = 0; column < columns;)
+            if (in == end)
+                return false;
+            c = *in++;
+            if (c >= 0xC0)
             {
-                packetHeader = getc(fin);
-                packetSize = 1 + (packetHeader & 0x7f);
-                if (packetHeader & 0x80) // run-length packet
-                {
-                    switch (targa_header.pixel_size)
-                    {
-                    case 24:
-                        blue = getc(fin);
-                        green = getc(fin);
-                        red = getc(fin);
-                        alphabyte = 255;
-                        break;
-                    case 32:
-                        blue = getc(fin);
-                        green = getc(fin);
-                        red = getc(fin);
-                        alphabyte = getc(fin);
-                        break;
-                    }
-
-                    for (j = 0; j < packetSize; j++)
-                    {
-                        *pixbuf++ = red;
-                        *pixbuf++ = green;
-                        *pixbuf++ = blue;
-                        *pixbuf++ = alphabyte;
-                        column++;
-                        if (column == columns) // run spans across rows
-                        {
-                            column = 0;
-                            if (row > 0)
-                                row--;
-                            else
-                                goto breakOut;
-                            //johnfitz -- fix for upside-down targas
-                            realrow = upside_down ? row : rows - 1 - row;
-                            pixbuf = targa_rgba + realrow * columns * 4;
-                            //johnfitz
-                        }
-                    }
-                }
-                else // non run-length packet
-                {
-                    for (j = 0; j < packetSize; j++)
-                    {
-                        switch (targa_header.pixel_size)
-                        {
-                        case 24:
-                            blue = getc(fin);
-                            green = getc(fin);
-                            red = getc(fin);
-                            *pixbuf++ = red;
-                            *pixbuf++ = green;
-                            *pixbuf++ = blue;
-                            *pixbuf++ = 255;
-                            break;
-                        case 32:
-                            blue = getc(fin);
-                            green = getc(fin);
-                            red = getc(fin);
-                            alphabyte = getc(fin);
-                            *pixbuf++ = red;
-                            *pixbuf++ = green;
-                            *pixbuf++ = blue;
-                            *pixbuf++ = alphabyte;
-                            break;
-                        }
-                        column++;
-                        if (column == columns) // pixel packet run spans across rows
-                        {
-                            column = 0;
-                            if (row > 0)
-                                row--;
-                            else
-                                goto breakOut;
-                            //johnfitz -- fix for upside-down targas
-                            realrow = upside_down ? row : rows - 1 - row;
-                            pixbuf = targa_rgba + realrow * columns * 4;
-                            //johnfitz
-                        }
-                    }
-                }
+                n = c & 0x3F;
+                if (in == end)
+                    return false;
+                c = *in++;
             }
-        breakOut:;
+            else
+                n = 1;
+
+            if (n == 1 && x < width)
+                memcpy(row + x * 4, colors[c], 4);
+            else if (x < width)
+                Image_FillPixels(row + x * 4, colors[c], width - x < n ? width - x : n);
         }
     }
 
-    fclose(fin);
-
-    *width = (int)(targa_header.width);
-    *height = (int)(targa_header.height);
-    return targa_rgba;
+    return true;
 }
 
 //==============================================================================
 //
-//  PCX
+//  DECODE BENCHMARK
 //
 //==============================================================================
 
 typedef struct
 {
-    char signature;
-    char version;
-    char encoding;
-    char bits_per_pixel;
-    unsigned short xmin, ymin, xmax, ymax;
-    unsigned short hdpi, vdpi;
-    uint8_t colortable[48];
-    char reserved;
-    char color_planes;
-    unsigned short bytes_per_line;
-    unsigned short palette_type;
-    char filler[58];
-} pcxheader_t;
+    const char* name;
+    imageformat_t format;
+    uint8_t* file;
+    int filesize;
+    uint8_t* out;
+} benchimage_t;
+
+#define NUMBENCHIMAGES 5
+
+static benchimage_t benchimages[NUMBENCHIMAGES] = {
+    { "tga 24 bit", IMAGE_TGA },
+    { "tga 32 bit", IMAGE_TGA },
+    { "tga 24 bit rle", IMAGE_TGA },
+    { "tga 32 bit rle", IMAGE_TGA },
+    { "pcx", IMAGE_PCX },
+};
 
 /*
 ============
-Image_LoadPCX
+Image_BenchPixel -- flat 16 pixel blocks on the left for the encoders' runs, noise on the right
 ============
 */
-uint8_t* Image_LoadPCX(FILE* f, int* width, int* height)
+static int Image_BenchPixel(int x, int y, int width)
 {
-    pcxheader_t pcx;
-    int x, y, w, h, readbyte, runlength, start;
-    uint8_t *p, *data;
-    uint8_t palette[768];
+    if (x < width / 2)
+        return ((x >> 4) * 7 + (y >> 4) * 13) & 255;
+    return (((unsigned)x * 1103515245u + (unsigned)y * 12345u) >> 8) & 255;
+}
 
-    start = ftell(f); //save start of file (since we might be inside a pak file, SEEK_SET might not be the start of the pcx)
+/*
+============
+Image_BenchTGA -- bottom up like most tgas, so the decoder flips it
+============
+*/
+static uint8_t* Image_BenchTGA(int width, int height, int bpp, bool rle, int* size)
+{
+    uint8_t *file, *row, *p;
+    int bytes, x, y, c, n, i;
 
-    fread(&pcx, sizeof(pcx), 1, f);
-    pcx.xmin = (unsigned short)LittleShort(pcx.xmin);
-    pcx.ymin = (unsigned short)LittleShort(pcx.ymin);
-    pcx.xmax = (unsigned short)LittleShort(pcx.xmax);
-    pcx.ymax = (unsigned short)LittleShort(pcx.ymax);
-    pcx.bytes_per_line = (unsigned short)LittleShort(pcx.bytes_per_line);
+    bytes = bpp / 8;
+    file = malloc(TARGAHEADERSIZE + width * height * (bytes + 1));
+    row = malloc(width * 4);
+    if (!file || !row)
+    {
+        free(file);
+        free(row);
+        return NULL;
+    }
 
-    if (pcx.signature != 0x0A)
-        Sys_Error("'%s' is not a valid PCX file", loadfilename);
+    memset(file, 0, TARGAHEADERSIZE);
+    file[2] = rle ? 10 : 2;
+    file[12] = width & 255;
+    file[13] = width >> 8;
+    file[14] = height & 255;
+    file[15] = height >> 8;
+    file[16] = bpp;
 
-    if (pcx.version != 5)
-        Sys_Error("'%s' is version %i, should be 5", loadfilename, pcx.version);
+    p = file + TARGAHEADERSIZE;
+    for (y = height - 1; y >= 0; y--)
+    {
+        for (x = 0; x < width; x++)
+        {
+            c = Image_BenchPixel(x, y, width);
+            row[x * 4] = c * 5; // stored BGRA
+            row[x * 4 + 1] = c * 3;
+            row[x * 4 + 2] = c;
+            row[x * 4 + 3] = 255 - c;
+        }
 
-    if (pcx.encoding != 1 || pcx.bits_per_pixel != 8 || pcx.color_planes != 1)
-        Sys_Error("'%s' has wrong encoding or bit depth", loadfilename);
+        for (x = 0; x < width; x += n)
+        {
+            if (!rle)
+                n = width - x;
+            else
+            {
+                // a run of one pixel, or the pixels up to the next run
+                for (n = 1; n < 128 && x + n < width && !memcmp(row + (x + n) * 4, row + x * 4, 4); n++)
+                    ;
+                if (n > 1)
+                {
+                    *p++ = 0x80 | (n - 1);
+                    memcpy(p, row + x * 4, bytes);
+                    p += bytes;
+                    continue;
+                }
+                for (; n < 128 && x + n + 1 < width && memcmp(row + (x + n) * 4, row + (x + n + 1) * 4, 4); n++)
+                    ;
+                *p++ = n - 1;
+            }
+            for (i = 0; i < n; i++, p += bytes)
+                memcpy(p, row + (x + i) * 4, bytes);
+        }
+    }
 
-    w = pcx.xmax - pcx.xmin + 1;
-    h = pcx.ymax - pcx.ymin + 1;
+    free(row);
+    *size = p - file;
+    return file;
+}
 
-    data = Hunk_Alloc((w * h + 1) * 4); //+1 to allow reading padding byte on last line
+/*
+============
+Image_BenchPCX
+============
+*/
+static uint8_t* Image_BenchPCX(int width, int height, int* size)
+{
+    uint8_t *file, *p;
+    int linebytes, x, y, c, n;
 
-    //load palette
-    fseek(f, start + com_filesize - 768, SEEK_SET);
-    fread(palette, 1, 768, f);
+    linebytes = (width + 1) & ~1;
+    file = malloc(PCXHEADERSIZE + linebytes * height * 2 + 769);
+    if (!file)
+        return NULL;
 
-    //back to start of image data
-    fseek(f, start + sizeof(pcx), SEEK_SET);
+    memset(file, 0, PCXHEADERSIZE);
+    file[0] = 0x0A;
+    file[1] = 5;
+    file[2] = 1;
+    file[3] = 8;
+    file[8] = (width - 1) & 255;
+    file[9] = (width - 1) >> 8;
+    file[10] = (height - 1) & 255;
+    file[11] = (height - 1) >> 8;
+    file[65] = 1;
+    file[66] = linebytes & 255;
+    file[67] = linebytes >> 8;
 
-    for (y = 0; y < h; y++)
+    p = file + PCXHEADERSIZE;
+    for (y = 0; y < height; y++)
     {
-        p = data + y * w * 4;
+        for (x = 0; x < linebytes; x += n)
+        {
+            c = x < width ? Image_BenchPixel(x, y, width) : 0;
+            for (n = 1; n < 63 && x + n < width && Image_BenchPixel(x + n, y, width) == c; n++)
+                ;
+            if (n > 1 || c >= 0xC0)
+                *p++ = 0xC0 | n;
+            *p++ = c;
+        }
+    }
+
+    *p++ = 0x0C;
+    for (c = 0; c < 256; c++, p += 3)
+    {
+        p[0] = c;
+        p[1] = c * 3;
+        p[2] = c * 5;
+    }
+
+    *size = p - file;
+    return file;
+}
+
+/*
+============
+Image_BenchCheck -- the decoded image against the pixels it was made from
+============
+*/
+static bool Image_BenchCheck(const uint8_t* data, int size, bool alpha)
+{
+    int x, y, c;
 
-        for (x = 0; x < (pcx.bytes_per_line);) //read the extra padding byte if necessary
+    for (y = 0; y < size; y++)
+        for (x = 0; x < size; x++, data += 4)
         {
-            readbyte = fgetc(f);
+            c = Image_BenchPixel(x, y, size);
+            if (data[0] != c || data[1] != ((c * 3) & 255) || data[2] != ((c * 5) & 255) || data[3] != (alpha ? 255 - c : 255))
+                return false;
+        }
 
-            if (readbyte >= 0xC0)
+    return true;
+}
+
+/*
+============
+Image_BenchTask -- Tasks_ParallelFor callback, decodes one of the six faces of a skybox
+============
+*/
+static void Image_BenchTask(int index, int thread, void* data)
+{
+    benchimage_t* bi = &benchimages[2];
+
+    Image_Decode(bi->file, bi->filesize, bi->format, ((uint8_t**)data)[index]);
+}
+
+/*
+============
+Image_Bench_f -- decode throughput of large synthetic images in memory, one at a time
+and six at once on the worker threads the way a skybox loads
+
+imagebench [size] [passes]
+============
+*/
+void Image_Bench_f(void)
+{
+    benchimage_t* bi;
+    uint8_t* faces[6];
+    int i, j, size, passes, width, height;
+    double start, time, mb;
+    bool ok;
+
+    size = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 2048;
+    passes = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 5;
+    if (size < 16 || size > 8192 || passes < 1)
+    {
+        Con_Printf("usage: imagebench [size] [passes]\n");
+        return;
+    }
+
+    ok = true;
+    for (i = 0, bi = benchimages; i < NUMBENCHIMAGES; i++, bi++)
+    {
+        if (bi->format == IMAGE_PCX)
+            bi->file = Image_BenchPCX(size, size, &bi->filesize);
+        else
+            bi->file = Image_BenchTGA(size, size, (i & 1) ? 32 : 24, i >= 2, &bi->filesize);
+        bi->out = malloc(size * size * 4);
+        ok &= bi->file && bi->out;
+    }
+    memset(faces, 0, sizeof(faces));
+    for (i = 0; i < 6; i++)
+        ok &= (faces[i] = malloc(size * size * 4)) != NULL;
+
+    if (!ok)
+        Con_Printf("imagebench: out of memory\n");
+    else
+    {
+        mb = size * size * 4 / (1024.0 * 1024.0);
+        Con_Printf("imagebench: %ix%i, %.1f MB decoded per image\n", size, size, mb);
+
+        for (i = 0, bi = benchimages; i < NUMBENCHIMAGES; i++, bi++)
+        {
+            // the synthetic files go through the same checks as real ones
+            if (!Image_Info(bi->file, bi->filesize, bi->format, &width, &height) || width != size || height != size)
             {
-                runlength = readbyte & 0x3F;
-                readbyte = fgetc(f);
+                Con_Printf("%-15s bad header\n", bi->name);
+                continue;
             }
+
+            ok = true;
+            start = Sys_FloatTime();
+            for (j = 0; j < passes; j++)
+                ok &= Image_Decode(bi->file, bi->filesize, bi->format, bi->out);
+            time = (Sys_FloatTime() - start) / passes;
+
+            if (!ok)
+                Con_Printf("%-15s decode failed\n", bi->name);
+            else if (!Image_BenchCheck(bi->out, size, bi->format == IMAGE_TGA && (i & 1)))
+                Con_Printf("%-15s wrong pixels\n", bi->name);
             else
-                runlength = 1;
+                Con_Printf("%-15s %7.1f KB file, %7.2f ms, %7.1f MB/s\n", bi->name, bi->filesize / 1024.0,
+                    time * 1000.0, mb / time);
+        }
+
+        // a skybox of the rle tga, decoded in turn then in parallel
+        bi = &benchimages[2];
+        start = Sys_FloatTime();
+        for (j = 0; j < passes; j++)
+            for (i = 0; i < 6; i++)
+                Image_Decode(bi->file, bi->filesize, bi->format, faces[i]);
+        time = (Sys_FloatTime() - start) / passes;
+        Con_Printf("skybox, 1 thread:   %7.2f ms\n", time * 1000.0);
+
+        start = Sys_FloatTime();
+        for (j = 0; j < passes; j++)
+            Tasks_ParallelFor(6, Image_BenchTask, faces);
+        time = (Sys_FloatTime() - start) / passes;
+        Con_Printf("skybox, %2i threads: %7.2f ms\n", task_numthreads, time * 1000.0);
+    }
 
-            while (runlength--)
+    for (i = 0, bi = benchimages; i < NUMBENCHIMAGES; i++, bi++)
+    {
+        free(bi->file);
+        free(bi->out);
+        bi->file = bi->out = NULL;
+    }
+    for (i = 0; i < 6; i++)
+        free(faces[i]);
+}
+
+/*
+================================================================================
+
+	BLOCK COMPRESSION
+
+BC1 (DXT1) for opaque images and BC3 (DXT5) for images with alpha. each 4x4 block of pixels
+becomes two 565 endpoint colors and a 2 bit index per pixel choosing among them and two
+colors in between, plus for BC3 two alpha endpoints and a 3 bit index per pixel. blocks
+hanging over the edge of an image repeat its last row and column.
+
+the encoder fits the endpoints to the principal axis of the block's colors, then refines them
+once by least squares over the chosen indices. no gl calls, so it runs on the workers
+================================================================================
+*/
+
+/*
+============
+Image_BCSize -- bytes of a compressed width x height image
+============
+*/
+int Image_BCSize(int width, int height, bool alpha)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * (alpha ? 16 : 8);
+}
+
+/*
+============
+Image_Pack565
+============
+*/
+static int Image_Pack565(const float* c)
+{
+    int r, g, b;
+
+    r = (int)(c[0] * 31.0f / 255.0f + 0.5f);
+    g = (int)(c[1] * 63.0f / 255.0f + 0.5f);
+    b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+    r = r < 0 ? 0 : r > 31 ? 31 : r;
+    g = g < 0 ? 0 : g > 63 ? 63 : g;
+    b = b < 0 ? 0 : b > 31 ? 31 : b;
+    return (r << 11) | (g << 5) | b;
+}
+
+/*
+============
+Image_Unpack565
+============
+*/
+static void Image_Unpack565(int c, int* out)
+{
+    out[0] = ((c >> 11) & 31) * 255 / 31;
+    out[1] = ((c >> 5) & 63) * 255 / 63;
+    out[2] = (c & 31) * 255 / 31;
+}
+
+/*
+============
+Image_BCPalette -- the four colors a pair of endpoints gives in four color mode
+============
+*/
+static void Image_BCPalette(int c0, int c1, int palette[4][3])
+{
+    int i;
+
+    Image_Unpack565(c0, palette[0]);
+    Image_Unpack565(c1, palette[1]);
+    for (i = 0; i < 3; i++)
+    {
+        palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+        palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+    }
+}
+
+/*
+============
+Image_BCIndices -- picks the nearest of the four colors for each pixel. returns the squared error
+============
+*/
+static int Image_BCIndices(const uint8_t block[16][4], int c0, int c1, unsigned* indices)
+{
+    int palette[4][3], i, j, d, dr, dg, db, best, besterror, error;
+
+    Image_BCPalette(c0, c1, palette);
+    *indices = 0;
+    error = 0;
+    for (i = 0; i < 16; i++)
+    {
+        best = 0;
+        besterror = 0x7fffffff;
+        for (j = 0; j < 4; j++)
+        {
+            dr = block[i][0] - palette[j][0];
+            dg = block[i][1] - palette[j][1];
+            db = block[i][2] - palette[j][2];
+            d = dr * dr + dg * dg + db * db;
+            if (d < besterror)
             {
-                p[0] = palette[readbyte * 3];
-                p[1] = palette[readbyte * 3 + 1];
-                p[2] = palette[readbyte * 3 + 2];
-                p[3] = 255;
-                p += 4;
-                x++;
+                besterror = d;
+                best = j;
             }
         }
+        *indices |= (unsigned)best << (i * 2);
+        error += besterror;
     }
+    return error;
+}
 
-    fclose(f);
+/*
+============
+Image_BCColorBlock -- encodes the colors of a block into 8 bytes, always in four color mode
+============
+*/
+static void Image_BCColorBlock(const uint8_t block[16][4], uint8_t* out)
+{
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float mean[3], cov[6], axis[3], v[3], e0[3], e1[3], d, lo, hi, len;
+    float aa, bb, ab, ax[3], bx[3], det, w;
+    int i, j, iter, c0, c1, r0, r1, error, refined;
+    unsigned indices, refinedindices;
 
-    *width = w;
-    *height = h;
-    return data;
+    // principal axis of the colors
+    mean[0] = mean[1] = mean[2] = 0;
+    for (i = 0; i < 16; i++)
+        for (j = 0; j < 3; j++)
+            mean[j] += block[i][j];
+    for (j = 0; j < 3; j++)
+        mean[j] /= 16.0f;
+
+    memset(cov, 0, sizeof(cov));
+    for (i = 0; i < 16; i++)
+    {
+        for (j = 0; j < 3; j++)
+            v[j] = block[i][j] - mean[j];
+        cov[0] += v[0] * v[0];
+        cov[1] += v[0] * v[1];
+        cov[2] += v[0] * v[2];
+        cov[3] += v[1] * v[1];
+        cov[4] += v[1] * v[2];
+        cov[5] += v[2] * v[2];
+    }
+
+    axis[0] = axis[1] = axis[2] = 1.0f;
+    for (iter = 0; iter < 4; iter++)
+    {
+        v[0] = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        v[1] = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        v[2] = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        len = fabsf(v[0]) > fabsf(v[1]) ? fabsf(v[0]) : fabsf(v[1]);
+        len = len > fabsf(v[2]) ? len : fabsf(v[2]);
+        if (len < 1e-4f)
+            break; // a flat block, any axis will do
+        for (j = 0; j < 3; j++)
+            axis[j] = v[j] / len;
+    }
+
+    // the extremes along it are the endpoints
+    lo = hi = 0;
+    for (i = 0; i < 16; i++)
+    {
+        d = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+        if (i == 0 || d < lo)
+        {
+            lo = d;
+            for (j = 0; j < 3; j++)
+                e1[j] = block[i][j];
+        }
+        if (i == 0 || d > hi)
+        {
+            hi = d;
+            for (j = 0; j < 3; j++)
+                e0[j] = block[i][j];
+        }
+    }
+    c0 = Image_Pack565(e0);
+    c1 = Image_Pack565(e1);
+    error = Image_BCIndices(block, c0, c1, &indices);
+
+    // least squares endpoints for those indices, kept if they do better
+    aa = bb = ab = 0;
+    ax[0] = ax[1] = ax[2] = bx[0] = bx[1] = bx[2] = 0;
+    for (i = 0; i < 16; i++)
+    {
+        w = weights[(indices >> (i * 2)) & 3];
+        aa += w * w;
+        bb += (1.0f - w) * (1.0f - w);
+        ab += w * (1.0f - w);
+        for (j = 0; j < 3; j++)
+        {
+            ax[j] += w * block[i][j];
+            bx[j] += (1.0f - w) * block[i][j];
+        }
+    }
+    det = aa * bb - ab * ab;
+    if (fabsf(det) > 1e-4f)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            e0[j] = (ax[j] * bb - bx[j] * ab) / det;
+            e1[j] = (bx[j] * aa - ax[j] * ab) / det;
+        }
+        r0 = Image_Pack565(e0);
+        r1 = Image_Pack565(e1);
+        refined = Image_BCIndices(block, r0, r1, &refinedindices);
+        if (refined < error)
+        {
+            c0 = r0;
+            c1 = r1;
+            indices = refinedindices;
+        }
+    }
+
+    // four color mode needs c0 > c1: swapping the endpoints swaps indices 0/1 and 2/3
+    if (c0 < c1)
+    {
+        i = c0;
+        c0 = c1;
+        c1 = i;
+        indices ^= 0x55555555;
+    }
+    else if (c0 == c1)
+        indices = 0;
+
+    out[0] = c0 & 255;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 255;
+    out[3] = c1 >> 8;
+    out[4] = indices & 255;
+    out[5] = (indices >> 8) & 255;
+    out[6] = (indices >> 16) & 255;
+    out[7] = indices >> 24;
+}
+
+/*
+============
+Image_BCAlphaBlock -- encodes the alpha of a block into 8 bytes, eight value mode between the
+lowest and highest alpha, so all-or-nothing alpha comes through exactly
+============
+*/
+static void Image_BCAlphaBlock(const uint8_t block[16][4], uint8_t* out)
+{
+    int i, a0, a1, t;
+    uint64_t indices;
+
+    a0 = a1 = block[0][3];
+    for (i = 1; i < 16; i++)
+    {
+        if (block[i][3] > a0)
+            a0 = block[i][3];
+        if (block[i][3] < a1)
+            a1 = block[i][3];
+    }
+
+    indices = 0;
+    if (a0 > a1)
+        for (i = 0; i < 16; i++)
+        {
+            // steps from a0 to a1, index 0 is a0, 1 is a1 and 2-7 the steps between
+            t = ((a0 - block[i][3]) * 7 + (a0 - a1) / 2) / (a0 - a1);
+            t = t == 0 ? 0 : t == 7 ? 1 : t + 1;
+            indices |= (uint64_t)t << (i * 3);
+        }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (i * 8)) & 255;
+}
+
+/*
+============
+Image_CompressBC -- width x height RGBA pixels to BC1, or BC3 with alpha
+============
+*/
+void Image_CompressBC(const uint8_t* data, int width, int height, bool alpha, uint8_t* out)
+{
+    uint8_t block[16][4];
+    int bx, by, x, y, sx, sy;
+
+    for (by = 0; by < height; by += 4)
+        for (bx = 0; bx < width; bx += 4)
+        {
+            for (y = 0; y < 4; y++)
+            {
+                sy = by + y < height ? by + y : height - 1;
+                for (x = 0; x < 4; x++)
+                {
+                    sx = bx + x < width ? bx + x : width - 1;
+                    memcpy(block[y * 4 + x], data + (sy * width + sx) * 4, 4);
+                }
+            }
+
+            if (alpha)
+            {
+                Image_BCAlphaBlock(block, out);
+                out += 8;
+            }
+            Image_BCColorBlock(block, out);
+            out += 8;
+        }
+}
+
+/*
+============
+Image_DecompressBC -- the other way, for checking the encoder without a gpu
+============
+*/
+void Image_DecompressBC(const uint8_t* in, int width, int height, bool alpha, uint8_t* data)
+{
+    int palette[4][3], alphas[8], bx, by, x, y, i, c0, c1, a0, a1;
+    unsigned indices;
+    uint64_t alphaindices;
+    uint8_t* p;
+
+    for (by = 0; by < height; by += 4)
+        for (bx = 0; bx < width; bx += 4)
+        {
+            alphaindices = 0;
+            alphas[0] = 255;
+            if (alpha)
+            {
+                a0 = alphas[0] = in[0];
+                a1 = alphas[1] = in[1];
+                if (a0 > a1)
+                    for (i = 1; i < 7; i++)
+                        alphas[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+                else
+                {
+                    for (i = 1; i < 5; i++)
+                        alphas[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+                    alphas[6] = 0;
+                    alphas[7] = 255;
+                }
+                for (i = 0; i < 6; i++)
+                    alphaindices |= (uint64_t)in[2 + i] << (i * 8);
+                in += 8;
+            }
+
+            c0 = in[0] | (in[1] << 8);
+            c1 = in[2] | (in[3] << 8);
+            indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned)in[7] << 24);
+            Image_BCPalette(c0, c1, palette);
+            in += 8;
+
+            for (y = 0; y < 4 && by + y < height; y++)
+                for (x = 0; x < 4 && bx + x < width; x++)
+                {
+                    i = y * 4 + x;
+                    p = data + ((by + y) * width + bx + x) * 4;
+                    p[0] = palette[(indices >> (i * 2)) & 3][0];
+                    p[1] = palette[(indices >> (i * 2)) & 3][1];
+                    p[2] = palette[(indices >> (i * 2)) & 3][2];
+                    p[3] = alphas[(alphaindices >> (i * 3)) & 7];
+                }
+        }
+}
+
+/*
+================================================================================
+
+	IMAGE ENCODING
+
+these build the whole file in memory and touch nothing else, so the capture thread
+can call them. data is RGB (bpp 24) or RGBA (bpp 32), and as with Image_WriteTGA,
+upsidedown means the rows run top to bottom, otherwise bottom to top as gl reads them
+================================================================================
+*/
+
+/*
+============
+Image_EncodeTGA -- returns a malloc'd file of *size bytes, or NULL
+============
+*/
+uint8_t* Image_EncodeTGA(const uint8_t* data, int width, int height, int bpp, bool upsidedown, int* size)
+{
+    uint8_t *out, *dst;
+    int i, bytes;
+
+    bytes = bpp / 8;
+    *size = TARGAHEADERSIZE + width * height * bytes;
+    out = malloc(*size);
+    if (!out)
+        return NULL;
+
+    memset(out, 0, TARGAHEADERSIZE);
+    out[2] = 2; // uncompressed type
+    out[12] = width & 255;
+    out[13] = width >> 8;
+    out[14] = height & 255;
+    out[15] = height >> 8;
+    out[16] = bpp; // pixel size
+    if (upsidedown)
+        out[17] = 0x20; //upside-down attribute
+
+    // swap red and blue bytes
+    dst = out + TARGAHEADERSIZE;
+    for (i = 0; i < width * height; i++, data += bytes, dst += bytes)
+    {
+        dst[0] = data[2];
+        dst[1] = data[1];
+        dst[2] = data[0];
+        if (bytes == 4)
+            dst[3] = data[3];
+    }
+
+    return out;
+}
+
+/*
+============
+Image_PNGChunk -- appends a chunk around the length bytes already at out + 8
+============
+*/
+static uint8_t* Image_PNGChunk(uint8_t* out, const char* type, int length, const unsigned* crctable)
+{
+    unsigned crc;
+    int i;
+
+    out[0] = length >> 24;
+    out[1] = (length >> 16) & 255;
+    out[2] = (length >> 8) & 255;
+    out[3] = length & 255;
+    memcpy(out + 4, type, 4);
+
+    crc = 0xffffffff;
+    for (i = 4; i < length + 8; i++)
+        crc = crctable[(crc ^ out[i]) & 255] ^ (crc >> 8);
+    crc ^= 0xffffffff;
+
+    out += length + 8;
+    out[0] = crc >> 24;
+    out[1] = (crc >> 16) & 255;
+    out[2] = (crc >> 8) & 255;
+    out[3] = crc & 255;
+    return out + 4;
+}
+
+/*
+============
+Image_PNGFilterRow -- filters a row each of the five ways and keeps the one with the
+smallest sum of absolute differences, the usual guess at what deflates best
+============
+*/
+static void Image_PNGFilterRow(const uint8_t* row, const uint8_t* above, int length, int bytes, uint8_t* out, uint8_t* scratch)
+{
+    int filter, i, a, b, c, p, pa, pb, pc, sum, bestsum;
+    uint8_t* dst;
+
+    bestsum = -1;
+    for (filter = 0; filter < 5; filter++)
+    {
+        dst = filter ? scratch : out + 1;
+        for (i = 0, sum = 0; i < length; i++)
+        {
+            a = i >= bytes ? row[i - bytes] : 0;
+            b = above ? above[i] : 0;
+            c = i >= bytes && above ? above[i - bytes] : 0;
+            switch (filter)
+            {
+            case 0:
+                p = row[i];
+                break;
+            case 1:
+                p = row[i] - a;
+                break;
+            case 2:
+                p = row[i] - b;
+                break;
+            case 3:
+                p = row[i] - ((a + b) >> 1);
+                break;
+            default:
+                pa = abs(b - c);
+                pb = abs(a - c);
+                pc = abs(a + b - c - c);
+                p = row[i] - ((pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c);
+                break;
+            }
+            dst[i] = p;
+            sum += (signed char)dst[i] < 0 ? -(signed char)dst[i] : dst[i];
+        }
+
+        if (bestsum < 0 || sum < bestsum)
+        {
+            bestsum = sum;
+            out[0] = filter;
+            if (filter)
+                memcpy(out + 1, scratch, length);
+        }
+    }
+}
+
+/*
+============
+Image_EncodePNG -- returns a malloc'd file of *size bytes, or NULL
+============
+*/
+uint8_t* Image_EncodePNG(const uint8_t* data, int width, int height, int bpp, bool upsidedown, int* size)
+{
+    static const uint8_t signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+    unsigned crctable[256], c;
+    uint8_t *filtered, *scratch, *out, *p;
+    const uint8_t *row, *above;
+    int bytes, length, y, i, k, bound, zsize;
+
+    bytes = bpp / 8;
+    length = width * bytes;
+
+    filtered = malloc((length + 1) * height);
+    scratch = malloc(length);
+    bound = Deflate_Bound((length + 1) * height);
+    out = malloc(8 + 25 + 12 + bound + 12);
+    if (!filtered || !scratch || !out)
+    {
+        free(filtered);
+        free(scratch);
+        free(out);
+        return NULL;
+    }
+
+    for (y = 0, above = NULL; y < height; y++, above = row)
+    {
+        row = data + (upsidedown ? y : height - 1 - y) * length;
+        Image_PNGFilterRow(row, above, length, bytes, filtered + y * (length + 1), scratch);
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        for (c = i, k = 0; k < 8; k++)
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crctable[i] = c;
+    }
+
+    memcpy(out, signature, 8);
+    p = out + 8;
+
+    p[8] = width >> 24;
+    p[9] = (width >> 16) & 255;
+    p[10] = (width >> 8) & 255;
+    p[11] = width & 255;
+    p[12] = height >> 24;
+    p[13] = (height >> 16) & 255;
+    p[14] = (height >> 8) & 255;
+    p[15] = height & 255;
+    p[16] = 8; // bits per channel
+    p[17] = bytes == 4 ? 6 : 2; // RGBA or RGB
+    p[18] = p[19] = p[20] = 0; // deflate, adaptive filtering, not interlaced
+    p = Image_PNGChunk(p, "IHDR", 13, crctable);
+
+    zsize = Deflate_Compress(filtered, (length + 1) * height, p + 8, bound);
+    free(filtered);
+    free(scratch);
+    if (zsize < 0)
+    {
+        free(out);
+        return NULL;
+    }
+    p = Image_PNGChunk(p, "IDAT", zsize, crctable);
+    p = Image_PNGChunk(p, "IEND", 0, crctable);
+
+    *size = p - out;
+    return out;
 }
@@ -22,9 +22,37 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 //image.h -- image reading / writing
 
-//be sure to free the hunk after using these loading functions
-uint8_t* Image_LoadTGA(FILE* f, int* width, int* height);
-uint8_t* Image_LoadPCX(FILE* f, int* width, int* height);
+typedef enum
+{
+    IMAGE_TGA,
+    IMAGE_PCX
+} imageformat_t;
+
+//be sure to free the hunk after using this loading function
 uint8_t* Image_LoadImage(char* name, int* width, int* height);
 
+// name.tga or name.pcx read whole, free it when done
+uint8_t* Image_LoadFile(const char* name, imageformat_t* format, int* filesize);
+
+// decoders for whole files in memory. Info checks the header and gives the size, Decode
+// writes width * height RGBA pixels, top row first, to out and returns false if the file
+// is bad or ends early. they keep no state and allocate nothing, so they can run on any thread
+bool Image_Info(const uint8_t* file, int filesize, imageformat_t format, int* width, int* height);
+bool Image_Decode(const uint8_t* file, int filesize, imageformat_t format, uint8_t* out);
+bool Image_TGAInfo(const uint8_t* file, int filesize, int* width, int* height);
+bool Image_DecodeTGA(const uint8_t* file, int filesize, uint8_t* out);
+bool Image_PCXInfo(const uint8_t* file, int filesize, int* width, int* height);
+bool Image_DecodePCX(const uint8_t* file, int filesize, uint8_t* out);
+
+void Image_Bench_f(void);
+
 bool Image_WriteTGA(char* name, uint8_t* data, int width, int height, int bpp, bool upsidedown);
+
+// whole files in memory, malloc'd, for writing off the main thread
+uint8_t* Image_EncodeTGA(const uint8_t* data, int width, int height, int bpp, bool upsidedown, int* size);
+uint8_t* Image_EncodePNG(const uint8_t* data, int width, int height, int bpp, bool upsidedown, int* size);
+
+// block compression, BC1 or with alpha BC3
+int Image_BCSize(int width, int height, bool alpha);
+void Image_CompressBC(const uint8_t* data, int width, int height, bool alpha, uint8_t* out);
+void Image_DecompressBC(const uint8_t* in, int width, int height, bool alpha, uint8_t* data);
@@ -137,6 +137,7 @@ typedef struct qsocket_s
     unsigned int sendSequence;
     unsigned int unreliableSendSequence;
     int sendMessageLength;
+    int sendMessageOffset; // start of the unacknowledged part of sendMessage
     uint8_t sendMessage[NET_MAXMESSAGE];
 
     unsigned int receiveSequence;
@@ -149,6 +150,16 @@ typedef struct qsocket_s
 
 } qsocket_t;
 
+// one piece of an outgoing datagram; the lan driver gathers these at send
+// time so the pieces never have to be copied into a contiguous packet
+typedef struct
+{
+    uint8_t* data;
+    int len;
+} qiovec_t;
+
+#define NET_MAXIOVECS 8
+
 extern qsocket_t* net_activeSockets;
 extern qsocket_t* net_freeSockets;
 extern int net_numsockets;
@@ -167,6 +178,7 @@ typedef struct
     int (*CheckNewConnections)(void);
     int (*Read)(int socket, uint8_t* buf, int len, struct qsockaddr* addr);
     int (*Write)(int socket, uint8_t* buf, int len, struct qsockaddr* addr);
+    int (*WriteV)(int socket, qiovec_t* iov, int iovcnt, struct qsockaddr* addr);
     int (*Broadcast)(int socket, uint8_t* buf, int len);
     char* (*AddrToString)(struct qsockaddr* addr);
     int (*StringToAddr)(char* string, struct qsockaddr* addr);
@@ -193,7 +205,7 @@ typedef struct
     qsocket_t* (*CheckNewConnections)(void);
     int (*QGetMessage)(qsocket_t* sock);
     int (*QSendMessage)(qsocket_t* sock, sizebuf_t* data);
-    int (*SendUnreliableMessage)(qsocket_t* sock, sizebuf_t* data);
+    int (*SendUnreliableMessage)(qsocket_t* sock, sizebuf_t** data, int count);
     bool (*CanSendMessage)(qsocket_t* sock);
     bool (*CanSendUnreliableMessage)(qsocket_t* sock);
     void (*Close)(qsocket_t* sock);
@@ -217,6 +229,8 @@ extern int messagesReceived;
 extern int unreliableMessagesSent;
 extern int unreliableMessagesReceived;
 
+extern int net_copybytes; // running total of bytes memcpy'd on the send path
+
 qsocket_t* NET_NewQSocket(void);
 void NET_FreeQSocket(qsocket_t*);
 double SetNetTime(void);
@@ -285,6 +299,10 @@ int NET_GetMessage(struct qsocket_s* sock);
 
 int NET_SendMessage(struct qsocket_s* sock, sizebuf_t* data);
 int NET_SendUnreliableMessage(struct qsocket_s* sock, sizebuf_t* data);
+int NET_SendUnreliableMessageV(struct qsocket_s* sock, sizebuf_t** data, int count);
+// the V form sends the buffers back to back as a single datagram without
+//		first copying them together, so shared buffers such as sv.datagram
+//		can be referenced by every client
 // returns 0 if the message connot be delivered reliably, but the connection
 //		is still considered valid
 // returns 1 if the message was sent properly
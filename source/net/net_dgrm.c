@@ -161,12 +161,65 @@ void NET_Ban_f(void)
 }
 #endif
 
-int Datagram_SendMessage(qsocket_t* sock, sizebuf_t* data)
+/*
+==================
+Datagram_WritePacket
+
+Sends a packet whose payload is iov[1..iovcnt-1].  iov[0] is reserved by the
+caller as headroom for the packet header, so the payload is handed to the
+lan driver as is instead of being copied into packetBuffer.
+==================
+*/
+static int Datagram_WritePacket(qsocket_t* sock, unsigned int flags, unsigned int sequence, qiovec_t* iov, int iovcnt)
 {
+    static unsigned int header[2];
     unsigned int packetLen;
-    unsigned int dataLen;
+    int i;
+
+    packetLen = NET_HEADERSIZE;
+    for (i = 1; i < iovcnt; i++)
+        packetLen += iov[i].len;
+
+    header[0] = BigLong(packetLen | flags);
+    header[1] = BigLong(sequence);
+    iov[0].data = (uint8_t*)header;
+    iov[0].len = NET_HEADERSIZE;
+
+    return sfunc.WriteV(sock->socket, iov, iovcnt, &sock->addr);
+}
+
+/*
+==================
+Datagram_SendFragment
+
+Sends the next MAX_DATAGRAM sized piece of the reliable message, straight
+out of sock->sendMessage
+==================
+*/
+static int Datagram_SendFragment(qsocket_t* sock, unsigned int sequence)
+{
+    qiovec_t iov[2];
     unsigned int eom;
 
+    if (sock->sendMessageLength <= MAX_DATAGRAM)
+    {
+        iov[1].len = sock->sendMessageLength;
+        eom = NETFLAG_EOM;
+    }
+    else
+    {
+        iov[1].len = MAX_DATAGRAM;
+        eom = 0;
+    }
+    iov[1].data = sock->sendMessage + sock->sendMessageOffset;
+
+    sock->sendNext = false;
+
+    return Datagram_WritePacket(sock, NETFLAG_DATA | eom, sequence, iov, 2);
+}
+
+int Datagram_SendMessage(qsocket_t* sock, sizebuf_t* data)
+{
 #ifdef DEBUG
     if (data->cursize == 0)
         Sys_Error("Datagram_SendMessage: zero length message\n");
@@ -178,28 +231,15 @@ int Datagram_SendMessage(qsocket_t* sock, sizebuf_t* data)
         Sys_Error("SendMessage: called with canSend == false\n");
 #endif
 
+    // the caller reuses its buffer, so keep a copy around for resends
     Q_memcpy(sock->sendMessage, data->data, data->cursize);
     sock->sendMessageLength = data->cursize;
-
-    if (data->cursize <= MAX_DATAGRAM)
-    {
-        dataLen = data->cursize;
-        eom = NETFLAG_EOM;
-    }
-    else
-    {
-        dataLen = MAX_DATAGRAM;
-        eom = 0;
-    }
-    packetLen = NET_HEADERSIZE + dataLen;
-
-    packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
-    packetBuffer.sequence = BigLong(sock->sendSequence++);
-    Q_memcpy(packetBuffer.data, sock->sendMessage, dataLen);
+    sock->sendMessageOffset = 0;
+    net_copybytes += data->cursize;
 
     sock->canSend = false;
 
-    if (sfunc.Write(sock->socket, (uint8_t*)&packetBuffer, packetLen, &sock->addr) == -1)
+    if (Datagram_SendFragment(sock, sock->sendSequence++) == -1)
         return -1;
 
     sock->lastSendTime = net_time;
@@ -209,29 +249,7 @@ int Datagram_SendMessage(qsocket_t* sock, sizebuf_t* data)
 
 int SendMessageNext(qsocket_t* sock)
 {
-    unsigned int packetLen;
-    unsigned int dataLen;
-    unsigned int eom;
-
-    if (sock->sendMessageLength <= MAX_DATAGRAM)
-    {
-        dataLen = sock->sendMessageLength;
-        eom = NETFLAG_EOM;
-    }
-    else
-    {
-        dataLen = MAX_DATAGRAM;
-        eom = 0;
-    }
-    packetLen = NET_HEADERSIZE + dataLen;
-
-    packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
-    packetBuffer.sequence = BigLong(sock->sendSequence++);
-    Q_memcpy(packetBuffer.data, sock->sendMessage, dataLen);
-
-    sock->sendNext = false;
-
-    if (sfunc.Write(sock->socket, (uint8_t*)&packetBuffer, packetLen, &sock->addr) == -1)
+    if (Datagram_SendFragment(sock, sock->sendSequence++) == -1)
         return -1;
 
     sock->lastSendTime = net_time;
@@ -241,29 +259,7 @@ int SendMessageNext(qsocket_t* sock)
 
 int ReSendMessage(qsocket_t* sock)
 {
-    unsigned int packetLen;
-    unsigned int dataLen;
-    unsigned int eom;
-
-    if (sock->sendMessageLength <= MAX_DATAGRAM)
-    {
-        dataLen = sock->sendMessageLength;
-        eom = NETFLAG_EOM;
-    }
-    else
-    {
-        dataLen = MAX_DATAGRAM;
-        eom = 0;
-    }
-    packetLen = NET_HEADERSIZE + dataLen;
-
-    packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
-    packetBuffer.sequence = BigLong(sock->sendSequence - 1);
-    Q_memcpy(packetBuffer.data, sock->sendMessage, dataLen);
-
-    sock->sendNext = false;
-
-    if (sfunc.Write(sock->socket, (uint8_t*)&packetBuffer, packetLen, &sock->addr) == -1)
+    if (Datagram_SendFragment(sock, sock->sendSequence - 1) == -1)
         return -1;
 
     sock->lastSendTime = net_time;
@@ -284,25 +280,39 @@ bool Datagram_CanSendUnreliableMessage(qsocket_t* sock)
     return true;
 }
 
-int Datagram_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data)
+int Datagram_SendUnreliableMessage(qsocket_t* sock, sizebuf_t** data, int count)
 {
-    int packetLen;
+    qiovec_t iov[NET_MAXIOVECS];
+    int i, iovcnt;
 
-#ifdef DEBUG
-    if (data->cursize == 0)
-        Sys_Error("Datagram_SendUnreliableMessage: zero length message\n");
+    if (count > NET_MAXIOVECS - 1)
+        Sys_Error("Datagram_SendUnreliableMessage: too many buffers %i\n", count);
 
-    if (data->cursize > MAX_DATAGRAM)
-        Sys_Error("Datagram_SendUnreliableMessage: message too big %u\n", data->cursize);
-#endif
+    iovcnt = 1; // iov[0] is the header
+    for (i = 0; i < count; i++)
+    {
+        if (!data[i]->cursize)
+            continue;
+        iov[iovcnt].data = data[i]->data;
+        iov[iovcnt].len = data[i]->cursize;
+        iovcnt++;
+    }
 
-    packetLen = NET_HEADERSIZE + data->cursize;
+#ifdef DEBUG
+    {
+        int size = 0;
+        for (i = 1; i < iovcnt; i++)
+            size += iov[i].len;
+
+        if (size == 0)
+            Sys_Error("Datagram_SendUnreliableMessage: zero length message\n");
 
-    packetBuffer.length = BigLong(packetLen | NETFLAG_UNRELIABLE);
-    packetBuffer.sequence = BigLong(sock->unreliableSendSequence++);
-    Q_memcpy(packetBuffer.data, data->data, data->cursize);
+        if (size > MAX_DATAGRAM)
+            Sys_Error("Datagram_SendUnreliableMessage: message too big %u\n", size);
+    }
+#endif
 
-    if (sfunc.Write(sock->socket, (uint8_t*)&packetBuffer, packetLen, &sock->addr) == -1)
+    if (Datagram_WritePacket(sock, NETFLAG_UNRELIABLE, sock->unreliableSendSequence++, iov, iovcnt) == -1)
         return -1;
 
     packetsSent++;
@@ -410,12 +420,13 @@ int Datagram_GetMessage(qsocket_t* sock)
             sock->sendMessageLength -= MAX_DATAGRAM;
             if (sock->sendMessageLength > 0)
             {
-                Q_memcpy(sock->sendMessage, sock->sendMessage + MAX_DATAGRAM, sock->sendMessageLength);
+                sock->sendMessageOffset += MAX_DATAGRAM;
                 sock->sendNext = true;
             }
             else
             {
                 sock->sendMessageLength = 0;
+                sock->sendMessageOffset = 0;
                 sock->canSend = true;
             }
             continue;
@@ -483,6 +494,7 @@ void NET_Stats_f(void)
         Con_Printf("receivedDuplicateCount     = %i\n", receivedDuplicateCount);
         Con_Printf("shortPacketCount           = %i\n", shortPacketCount);
         Con_Printf("droppedDatagrams           = %i\n", droppedDatagrams);
+        Con_Printf("sendBytesCopied            = %i\n", net_copybytes);
     }
     else if (Q_strcmp(Cmd_Argv(1), "*") == 0)
     {
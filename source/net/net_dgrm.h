@@ -29,7 +29,7 @@ qsocket_t* Datagram_Connect(char* host);
 qsocket_t* Datagram_CheckNewConnections(void);
 int Datagram_GetMessage(qsocket_t* sock);
 int Datagram_SendMessage(qsocket_t* sock, sizebuf_t* data);
-int Datagram_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data);
+int Datagram_SendUnreliableMessage(qsocket_t* sock, sizebuf_t** data, int count);
 bool Datagram_CanSendMessage(qsocket_t* sock);
 bool Datagram_CanSendUnreliableMessage(qsocket_t* sock);
 void Datagram_Close(qsocket_t* sock);
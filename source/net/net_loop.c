@@ -172,22 +172,27 @@ int Loop_SendMessage(qsocket_t* sock, sizebuf_t* data)
     // message
     Q_memcpy(buffer, data->data, data->cursize);
     *bufferLength = IntAlign(*bufferLength + data->cursize + 4);
+    net_copybytes += data->cursize;
 
     sock->canSend = false;
     return 1;
 }
 
-int Loop_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data)
+int Loop_SendUnreliableMessage(qsocket_t* sock, sizebuf_t** data, int count)
 {
     uint8_t* buffer;
     int* bufferLength;
+    int i, size;
 
     if (!sock->driverdata)
         return -1;
 
+    for (i = 0, size = 0; i < count; i++)
+        size += data[i]->cursize;
+
     bufferLength = &((qsocket_t*)sock->driverdata)->receiveMessageLength;
 
-    if ((*bufferLength + data->cursize + sizeof(uint8_t) + sizeof(short)) > NET_MAXMESSAGE)
+    if ((*bufferLength + size + sizeof(uint8_t) + sizeof(short)) > NET_MAXMESSAGE)
         return 0;
 
     buffer = ((qsocket_t*)sock->driverdata)->receiveMessage + *bufferLength;
@@ -196,15 +201,20 @@ int Loop_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data)
     *buffer++ = 2;
 
     // length
-    *buffer++ = data->cursize & 0xff;
-    *buffer++ = data->cursize >> 8;
+    *buffer++ = size & 0xff;
+    *buffer++ = size >> 8;
 
     // align
     buffer++;
 
     // message
-    Q_memcpy(buffer, data->data, data->cursize);
-    *bufferLength = IntAlign(*bufferLength + data->cursize + 4);
+    for (i = 0; i < count; i++)
+    {
+        Q_memcpy(buffer, data[i]->data, data[i]->cursize);
+        buffer += data[i]->cursize;
+    }
+    *bufferLength = IntAlign(*bufferLength + size + 4);
+    net_copybytes += size;
     return 1;
 }
 
@@ -29,7 +29,7 @@ qsocket_t* Loop_Connect(char* host);
 qsocket_t* Loop_CheckNewConnections(void);
 int Loop_GetMessage(qsocket_t* sock);
 int Loop_SendMessage(qsocket_t* sock, sizebuf_t* data);
-int Loop_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data);
+int Loop_SendUnreliableMessage(qsocket_t* sock, sizebuf_t** data, int count);
 bool Loop_CanSendMessage(qsocket_t* sock);
 bool Loop_CanSendUnreliableMessage(qsocket_t* sock);
 void Loop_Close(qsocket_t* sock);
@@ -62,6 +62,8 @@ int messagesReceived = 0;
 int unreliableMessagesSent = 0;
 int unreliableMessagesReceived = 0;
 
+int net_copybytes = 0;
+
 cvar_t net_messagetimeout = { "net_messagetimeout", "300" };
 cvar_t hostname = { "hostname", "UNNAMED" };
 
@@ -128,6 +130,7 @@ qsocket_t* NET_NewQSocket(void)
     sock->sendSequence = 0;
     sock->unreliableSendSequence = 0;
     sock->sendMessageLength = 0;
+    sock->sendMessageOffset = 0;
     sock->receiveSequence = 0;
     sock->unreliableReceiveSequence = 0;
     sock->receiveMessageLength = 0;
@@ -557,6 +560,19 @@ int NET_SendMessage(qsocket_t* sock, sizebuf_t* data)
 }
 
 int NET_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data)
+{
+    return NET_SendUnreliableMessageV(sock, &data, 1);
+}
+
+/*
+==================
+NET_SendUnreliableMessageV
+
+Sends several buffers as one unreliable datagram.  The buffers are gathered
+by the driver at send time, so they are not copied here.
+==================
+*/
+int NET_SendUnreliableMessageV(qsocket_t* sock, sizebuf_t** data, int count)
 {
     int r;
 
@@ -570,7 +586,7 @@ int NET_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data)
     }
 
     SetNetTime();
-    r = sfunc.SendUnreliableMessage(sock, data);
+    r = sfunc.SendUnreliableMessage(sock, data, count);
     if (r == 1 && sock->driver)
         unreliableMessagesSent++;
 
@@ -29,7 +29,7 @@ static int NetNull_QSendMessage(qsocket_t* sock, sizebuf_t* data)
     return 0;
 }
 
-static int NetNull_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data)
+static int NetNull_SendUnreliableMessage(qsocket_t* sock, sizebuf_t** data, int count)
 {
     return 0;
 }
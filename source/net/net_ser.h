@@ -29,7 +29,7 @@ qsocket_t* Serial_Connect(char* host);
 qsocket_t* Serial_CheckNewConnections(void);
 int Serial_GetMessage(qsocket_t* sock);
 int Serial_SendMessage(qsocket_t* sock, sizebuf_t* data);
-int Serial_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data);
+int Serial_SendUnreliableMessage(qsocket_t* sock, sizebuf_t** data, int count);
 bool Serial_CanSendMessage(qsocket_t* sock);
 bool Serial_CanSendUnreliableMessage(qsocket_t* sock);
 void Serial_Close(qsocket_t* sock);
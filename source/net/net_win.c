@@ -73,6 +73,7 @@ net_landriver_t net_landrivers[MAX_NET_DRIVERS] = {
         WINS_CheckNewConnections,
         WINS_Read,
         WINS_Write,
+        WINS_WriteV,
         WINS_Broadcast,
         WINS_AddrToString,
         WINS_StringToAddr,
@@ -94,6 +95,7 @@ net_landriver_t net_landrivers[MAX_NET_DRIVERS] = {
         WIPX_CheckNewConnections,
         WIPX_Read,
         WIPX_Write,
+        WIPX_WriteV,
         WIPX_Broadcast,
         WIPX_AddrToString,
         WIPX_StringToAddr,
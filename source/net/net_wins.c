@@ -55,6 +55,18 @@ struct hostent FAR*(PASCAL FAR* pgethostbyaddr)(const char FAR* addr,
 int(PASCAL FAR* pgetsockname)(SOCKET s, struct sockaddr FAR* name,
     int FAR* namelen);
 
+// WSASendTo only exists in winsock 2, so it is looked up separately and
+// WINS_WriteV falls back to gathering into a local buffer without it
+typedef struct
+{
+    u_long len;
+    char FAR* buf;
+} wsabuf_t;
+
+int(PASCAL FAR* pWSASendTo)(SOCKET s, wsabuf_t FAR* buffers, DWORD count,
+    DWORD FAR* sent, DWORD flags, const struct sockaddr FAR* to, int tolen,
+    void FAR* overlapped, void FAR* completion);
+
 #include "net_wins.h"
 
 int winsock_initialized = 0;
@@ -156,6 +168,10 @@ int WINS_Init(void)
         return -1;
     }
 
+    hInst = LoadLibrary("ws2_32.dll");
+    if (hInst != NULL)
+        pWSASendTo = (void*)GetProcAddress(hInst, "WSASendTo");
+
     if (COM_CheckParm("-noudp"))
         return -1;
 
@@ -457,6 +473,48 @@ int WINS_Write(int socket, uint8_t* buf, int len, struct qsockaddr* addr)
 
 //=============================================================================
 
+int WINS_WriteV(int socket, qiovec_t* iov, int iovcnt, struct qsockaddr* addr)
+{
+    wsabuf_t buffers[NET_MAXIOVECS];
+    uint8_t packet[NET_DATAGRAMSIZE];
+    DWORD sent;
+    int i, len;
+
+    if (iovcnt > NET_MAXIOVECS)
+        Sys_Error("WINS_WriteV: too many buffers %i", iovcnt);
+
+    if (pWSASendTo)
+    {
+        for (i = 0; i < iovcnt; i++)
+        {
+            buffers[i].len = iov[i].len;
+            buffers[i].buf = (char*)iov[i].data;
+        }
+
+        if (pWSASendTo(socket, buffers, iovcnt, &sent, 0, (struct sockaddr*)addr, sizeof(struct qsockaddr), NULL, NULL) == SOCKET_ERROR)
+        {
+            if (pWSAGetLastError() == WSAEWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        return sent;
+    }
+
+    // no scatter/gather support, so assemble the packet here
+    for (i = 0, len = 0; i < iovcnt; i++)
+    {
+        if (len + iov[i].len > sizeof(packet))
+            Sys_Error("WINS_WriteV: packet too big");
+        Q_memcpy(packet + len, iov[i].data, iov[i].len);
+        len += iov[i].len;
+    }
+    net_copybytes += len;
+
+    return WINS_Write(socket, packet, len, addr);
+}
+
+//=============================================================================
+
 char* WINS_AddrToString(struct qsockaddr* addr)
 {
     static char buffer[22];
@@ -31,6 +31,7 @@ int WINS_Connect(int socket, struct qsockaddr* addr);
 int WINS_CheckNewConnections(void);
 int WINS_Read(int socket, uint8_t* buf, int len, struct qsockaddr* addr);
 int WINS_Write(int socket, uint8_t* buf, int len, struct qsockaddr* addr);
+int WINS_WriteV(int socket, qiovec_t* iov, int iovcnt, struct qsockaddr* addr);
 int WINS_Broadcast(int socket, uint8_t* buf, int len);
 char* WINS_AddrToString(struct qsockaddr* addr);
 int WINS_StringToAddr(char* string, struct qsockaddr* addr);
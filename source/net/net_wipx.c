@@ -96,6 +96,11 @@ int WIPX_Write(int handle, uint8_t* buf, int len, struct qsockaddr* addr)
     return -1;
 }
 
+int WIPX_WriteV(int handle, qiovec_t* iov, int iovcnt, struct qsockaddr* addr)
+{
+    return -1;
+}
+
 //=============================================================================
 
 char* WIPX_AddrToString(struct qsockaddr* addr)
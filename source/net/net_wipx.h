@@ -31,6 +31,7 @@ int WIPX_Connect(int socket, struct qsockaddr* addr);
 int WIPX_CheckNewConnections(void);
 int WIPX_Read(int socket, byte* buf, int len, struct qsockaddr* addr);
 int WIPX_Write(int socket, byte* buf, int len, struct qsockaddr* addr);
+int WIPX_WriteV(int socket, qiovec_t* iov, int iovcnt, struct qsockaddr* addr);
 int WIPX_Broadcast(int socket, byte* buf, int len);
 char* WIPX_AddrToString(struct qsockaddr* addr);
 int WIPX_StringToAddr(char* string, struct qsockaddr* addr);
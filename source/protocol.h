@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define PROTOCOL_NETQUAKE 15 //johnfitz -- standard quake protocol
 #define PROTOCOL_FITZQUAKE 666 //johnfitz -- added new protocol for fitzquake 0.85
+#define PROTOCOL_BITPACK 667 // PROTOCOL_FITZQUAKE with bit packed, delta coded entity updates (see delta.c)
 
 // if the high bit of the servercmd is set, the low bits are fast update flags:
 #define U_MOREBITS (1 << 0)
@@ -183,13 +184,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define svc_spawnstaticsound2 44 // [coord3] [short] samp [byte] vol [byte] aten
 //johnfitz
 
+// PROTOCOL_BITPACK -- replaces the fast updates
+#define svc_packetentities 50 // [byte] sequence [byte] delta back to reference, 0 for baselines, <bits>
+
 //
 // client to server
 //
 #define clc_bad 0
 #define clc_nop 1
 #define clc_disconnect 2
-#define clc_move 3 // [usercmd_t]
+#define clc_move 3 // [usercmd_t], PROTOCOL_BITPACK adds [short] last svc_packetentities sequence, -1 for none
 #define clc_stringcmd 4 // [string] message
 
 //
@@ -46,6 +46,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <setjmp.h>
 #include <stdbool.h>
 #include <assert.h> //johnfitz
@@ -203,11 +204,14 @@ void VID_UnlockBuffer(void);
 
 #include "common/common.h"
 #include "common/crc.h"
+#include "common/lz.h"
+#include "common/deflate.h"
 
 #include "bspfile.h"
 #include "vid.h"
 #include "sys.h"
 #include "zone.h"
+#include "tasks.h"
 #include "mathlib.h"
 
 typedef struct
@@ -228,6 +232,7 @@ typedef struct
 #include "screen.h"
 #include "net/net.h"
 #include "protocol.h"
+#include "common/delta.h"
 #include "cmd.h"
 #include "sbar.h"
 #include "sound.h"
@@ -238,6 +243,7 @@ typedef struct
 #include "gl_model.h"
 
 #include "image.h" //johnfitz
+#include "capture.h"
 #include "gl_texmgr.h" //johnfitz
 
 #include "input.h"
@@ -23,8 +23,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 extern bool mtexenabled; //johnfitz
 extern cvar_t r_drawflat, gl_overbright_models, gl_fullbrights, r_lerpmodels, r_lerpmove; //johnfitz
+extern cvar_t r_aliasarrays;
 
 //up to 16 color translated skins
 gltexture_t* playertextures[MAX_SCOREBOARD]; //johnfitz -- changed to an array of pointers
@@ -467,16 +473,189 @@ bool overbright; //johnfitz
 
 bool shading = true; //johnfitz -- if false, disable vertex shading for various reasons (fullbright, r_lightmap, showtris, etc)
 
-//johnfitz -- struct for passing lerp information to drawing functions
-typedef struct
+/*
+=============================================================
+
+  ALIAS MODEL VERTEX ARRAYS
+
+=============================================================
+*/
+
+// one lerped and lit vertex, in the stream buffer layout
+typedef struct aliasvert_s
 {
-    short pose1;
-    short pose2;
-    float blend;
-    vec3_t origin;
-    vec3_t angles;
-} lerpdata_t;
-//johnfitz
+    float xyz[4]; // w is scratch, so each half can be written with one 16 byte store
+    float color[4];
+} aliasvert_t;
+
+#define MAX_ALIAS_ORDER 8192 // size of vertexorder in gl_mesh.c
+#define MAX_PREP_ALIASVERTS 32768 // for all the entities of one scene prep
+
+static aliasvert_t aliasverts[MAX_ALIAS_ORDER];
+static aliasvert_t* aliasdrawverts; // the current entity's frame, aliasverts or prepared by R_PrepareAliasModel
+static bool aliasvertsready; // aliasdrawverts is set up, so later passes reuse it
+static bool aliasvertsvbo; // ...and it has been copied into aliasstreamvbo
+static GLuint aliasstreamvbo;
+
+static aliasvert_t aliasprepverts[MAX_PREP_ALIASVERTS];
+static int aliasnumprepverts;
+
+/*
+=============
+R_LerpAliasVerts -- blends both poses and applies the shadedots lighting for every vertex in
+one pass. touches nothing but out, so the scene prep thread can run it
+=============
+*/
+static void R_LerpAliasVerts(aliashdr_t* paliashdr, lerpdata_t* lerpdata, const float* dots, const float* light, float alpha, aliasvert_t* out)
+{
+    trivertx_t *verts1, *verts2;
+    float blend, iblend;
+    int i, count;
+
+    verts1 = (trivertx_t*)((uint8_t*)paliashdr + paliashdr->posedata);
+    verts2 = verts1;
+    verts1 += lerpdata->pose1 * paliashdr->poseverts;
+    verts2 += lerpdata->pose2 * paliashdr->poseverts;
+
+    // a blend of 0 reproduces pose1 exactly when the poses are the same
+    blend = (lerpdata->pose1 != lerpdata->pose2) ? lerpdata->blend : 0;
+    iblend = 1.0f - blend;
+
+    count = paliashdr->poseverts;
+
+#ifdef USE_SSE2
+    {
+        __m128 vblend = _mm_set1_ps(blend);
+        __m128 viblend = _mm_set1_ps(iblend);
+        __m128 vlight = _mm_setr_ps(light[0], light[1], light[2], 0);
+        __m128 valpha = _mm_setr_ps(0, 0, 0, alpha);
+        __m128i zero = _mm_setzero_si128();
+        __m128i p1, p2;
+        __m128 pos, shade;
+        int v;
+
+        for (i = 0; i < count; i++, out++)
+        {
+            // the four trivertx_t bytes widen to four floats, the lightnormalindex lands in w
+            memcpy(&v, &verts1[i], 4);
+            p1 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+            memcpy(&v, &verts2[i], 4);
+            p2 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+            pos = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(p1), viblend), _mm_mul_ps(_mm_cvtepi32_ps(p2), vblend));
+            _mm_storeu_ps(out->xyz, pos);
+
+            shade = _mm_set1_ps(dots[verts1[i].lightnormalindex] * iblend + dots[verts2[i].lightnormalindex] * blend);
+            _mm_storeu_ps(out->color, _mm_add_ps(_mm_mul_ps(shade, vlight), valpha));
+        }
+    }
+#else
+    {
+        float shade;
+
+        for (i = 0; i < count; i++, out++)
+        {
+            out->xyz[0] = verts1[i].v[0] * iblend + verts2[i].v[0] * blend;
+            out->xyz[1] = verts1[i].v[1] * iblend + verts2[i].v[1] * blend;
+            out->xyz[2] = verts1[i].v[2] * iblend + verts2[i].v[2] * blend;
+
+            shade = dots[verts1[i].lightnormalindex] * iblend + dots[verts2[i].lightnormalindex] * blend;
+            out->color[0] = shade * light[0];
+            out->color[1] = shade * light[1];
+            out->color[2] = shade * light[2];
+            out->color[3] = alpha;
+        }
+    }
+#endif
+}
+
+/*
+=============
+GL_LerpAliasFrame -- lerps the current entity into aliasverts, the array that every pass of
+the entity draws from
+=============
+*/
+static void GL_LerpAliasFrame(aliashdr_t* paliashdr, lerpdata_t* lerpdata)
+{
+    R_LerpAliasVerts(paliashdr, lerpdata, shadedots, lightcolor, entalpha, aliasverts);
+    aliasdrawverts = aliasverts;
+    aliasvertsready = true;
+    aliasvertsvbo = false;
+}
+
+/*
+=============
+GL_DrawAliasArrays -- draws the frame in aliasdrawverts with a single indexed call
+=============
+*/
+static void GL_DrawAliasArrays(aliashdr_t* paliashdr)
+{
+    uint8_t *verts, *texcoords, *indexes;
+
+    if (gl_vbo_able && gl_vbo.value && !aliasvertsvbo)
+    {
+        if (!aliasstreamvbo)
+            GL_GenBuffersFunc(1, &aliasstreamvbo);
+        GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, aliasstreamvbo);
+        GL_BufferDataFunc(GL_ARRAY_BUFFER_ARB, paliashdr->poseverts * sizeof(aliasvert_t), aliasdrawverts, GL_STREAM_DRAW_ARB);
+        GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, 0);
+        aliasvertsvbo = true;
+    }
+
+    if (aliasvertsvbo)
+    {
+        GL_UploadAliasMesh(currententity->model, paliashdr);
+        verts = NULL;
+        texcoords = NULL;
+        indexes = NULL;
+        GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, aliasstreamvbo);
+    }
+    else
+    {
+        verts = (uint8_t*)aliasdrawverts;
+        texcoords = (uint8_t*)paliashdr + paliashdr->texcoords;
+        indexes = (uint8_t*)paliashdr + paliashdr->indexes;
+    }
+
+    glVertexPointer(3, GL_FLOAT, sizeof(aliasvert_t), verts);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if (shading)
+    {
+        glColorPointer(4, GL_FLOAT, sizeof(aliasvert_t), verts + offsetof(aliasvert_t, color));
+        glEnableClientState(GL_COLOR_ARRAY);
+    }
+
+    if (aliasvertsvbo)
+        GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, currententity->model->meshvbo);
+    if (mtexenabled)
+    {
+        GL_ClientActiveTextureFunc(TEXTURE1);
+        glTexCoordPointer(2, GL_FLOAT, 0, texcoords);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        GL_ClientActiveTextureFunc(TEXTURE0);
+    }
+    glTexCoordPointer(2, GL_FLOAT, 0, texcoords);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    if (aliasvertsvbo)
+    {
+        GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, 0);
+        GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, currententity->model->meshibo);
+    }
+
+    glDrawElements(GL_TRIANGLES, paliashdr->numindexes, GL_UNSIGNED_SHORT, indexes);
+
+    if (aliasvertsvbo)
+        GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    if (mtexenabled)
+    {
+        GL_ClientActiveTextureFunc(TEXTURE1);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        GL_ClientActiveTextureFunc(TEXTURE0);
+    }
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
 
 /*
 =============
@@ -493,6 +672,16 @@ void GL_DrawAliasFrame(aliashdr_t* paliashdr, lerpdata_t lerpdata)
     float blend, iblend;
     bool lerping;
 
+    // r_drawflat colors each strip, so it keeps the command list
+    if (r_aliasarrays.value && !r_drawflat_cheatsafe && paliashdr->poseverts <= MAX_ALIAS_ORDER && (!mtexenabled || GL_ClientActiveTextureFunc))
+    {
+        if (!aliasvertsready)
+            GL_LerpAliasFrame(paliashdr, &lerpdata);
+        GL_DrawAliasArrays(paliashdr);
+        rs_aliaspasses += paliashdr->numtris;
+        return;
+    }
+
     if (lerpdata.pose1 != lerpdata.pose2)
     {
         lerping = true;
@@ -592,9 +781,8 @@ void GL_DrawAliasFrame(aliashdr_t* paliashdr, lerpdata_t lerpdata)
 R_SetupAliasFrame -- johnfitz -- rewritten to support lerping
 =================
 */
-void R_SetupAliasFrame(aliashdr_t* paliashdr, int frame, lerpdata_t* lerpdata)
+void R_SetupAliasFrame(entity_t* e, aliashdr_t* paliashdr, int frame, lerpdata_t* lerpdata)
 {
-    entity_t* e = currententity;
     int posenum, numposes;
 
     if ((frame >= paliashdr->numframes) || (frame < 0))
@@ -725,96 +913,164 @@ void R_SetupEntityTransform(entity_t* e, lerpdata_t* lerpdata)
 R_SetupAliasLighting -- johnfitz -- broken out from R_DrawAliasModel and rewritten
 =================
 */
-void R_SetupAliasLighting(entity_t* e)
+static void R_SetupAliasLighting(aliasprep_t* prep)
 {
-    vec3_t dist;
+    entity_t* e = prep->entity;
     float add;
-    int i;
 
-    R_LightPoint(e->origin);
-
-    //add dlights
-    for (i = 0; i < MAX_DLIGHTS; i++)
-    {
-        if (cl_dlights[i].die >= cl.time)
-        {
-            VectorSubtract(currententity->origin, cl_dlights[i].origin, dist);
-            add = cl_dlights[i].radius - Length(dist);
-            if (add > 0)
-                VectorMA(lightcolor, add, cl_dlights[i].color, lightcolor);
-        }
-    }
+    R_LightEntity(e->origin, prep->lightcolor); // with dlights
 
     // minimum light value on gun (24)
     if (e == &cl.viewent)
     {
-        add = 72.0f - (lightcolor[0] + lightcolor[1] + lightcolor[2]);
+        add = 72.0f - (prep->lightcolor[0] + prep->lightcolor[1] + prep->lightcolor[2]);
         if (add > 0.0f)
         {
-            lightcolor[0] += add / 3.0f;
-            lightcolor[1] += add / 3.0f;
-            lightcolor[2] += add / 3.0f;
+            prep->lightcolor[0] += add / 3.0f;
+            prep->lightcolor[1] += add / 3.0f;
+            prep->lightcolor[2] += add / 3.0f;
         }
     }
 
     // minimum light value on players (8)
-    if (currententity > cl_entities && currententity <= cl_entities + cl.maxclients)
+    if (e > cl_entities && e <= cl_entities + cl.maxclients)
     {
-        add = 24.0f - (lightcolor[0] + lightcolor[1] + lightcolor[2]);
+        add = 24.0f - (prep->lightcolor[0] + prep->lightcolor[1] + prep->lightcolor[2]);
         if (add > 0.0f)
         {
-            lightcolor[0] += add / 3.0f;
-            lightcolor[1] += add / 3.0f;
-            lightcolor[2] += add / 3.0f;
+            prep->lightcolor[0] += add / 3.0f;
+            prep->lightcolor[1] += add / 3.0f;
+            prep->lightcolor[2] += add / 3.0f;
         }
     }
 
     // clamp lighting so it doesn't overbright as much (96)
-    if (overbright)
+    if (prep->overbright)
     {
-        add = 288.0f / (lightcolor[0] + lightcolor[1] + lightcolor[2]);
+        add = 288.0f / (prep->lightcolor[0] + prep->lightcolor[1] + prep->lightcolor[2]);
         if (add < 1.0f)
-            VectorScale(lightcolor, add, lightcolor);
+            VectorScale(prep->lightcolor, add, prep->lightcolor);
     }
 
     //hack up the brightness when fullbrights but no overbrights (256)
     if (gl_fullbrights.value && !gl_overbright_models.value)
         if (e->model->flags & MOD_FBRIGHTHACK)
         {
-            lightcolor[0] = 256.0f;
-            lightcolor[1] = 256.0f;
-            lightcolor[2] = 256.0f;
+            prep->lightcolor[0] = 256.0f;
+            prep->lightcolor[1] = 256.0f;
+            prep->lightcolor[2] = 256.0f;
         }
 
-    shadedots = r_avertexnormal_dots[((int)(e->angles[1] * (SHADEDOT_QUANT / 360.0))) & (SHADEDOT_QUANT - 1)];
-    VectorScale(lightcolor, 1.0f / 200.0f, lightcolor);
+    prep->shadedots = r_avertexnormal_dots[((int)(e->angles[1] * (SHADEDOT_QUANT / 360.0))) & (SHADEDOT_QUANT - 1)];
+    VectorScale(prep->lightcolor, 1.0f / 200.0f, prep->lightcolor);
 }
 
 /*
 =================
-R_DrawAliasModel -- johnfitz -- almost completely rewritten
+R_ResetAliasPrep -- frees the prepared vertexes of the last scene
 =================
 */
-void R_DrawAliasModel(entity_t* e)
+void R_ResetAliasPrep(void)
 {
-    aliashdr_t* paliashdr;
-    int i, anim;
-    gltexture_t *tx, *fb;
-    lerpdata_t lerpdata;
+    aliasnumprepverts = 0;
+}
 
+/*
+=================
+R_PrepareAliasModel -- everything R_DrawAliasModel does before it starts drawing, with the
+results left in prep. no gl calls and no rendering statistics, so it can run on the scene
+prep thread while the main thread draws the world. paliashdr comes from Mod_Extradata on
+the main thread, which may have to load the model again. with lerpverts, the frame is
+lerped and lit here too when it will be drawn from the vertex arrays
+=================
+*/
+void R_PrepareAliasModel(entity_t* e, aliashdr_t* paliashdr, aliasprep_t* prep, bool lerpverts)
+{
     //
     // setup pose/lerp data -- do it first so we don't miss updates due to culling
     //
-    paliashdr = (aliashdr_t*)Mod_Extradata(e->model);
-    R_SetupAliasFrame(paliashdr, e->frame, &lerpdata);
-    R_SetupEntityTransform(e, &lerpdata);
+    prep->entity = e;
+    prep->paliashdr = paliashdr;
+    prep->verts = NULL;
+    R_SetupAliasFrame(e, paliashdr, e->frame, &prep->lerpdata);
+    R_SetupEntityTransform(e, &prep->lerpdata);
 
     //
     // cull it
     //
-    if (R_CullModelForEntity(e))
+    R_EntityBounds(e, prep->mins, prep->maxs);
+    prep->occluded = false;
+    prep->culled = R_CullBox(prep->mins, prep->maxs);
+    if (!prep->culled && e != &cl.viewent && R_OccludedBox(prep->mins, prep->maxs))
+        prep->culled = prep->occluded = true;
+    if (prep->culled)
+        return;
+
+    //
+    // set up for alpha blending
+    //
+    prep->overbright = gl_overbright_models.value;
+    if (r_drawflat_cheatsafe || r_lightmap_cheatsafe) //no alpha in drawflat or lightmap mode
+        prep->entalpha = 1;
+    else
+        prep->entalpha = ENTALPHA_DECODE(e->alpha);
+    if (prep->entalpha == 0)
+        return;
+    if (prep->entalpha < 1 && !gl_texture_env_combine)
+        prep->overbright = false; //overbright can't be done in a single pass without combiners
+
+    //
+    // set up lighting
+    //
+    R_SetupAliasLighting(prep);
+
+    if (lerpverts && r_aliasarrays.value && !r_drawflat_cheatsafe && paliashdr->poseverts <= MAX_ALIAS_ORDER
+        && aliasnumprepverts + paliashdr->poseverts <= MAX_PREP_ALIASVERTS)
+    {
+        prep->verts = aliasprepverts + aliasnumprepverts;
+        aliasnumprepverts += paliashdr->poseverts;
+        R_LerpAliasVerts(paliashdr, &prep->lerpdata, prep->shadedots, prep->lightcolor, prep->entalpha, prep->verts);
+    }
+}
+
+/*
+=================
+R_DrawAliasModel -- johnfitz -- almost completely rewritten
+=================
+*/
+void R_DrawAliasModel(entity_t* e)
+{
+    aliasprep_t prep;
+
+    R_PrepareAliasModel(e, (aliashdr_t*)Mod_Extradata(e->model), &prep, false);
+    R_DrawPreparedAliasModel(&prep);
+}
+
+/*
+=================
+R_DrawPreparedAliasModel
+=================
+*/
+void R_DrawPreparedAliasModel(aliasprep_t* prep)
+{
+    entity_t* e = prep->entity;
+    aliashdr_t* paliashdr = prep->paliashdr;
+    lerpdata_t lerpdata = prep->lerpdata;
+    int i, anim;
+    gltexture_t *tx, *fb;
+
+    if (prep->occluded)
+    {
+        rs_occludedents++;
+        R_OcclusionShow(prep->mins, prep->maxs, true);
+    }
+    if (prep->culled)
         return;
 
+    aliasdrawverts = prep->verts;
+    aliasvertsready = prep->verts != NULL;
+    aliasvertsvbo = false;
+
     //
     // transform it
     //
@@ -830,22 +1086,17 @@ void R_DrawAliasModel(entity_t* e)
         glShadeModel(GL_SMOOTH);
     if (gl_affinemodels.value)
         glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_FASTEST);
-    overbright = gl_overbright_models.value;
+    overbright = prep->overbright;
     shading = true;
 
     //
     // set up for alpha blending
     //
-    if (r_drawflat_cheatsafe || r_lightmap_cheatsafe) //no alpha in drawflat or lightmap mode
-        entalpha = 1;
-    else
-        entalpha = ENTALPHA_DECODE(e->alpha);
+    entalpha = prep->entalpha;
     if (entalpha == 0)
         goto cleanup;
     if (entalpha < 1)
     {
-        if (!gl_texture_env_combine)
-            overbright = false; //overbright can't be done in a single pass without combiners
         glDepthMask(GL_FALSE);
         glEnable(GL_BLEND);
     }
@@ -854,7 +1105,8 @@ void R_DrawAliasModel(entity_t* e)
     // set up lighting
     //
     rs_aliaspolys += paliashdr->numtris;
-    R_SetupAliasLighting(e);
+    VectorCopy(prep->lightcolor, lightcolor);
+    shadedots = prep->shadedots;
 
     //
     // set up textures
@@ -1074,7 +1326,7 @@ void GL_DrawAliasShadow(entity_t* e)
     aliashdr_t* paliashdr;
     lerpdata_t lerpdata;
 
-    if (R_CullModelForEntity(e))
+    if (R_CullModelForEntity(e, false))
         return;
 
     if (e == &cl.viewent || e->model->flags & MOD_NOSHADOW)
@@ -1085,8 +1337,9 @@ void GL_DrawAliasShadow(entity_t* e)
         return;
 
     paliashdr = (aliashdr_t*)Mod_Extradata(e->model);
-    R_SetupAliasFrame(paliashdr, e->frame, &lerpdata);
+    R_SetupAliasFrame(e, paliashdr, e->frame, &lerpdata);
     R_SetupEntityTransform(e, &lerpdata);
+    aliasvertsready = false;
     R_LightPoint(e->origin);
     lheight = currententity->origin[2] - lightspot[2];
 
@@ -1128,12 +1381,13 @@ void R_DrawAliasModel_ShowTris(entity_t* e)
     aliashdr_t* paliashdr;
     lerpdata_t lerpdata;
 
-    if (R_CullModelForEntity(e))
+    if (R_CullModelForEntity(e, false))
         return;
 
     paliashdr = (aliashdr_t*)Mod_Extradata(e->model);
-    R_SetupAliasFrame(paliashdr, e->frame, &lerpdata);
+    R_SetupAliasFrame(e, paliashdr, e->frame, &lerpdata);
     R_SetupEntityTransform(e, &lerpdata);
+    aliasvertsready = false;
 
     glPushMatrix();
     R_RotateForEntity(lerpdata.origin, lerpdata.angles);
@@ -1145,4 +1399,85 @@ void R_DrawAliasModel_ShowTris(entity_t* e)
     GL_DrawAliasFrame(paliashdr, lerpdata);
 
     glPopMatrix();
-}
\ No newline at end of file
+}
+/*
+=================
+R_CrowdBench_f -- draws a grid of animated ogres in front of the view, first through the
+command list and then through the vertex arrays, and reports the cpu time per frame
+
+crowdbench [count] [frames]
+=================
+*/
+void R_CrowdBench_f(void)
+{
+    static entity_t crowd[1024];
+    model_t* mod;
+    entity_t* e;
+    int count, frames, pass, frame, i;
+    float saved;
+    double start, cpu[2], total[2];
+
+    if (!cl.worldmodel)
+    {
+        Con_Printf("crowdbench: no map loaded\n");
+        return;
+    }
+
+    mod = Mod_ForName("progs/ogre.mdl", false);
+    if (!mod || mod->type != mod_alias)
+    {
+        Con_Printf("crowdbench: couldn't load progs/ogre.mdl\n");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 200;
+    frames = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 100;
+    count = CLAMP(1, count, 1024);
+    if (frames < 1)
+        frames = 1;
+
+    // rows of 20 facing the camera, starting just in front of it
+    memset(crowd, 0, count * sizeof(entity_t));
+    for (i = 0, e = crowd; i < count; i++, e++)
+    {
+        e->model = mod;
+        e->colormap = vid.colormap;
+        e->alpha = ENTALPHA_DEFAULT;
+        e->lerpflags = LERP_RESETANIM | LERP_RESETMOVE;
+        VectorMA(r_refdef.vieworg, 128 + (i / 20) * 64, vpn, e->origin);
+        VectorMA(e->origin, ((i % 20) - 9.5f) * 48, vright, e->origin);
+        e->angles[1] = r_refdef.viewangles[1] + 180;
+    }
+
+    saved = r_aliasarrays.value;
+    glDrawBuffer(GL_FRONT);
+    R_RenderView();
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        Cvar_SetValue("r_aliasarrays", pass);
+        glFinish();
+
+        start = Sys_FloatTime();
+        for (frame = 0; frame < frames; frame++)
+        {
+            for (i = 0, e = crowd; i < count; i++, e++)
+            {
+                e->frame = (frame + i) % mod->numframes;
+                currententity = e;
+                R_DrawAliasModel(e);
+            }
+        }
+        cpu[pass] = (Sys_FloatTime() - start) * 1000.0 / frames;
+        glFinish();
+        total[pass] = (Sys_FloatTime() - start) * 1000.0 / frames;
+    }
+
+    Cvar_SetValue("r_aliasarrays", saved);
+    glDrawBuffer(GL_BACK);
+    GL_EndRendering();
+
+    Con_Printf("crowdbench: %i x %s, %i frames\n", count, mod->name, frames);
+    Con_Printf("command list: %6.2f ms cpu, %6.2f ms with glFinish\n", cpu[0], total[0]);
+    Con_Printf("arrays:       %6.2f ms cpu, %6.2f ms with glFinish\n", cpu[1], total[1]);
+}
@@ -22,36 +22,74 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 extern cvar_t gl_fullbrights, r_drawflat, gl_overbright, r_oldwater; //johnfitz
+extern int gl_hardware_maxsize;
 
 int gl_lightmap_format;
 int lightmap_bytes;
 
-#define BLOCK_WIDTH 128 //johnfitz -- was 128
-#define BLOCK_HEIGHT 128 //johnfitz -- was 128
+#define MAX_SURFACE_LIGHTMAP 128 // largest surface lightmap side, from the 2000 unit extents limit in CalcSurfaceExtents
+
+// lightmap page size, picked from gl_lightmap_size when the map loads
+int lightmap_width;
+int lightmap_height;
+int lightmap_count; // pages in use
+
+// one per worker thread so surfaces can be lit in parallel
+unsigned blocklights[MAX_TASK_THREADS][MAX_SURFACE_LIGHTMAP * MAX_SURFACE_LIGHTMAP * 3]; //johnfitz -- was 18*18, added lit support (*3) and loosened surface extents maximum
 
-unsigned blocklights[BLOCK_WIDTH * BLOCK_HEIGHT * 3]; //johnfitz -- was 18*18, added lit support (*3) and loosened surface extents maximum (BLOCK_WIDTH*BLOCK_HEIGHT)
+// world surfaces whose lightmaps need rebuilding this frame
+msurface_t** lightmap_dirty;
+int lightmap_numdirty;
+
+// lightstyle -> surfaces using it, so a style change only touches its own surfaces
+msurface_t** lightstyle_surfs;
+int lightstyle_first[MAX_LIGHTSTYLES + 1];
 
 
 
 typedef struct glRect_s
 {
-    unsigned char l, t, w, h;
+    unsigned short l, t, w, h;
 } glRect_t;
 
 glpoly_t* lightmap_polys[MAX_LIGHTMAPS];
 bool lightmap_modified[MAX_LIGHTMAPS];
 glRect_t lightmap_rectchange[MAX_LIGHTMAPS];
 
-int allocated[MAX_LIGHTMAPS][BLOCK_WIDTH];
-
 // the lightmap texture data needs to be kept in
 // main memory so texsubimage can update properly
-uint8_t lightmaps[4 * MAX_LIGHTMAPS * BLOCK_WIDTH * BLOCK_HEIGHT];
+uint8_t* lightmaps; // lightmap_count pages, on the hunk
+
+// skyline packer: each page keeps the top edge of its used area as a list of
+// horizontal segments, left to right
+typedef struct
+{
+    short x, y, w;
+} skyline_t;
+
+typedef struct
+{
+    skyline_t* nodes;
+    int numnodes;
+    int texels; // allocated area, for occupancy
+} lightmappage_t;
+
+lightmappage_t lightmap_pages[MAX_LIGHTMAPS];
+
+cvar_t r_lightmapthreads = { "r_lightmapthreads", "1" };
+cvar_t gl_lightmap_size = { "gl_lightmap_size", "1024" };
 
 void R_RenderDynamicLightmaps(msurface_t* fa);
 void R_BuildLightMap(msurface_t* surf, uint8_t* dest, int stride);
+void R_BuildLightMapBlock(msurface_t* surf, uint8_t* dest, int stride, unsigned* blocklights);
 void R_UploadLightmap(int lmap);
+void R_MarkLights(dlight_t* light, int bit, mnode_t* node);
 
 /*
 ===============
@@ -506,7 +544,7 @@ void R_DrawBrushModel(entity_t* e)
     mplane_t* pplane;
     model_t* clmodel;
 
-    if (R_CullModelForEntity(e))
+    if (R_CullModelForEntity(e, true))
         return;
 
     currententity = e;
@@ -585,7 +623,7 @@ void R_DrawBrushModel_ShowTris(entity_t* e)
     model_t* clmodel;
     glpoly_t* p;
 
-    if (R_CullModelForEntity(e))
+    if (R_CullModelForEntity(e, false))
         return;
 
     currententity = e;
@@ -642,33 +680,28 @@ void R_DrawBrushModel_ShowTris(entity_t* e)
 
 /*
 ================
-R_RenderDynamicLightmaps
-called during rendering
+R_CheckLightmap -- returns true if the lightmap has to be rebuilt this frame, and grows
+the modified rect of its page to cover it
 ================
 */
-void R_RenderDynamicLightmaps(msurface_t* fa)
+static bool R_CheckLightmap(msurface_t* fa)
 {
-    uint8_t* base;
-    int maps;
     glRect_t* theRect;
     int smax, tmax;
 
     if (fa->flags & SURF_DRAWTILED) //johnfitz -- not a lightmapped surface
-        return;
+        return false;
 
-    // add to lightmap chain
-    fa->polys->chain = lightmap_polys[fa->lightmaptexturenum];
-    lightmap_polys[fa->lightmaptexturenum] = fa->polys;
+    if (fa->lightmapframe == r_framecount) // already rebuilt this frame
+        return false;
 
-    // check for lightmap modification
-    for (maps = 0; maps < MAXLIGHTMAPS && fa->styles[maps] != 255; maps++)
-        if (d_lightstylevalue[fa->styles[maps]] != fa->cached_light[maps])
-            goto dynamic;
+    rs_lightmapchecks++;
 
-    if (fa->dlightframe == r_framecount // dynamic this frame
+    // check for lightmap modification
+    if (fa->stylesdirty // lightstyle changed, see R_DirtyLightStyle
+        || fa->dlightframe == r_framecount // dynamic this frame
         || fa->cached_dlight) // dynamic previously
     {
-    dynamic:
         if (r_dynamic.value)
         {
             lightmap_modified[fa->lightmaptexturenum] = true;
@@ -691,50 +724,283 @@ void R_RenderDynamicLightmaps(msurface_t* fa)
                 theRect->w = (fa->light_s - theRect->l) + smax;
             if ((theRect->h + theRect->t) < (fa->light_t + tmax))
                 theRect->h = (fa->light_t - theRect->t) + tmax;
-            base = lightmaps + fa->lightmaptexturenum * lightmap_bytes * BLOCK_WIDTH * BLOCK_HEIGHT;
-            base += fa->light_t * BLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
-            R_BuildLightMap(fa, base, BLOCK_WIDTH * lightmap_bytes);
+            fa->lightmapframe = r_framecount;
+            rs_lightmaprebuilds++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+================
+R_RenderDynamicLightmaps
+called during rendering
+================
+*/
+void R_RenderDynamicLightmaps(msurface_t* fa)
+{
+    uint8_t* base;
+
+    if (fa->flags & SURF_DRAWTILED) //johnfitz -- not a lightmapped surface
+        return;
+
+    // add to lightmap chain
+    fa->polys->chain = lightmap_polys[fa->lightmaptexturenum];
+    lightmap_polys[fa->lightmaptexturenum] = fa->polys;
+
+    // world surfaces were normally rebuilt up front by R_UpdateWorldLightmaps
+    if (R_CheckLightmap(fa))
+    {
+        base = lightmaps + fa->lightmaptexturenum * lightmap_bytes * lightmap_width * lightmap_height;
+        base += fa->light_t * lightmap_width * lightmap_bytes + fa->light_s * lightmap_bytes;
+        R_BuildLightMap(fa, base, lightmap_width * lightmap_bytes);
+    }
+}
+
+/*
+================
+R_DirtyLightStyle -- called when a lightstyle's value changes. flags every surface using
+it, visible or not; the flag is only acted on when the surface is next drawn
+================
+*/
+void R_DirtyLightStyle(int style)
+{
+    int i;
+
+    for (i = lightstyle_first[style]; i < lightstyle_first[style + 1]; i++)
+        lightstyle_surfs[i]->stylesdirty = true;
+}
+
+/*
+================
+R_BuildLightStyleIndex -- fills lightstyle_surfs, grouped by style, for every lightmapped
+surface of every loaded brush model
+================
+*/
+static void R_BuildLightStyleIndex(void)
+{
+    int counts[MAX_LIGHTSTYLES];
+    int pass, i, j, maps, style;
+    model_t* m;
+    msurface_t* surf;
+
+    memset(lightstyle_first, 0, sizeof(lightstyle_first));
+
+    // first pass counts, second pass places
+    for (pass = 0; pass < 2; pass++)
+    {
+        memset(counts, 0, sizeof(counts));
+        for (j = 1; j < MAX_MODELS; j++)
+        {
+            m = cl.model_precache[j];
+            if (!m)
+                break;
+            if (m->name[0] == '*')
+                continue;
+            for (i = 0, surf = m->surfaces; i < m->numsurfaces; i++, surf++)
+            {
+                if (surf->flags & SURF_DRAWTILED)
+                    continue;
+                for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
+                {
+                    style = surf->styles[maps];
+                    if (style >= MAX_LIGHTSTYLES) // never animated
+                        continue;
+                    if (pass)
+                        lightstyle_surfs[lightstyle_first[style] + counts[style]] = surf;
+                    counts[style]++;
+                }
+            }
+        }
+
+        if (!pass)
+        {
+            for (i = 0; i < MAX_LIGHTSTYLES; i++)
+                lightstyle_first[i + 1] = lightstyle_first[i] + counts[i];
+            lightstyle_surfs = Hunk_AllocName((lightstyle_first[MAX_LIGHTSTYLES] + 1) * sizeof(msurface_t*), "lstyles");
+        }
+    }
+}
+
+/*
+================
+R_BuildLightmapTask
+================
+*/
+static void R_BuildLightmapTask(int index, int thread, void* data)
+{
+    msurface_t* fa = ((msurface_t**)data)[index];
+    uint8_t* base;
+
+    base = lightmaps + fa->lightmaptexturenum * lightmap_bytes * lightmap_width * lightmap_height;
+    base += fa->light_t * lightmap_width * lightmap_bytes + fa->light_s * lightmap_bytes;
+    R_BuildLightMapBlock(fa, base, lightmap_width * lightmap_bytes, blocklights[thread]);
+}
+
+/*
+================
+R_BuildLightmapList -- rebuilds a list of surfaces, spread over the worker threads
+
+each surface owns its own rect of its lightmap page and its own blocklights, so
+the builds don't touch anything shared
+================
+*/
+void R_BuildLightmapList(msurface_t** surfs, int count)
+{
+    int i;
+
+    if (r_lightmapthreads.value)
+        Tasks_ParallelFor(count, R_BuildLightmapTask, surfs);
+    else
+        for (i = 0; i < count; i++)
+            R_BuildLightmapTask(i, 0, surfs);
+}
+
+/*
+================
+R_UpdateWorldLightmaps -- collects the visible world surfaces with stale lightmaps and
+rebuilds them all at once, before the draw loops start uploading
+================
+*/
+void R_UpdateWorldLightmaps(void)
+{
+    msurface_t* s;
+    int i;
+
+    lightmap_numdirty = 0;
+    s = &cl.worldmodel->surfaces[cl.worldmodel->firstmodelsurface];
+    for (i = 0; i < cl.worldmodel->nummodelsurfaces; i++, s++)
+        if (s->visframe == r_visframecount && !s->culled && !(s->flags & SURF_NOTEXTURE) && R_CheckLightmap(s))
+            lightmap_dirty[lightmap_numdirty++] = s;
+
+    R_BuildLightmapList(lightmap_dirty, lightmap_numdirty);
+}
+
+/*
+========================
+Skyline_Fit -- returns the y a w*h rect would sit at with its left edge on node index,
+or -1 if it doesn't fit there
+========================
+*/
+static int Skyline_Fit(lightmappage_t* page, int index, int w, int h)
+{
+    skyline_t* node;
+    int y, left;
+
+    if (page->nodes[index].x + w > lightmap_width)
+        return -1;
+
+    y = 0;
+    for (left = w, node = &page->nodes[index]; left > 0; left -= node->w, node++)
+    {
+        if (node->y > y)
+            y = node->y;
+        if (y + h > lightmap_height)
+            return -1;
+    }
+
+    return y;
+}
+
+/*
+========================
+Skyline_Place -- adds a segment at height y over [x, x+w), starting at node index
+========================
+*/
+static void Skyline_Place(lightmappage_t* page, int index, int x, int y, int w)
+{
+    skyline_t* nodes = page->nodes;
+    int i, shrink;
+
+    memmove(&nodes[index + 1], &nodes[index], (page->numnodes - index) * sizeof(skyline_t));
+    nodes[index].x = x;
+    nodes[index].y = y;
+    nodes[index].w = w;
+    page->numnodes++;
+
+    // trim or drop the segments now underneath it
+    for (i = index + 1; i < page->numnodes;)
+    {
+        shrink = nodes[index].x + nodes[index].w - nodes[i].x;
+        if (shrink <= 0)
+            break;
+        if (shrink < nodes[i].w)
+        {
+            nodes[i].x += shrink;
+            nodes[i].w -= shrink;
+            break;
         }
+        memmove(&nodes[i], &nodes[i + 1], (page->numnodes - i - 1) * sizeof(skyline_t));
+        page->numnodes--;
+    }
+
+    // merge neighbours at the same height
+    for (i = 0; i < page->numnodes - 1;)
+    {
+        if (nodes[i].y == nodes[i + 1].y)
+        {
+            nodes[i].w += nodes[i + 1].w;
+            memmove(&nodes[i + 1], &nodes[i + 2], (page->numnodes - i - 2) * sizeof(skyline_t));
+            page->numnodes--;
+        }
+        else
+            i++;
     }
 }
 
 /*
 ========================
 AllocBlock -- returns a texture number and the position inside it
+
+bottom-left skyline placement: the rect goes wherever its top edge ends up lowest.
+GL_PackLightmaps hands surfaces over tallest first, which keeps each skyline down
+to a few segments, so this is close to constant time per surface
 ========================
 */
 int AllocBlock(int w, int h, int* x, int* y)
 {
-    int i, j;
+    lightmappage_t* page;
+    int texnum, i, fit, best, bestindex, besty;
 
-    for (int texnum = 0; texnum < MAX_LIGHTMAPS; texnum++)
+    for (texnum = 0; texnum < MAX_LIGHTMAPS; texnum++)
     {
-        int best = BLOCK_HEIGHT;
-
-        for (int i = 0; i < BLOCK_WIDTH - w; i++)
+        page = &lightmap_pages[texnum];
+        if (texnum == lightmap_count)
         {
-            int best2 = 0;
+            // open a new page with a flat skyline
+            page->nodes = (skyline_t*)malloc((lightmap_width + 1) * sizeof(skyline_t));
+            if (!page->nodes)
+                Sys_Error("AllocBlock: out of memory");
+            page->nodes[0].x = 0;
+            page->nodes[0].y = 0;
+            page->nodes[0].w = lightmap_width;
+            page->numnodes = 1;
+            page->texels = 0;
+            lightmap_count++;
+        }
 
-            for (j = 0; j < w; j++)
+        best = lightmap_height + 1;
+        bestindex = besty = -1;
+        for (i = 0; i < page->numnodes; i++)
+        {
+            fit = Skyline_Fit(page, i, w, h);
+            if (fit >= 0 && fit + h < best)
             {
-                if (allocated[texnum][i + j] >= best)
-                    break;
-                if (allocated[texnum][i + j] > best2)
-                    best2 = allocated[texnum][i + j];
-            }
-            if (j == w)
-            { // this is a valid spot
-                *x = i;
-                *y = best = best2;
+                best = fit + h;
+                bestindex = i;
+                besty = fit;
             }
         }
 
-        if (best + h > BLOCK_HEIGHT)
+        if (bestindex < 0)
             continue;
 
-        for (i = 0; i < w; i++)
-            allocated[texnum][*x + i] = best + h;
-
+        *x = page->nodes[bestindex].x;
+        *y = besty;
+        Skyline_Place(page, bestindex, *x, besty + h, w);
+        page->texels += w * h;
         return texnum;
     }
 
@@ -754,16 +1020,106 @@ GL_CreateSurfaceLightmap
 */
 void GL_CreateSurfaceLightmap(msurface_t* surf)
 {
-    int smax, tmax;
     uint8_t* base;
 
-    smax = (surf->extents[0] >> 4) + 1;
-    tmax = (surf->extents[1] >> 4) + 1;
+    base = lightmaps + surf->lightmaptexturenum * lightmap_bytes * lightmap_width * lightmap_height;
+    base += (surf->light_t * lightmap_width + surf->light_s) * lightmap_bytes;
+    R_BuildLightMap(surf, base, lightmap_width * lightmap_bytes);
+}
+
+/*
+========================
+GL_SurfaceSortHeight -- tallest first, then widest
+========================
+*/
+static int GL_SurfaceSortHeight(const void* a, const void* b)
+{
+    const msurface_t* sa = *(const msurface_t**)a;
+    const msurface_t* sb = *(const msurface_t**)b;
+
+    if (sa->extents[1] != sb->extents[1])
+        return sb->extents[1] - sa->extents[1];
+    return sb->extents[0] - sa->extents[0];
+}
+
+/*
+========================
+GL_PackLightmaps -- gives every lightmapped surface of every brush model its place in the pages
+========================
+*/
+static void GL_PackLightmaps(void)
+{
+    msurface_t** surfs;
+    msurface_t* surf;
+    model_t* m;
+    int i, j, count, smax, tmax;
+
+    count = 0;
+    for (j = 1; j < MAX_MODELS; j++)
+    {
+        m = cl.model_precache[j];
+        if (!m)
+            break;
+        if (m->name[0] != '*')
+            count += m->numsurfaces;
+    }
+
+    surfs = (msurface_t**)malloc((count + 1) * sizeof(msurface_t*));
+    if (!surfs)
+        Sys_Error("GL_PackLightmaps: out of memory");
+    count = 0;
+    for (j = 1; j < MAX_MODELS; j++)
+    {
+        m = cl.model_precache[j];
+        if (!m)
+            break;
+        if (m->name[0] == '*')
+            continue;
+        for (i = 0, surf = m->surfaces; i < m->numsurfaces; i++, surf++)
+            if (!(surf->flags & SURF_DRAWTILED))
+                surfs[count++] = surf;
+    }
+
+    qsort(surfs, count, sizeof(msurface_t*), GL_SurfaceSortHeight);
+
+    for (i = 0; i < count; i++)
+    {
+        surf = surfs[i];
+        smax = (surf->extents[0] >> 4) + 1;
+        tmax = (surf->extents[1] >> 4) + 1;
+        surf->lightmaptexturenum = AllocBlock(smax, tmax, &surf->light_s, &surf->light_t);
+    }
+
+    free(surfs);
+    for (i = 0; i < lightmap_count; i++)
+    {
+        free(lightmap_pages[i].nodes);
+        lightmap_pages[i].nodes = NULL;
+    }
+}
 
-    surf->lightmaptexturenum = AllocBlock(smax, tmax, &surf->light_s, &surf->light_t);
-    base = lightmaps + surf->lightmaptexturenum * lightmap_bytes * BLOCK_WIDTH * BLOCK_HEIGHT;
-    base += (surf->light_t * BLOCK_WIDTH + surf->light_s) * lightmap_bytes;
-    R_BuildLightMap(surf, base, BLOCK_WIDTH * lightmap_bytes);
+/*
+========================
+GL_LightmapInfo_f -- prints how full the lightmap pages are
+========================
+*/
+void GL_LightmapInfo_f(void)
+{
+    int i, total;
+
+    if (!lightmap_count)
+    {
+        Con_Printf("no lightmaps\n");
+        return;
+    }
+
+    for (i = total = 0; i < lightmap_count; i++)
+    {
+        Con_Printf("lightmap%03i %5.1f%%\n", i, lightmap_pages[i].texels * 100.0 / (lightmap_width * lightmap_height));
+        total += lightmap_pages[i].texels;
+    }
+    Con_Printf("%i lightmaps of %ix%i, %5.1f%% used\n", lightmap_count, lightmap_width, lightmap_height,
+        total * 100.0 / ((double)lightmap_count * lightmap_width * lightmap_height));
 }
 
 /*
@@ -824,13 +1180,13 @@ void BuildSurfaceDisplayList(msurface_t* fa)
         s -= fa->texturemins[0];
         s += fa->light_s * 16;
         s += 8;
-        s /= BLOCK_WIDTH * 16; //fa->texinfo->texture->width;
+        s /= lightmap_width * 16; //fa->texinfo->texture->width;
 
         t = DotProduct(vec, fa->texinfo->vecs[1]) + fa->texinfo->vecs[1][3];
         t -= fa->texturemins[1];
         t += fa->light_t * 16;
         t += 8;
-        t /= BLOCK_HEIGHT * 16; //fa->texinfo->texture->height;
+        t /= lightmap_height * 16; //fa->texinfo->texture->height;
 
         poly->verts[i][5] = s;
         poly->verts[i][6] = t;
@@ -841,6 +1197,68 @@ void BuildSurfaceDisplayList(msurface_t* fa)
     poly->numverts = lnumverts;
 }
 
+/*
+==================
+GL_BuildVertexBuffer -- called at level load time, after GL_BuildLightmaps
+
+copies the display list of every lightmapped surface of every brush model into
+one static vertex buffer, in the same VERTEXSIZE layout as glpoly_t
+==================
+*/
+GLuint gl_bmodel_vbo;
+
+void GL_BuildVertexBuffer(void)
+{
+    int i, j, numverts;
+    model_t* m;
+    msurface_t* s;
+    float* verts;
+
+    if (!gl_vbo_able)
+        return;
+
+    numverts = 0;
+    for (j = 1; j < MAX_MODELS; j++)
+    {
+        m = cl.model_precache[j];
+        if (!m)
+            break;
+        if (m->name[0] == '*')
+            continue;
+        for (i = 0, s = m->surfaces; i < m->numsurfaces; i++, s++)
+        {
+            if (s->flags & SURF_DRAWTILED)
+                continue;
+            s->vbo_firstvert = numverts;
+            numverts += s->polys->numverts;
+        }
+    }
+
+    verts = (float*)malloc((numverts + 1) * VERTEXSIZE * sizeof(float));
+    if (!verts)
+        Sys_Error("GL_BuildVertexBuffer: out of memory");
+    for (j = 1; j < MAX_MODELS; j++)
+    {
+        m = cl.model_precache[j];
+        if (!m)
+            break;
+        if (m->name[0] == '*')
+            continue;
+        for (i = 0, s = m->surfaces; i < m->numsurfaces; i++, s++)
+            if (!(s->flags & SURF_DRAWTILED))
+                memcpy(verts + s->vbo_firstvert * VERTEXSIZE, s->polys->verts, s->polys->numverts * VERTEXSIZE * sizeof(float));
+    }
+
+    if (!gl_bmodel_vbo)
+        GL_GenBuffersFunc(1, &gl_bmodel_vbo);
+    GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, gl_bmodel_vbo);
+    GL_BufferDataFunc(GL_ARRAY_BUFFER_ARB, numverts * VERTEXSIZE * sizeof(float), verts, GL_STATIC_DRAW_ARB);
+    GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, 0);
+    free(verts);
+
+    Con_DPrintf("%i brush model vertexes in vertex buffer\n", numverts);
+}
+
 /*
 ==================
 GL_BuildLightmaps -- called at level load time
@@ -856,10 +1274,19 @@ void GL_BuildLightmaps(void)
     int i, j;
     model_t* m;
 
-    memset(allocated, 0, sizeof(allocated));
-
     r_framecount = 1; // no dlightcache
 
+    // bigger pages mean fewer textures to bind, as far as the hardware allows
+    for (lightmap_width = MAX_SURFACE_LIGHTMAP; lightmap_width < (int)gl_lightmap_size.value; lightmap_width <<= 1)
+        ;
+    while (lightmap_width > MAX_SURFACE_LIGHTMAP && lightmap_width > gl_hardware_maxsize)
+        lightmap_width >>= 1;
+    lightmap_height = lightmap_width;
+    lightmap_count = 0;
+
+    lightmap_dirty = Hunk_AllocName(cl.worldmodel->numsurfaces * sizeof(msurface_t*), "lmdirty");
+    lightmap_numdirty = 0;
+
     //johnfitz -- null out array (the gltexture objects themselves were already freed by Mod_ClearAll)
     for (i = 0; i < MAX_LIGHTMAPS; i++)
         lightmap_textures[i] = NULL;
@@ -878,6 +1305,10 @@ void GL_BuildLightmaps(void)
     }
     //johnfitz
 
+    GL_PackLightmaps();
+
+    lightmaps = Hunk_AllocName(lightmap_count * lightmap_width * lightmap_height * lightmap_bytes, "lightmaps");
+
     for (j = 1; j < MAX_MODELS; j++)
     {
         m = cl.model_precache[j];
@@ -901,36 +1332,88 @@ void GL_BuildLightmaps(void)
     //
     // upload all lightmaps that were filled
     //
-    for (i = 0; i < MAX_LIGHTMAPS; i++)
+    for (i = 0; i < lightmap_count; i++)
     {
-        if (!allocated[i][0])
-            break; // no more used
         lightmap_modified[i] = false;
-        lightmap_rectchange[i].l = BLOCK_WIDTH;
-        lightmap_rectchange[i].t = BLOCK_HEIGHT;
+        lightmap_rectchange[i].l = lightmap_width;
+        lightmap_rectchange[i].t = lightmap_height;
         lightmap_rectchange[i].w = 0;
         lightmap_rectchange[i].h = 0;
 
         //johnfitz -- use texture manager
         sprintf(name, "lightmap%03i", i);
-        data = lightmaps + i * BLOCK_WIDTH * BLOCK_HEIGHT * lightmap_bytes;
-        lightmap_textures[i] = TexMgr_LoadImage(cl.worldmodel, name, BLOCK_WIDTH, BLOCK_HEIGHT,
+        data = lightmaps + i * lightmap_width * lightmap_height * lightmap_bytes;
+        lightmap_textures[i] = TexMgr_LoadImage(cl.worldmodel, name, lightmap_width, lightmap_height,
             SRC_LIGHTMAP, data, "", (unsigned)data, TEXPREF_NEAREST | TEXPREF_NOPICMIP);
         //johnfitz
     }
 
+    R_BuildLightStyleIndex();
+
     //johnfitz -- warn about exceeding old limits
-    if (i >= 64)
+    if (lightmap_width == 128 && i >= 64)
         Con_Warning("%i lightmaps exceeds standard limit of 64.\n", i);
     //johnfitz
+    Con_DPrintf("%i lightmaps of %ix%i\n", lightmap_count, lightmap_width, lightmap_height);
+}
+
+#ifdef USE_SSE2
+/*
+===============
+R_AddDynamicLightRow -- four texels per step; the texel distances and brightness are
+worked out for all four at once, then spread over their rgb triples
+===============
+*/
+static int R_AddDynamicLightRow(unsigned* bl, int smax, float local0, int td, float rad, float minlight, const float* color)
+{
+    __m128i vtd, vtdhalf, sd, sign, gt, dist;
+    __m128 vs, step, vlocal, vrad, vminlight, distf, brightness;
+    __m128 c0, c1, c2;
+    int s;
+
+    vtd = _mm_set1_epi32(td);
+    vtdhalf = _mm_srai_epi32(vtd, 1);
+    vs = _mm_setr_ps(0, 16, 32, 48);
+    step = _mm_set1_ps(64);
+    vlocal = _mm_set1_ps(local0);
+    vrad = _mm_set1_ps(rad);
+    vminlight = _mm_set1_ps(minlight);
+    // four rgb triples make three vectors: rgbr gbrg brgb
+    c0 = _mm_setr_ps(color[0], color[1], color[2], color[0]);
+    c1 = _mm_setr_ps(color[1], color[2], color[0], color[1]);
+    c2 = _mm_setr_ps(color[2], color[0], color[1], color[2]);
+
+    for (s = 0; s + 4 <= smax; s += 4, bl += 12, vs = _mm_add_ps(vs, step))
+    {
+        // same truncation as the int assignment in the scalar loop
+        sd = _mm_cvttps_epi32(_mm_sub_ps(vlocal, vs));
+        sign = _mm_srai_epi32(sd, 31);
+        sd = _mm_sub_epi32(_mm_xor_si128(sd, sign), sign);
+
+        gt = _mm_cmpgt_epi32(sd, vtd);
+        dist = _mm_or_si128(_mm_and_si128(gt, _mm_add_epi32(sd, vtdhalf)),
+            _mm_andnot_si128(gt, _mm_add_epi32(vtd, _mm_srai_epi32(sd, 1))));
+        distf = _mm_cvtepi32_ps(dist);
+        brightness = _mm_and_ps(_mm_cmplt_ps(distf, vminlight), _mm_sub_ps(vrad, distf));
+
+        _mm_storeu_si128((__m128i*)bl, _mm_add_epi32(_mm_loadu_si128((__m128i*)bl),
+                                           _mm_cvttps_epi32(_mm_mul_ps(_mm_shuffle_ps(brightness, brightness, _MM_SHUFFLE(1, 0, 0, 0)), c0))));
+        _mm_storeu_si128((__m128i*)(bl + 4), _mm_add_epi32(_mm_loadu_si128((__m128i*)(bl + 4)),
+                                                 _mm_cvttps_epi32(_mm_mul_ps(_mm_shuffle_ps(brightness, brightness, _MM_SHUFFLE(2, 2, 1, 1)), c1))));
+        _mm_storeu_si128((__m128i*)(bl + 8), _mm_add_epi32(_mm_loadu_si128((__m128i*)(bl + 8)),
+                                                 _mm_cvttps_epi32(_mm_mul_ps(_mm_shuffle_ps(brightness, brightness, _MM_SHUFFLE(3, 3, 3, 2)), c2))));
+    }
+
+    return s;
 }
+#endif
 
 /*
 ===============
 R_AddDynamicLights
 ===============
 */
-void R_AddDynamicLights(msurface_t* surf)
+void R_AddDynamicLights(msurface_t* surf, unsigned* blocklights)
 {
     int lnum;
     int sd, td;
@@ -944,6 +1427,7 @@ void R_AddDynamicLights(msurface_t* surf)
     float cred, cgreen, cblue, brightness;
     unsigned* bl;
     //johnfitz
+    float color[3];
 
     smax = (surf->extents[0] >> 4) + 1;
     tmax = (surf->extents[1] >> 4) + 1;
@@ -979,12 +1463,21 @@ void R_AddDynamicLights(msurface_t* surf)
         cgreen = cl_dlights[lnum].color[1] * 256.0f;
         cblue = cl_dlights[lnum].color[2] * 256.0f;
         //johnfitz
+        color[0] = cred;
+        color[1] = cgreen;
+        color[2] = cblue;
         for (t = 0; t < tmax; t++)
         {
             td = local[1] - t * 16;
             if (td < 0)
                 td = -td;
-            for (s = 0; s < smax; s++)
+#ifdef USE_SSE2
+            s = R_AddDynamicLightRow(bl, smax, local[0], td, rad, minlight, color);
+            bl += s * 3;
+#else
+            s = 0;
+#endif
+            for (; s < smax; s++)
             {
                 sd = local[0] - s * 16;
                 if (sd < 0)
@@ -1010,22 +1503,95 @@ void R_AddDynamicLights(msurface_t* surf)
 
 /*
 ===============
-R_BuildLightMap -- johnfitz -- revised for lit support via lordhavoc
+R_AddLightStyle -- blocklights += samples * scale over count channels
+===============
+*/
+static void R_AddLightStyle(unsigned* bl, const uint8_t* lightmap, int count, unsigned scale)
+{
+#ifdef USE_SSE2
+    __m128i zero, vscale, bytes, half, lo, hi;
 
-Combine and scale multiple lightmaps into the 8.8 format in blocklights
+    // the products need more than 16 bits, so put them together from mullo/mulhi
+    if (scale <= 0xffff)
+    {
+        zero = _mm_setzero_si128();
+        vscale = _mm_set1_epi16((short)scale);
+        for (; count >= 16; count -= 16, bl += 16, lightmap += 16)
+        {
+            bytes = _mm_loadu_si128((const __m128i*)lightmap);
+
+            half = _mm_unpacklo_epi8(bytes, zero);
+            lo = _mm_mullo_epi16(half, vscale);
+            hi = _mm_mulhi_epu16(half, vscale);
+            _mm_storeu_si128((__m128i*)bl, _mm_add_epi32(_mm_loadu_si128((__m128i*)bl), _mm_unpacklo_epi16(lo, hi)));
+            _mm_storeu_si128((__m128i*)(bl + 4), _mm_add_epi32(_mm_loadu_si128((__m128i*)(bl + 4)), _mm_unpackhi_epi16(lo, hi)));
+
+            half = _mm_unpackhi_epi8(bytes, zero);
+            lo = _mm_mullo_epi16(half, vscale);
+            hi = _mm_mulhi_epu16(half, vscale);
+            _mm_storeu_si128((__m128i*)(bl + 8), _mm_add_epi32(_mm_loadu_si128((__m128i*)(bl + 8)), _mm_unpacklo_epi16(lo, hi)));
+            _mm_storeu_si128((__m128i*)(bl + 12), _mm_add_epi32(_mm_loadu_si128((__m128i*)(bl + 12)), _mm_unpackhi_epi16(lo, hi)));
+        }
+    }
+#endif
+
+    for (; count; count--)
+        *bl++ += *lightmap++ * scale;
+}
+
+/*
+===============
+R_StoreLightmapRow -- shifts count channels down to bytes, clamped to 255
 ===============
 */
-void R_BuildLightMap(msurface_t* surf, uint8_t* dest, int stride)
+static void R_StoreLightmapRow(uint8_t* dest, const unsigned* bl, int count, int shift)
+{
+    unsigned t;
+#ifdef USE_SSE2
+    __m128i vshift, a, b, c, d;
+
+    // blocklights never reach the sign bit after the shift, so the signed
+    // pack is safe and packus does the clamp
+    vshift = _mm_cvtsi32_si128(shift);
+    for (; count >= 16; count -= 16, bl += 16, dest += 16)
+    {
+        a = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)bl), vshift);
+        b = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)(bl + 4)), vshift);
+        c = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)(bl + 8)), vshift);
+        d = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)(bl + 12)), vshift);
+        _mm_storeu_si128((__m128i*)dest, _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+#endif
+
+    for (; count; count--)
+    {
+        t = *bl++ >> shift;
+        if (t > 255)
+            t = 255;
+        *dest++ = t;
+    }
+}
+
+/*
+===============
+R_BuildLightMapBlock -- johnfitz -- revised for lit support via lordhavoc
+
+Combine and scale multiple lightmaps into the 8.8 format in blocklights, which
+is scratch space owned by the calling thread
+===============
+*/
+void R_BuildLightMapBlock(msurface_t* surf, uint8_t* dest, int stride, unsigned* blocklights)
 {
     int smax, tmax;
-    int t;
-    int i, j, size;
+    int i, size;
     uint8_t* lightmap;
     unsigned scale;
     int maps;
+    int shift;
     unsigned* bl;
 
     surf->cached_dlight = (surf->dlightframe == r_framecount);
+    surf->stylesdirty = false;
 
     smax = (surf->extents[0] >> 4) + 1;
     tmax = (surf->extents[1] >> 4) + 1;
@@ -1044,20 +1610,13 @@ void R_BuildLightMap(msurface_t* surf, uint8_t* dest, int stride)
             {
                 scale = d_lightstylevalue[surf->styles[maps]];
                 surf->cached_light[maps] = scale; // 8.8 fraction
-                //johnfitz -- lit support via lordhavoc
-                bl = blocklights;
-                for (i = 0; i < size; i++)
-                {
-                    *bl++ += *lightmap++ * scale;
-                    *bl++ += *lightmap++ * scale;
-                    *bl++ += *lightmap++ * scale;
-                }
-                //johnfitz
+                R_AddLightStyle(blocklights, lightmap, size * 3, scale); //johnfitz -- lit support via lordhavoc
+                lightmap += size * 3;
             }
 
         // add all the dynamic lights
         if (surf->dlightframe == r_framecount)
-            R_AddDynamicLights(surf);
+            R_AddDynamicLights(surf, blocklights);
     }
     else
     {
@@ -1071,44 +1630,10 @@ void R_BuildLightMap(msurface_t* surf, uint8_t* dest, int stride)
     switch (gl_lightmap_format)
     {
     case GL_RGB:
-        stride -= smax * 3;
+        shift = gl_overbright.value ? 8 : 7;
         bl = blocklights;
-        for (i = 0; i < tmax; i++, dest += stride)
-        {
-            for (j = 0; j < smax; j++)
-            {
-                if (gl_overbright.value)
-                {
-                    t = *bl++ >> 8;
-                    if (t > 255)
-                        t = 255;
-                    *dest++ = t;
-                    t = *bl++ >> 8;
-                    if (t > 255)
-                        t = 255;
-                    *dest++ = t;
-                    t = *bl++ >> 8;
-                    if (t > 255)
-                        t = 255;
-                    *dest++ = t;
-                }
-                else
-                {
-                    t = *bl++ >> 7;
-                    if (t > 255)
-                        t = 255;
-                    *dest++ = t;
-                    t = *bl++ >> 7;
-                    if (t > 255)
-                        t = 255;
-                    *dest++ = t;
-                    t = *bl++ >> 7;
-                    if (t > 255)
-                        t = 255;
-                    *dest++ = t;
-                }
-            }
-        }
+        for (i = 0; i < tmax; i++, dest += stride, bl += smax * 3)
+            R_StoreLightmapRow(dest, bl, smax * 3, shift);
         break;
     default:
         Sys_Error("R_BuildLightMap: bad lightmap format");
@@ -1116,6 +1641,16 @@ void R_BuildLightMap(msurface_t* surf, uint8_t* dest, int stride)
     //johnfitz
 }
 
+/*
+===============
+R_BuildLightMap -- builds on the calling thread, using the main thread's blocklights
+===============
+*/
+void R_BuildLightMap(msurface_t* surf, uint8_t* dest, int stride)
+{
+    R_BuildLightMapBlock(surf, dest, stride, blocklights[0]);
+}
+
 /*
 ===============
 R_UploadLightmap -- johnfitz -- uploads the modified lightmap to opengl if necessary
@@ -1133,10 +1668,10 @@ void R_UploadLightmap(int lmap)
     lightmap_modified[lmap] = false;
 
     theRect = &lightmap_rectchange[lmap];
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, theRect->t, BLOCK_WIDTH, theRect->h, gl_lightmap_format,
-        GL_UNSIGNED_BYTE, lightmaps + (lmap * BLOCK_HEIGHT + theRect->t) * BLOCK_WIDTH * lightmap_bytes);
-    theRect->l = BLOCK_WIDTH;
-    theRect->t = BLOCK_HEIGHT;
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, theRect->t, lightmap_width, theRect->h, gl_lightmap_format,
+        GL_UNSIGNED_BYTE, lightmaps + (lmap * lightmap_height + theRect->t) * lightmap_width * lightmap_bytes);
+    theRect->l = lightmap_width;
+    theRect->t = lightmap_height;
     theRect->h = 0;
     theRect->w = 0;
 
@@ -1168,19 +1703,110 @@ void R_RebuildAllLightmaps(void)
         {
             if (fa->flags & SURF_DRAWTILED)
                 continue;
-            base = lightmaps + fa->lightmaptexturenum * lightmap_bytes * BLOCK_WIDTH * BLOCK_HEIGHT;
-            base += fa->light_t * BLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
-            R_BuildLightMap(fa, base, BLOCK_WIDTH * lightmap_bytes);
+            base = lightmaps + fa->lightmaptexturenum * lightmap_bytes * lightmap_width * lightmap_height;
+            base += fa->light_t * lightmap_width * lightmap_bytes + fa->light_s * lightmap_bytes;
+            R_BuildLightMap(fa, base, lightmap_width * lightmap_bytes);
         }
     }
 
     //for each lightmap, upload it
-    for (i = 0; i < MAX_LIGHTMAPS; i++)
+    for (i = 0; i < lightmap_count; i++)
     {
-        if (!allocated[i][0])
-            break;
         GL_Bind(lightmap_textures[i]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, BLOCK_WIDTH, BLOCK_HEIGHT, gl_lightmap_format,
-            GL_UNSIGNED_BYTE, lightmaps + i * BLOCK_WIDTH * BLOCK_HEIGHT * lightmap_bytes);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, lightmap_width, lightmap_height, gl_lightmap_format,
+            GL_UNSIGNED_BYTE, lightmaps + i * lightmap_width * lightmap_height * lightmap_bytes);
     }
 }
+
+/*
+================
+R_LightmapBench_f -- rebuilds every world lightmap under a set of moving dynamic lights,
+serially and then on the worker threads, without drawing anything
+
+lightmapbench [dlights] [frames]
+================
+*/
+void R_LightmapBench_f(void)
+{
+    extern int r_dlightframecount;
+    static dlight_t saved[MAX_DLIGHTS];
+    int numlights, frames, pass, frame, i, count, texels;
+    msurface_t* s;
+    dlight_t* dl;
+    vec3_t center, size;
+    double start, time[2];
+    float angle;
+
+    if (!cl.worldmodel)
+    {
+        Con_Printf("lightmapbench: no map loaded\n");
+        return;
+    }
+
+    numlights = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 8;
+    frames = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 100;
+    if (numlights < 0)
+        numlights = 0;
+    if (numlights > 32) // dlightbits is an int
+        numlights = 32;
+    if (frames < 1)
+        frames = 1;
+
+    // every lit surface gets rebuilt each frame, whether it changed or not
+    count = texels = 0;
+    s = &cl.worldmodel->surfaces[cl.worldmodel->firstmodelsurface];
+    for (i = 0; i < cl.worldmodel->nummodelsurfaces; i++, s++)
+        if (!(s->flags & SURF_DRAWTILED))
+        {
+            lightmap_dirty[count++] = s;
+            texels += ((s->extents[0] >> 4) + 1) * ((s->extents[1] >> 4) + 1);
+        }
+
+    VectorAdd(cl.worldmodel->mins, cl.worldmodel->maxs, center);
+    VectorScale(center, 0.5, center);
+    VectorSubtract(cl.worldmodel->maxs, cl.worldmodel->mins, size);
+
+    memcpy(saved, cl_dlights, sizeof(saved));
+    memset(cl_dlights, 0, sizeof(cl_dlights));
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        start = Sys_FloatTime();
+        for (frame = 0; frame < frames; frame++)
+        {
+            r_framecount++;
+            r_dlightframecount = r_framecount;
+
+            // lights circle the middle of the map at a few different heights
+            for (i = 0, dl = cl_dlights; i < numlights; i++, dl++)
+            {
+                angle = (frame * 0.05f) + i * (2 * M_PI / numlights);
+                dl->origin[0] = center[0] + cos(angle) * size[0] * 0.25f;
+                dl->origin[1] = center[1] + sin(angle) * size[1] * 0.25f;
+                dl->origin[2] = center[2] + ((i & 3) - 1.5f) * size[2] * 0.125f;
+                dl->radius = 350;
+                dl->die = cl.time + 1;
+                dl->color[0] = dl->color[1] = dl->color[2] = 1;
+                R_MarkLights(dl, 1 << i, cl.worldmodel->nodes);
+            }
+
+            if (pass)
+                Tasks_ParallelFor(count, R_BuildLightmapTask, lightmap_dirty);
+            else
+                for (i = 0; i < count; i++)
+                    R_BuildLightmapTask(i, 0, lightmap_dirty);
+        }
+        time[pass] = (Sys_FloatTime() - start) * 1000.0;
+    }
+
+    memcpy(cl_dlights, saved, sizeof(saved));
+
+    Con_Printf("lightmapbench: %i surfaces, %i texels, %i dlights, %i frames\n", count, texels, numlights, frames);
+    for (pass = 0; pass < 2; pass++)
+        Con_Printf("%2i thread%s %7.3f ms/frame %9.0f texels/ms\n", pass ? task_numthreads : 1, pass && task_numthreads > 1 ? "s" : " ",
+            time[pass] / frames, time[pass] > 0 ? (double)texels * frames / time[pass] : 0.0);
+
+    // put back the lightmaps the benchmark scribbled over, without its lights
+    r_framecount++;
+    R_RebuildAllLightmaps();
+}
@@ -0,0 +1,458 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// r_lightgrid.c -- light probes sampled from the world lightmaps, for lighting entities
+
+#include "quakedef.h"
+
+/*
+R_LightPoint traces from an entity down to the floor and filters the lightmap where it lands,
+for every entity in every frame. the grid makes those traces once per map, on the background
+thread, from probes LIGHTGRID_CELL units apart, and keeps what each lightstyle adds separately
+so animated lights still animate. an entity blends the eight probes around its origin.
+
+the probes are kept in blocks of 4x4x4 and blocks that are entirely solid are left out, so the
+grid only costs memory where there is open space. probes inside solid take no part in the
+blend, and an entity with none of them around it falls back to R_LightPoint.
+*/
+
+#define LIGHTGRID_CELL 32 // units between probes, doubled until the world fits
+#define LIGHTGRID_MAXPROBES (1 << 21) // in the bounding box of the world
+#define LIGHTGRID_BLOCK 4
+#define LIGHTGRID_BLOCKPROBES (LIGHTGRID_BLOCK * LIGHTGRID_BLOCK * LIGHTGRID_BLOCK)
+#define LIGHTPROBE_SOLID 254 // in styles[0]. 255 ends the styles, like in msurface_t
+
+cvar_t r_lightgrid = { "r_lightgrid", "1" };
+
+typedef struct
+{
+    uint8_t styles[MAXLIGHTMAPS];
+    uint8_t rgb[MAXLIGHTMAPS][3]; // the filtered lightmap of each style, before d_lightstylevalue
+} lightprobe_t;
+
+typedef struct
+{
+    model_t* model; // the world it is built for
+    vec3_t origin; // of probe 0,0,0
+    float cell, invcell;
+    int size[3]; // in probes
+    int blocks[3];
+    int* blockindex; // by block, -1 if it is all solid, else its place in probes
+    lightprobe_t* probes;
+    int numblocks; // in probes
+    bool building; // on the background thread
+    bool ready;
+    double buildtime;
+} lightgrid_t;
+
+static lightgrid_t lightgrid;
+
+/*
+=============
+R_LightProbeSolid
+=============
+*/
+static bool R_LightProbeSolid(model_t* model, vec3_t p)
+{
+    int contents = Mod_PointInLeaf(p, model)->contents;
+
+    return contents == CONTENTS_SOLID || contents == CONTENTS_SKY;
+}
+
+/*
+=============
+R_TraceLightProbe -- RecursiveLightPoint, but keeping each style of the texel it lands on apart
+=============
+*/
+static bool R_TraceLightProbe(model_t* model, lightprobe_t* probe, mnode_t* node, vec3_t start, vec3_t end)
+{
+    float front, back, frac;
+    vec3_t mid;
+    msurface_t* surf;
+    uint8_t* lightmap;
+    int i, ds, dt, maps, c, line3, mapsize, s0, s1;
+
+loc0:
+    if (node->contents < 0)
+        return false; // didn't hit anything
+
+    if (node->plane->type < 3)
+    {
+        front = start[node->plane->type] - node->plane->dist;
+        back = end[node->plane->type] - node->plane->dist;
+    }
+    else
+    {
+        front = DotProduct(start, node->plane->normal) - node->plane->dist;
+        back = DotProduct(end, node->plane->normal) - node->plane->dist;
+    }
+
+    if ((back < 0) == (front < 0))
+    {
+        node = node->children[front < 0];
+        goto loc0;
+    }
+
+    frac = front / (front - back);
+    mid[0] = start[0] + (end[0] - start[0]) * frac;
+    mid[1] = start[1] + (end[1] - start[1]) * frac;
+    mid[2] = start[2] + (end[2] - start[2]) * frac;
+
+    // go down front side
+    if (R_TraceLightProbe(model, probe, node->children[front < 0], start, mid))
+        return true;
+
+    // check for impact on this node
+    surf = model->surfaces + node->firstsurface;
+    for (i = 0; i < node->numsurfaces; i++, surf++)
+    {
+        if (surf->flags & SURF_DRAWTILED)
+            continue; // no lightmaps
+
+        ds = (int)((float)DotProduct(mid, surf->texinfo->vecs[0]) + surf->texinfo->vecs[0][3]);
+        dt = (int)((float)DotProduct(mid, surf->texinfo->vecs[1]) + surf->texinfo->vecs[1][3]);
+
+        if (ds < surf->texturemins[0] || dt < surf->texturemins[1])
+            continue;
+
+        ds -= surf->texturemins[0];
+        dt -= surf->texturemins[1];
+
+        if (ds > surf->extents[0] || dt > surf->extents[1])
+            continue;
+
+        if (surf->samples)
+        {
+            // the same bilinear filter as RecursiveLightPoint, in 8.8 fixed point
+            line3 = ((surf->extents[0] >> 4) + 1) * 3;
+            mapsize = line3 * ((surf->extents[1] >> 4) + 1);
+            lightmap = surf->samples + (dt >> 4) * line3 + (ds >> 4) * 3;
+            ds &= 15;
+            dt &= 15;
+
+            for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++, lightmap += mapsize)
+            {
+                probe->styles[maps] = surf->styles[maps];
+                for (c = 0; c < 3; c++)
+                {
+                    s0 = lightmap[c] * 16 + (lightmap[3 + c] - lightmap[c]) * ds;
+                    s1 = lightmap[line3 + c] * 16 + (lightmap[line3 + 3 + c] - lightmap[line3 + c]) * ds;
+                    probe->rgb[maps][c] = (s0 * 16 + (s1 - s0) * dt) >> 8;
+                }
+            }
+        }
+        return true;
+    }
+
+    // go down back side
+    return R_TraceLightProbe(model, probe, node->children[front >= 0], mid, end);
+}
+
+/*
+=============
+R_BuildLightGrid -- runs on the background thread. only reads the world, and allocates with
+malloc rather than on the hunk
+=============
+*/
+static void R_BuildLightGrid(int index, int thread, void* data)
+{
+    lightgrid_t* grid = (lightgrid_t*)data;
+    model_t* model = grid->model;
+    lightprobe_t* probe;
+    vec3_t p, end;
+    int b, numblocks, i, x, y, z, open;
+    double start;
+
+    start = Sys_PerfTime();
+
+    // find the blocks with any open space in them
+    numblocks = grid->blocks[0] * grid->blocks[1] * grid->blocks[2];
+    grid->numblocks = 0;
+    for (b = 0; b < numblocks; b++)
+    {
+        open = 0;
+        for (i = 0; i < LIGHTGRID_BLOCKPROBES && !open; i++)
+        {
+            x = (b % grid->blocks[0]) * LIGHTGRID_BLOCK + (i & 3);
+            y = ((b / grid->blocks[0]) % grid->blocks[1]) * LIGHTGRID_BLOCK + ((i >> 2) & 3);
+            z = (b / (grid->blocks[0] * grid->blocks[1])) * LIGHTGRID_BLOCK + (i >> 4);
+            if (x >= grid->size[0] || y >= grid->size[1] || z >= grid->size[2])
+                continue;
+            p[0] = grid->origin[0] + x * grid->cell;
+            p[1] = grid->origin[1] + y * grid->cell;
+            p[2] = grid->origin[2] + z * grid->cell;
+            open = !R_LightProbeSolid(model, p);
+        }
+        grid->blockindex[b] = open ? grid->numblocks++ : -1;
+    }
+
+    grid->probes = (lightprobe_t*)malloc(grid->numblocks * LIGHTGRID_BLOCKPROBES * sizeof(lightprobe_t));
+    if (!grid->probes)
+    {
+        grid->numblocks = 0;
+        return; // every entity falls back to R_LightPoint
+    }
+
+    // trace each probe in them
+    for (b = 0; b < numblocks; b++)
+    {
+        if (grid->blockindex[b] < 0)
+            continue;
+
+        probe = grid->probes + grid->blockindex[b] * LIGHTGRID_BLOCKPROBES;
+        for (i = 0; i < LIGHTGRID_BLOCKPROBES; i++, probe++)
+        {
+            memset(probe->styles, 255, sizeof(probe->styles));
+            memset(probe->rgb, 0, sizeof(probe->rgb));
+
+            x = (b % grid->blocks[0]) * LIGHTGRID_BLOCK + (i & 3);
+            y = ((b / grid->blocks[0]) % grid->blocks[1]) * LIGHTGRID_BLOCK + ((i >> 2) & 3);
+            z = (b / (grid->blocks[0] * grid->blocks[1])) * LIGHTGRID_BLOCK + (i >> 4);
+            p[0] = grid->origin[0] + x * grid->cell;
+            p[1] = grid->origin[1] + y * grid->cell;
+            p[2] = grid->origin[2] + z * grid->cell;
+            if (x >= grid->size[0] || y >= grid->size[1] || z >= grid->size[2] || R_LightProbeSolid(model, p))
+            {
+                probe->styles[0] = LIGHTPROBE_SOLID;
+                continue;
+            }
+
+            end[0] = p[0];
+            end[1] = p[1];
+            end[2] = p[2] - 8192; // as far as R_LightPoint looks
+            R_TraceLightProbe(model, probe, model->nodes, p, end);
+        }
+    }
+
+    grid->buildtime = Sys_PerfTime() - start;
+}
+
+/*
+=============
+R_FreeLightGrid
+=============
+*/
+void R_FreeLightGrid(void)
+{
+    if (lightgrid.building)
+        Tasks_Join();
+
+    free(lightgrid.blockindex);
+    free(lightgrid.probes);
+    memset(&lightgrid, 0, sizeof(lightgrid));
+}
+
+/*
+=============
+R_InitLightGrid -- starts building the grid for the new map on the background thread, entities
+are lit with R_LightPoint until R_PollLightGrid sees it done
+=============
+*/
+void R_InitLightGrid(void)
+{
+    model_t* model = cl.worldmodel;
+    int i;
+
+    R_FreeLightGrid();
+
+    if (!model->lightdata)
+        return; // R_LightPoint is fullbright anyway
+
+    lightgrid.model = model;
+    VectorCopy(model->mins, lightgrid.origin);
+    for (lightgrid.cell = LIGHTGRID_CELL;; lightgrid.cell *= 2)
+    {
+        for (i = 0; i < 3; i++)
+            lightgrid.size[i] = (int)ceil((model->maxs[i] - model->mins[i]) / lightgrid.cell) + 1;
+        if ((double)lightgrid.size[0] * lightgrid.size[1] * lightgrid.size[2] <= LIGHTGRID_MAXPROBES)
+            break;
+    }
+    lightgrid.invcell = 1.0f / lightgrid.cell;
+
+    for (i = 0; i < 3; i++)
+        lightgrid.blocks[i] = (lightgrid.size[i] + LIGHTGRID_BLOCK - 1) / LIGHTGRID_BLOCK;
+    lightgrid.blockindex = (int*)malloc(lightgrid.blocks[0] * lightgrid.blocks[1] * lightgrid.blocks[2] * sizeof(int));
+    if (!lightgrid.blockindex)
+        return;
+
+    lightgrid.building = true;
+    Tasks_Begin(R_BuildLightGrid, &lightgrid);
+}
+
+/*
+=============
+R_PollLightGrid -- called once per scene on the main thread, before the scene prep starts
+=============
+*/
+void R_PollLightGrid(void)
+{
+    if (!lightgrid.building || !Tasks_Done())
+        return;
+
+    lightgrid.building = false;
+    lightgrid.ready = lightgrid.probes != NULL;
+    if (lightgrid.ready)
+        Con_DPrintf("light grid: %i of %i probes in %.0f unit cells, %.0f ms\n",
+            lightgrid.numblocks * LIGHTGRID_BLOCKPROBES, lightgrid.size[0] * lightgrid.size[1] * lightgrid.size[2],
+            lightgrid.cell, lightgrid.buildtime * 1000.0);
+}
+
+/*
+=============
+R_LightProbe -- NULL if the probe is outside the open space
+=============
+*/
+static lightprobe_t* R_LightProbe(int x, int y, int z)
+{
+    lightprobe_t* probe;
+    int b;
+
+    b = lightgrid.blockindex[(x >> 2) + ((y >> 2) + (z >> 2) * lightgrid.blocks[1]) * lightgrid.blocks[0]];
+    if (b < 0)
+        return NULL;
+
+    probe = lightgrid.probes + b * LIGHTGRID_BLOCKPROBES + (x & 3) + (y & 3) * 4 + (z & 3) * 16;
+    return probe->styles[0] == LIGHTPROBE_SOLID ? NULL : probe;
+}
+
+/*
+=============
+R_LightGridPoint -- what R_LightPointColor would give at p, blended from the probes around it.
+false if the grid isn't ready or has no open probes there
+=============
+*/
+bool R_LightGridPoint(vec3_t p, vec3_t color)
+{
+    lightprobe_t* probe;
+    float frac[3], w, weight, scale;
+    int cell[3], corner, maps, i;
+
+    if (!lightgrid.ready || lightgrid.model != cl.worldmodel)
+        return false;
+
+    for (i = 0; i < 3; i++)
+    {
+        frac[i] = (p[i] - lightgrid.origin[i]) * lightgrid.invcell;
+        cell[i] = (int)floor(frac[i]);
+        if (cell[i] < 0 || cell[i] >= lightgrid.size[i] - 1)
+            return false;
+        frac[i] -= cell[i];
+    }
+
+    color[0] = color[1] = color[2] = 0;
+    weight = 0;
+    for (corner = 0; corner < 8; corner++)
+    {
+        probe = R_LightProbe(cell[0] + (corner & 1), cell[1] + ((corner >> 1) & 1), cell[2] + (corner >> 2));
+        if (!probe)
+            continue;
+
+        w = ((corner & 1) ? frac[0] : 1 - frac[0]) * ((corner & 2) ? frac[1] : 1 - frac[1]) * ((corner & 4) ? frac[2] : 1 - frac[2]);
+        for (maps = 0; maps < MAXLIGHTMAPS && probe->styles[maps] != 255; maps++)
+        {
+            scale = w * d_lightstylevalue[probe->styles[maps]] * (1.0f / 256.0f);
+            color[0] += probe->rgb[maps][0] * scale;
+            color[1] += probe->rgb[maps][1] * scale;
+            color[2] += probe->rgb[maps][2] * scale;
+        }
+        weight += w;
+    }
+
+    if (weight < 0.01f)
+        return false;
+
+    VectorScale(color, 1.0f / weight, color);
+    return true;
+}
+
+/*
+=============
+R_LightGridBench_f -- lights a crowd of entities in front of the view, the crowdbench layout,
+with R_LightPoint and then with the light grid, and reports the cpu time per frame
+
+lightgridbench [count] [frames]
+=============
+*/
+void R_LightGridBench_f(void)
+{
+    static vec3_t crowd[1024];
+    vec3_t color, check;
+    int count, frames, pass, frame, i, fallbacks;
+    float saved, diff;
+    double start, cpu[2];
+
+    if (!cl.worldmodel)
+    {
+        Con_Printf("lightgridbench: no map loaded\n");
+        return;
+    }
+    if (!lightgrid.ready)
+    {
+        Con_Printf("lightgridbench: the light grid is %s\n", lightgrid.building ? "still being built" : "not available");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 200;
+    frames = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 100;
+    count = CLAMP(1, count, 1024);
+    if (frames < 1)
+        frames = 1;
+
+    // rows of 20 starting just in front of the view
+    for (i = 0; i < count; i++)
+    {
+        VectorMA(r_refdef.vieworg, 128 + (i / 20) * 64, vpn, crowd[i]);
+        VectorMA(crowd[i], ((i % 20) - 9.5f) * 48, vright, crowd[i]);
+    }
+
+    saved = r_lightgrid.value;
+    for (pass = 0; pass < 2; pass++)
+    {
+        Cvar_SetValue("r_lightgrid", pass);
+        start = Sys_FloatTime();
+        for (frame = 0; frame < frames; frame++)
+            for (i = 0; i < count; i++)
+                R_LightEntity(crowd[i], color);
+        cpu[pass] = (Sys_FloatTime() - start) * 1000.0 / frames;
+    }
+    Cvar_SetValue("r_lightgrid", saved);
+
+    // how far the grid is from the traces
+    fallbacks = 0;
+    diff = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (!R_LightGridPoint(crowd[i], color))
+        {
+            fallbacks++;
+            continue;
+        }
+        R_LightPointColor(crowd[i], check);
+        diff += fabs(color[0] - check[0]) + fabs(color[1] - check[1]) + fabs(color[2] - check[2]);
+    }
+
+    Con_Printf("lightgridbench: %i entities, %i frames, %i dlights\n", count, frames, r_numlivedlights);
+    Con_Printf("grid:        %i probes in %.0f unit cells, %.1f kb, built in %.0f ms\n",
+        lightgrid.numblocks * LIGHTGRID_BLOCKPROBES, lightgrid.cell,
+        lightgrid.numblocks * LIGHTGRID_BLOCKPROBES * sizeof(lightprobe_t) / 1024.0, lightgrid.buildtime * 1000.0);
+    Con_Printf("R_LightPoint: %7.3f ms per frame\n", cpu[0]);
+    Con_Printf("light grid:   %7.3f ms per frame, %i fell back, %.1f mean difference\n",
+        cpu[1], fallbacks, count > fallbacks ? diff / (3 * (count - fallbacks)) : 0.0f);
+}
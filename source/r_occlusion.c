@@ -0,0 +1,552 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// r_occlusion.c -- software rasterized occlusion buffer, for culling hidden leafs and entities
+
+#include "quakedef.h"
+
+void R_MarkSurfaces(void);
+void R_CullSurfaces(void);
+void R_SetFrustum(float fovx, float fovy);
+extern float r_fovx, r_fovy;
+extern cvar_t r_stereo;
+
+/*
+the buffer holds 1/z (view depth) of the large world faces that survived frustum and backface
+culling, at a fraction of the screen resolution. everything here is done on the cpu, so it
+doesn't need a gl context and works the same in the benchmarks.
+
+both sides of the test are conservative: an occluder only writes pixels it covers completely,
+with the farthest depth it has inside the pixel, and a box is only hidden if every pixel under
+its screen rectangle is closer than the nearest corner of the box.
+*/
+
+#define OCC_WIDTH 256
+#define OCC_HEIGHT 128
+#define OCC_LEVELS 5 // 256x128 down to 16x8
+#define OCC_BANDROWS 8 // rows per rasterizer task
+#define OCC_NEAR 4 // NEARCLIP in gl_rmain.c
+#define OCC_MAXVERTS 64 // faces with more are not used as occluders
+
+#define MAX_OCC_SHOWN 1024
+
+#define OCC_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define OCC_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+cvar_t r_occlusion = { "r_occlusion", "1" };
+cvar_t r_occlusion_minarea = { "r_occlusion_minarea", "64" }; // in buffer pixels, smaller faces don't occlude
+cvar_t r_showocclusion = { "r_showocclusion", "0" };
+
+int rs_occluders, rs_occludedleafs, rs_occludedents;
+
+bool r_occlusionready; // the buffer is built for the current view
+
+typedef struct
+{
+    int firstvert;
+    int numverts;
+    int minx, maxx, miny, maxy; // pixels it may cover
+    float wa, wb, wc; // 1/z = wa * x + wb * y + wc across the face
+    float winding; // 1 if the screen vertexes run counterclockwise, -1 if clockwise
+} occpoly_t;
+
+typedef struct
+{
+    vec3_t mins, maxs;
+    bool entity;
+} occshown_t;
+
+// level 0 is the full buffer, each level above holds the smallest (farthest) 1/z of the 2x2
+// pixels under it. 0 means nothing has been drawn there
+static float occ_buffer[OCC_WIDTH * OCC_HEIGHT * 2];
+static float* occ_levels[OCC_LEVELS];
+
+static occpoly_t* occ_polys;
+static float (*occ_verts)[3]; // screen x, y and 1/z
+static int occ_numpolys, occ_numverts;
+
+static vec3_t occ_origin, occ_forward, occ_right, occ_up;
+static float occ_xscale, occ_yscale;
+
+static occshown_t occ_shown[MAX_OCC_SHOWN]; // for r_showocclusion
+static int occ_numshown;
+
+/*
+===============
+R_InitOcclusion -- called at level load time
+===============
+*/
+void R_InitOcclusion(void)
+{
+    int i, numverts;
+    msurface_t* s;
+    float* level;
+
+    numverts = 0;
+    for (i = 0, s = cl.worldmodel->surfaces; i < cl.worldmodel->numsurfaces; i++, s++)
+        if (!(s->flags & SURF_DRAWTILED))
+            numverts += s->polys->numverts + 1; // clipping against the near plane adds at most one
+
+    occ_polys = Hunk_AllocName((cl.worldmodel->numsurfaces + 1) * sizeof(occpoly_t), "occpolys");
+    occ_verts = Hunk_AllocName((numverts + 1) * sizeof(occ_verts[0]), "occverts");
+
+    level = occ_buffer;
+    for (i = 0; i < OCC_LEVELS; i++)
+    {
+        occ_levels[i] = level;
+        level += (OCC_WIDTH >> i) * (OCC_HEIGHT >> i);
+    }
+
+    r_occlusionready = false;
+}
+
+/*
+===============
+R_OcclusionView -- world position to view space. returns false if it is closer than the near plane
+===============
+*/
+static bool R_OcclusionView(const float* in, vec3_t out)
+{
+    vec3_t d;
+
+    VectorSubtract(in, occ_origin, d);
+    out[0] = DotProduct(d, occ_right);
+    out[1] = DotProduct(d, occ_up);
+    out[2] = DotProduct(d, occ_forward);
+    return out[2] >= OCC_NEAR;
+}
+
+/*
+===============
+R_OcclusionProject -- view space to buffer x, y and 1/z
+===============
+*/
+static void R_OcclusionProject(const vec3_t view, float* out)
+{
+    float w = 1.0f / view[2];
+
+    out[0] = OCC_WIDTH * 0.5f + view[0] * w * occ_xscale;
+    out[1] = OCC_HEIGHT * 0.5f - view[1] * w * occ_yscale;
+    out[2] = w;
+}
+
+/*
+===============
+R_AddOccluder -- clips a world face to the near plane and projects it into occ_polys, unless
+it turns out too small on screen to be worth drawing
+===============
+*/
+static void R_AddOccluder(msurface_t* surf)
+{
+    vec3_t view[OCC_MAXVERTS], clipped[OCC_MAXVERTS + 1];
+    bool front[OCC_MAXVERTS];
+    glpoly_t* p = surf->polys;
+    occpoly_t* poly;
+    float(*v)[3];
+    float area, best, a, frac, det, minx, maxx, miny, maxy;
+    int i, j, n, tri;
+
+    if (p->numverts > OCC_MAXVERTS)
+        return;
+
+    // clip against the near plane
+    for (i = 0; i < p->numverts; i++)
+        front[i] = R_OcclusionView(p->verts[i], view[i]);
+    for (i = n = 0; i < p->numverts; i++)
+    {
+        j = (i + 1) % p->numverts;
+        if (front[i])
+        {
+            VectorCopy(view[i], clipped[n]);
+            n++;
+        }
+        if (front[i] != front[j])
+        {
+            frac = (OCC_NEAR - view[i][2]) / (view[j][2] - view[i][2]);
+            clipped[n][0] = view[i][0] + frac * (view[j][0] - view[i][0]);
+            clipped[n][1] = view[i][1] + frac * (view[j][1] - view[i][1]);
+            clipped[n][2] = OCC_NEAR;
+            n++;
+        }
+    }
+    if (n < 3)
+        return;
+
+    v = occ_verts + occ_numverts;
+    for (i = 0; i < n; i++)
+        R_OcclusionProject(clipped[i], v[i]);
+
+    // screen area, and the fan triangle that gives the most reliable depth plane
+    area = best = 0;
+    tri = 1;
+    for (i = 1; i < n - 1; i++)
+    {
+        a = (v[i][0] - v[0][0]) * (v[i + 1][1] - v[0][1]) - (v[i + 1][0] - v[0][0]) * (v[i][1] - v[0][1]);
+        area += a;
+        if (fabs(a) > best)
+        {
+            best = fabs(a);
+            tri = i;
+        }
+    }
+    if (fabs(area) * 0.5f < r_occlusion_minarea.value)
+        return;
+
+    minx = maxx = v[0][0];
+    miny = maxy = v[0][1];
+    for (i = 1; i < n; i++)
+    {
+        minx = OCC_MIN(minx, v[i][0]);
+        maxx = OCC_MAX(maxx, v[i][0]);
+        miny = OCC_MIN(miny, v[i][1]);
+        maxy = OCC_MAX(maxy, v[i][1]);
+    }
+    if (maxx < 0 || minx >= OCC_WIDTH || maxy < 0 || miny >= OCC_HEIGHT)
+        return;
+
+    poly = &occ_polys[occ_numpolys++];
+    poly->firstvert = occ_numverts;
+    poly->numverts = n;
+    poly->minx = OCC_MAX(0, (int)minx);
+    poly->maxx = OCC_MIN(OCC_WIDTH - 1, (int)maxx);
+    poly->miny = OCC_MAX(0, (int)miny);
+    poly->maxy = OCC_MIN(OCC_HEIGHT - 1, (int)maxy);
+    poly->winding = area > 0 ? 1 : -1;
+
+    // 1/z is linear in screen space
+    det = (v[tri][0] - v[0][0]) * (v[tri + 1][1] - v[0][1]) - (v[tri + 1][0] - v[0][0]) * (v[tri][1] - v[0][1]);
+    poly->wa = ((v[tri][2] - v[0][2]) * (v[tri + 1][1] - v[0][1]) - (v[tri + 1][2] - v[0][2]) * (v[tri][1] - v[0][1])) / det;
+    poly->wb = ((v[tri][0] - v[0][0]) * (v[tri + 1][2] - v[0][2]) - (v[tri + 1][0] - v[0][0]) * (v[tri][2] - v[0][2])) / det;
+    poly->wc = v[0][2] - poly->wa * v[0][0] - poly->wb * v[0][1];
+
+    occ_numverts += n;
+}
+
+/*
+===============
+R_RasterOcclusionBand -- draws every occluder into OCC_BANDROWS rows of the buffer. bands
+don't share pixels, so they can all be drawn at once
+===============
+*/
+static void R_RasterOcclusionBand(int band, int thread, void* data)
+{
+    float edges[OCC_MAXVERTS + 1][3];
+    float *depth, (*v)[3], woffset, w, cx, cy;
+    occpoly_t* poly;
+    int i, j, x, y, top, bottom;
+
+    top = band * OCC_BANDROWS;
+    bottom = top + OCC_BANDROWS - 1;
+
+    for (i = 0, poly = occ_polys; i < occ_numpolys; i++, poly++)
+    {
+        if (poly->maxy < top || poly->miny > bottom)
+            continue;
+
+        // edge functions, positive inside and shifted in by half a pixel, so a pixel only
+        // passes if all of its square is inside
+        v = occ_verts + poly->firstvert;
+        for (j = 0; j < poly->numverts; j++)
+        {
+            float* v0 = v[j];
+            float* v1 = v[(j + 1) % poly->numverts];
+
+            edges[j][0] = (v0[1] - v1[1]) * poly->winding;
+            edges[j][1] = (v1[0] - v0[0]) * poly->winding;
+            edges[j][2] = (v0[0] * v1[1] - v1[0] * v0[1]) * poly->winding - 0.5f * (fabs(edges[j][0]) + fabs(edges[j][1]));
+        }
+
+        // and the farthest depth inside the pixel
+        woffset = 0.5f * (fabs(poly->wa) + fabs(poly->wb));
+
+        for (y = OCC_MAX(top, poly->miny); y <= OCC_MIN(bottom, poly->maxy); y++)
+        {
+            cy = y + 0.5f;
+            depth = occ_levels[0] + y * OCC_WIDTH;
+            for (x = poly->minx; x <= poly->maxx; x++)
+            {
+                cx = x + 0.5f;
+                for (j = 0; j < poly->numverts; j++)
+                    if (edges[j][0] * cx + edges[j][1] * cy + edges[j][2] < 0)
+                        break;
+                if (j < poly->numverts)
+                    continue;
+
+                w = poly->wa * cx + poly->wb * cy + poly->wc - woffset;
+                if (w > depth[x])
+                    depth[x] = w;
+            }
+        }
+    }
+}
+
+/*
+===============
+R_BuildOcclusion -- called every frame after R_CullSurfaces
+===============
+*/
+void R_BuildOcclusion(void)
+{
+    msurface_t* s;
+    float *src, *dst;
+    int i, x, y, w, h;
+
+    r_occlusionready = false;
+    occ_numshown = 0;
+
+    if (!r_occlusion.value || !r_drawworld_cheatsafe || r_stereo.value || !occ_polys)
+        return;
+
+    VectorCopy(r_origin, occ_origin);
+    VectorCopy(vpn, occ_forward);
+    VectorCopy(vright, occ_right);
+    VectorCopy(vup, occ_up);
+    occ_xscale = OCC_WIDTH * 0.5f / tan(r_fovx * M_PI / 360.0);
+    occ_yscale = OCC_HEIGHT * 0.5f / tan(r_fovy * M_PI / 360.0);
+
+    occ_numpolys = occ_numverts = 0;
+    s = &cl.worldmodel->surfaces[cl.worldmodel->firstmodelsurface];
+    for (i = 0; i < cl.worldmodel->nummodelsurfaces; i++, s++)
+        if (s->visframe == r_visframecount && !s->culled && !(s->flags & SURF_DRAWTILED))
+            R_AddOccluder(s);
+    rs_occluders += occ_numpolys;
+
+    memset(occ_levels[0], 0, OCC_WIDTH * OCC_HEIGHT * sizeof(float));
+    Tasks_ParallelFor(OCC_HEIGHT / OCC_BANDROWS, R_RasterOcclusionBand, NULL);
+
+    for (i = 1; i < OCC_LEVELS; i++)
+    {
+        w = OCC_WIDTH >> i;
+        h = OCC_HEIGHT >> i;
+        src = occ_levels[i - 1];
+        dst = occ_levels[i];
+        for (y = 0; y < h; y++)
+            for (x = 0; x < w; x++)
+            {
+                float* s0 = src + (y * 2) * (w * 2) + x * 2;
+                float* s1 = s0 + w * 2;
+                dst[y * w + x] = OCC_MIN(OCC_MIN(s0[0], s0[1]), OCC_MIN(s1[0], s1[1]));
+            }
+    }
+
+    r_occlusionready = true;
+}
+
+/*
+===============
+R_OccludedBox -- returns true if the box is completely hidden behind the occluders. safe to
+call from any thread once R_BuildOcclusion is done
+===============
+*/
+bool R_OccludedBox(vec3_t mins, vec3_t maxs)
+{
+    vec3_t corner, view;
+    float screen[3], minx, maxx, miny, maxy, nearest, *depth;
+    int i, x0, x1, y0, y1, x, y, level, width;
+
+    if (!r_occlusionready)
+        return false;
+
+    minx = miny = 999999;
+    maxx = maxy = -999999;
+    nearest = 0;
+    for (i = 0; i < 8; i++)
+    {
+        corner[0] = (i & 1) ? maxs[0] : mins[0];
+        corner[1] = (i & 2) ? maxs[1] : mins[1];
+        corner[2] = (i & 4) ? maxs[2] : mins[2];
+        if (!R_OcclusionView(corner, view))
+            return false; // reaches past the near plane, so it surrounds the camera
+        R_OcclusionProject(view, screen);
+        minx = OCC_MIN(minx, screen[0]);
+        maxx = OCC_MAX(maxx, screen[0]);
+        miny = OCC_MIN(miny, screen[1]);
+        maxy = OCC_MAX(maxy, screen[1]);
+        nearest = OCC_MAX(nearest, screen[2]);
+    }
+
+    if (maxx < 0 || minx >= OCC_WIDTH || maxy < 0 || miny >= OCC_HEIGHT)
+        return false; // off screen, that's for the frustum cull to decide
+
+    x0 = OCC_MAX(0, (int)minx);
+    x1 = OCC_MIN(OCC_WIDTH - 1, (int)maxx);
+    y0 = OCC_MAX(0, (int)miny);
+    y1 = OCC_MIN(OCC_HEIGHT - 1, (int)maxy);
+
+    // the coarsest level where the rectangle covers at most 4x4 pixels
+    for (level = 0; level < OCC_LEVELS - 1; level++)
+        if ((x1 >> level) - (x0 >> level) < 4 && (y1 >> level) - (y0 >> level) < 4)
+            break;
+
+    depth = occ_levels[level];
+    width = OCC_WIDTH >> level;
+    for (y = y0 >> level; y <= y1 >> level; y++)
+        for (x = x0 >> level; x <= x1 >> level; x++)
+            if (depth[y * width + x] <= nearest)
+                return false;
+
+    return true;
+}
+
+/*
+===============
+R_OcclusionShow -- remembers a hidden box for r_showocclusion
+===============
+*/
+void R_OcclusionShow(vec3_t mins, vec3_t maxs, bool entity)
+{
+    occshown_t* shown;
+
+    if (!r_showocclusion.value || occ_numshown == MAX_OCC_SHOWN)
+        return;
+
+    shown = &occ_shown[occ_numshown++];
+    VectorCopy(mins, shown->mins);
+    VectorCopy(maxs, shown->maxs);
+    shown->entity = entity;
+}
+
+/*
+===============
+R_ShowOcclusion -- draws the boxes hidden this frame, leafs in dark red and entities in bright red
+===============
+*/
+void R_ShowOcclusion(void)
+{
+    int i;
+
+    if (!r_showocclusion.value || cl.maxclients > 1 || !occ_numshown)
+        return;
+
+    glDisable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    GL_PolygonOffset(OFFSET_SHOWTRIS);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_CULL_FACE);
+
+    for (i = 0; i < occ_numshown; i++)
+    {
+        if (occ_shown[i].entity)
+            glColor3f(1, 0, 0);
+        else
+            glColor3f(0.4f, 0, 0);
+        R_EmitWireBox(occ_shown[i].mins, occ_shown[i].maxs);
+    }
+
+    glColor3f(1, 1, 1);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_CULL_FACE);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    GL_PolygonOffset(OFFSET_NONE);
+    glEnable(GL_DEPTH_TEST);
+
+    Sbar_Changed(); //so we don't get dots collecting on the statusbar
+}
+
+/*
+===============
+R_OcclusionBench_f -- turns the view in place and times building the occlusion buffer and
+testing the world leafs and the visible entities against it. nothing is drawn
+
+occlusionbench [frames]
+===============
+*/
+void R_OcclusionBench_f(void)
+{
+    vec3_t savedangles, mins, maxs;
+    entity_t* e;
+    int frames, frame, i, savedvisedicts, savedpolys, occluders, leafs, ents, tested;
+    double start, buildtime, leaftime, enttime;
+    float saved;
+
+    if (!cl.worldmodel || !r_viewleaf)
+    {
+        Con_Printf("occlusionbench: no map loaded\n");
+        return;
+    }
+
+    frames = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 360;
+    if (frames < 1)
+        frames = 1;
+
+    VectorCopy(r_refdef.viewangles, savedangles);
+    savedvisedicts = cl_numvisedicts;
+    savedpolys = rs_brushpolys;
+    saved = r_occlusion.value;
+    if (!saved)
+        Cvar_SetValue("r_occlusion", 1);
+
+    buildtime = leaftime = enttime = 0;
+    occluders = leafs = ents = tested = 0;
+    for (frame = 0; frame < frames; frame++)
+    {
+        r_refdef.viewangles[1] = frame * 360.0 / frames;
+        AngleVectors(r_refdef.viewangles, vpn, vright, vup);
+        R_SetFrustum(r_fovx, r_fovy);
+        r_oldviewleaf = NULL;
+        cl_numvisedicts = savedvisedicts;
+        R_MarkSurfaces();
+        R_CullSurfaces();
+
+        rs_occluders = rs_occludedleafs = rs_occludedents = 0;
+
+        start = Sys_FloatTime();
+        R_BuildOcclusion();
+        buildtime += Sys_FloatTime() - start;
+
+        start = Sys_FloatTime();
+        R_OccludeWorld();
+        leaftime += Sys_FloatTime() - start;
+
+        start = Sys_FloatTime();
+        for (i = 0; i < cl_numvisedicts; i++)
+        {
+            e = cl_visedicts[i];
+            if (!e->model)
+                continue;
+            VectorAdd(e->origin, e->model->rmins, mins);
+            VectorAdd(e->origin, e->model->rmaxs, maxs);
+            if (R_OccludedBox(mins, maxs))
+                rs_occludedents++;
+            tested++;
+        }
+        enttime += Sys_FloatTime() - start;
+
+        occluders += rs_occluders;
+        leafs += rs_occludedleafs;
+        ents += rs_occludedents;
+    }
+
+    if (!saved)
+        Cvar_SetValue("r_occlusion", 0);
+    VectorCopy(savedangles, r_refdef.viewangles);
+    AngleVectors(r_refdef.viewangles, vpn, vright, vup);
+    R_SetFrustum(r_fovx, r_fovy);
+    cl_numvisedicts = savedvisedicts;
+    rs_brushpolys = savedpolys;
+    r_occlusionready = false;
+    r_viewleaf = NULL; // rebuild the chains for the real view next frame
+
+    Con_Printf("occlusionbench: %i frames, %.0f occluders, %.0f leafs and %.0f of %.0f entities hidden per frame\n",
+        frames, (double)occluders / frames, (double)leafs / frames, (double)ents / frames, (double)tested / frames);
+    Con_Printf("build:    %7.3f ms per frame, %i threads\n", buildtime * 1000.0 / frames, task_numthreads);
+    Con_Printf("leafs:    %7.3f ms per frame\n", leaftime * 1000.0 / frames);
+    Con_Printf("entities: %7.3f ms per frame\n", enttime * 1000.0 / frames);
+}
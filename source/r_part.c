@@ -21,6 +21,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #define MAX_PARTICLES 2048 // default max # of particles at one
 //  time
 #define ABSOLUTE_MIN_PARTICLES 512 // no fewer than this no matter what's
@@ -30,11 +35,38 @@ int ramp1[8] = { 0x6f, 0x6d, 0x6b, 0x69, 0x67, 0x65, 0x63, 0x61 };
 int ramp2[8] = { 0x6f, 0x6e, 0x6d, 0x6c, 0x6b, 0x6a, 0x68, 0x66 };
 int ramp3[8] = { 0x6d, 0x6b, 6, 5, 4, 3 };
 
-particle_t *active_particles, *free_particles, *particles;
+// live particles of one type, as parallel arrays so each behavior is a flat loop over floats.
+// every pool can hold r_numparticles, but all of them together never hold more than that
+typedef struct
+{
+    int numparticles;
+    float* org[3];
+    float* vel[3];
+    float* ramp;
+    float* die;
+    uint8_t* color;
+} particlepool_t;
+
+static particlepool_t particlepools[NUM_PARTICLE_TYPES];
+static particle_t newparticle; // filled in by the spawn functions between R_NewParticle and R_AddParticle
+
+// one vertex of the particle array
+typedef struct
+{
+    float xyz[3];
+    float st[2];
+    uint8_t color[4];
+} partvert_t;
+
+static partvert_t* particleverts; // r_numparticles * 4
+static int particlenumprepverts = -1; // built by R_PrepareParticles, -1 when R_DrawParticles has to build them
+static bool particleprepquads;
+static GLuint particlevbo;
 
 vec3_t r_pright, r_pup, r_ppn;
 
 int r_numparticles;
+int r_activeparticles;
 
 gltexture_t *particletexture, *particletexture1, *particletexture2, *particletexture3, *particletexture4; //johnfitz
 float texturescalefactor; //johnfitz -- compensate for apparent size of different particle textures
@@ -42,6 +74,8 @@ float texturescalefactor; //johnfitz -- compensate for apparent size of differen
 cvar_t r_particles = { "r_particles", "1", true }; //johnfitz
 cvar_t r_quadparticles = { "r_quadparticles", "1", true }; //johnfitz
 
+void R_ParticleBench_f(void);
+
 /*
 ===============
 R_ParticleTextureLookup -- johnfitz -- generate nice antialiased 32x32 circle for particles
@@ -161,15 +195,80 @@ void R_InitParticles(void)
         r_numparticles = MAX_PARTICLES;
     }
 
-    particles = (particle_t*)
-        Hunk_AllocName(r_numparticles * sizeof(particle_t), "particles");
+    for (i = 0; i < NUM_PARTICLE_TYPES; i++)
+    {
+        particlepool_t* pool = &particlepools[i];
+        float* data = (float*)Hunk_AllocName(r_numparticles * (8 * sizeof(float) + 1), "particles");
+
+        pool->org[0] = data;
+        pool->org[1] = data + r_numparticles;
+        pool->org[2] = data + r_numparticles * 2;
+        pool->vel[0] = data + r_numparticles * 3;
+        pool->vel[1] = data + r_numparticles * 4;
+        pool->vel[2] = data + r_numparticles * 5;
+        pool->ramp = data + r_numparticles * 6;
+        pool->die = data + r_numparticles * 7;
+        pool->color = (uint8_t*)(data + r_numparticles * 8);
+    }
+    particleverts = (partvert_t*)Hunk_AllocName(r_numparticles * 4 * sizeof(partvert_t), "particleverts");
 
     Cvar_RegisterVariable(&r_particles, R_SetParticleTexture_f); //johnfitz
     Cvar_RegisterVariable(&r_quadparticles, NULL); //johnfitz
+    Cmd_AddCommand("particlebench", R_ParticleBench_f);
 
     R_InitParticleTextures(); //johnfitz
 }
 
+/*
+===============
+R_ClearParticles
+===============
+*/
+void R_ClearParticles(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_PARTICLE_TYPES; i++)
+        particlepools[i].numparticles = 0;
+    r_activeparticles = 0;
+}
+
+/*
+===============
+R_NewParticle -- returns a cleared particle to fill in, or NULL if the pools are full
+===============
+*/
+static particle_t* R_NewParticle(void)
+{
+    if (r_activeparticles >= r_numparticles)
+        return NULL;
+
+    memset(&newparticle, 0, sizeof(newparticle));
+    return &newparticle;
+}
+
+/*
+===============
+R_AddParticle -- copies a particle from R_NewParticle into the pool for its type
+===============
+*/
+static void R_AddParticle(particle_t* p)
+{
+    particlepool_t* pool = &particlepools[p->type];
+    int i = pool->numparticles++;
+
+    pool->org[0][i] = p->org[0];
+    pool->org[1][i] = p->org[1];
+    pool->org[2][i] = p->org[2];
+    pool->vel[0][i] = p->vel[0];
+    pool->vel[1][i] = p->vel[1];
+    pool->vel[2][i] = p->vel[2];
+    pool->ramp[i] = p->ramp;
+    pool->die[i] = p->die;
+    pool->color[i] = p->color;
+    r_activeparticles++;
+}
+
 /*
 ===============
 R_EntityParticles
@@ -218,12 +317,8 @@ void R_EntityParticles(entity_t* ent)
         forward[1] = cp * sy;
         forward[2] = -sp;
 
-        if (!free_particles)
+        if (!(p = R_NewParticle()))
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
         p->die = cl.time + 0.01;
         p->color = 0x6f;
@@ -232,26 +327,10 @@ void R_EntityParticles(entity_t* ent)
         p->org[0] = ent->origin[0] + r_avertexnormals[i][0] * dist + forward[0] * beamlength;
         p->org[1] = ent->origin[1] + r_avertexnormals[i][1] * dist + forward[1] * beamlength;
         p->org[2] = ent->origin[2] + r_avertexnormals[i][2] * dist + forward[2] * beamlength;
+        R_AddParticle(p);
     }
 }
 
-/*
-===============
-R_ClearParticles
-===============
-*/
-void R_ClearParticles(void)
-{
-    int i;
-
-    free_particles = &particles[0];
-    active_particles = NULL;
-
-    for (i = 0; i < r_numparticles; i++)
-        particles[i].next = &particles[i + 1];
-    particles[r_numparticles - 1].next = NULL;
-}
-
 /*
 ===============
 R_ReadPointFile_f
@@ -284,21 +363,18 @@ void R_ReadPointFile_f(void)
             break;
         c++;
 
-        if (!free_particles)
+        if (!(p = R_NewParticle()))
         {
             Con_Printf("Not enough free particles\n");
             break;
         }
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
         p->die = 99999;
         p->color = (-c) & 15;
         p->type = pt_static;
         VectorCopy(vec3_origin, p->vel);
         VectorCopy(org, p->org);
+        R_AddParticle(p);
     }
 
     fclose(f);
@@ -344,12 +420,8 @@ void R_ParticleExplosion(vec3_t org)
 
     for (i = 0; i < 1024; i++)
     {
-        if (!free_particles)
+        if (!(p = R_NewParticle()))
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
         p->die = cl.time + 5;
         p->color = ramp1[0];
@@ -372,6 +444,7 @@ void R_ParticleExplosion(vec3_t org)
                 p->vel[j] = (rand() % 512) - 256;
             }
         }
+        R_AddParticle(p);
     }
 }
 
@@ -388,12 +461,8 @@ void R_ParticleExplosion2(vec3_t org, int colorStart, int colorLength)
 
     for (i = 0; i < 512; i++)
     {
-        if (!free_particles)
+        if (!(p = R_NewParticle()))
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
         p->die = cl.time + 0.3;
         p->color = colorStart + (colorMod % colorLength);
@@ -405,6 +474,7 @@ void R_ParticleExplosion2(vec3_t org, int colorStart, int colorLength)
             p->org[j] = org[j] + ((rand() % 32) - 16);
             p->vel[j] = (rand() % 512) - 256;
         }
+        R_AddParticle(p);
     }
 }
 
@@ -420,12 +490,8 @@ void R_BlobExplosion(vec3_t org)
 
     for (i = 0; i < 1024; i++)
     {
-        if (!free_particles)
+        if (!(p = R_NewParticle()))
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
         p->die = cl.time + 1 + (rand() & 8) * 0.05;
 
@@ -449,6 +515,7 @@ void R_BlobExplosion(vec3_t org)
                 p->vel[j] = (rand() % 512) - 256;
             }
         }
+        R_AddParticle(p);
     }
 }
 
@@ -464,12 +531,8 @@ void R_RunParticleEffect(vec3_t org, vec3_t dir, int color, int count)
 
     for (i = 0; i < count; i++)
     {
-        if (!free_particles)
+        if (!(p = R_NewParticle()))
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
         if (count == 1024)
         { // rocket explosion
@@ -506,6 +569,7 @@ void R_RunParticleEffect(vec3_t org, vec3_t dir, int color, int count)
                 p->vel[j] = dir[j] * 15; // + (rand()%300)-150;
             }
         }
+        R_AddParticle(p);
     }
 }
 
@@ -525,12 +589,8 @@ void R_LavaSplash(vec3_t org)
         for (j = -16; j < 16; j++)
             for (k = 0; k < 1; k++)
             {
-                if (!free_particles)
+                if (!(p = R_NewParticle()))
                     return;
-                p = free_particles;
-                free_particles = p->next;
-                p->next = active_particles;
-                active_particles = p;
 
                 p->die = cl.time + 2 + (rand() & 31) * 0.02;
                 p->color = 224 + (rand() & 7);
@@ -547,6 +607,7 @@ void R_LavaSplash(vec3_t org)
                 VectorNormalize(dir);
                 vel = 50 + (rand() & 63);
                 VectorScale(dir, vel, p->vel);
+                R_AddParticle(p);
             }
 }
 
@@ -566,12 +627,8 @@ void R_TeleportSplash(vec3_t org)
         for (j = -16; j < 16; j += 4)
             for (k = -24; k < 32; k += 4)
             {
-                if (!free_particles)
+                if (!(p = R_NewParticle()))
                     return;
-                p = free_particles;
-                free_particles = p->next;
-                p->next = active_particles;
-                active_particles = p;
 
                 p->die = cl.time + 0.2 + (rand() & 7) * 0.02;
                 p->color = 7 + (rand() & 7);
@@ -588,6 +645,7 @@ void R_TeleportSplash(vec3_t org)
                 VectorNormalize(dir);
                 vel = 50 + (rand() & 63);
                 VectorScale(dir, vel, p->vel);
+                R_AddParticle(p);
             }
 }
 
@@ -621,12 +679,8 @@ void R_RocketTrail(vec3_t start, vec3_t end, int type)
     {
         len -= dec;
 
-        if (!free_particles)
+        if (!(p = R_NewParticle()))
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
         VectorCopy(vec3_origin, p->vel);
         p->die = cl.time + 2;
@@ -697,10 +751,82 @@ void R_RocketTrail(vec3_t start, vec3_t end, int type)
             break;
         }
 
+        R_AddParticle(p);
         VectorAdd(start, vec, start);
     }
 }
 
+/*
+===============
+R_ParticleMad -- dst += src * scale over one column of a pool
+===============
+*/
+static void R_ParticleMad(float* dst, const float* src, float scale, int count)
+{
+    int i = 0;
+
+#ifdef USE_SSE2
+    __m128 s = _mm_set1_ps(scale);
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), s)));
+#endif
+
+    for (; i < count; i++)
+        dst[i] += src[i] * scale;
+}
+
+/*
+===============
+R_ParticleAdd -- dst += add over one column of a pool
+===============
+*/
+static void R_ParticleAdd(float* dst, float add, int count)
+{
+    int i = 0;
+
+#ifdef USE_SSE2
+    __m128 a = _mm_set1_ps(add);
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), a));
+#endif
+
+    for (; i < count; i++)
+        dst[i] += add;
+}
+
+/*
+===============
+R_KillParticles -- removes the dead particles of a pool by moving the last one into each hole
+===============
+*/
+static void R_KillParticles(particlepool_t* pool)
+{
+    int i, j;
+
+    for (i = 0; i < pool->numparticles;)
+    {
+        if (pool->die[i] >= cl.time)
+        {
+            i++;
+            continue;
+        }
+
+        j = --pool->numparticles;
+        pool->org[0][i] = pool->org[0][j];
+        pool->org[1][i] = pool->org[1][j];
+        pool->org[2][i] = pool->org[2][j];
+        pool->vel[0][i] = pool->vel[0][j];
+        pool->vel[1][i] = pool->vel[1][j];
+        pool->vel[2][i] = pool->vel[2][j];
+        pool->ramp[i] = pool->ramp[j];
+        pool->die[i] = pool->die[j];
+        pool->color[i] = pool->color[j];
+        r_activeparticles--;
+    }
+}
+
 /*
 ===============
 CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawParticles
@@ -708,9 +834,10 @@ CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawP
 */
 void CL_RunParticles(void)
 {
-    particle_t *p, *kill;
-    int i;
-    float time1, time2, time3, dvel, frametime, grav;
+    particlepool_t* pool;
+    int i, type, count;
+    int* ramp;
+    float time1, time2, time3, dvel, frametime, grav, ramptime, ramplimit;
     extern cvar_t sv_gravity;
 
     frametime = cl.time - cl.oldtime;
@@ -720,199 +847,247 @@ void CL_RunParticles(void)
     grav = frametime * sv_gravity.value * 0.05;
     dvel = 4 * frametime;
 
-    for (;;)
+    for (type = 0; type < NUM_PARTICLE_TYPES; type++)
     {
-        kill = active_particles;
-        if (kill && kill->die < cl.time)
-        {
-            active_particles = kill->next;
-            kill->next = free_particles;
-            free_particles = kill;
+        pool = &particlepools[type];
+        R_KillParticles(pool);
+        count = pool->numparticles;
+        if (!count)
             continue;
-        }
-        break;
-    }
 
-    for (p = active_particles; p; p = p->next)
-    {
-        for (;;)
-        {
-            kill = p->next;
-            if (kill && kill->die < cl.time)
-            {
-                p->next = kill->next;
-                kill->next = free_particles;
-                free_particles = kill;
-                continue;
-            }
-            break;
-        }
+        R_ParticleMad(pool->org[0], pool->vel[0], frametime, count);
+        R_ParticleMad(pool->org[1], pool->vel[1], frametime, count);
+        R_ParticleMad(pool->org[2], pool->vel[2], frametime, count);
 
-        p->org[0] += p->vel[0] * frametime;
-        p->org[1] += p->vel[1] * frametime;
-        p->org[2] += p->vel[2] * frametime;
+        ramp = NULL;
+        ramptime = ramplimit = 0;
 
-        switch (p->type)
+        switch (type)
         {
         case pt_static:
             break;
+
         case pt_fire:
-            p->ramp += time1;
-            if (p->ramp >= 6)
-                p->die = -1;
-            else
-                p->color = ramp3[(int)p->ramp];
-            p->vel[2] += grav;
+            ramp = ramp3;
+            ramptime = time1;
+            ramplimit = 6;
+            R_ParticleAdd(pool->vel[2], grav, count);
             break;
 
         case pt_explode:
-            p->ramp += time2;
-            if (p->ramp >= 8)
-                p->die = -1;
-            else
-                p->color = ramp1[(int)p->ramp];
+            ramp = ramp1;
+            ramptime = time2;
+            ramplimit = 8;
             for (i = 0; i < 3; i++)
-                p->vel[i] += p->vel[i] * dvel;
-            p->vel[2] -= grav;
+                R_ParticleMad(pool->vel[i], pool->vel[i], dvel, count);
+            R_ParticleAdd(pool->vel[2], -grav, count);
             break;
 
         case pt_explode2:
-            p->ramp += time3;
-            if (p->ramp >= 8)
-                p->die = -1;
-            else
-                p->color = ramp2[(int)p->ramp];
+            ramp = ramp2;
+            ramptime = time3;
+            ramplimit = 8;
             for (i = 0; i < 3; i++)
-                p->vel[i] -= p->vel[i] * frametime;
-            p->vel[2] -= grav;
+                R_ParticleMad(pool->vel[i], pool->vel[i], -frametime, count);
+            R_ParticleAdd(pool->vel[2], -grav, count);
             break;
 
         case pt_blob:
             for (i = 0; i < 3; i++)
-                p->vel[i] += p->vel[i] * dvel;
-            p->vel[2] -= grav;
+                R_ParticleMad(pool->vel[i], pool->vel[i], dvel, count);
+            R_ParticleAdd(pool->vel[2], -grav, count);
             break;
 
         case pt_blob2:
             for (i = 0; i < 2; i++)
-                p->vel[i] -= p->vel[i] * dvel;
-            p->vel[2] -= grav;
+                R_ParticleMad(pool->vel[i], pool->vel[i], -dvel, count);
+            R_ParticleAdd(pool->vel[2], -grav, count);
             break;
 
         case pt_grav:
         case pt_slowgrav:
-            p->vel[2] -= grav;
+            R_ParticleAdd(pool->vel[2], -grav, count);
             break;
         }
+
+        // ramped types change color as they age, and die at the end of the ramp
+        if (ramp)
+        {
+            R_ParticleAdd(pool->ramp, ramptime, count);
+            for (i = 0; i < count; i++)
+            {
+                if (pool->ramp[i] >= ramplimit)
+                    pool->die[i] = -1;
+                else
+                    pool->color[i] = ramp[(int)pool->ramp[i]];
+            }
+        }
     }
 }
 
 /*
 ===============
-R_DrawParticles -- johnfitz -- moved all non-drawing code to CL_RunParticles
+R_BuildParticleVerts -- fills particleverts with a quad or a triangle for every live particle,
+and returns the number of vertexes
 ===============
 */
-void R_DrawParticles(void)
+static int R_BuildParticleVerts(bool quads)
 {
-    particle_t* p;
+    particlepool_t* pool;
+    partvert_t* v;
     float scale;
-    vec3_t up, right, p_up, p_right, p_upright; //johnfitz -- p_ vectors
-    uint8_t color[4]; //johnfitz -- particle transparency
-    extern cvar_t r_particles; //johnfitz
-
-    if (!r_particles.value)
-        return;
+    vec3_t up, right, org;
+    int type, i;
+    uint8_t color[4];
 
-    VectorScale(vup, 1.5, up);
-    VectorScale(vright, 1.5, right);
-
-    GL_Bind(particletexture);
-    glEnable(GL_BLEND);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    glDepthMask(GL_FALSE); //johnfitz -- fix for particle z-buffer bug
+    VectorScale(vup, 1.5f, up);
+    VectorScale(vright, 1.5f, right);
 
-    if (r_quadparticles.value) //johnitz -- quads save fillrate
+    v = particleverts;
+    for (type = 0; type < NUM_PARTICLE_TYPES; type++)
     {
-        glBegin(GL_QUADS);
-        for (p = active_particles; p; p = p->next)
+        pool = &particlepools[type];
+        for (i = 0; i < pool->numparticles; i++)
         {
+            org[0] = pool->org[0][i];
+            org[1] = pool->org[1][i];
+            org[2] = pool->org[2][i];
+
             // hack a scale up to keep particles from disapearing
-            scale = (p->org[0] - r_origin[0]) * vpn[0]
-                + (p->org[1] - r_origin[1]) * vpn[1]
-                + (p->org[2] - r_origin[2]) * vpn[2];
+            scale = (org[0] - r_origin[0]) * vpn[0]
+                + (org[1] - r_origin[1]) * vpn[1]
+                + (org[2] - r_origin[2]) * vpn[2];
             if (scale < 20)
                 scale = 1 + 0.08f; //johnfitz -- added .08 to be consistent
             else
                 scale = 1 + scale * 0.004f;
 
-            scale /= 2.0f; //quad is half the size of triangle
+            if (quads)
+                scale /= 2.0f; //quad is half the size of triangle
 
             scale *= texturescalefactor; //johnfitz -- compensate for apparent size of different particle textures
 
-            //johnfitz -- particle transparency and fade out
-            *(int*)color = d_8to24table[(int)p->color];
-            //alpha = CLAMP(0, p->die + 0.5 - cl.time, 1);
-            color[3] = 255; //(int)(alpha * 255);
-            glColor4ubv(color);
-            //johnfitz
+            *(int*)color = d_8to24table[pool->color[i]];
+            color[3] = 255;
 
-            glTexCoord2f(0, 0);
-            glVertex3fv(p->org);
+            VectorCopy(org, v[0].xyz);
+            v[0].st[0] = 0;
+            v[0].st[1] = 0;
+            VectorMA(org, scale, up, v[1].xyz);
+            VectorMA(org, scale, right, v[2].xyz);
+            if (quads)
+            {
+                v[1].st[0] = 0.5f;
+                v[1].st[1] = 0;
+                VectorMA(v[1].xyz, scale, right, v[2].xyz);
+                v[2].st[0] = 0.5f;
+                v[2].st[1] = 0.5f;
+                VectorMA(org, scale, right, v[3].xyz);
+                v[3].st[0] = 0;
+                v[3].st[1] = 0.5f;
+                memcpy(v[3].color, color, 4);
+            }
+            else
+            {
+                v[1].st[0] = 1;
+                v[1].st[1] = 0;
+                v[2].st[0] = 0;
+                v[2].st[1] = 1;
+            }
+            memcpy(v[0].color, color, 4);
+            memcpy(v[1].color, color, 4);
+            memcpy(v[2].color, color, 4);
 
-            glTexCoord2f(0.5f, 0);
-            VectorMA(p->org, scale, up, p_up);
-            glVertex3fv(p_up);
+            v += quads ? 4 : 3;
+        }
+    }
 
-            glTexCoord2f(0.5f, 0.5f);
-            VectorMA(p_up, scale, right, p_upright);
-            glVertex3fv(p_upright);
+    return v - particleverts;
+}
 
-            glTexCoord2f(0, 0.5f);
-            VectorMA(p->org, scale, right, p_right);
-            glVertex3fv(p_right);
+/*
+===============
+R_DrawParticleArrays -- draws the first numverts of particleverts, through a streamed vertex
+buffer when there is one
+===============
+*/
+static void R_DrawParticleArrays(int numverts, bool quads, bool textured)
+{
+    uint8_t* base;
 
-            rs_particles++; //johnfitz //FIXME: just use r_numparticles
-        }
-        glEnd();
-    }
-    else //johnitz --  triangles save verts
+    if (gl_vbo_able && gl_vbo.value)
     {
-        glBegin(GL_TRIANGLES);
-        for (p = active_particles; p; p = p->next)
-        {
-            // hack a scale up to keep particles from disapearing
-            scale = (p->org[0] - r_origin[0]) * vpn[0]
-                + (p->org[1] - r_origin[1]) * vpn[1]
-                + (p->org[2] - r_origin[2]) * vpn[2];
-            if (scale < 20)
-                scale = 1 + 0.08f; //johnfitz -- added .08 to be consistent
-            else
-                scale = 1 + scale * 0.004f;
+        if (!particlevbo)
+            GL_GenBuffersFunc(1, &particlevbo);
+        GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, particlevbo);
+        GL_BufferDataFunc(GL_ARRAY_BUFFER_ARB, numverts * sizeof(partvert_t), particleverts, GL_STREAM_DRAW_ARB);
+        base = NULL;
+    }
+    else
+        base = (uint8_t*)particleverts;
 
-            scale *= texturescalefactor; //johnfitz -- compensate for apparent size of different particle textures
+    glVertexPointer(3, GL_FLOAT, sizeof(partvert_t), base + offsetof(partvert_t, xyz));
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if (textured)
+    {
+        glTexCoordPointer(2, GL_FLOAT, sizeof(partvert_t), base + offsetof(partvert_t, st));
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(partvert_t), base + offsetof(partvert_t, color));
+        glEnableClientState(GL_COLOR_ARRAY);
+    }
 
-            //johnfitz -- particle transparency and fade out
-            *(int*)color = d_8to24table[(int)p->color];
-            //alpha = CLAMP(0, p->die + 0.5 - cl.time, 1);
-            color[3] = 255; //(int)(alpha * 255);
-            glColor4ubv(color);
-            //johnfitz
+    glDrawArrays(quads ? GL_QUADS : GL_TRIANGLES, 0, numverts);
 
-            glTexCoord2f(0, 0);
-            glVertex3fv(p->org);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    if (base == NULL)
+        GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, 0);
+}
 
-            glTexCoord2f(1, 0);
-            VectorMA(p->org, scale, up, p_up);
-            glVertex3fv(p_up);
+/*
+===============
+R_PrepareParticles -- builds the vertexes for the next R_DrawParticles. called on the scene
+prep thread, it only reads the pools and the view
+===============
+*/
+void R_PrepareParticles(void)
+{
+    particleprepquads = r_quadparticles.value != 0;
+    particlenumprepverts = r_particles.value ? R_BuildParticleVerts(particleprepquads) : 0;
+}
 
-            glTexCoord2f(0, 1);
-            VectorMA(p->org, scale, right, p_right);
-            glVertex3fv(p_right);
+/*
+===============
+R_DrawParticles -- johnfitz -- moved all non-drawing code to CL_RunParticles
+===============
+*/
+void R_DrawParticles(void)
+{
+    int numverts;
+    bool quads;
 
-            rs_particles++; //johnfitz //FIXME: just use r_numparticles
-        }
-        glEnd();
+    if (particlenumprepverts >= 0)
+    {
+        quads = particleprepquads;
+        numverts = particlenumprepverts;
+        particlenumprepverts = -1;
     }
+    else
+    {
+        quads = r_quadparticles.value != 0; //johnitz -- quads save fillrate, triangles save verts
+        numverts = r_particles.value ? R_BuildParticleVerts(quads) : 0;
+    }
+    if (!numverts)
+        return;
+
+    GL_Bind(particletexture);
+    glEnable(GL_BLEND);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glDepthMask(GL_FALSE); //johnfitz -- fix for particle z-buffer bug
+
+    R_DrawParticleArrays(numverts, quads, true);
+    rs_particles += r_activeparticles;
 
     glDepthMask(GL_TRUE); //johnfitz -- fix for particle z-buffer bug
     glDisable(GL_BLEND);
@@ -927,74 +1102,87 @@ R_DrawParticles_ShowTris -- johnfitz
 */
 void R_DrawParticles_ShowTris(void)
 {
-    particle_t* p;
-    float scale;
-    vec3_t up, right, p_up, p_right, p_upright;
-    extern cvar_t r_particles;
+    int numverts;
+    bool quads;
 
     if (!r_particles.value)
         return;
 
-    VectorScale(vup, 1.5f, up);
-    VectorScale(vright, 1.5f, right);
-
-    if (r_quadparticles.value)
-    {
-        for (p = active_particles; p; p = p->next)
-        {
-            glBegin(GL_TRIANGLE_FAN);
-
-            // hack a scale up to keep particles from disapearing
-            scale = (p->org[0] - r_origin[0]) * vpn[0]
-                + (p->org[1] - r_origin[1]) * vpn[1]
-                + (p->org[2] - r_origin[2]) * vpn[2];
-            if (scale < 20)
-                scale = 1 + 0.08f; //johnfitz -- added .08 to be consistent
-            else
-                scale = 1 + scale * 0.004f;
-
-            scale /= 2.0f; //quad is half the size of triangle
-
-            scale *= texturescalefactor; //compensate for apparent size of different particle textures
-
-            glVertex3fv(p->org);
-
-            VectorMA(p->org, scale, up, p_up);
-            glVertex3fv(p_up);
+    quads = r_quadparticles.value != 0;
+    numverts = R_BuildParticleVerts(quads);
+    if (numverts)
+        R_DrawParticleArrays(numverts, quads, false);
+}
 
-            VectorMA(p_up, scale, right, p_upright);
-            glVertex3fv(p_upright);
+/*
+===============
+R_ParticleBench_f -- runs storms of explosions and rocket trails through the particle pools
+without drawing anything, and reports how many particles are updated per millisecond
 
-            VectorMA(p->org, scale, right, p_right);
-            glVertex3fv(p_right);
+particlebench [storms] [frames]
+===============
+*/
+void R_ParticleBench_f(void)
+{
+    double savedtime, savedoldtime, start, spawntime, runtime, buildtime;
+    int storms, frames, frame, i, j, updates, peak;
+    vec3_t org, end;
+
+    storms = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 4;
+    frames = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 500;
+    if (storms < 1)
+        storms = 1;
+    if (frames < 1)
+        frames = 1;
+
+    savedtime = cl.time;
+    savedoldtime = cl.oldtime;
+    R_ClearParticles();
+
+    spawntime = runtime = buildtime = 0;
+    updates = peak = 0;
+    for (frame = 0; frame < frames; frame++)
+    {
+        cl.oldtime = cl.time;
+        cl.time += 1.0 / 72;
 
-            glEnd();
+        // each storm is an explosion every half second and eight rockets in flight
+        start = Sys_FloatTime();
+        for (i = 0; i < storms; i++)
+        {
+            org[0] = i * 256;
+            org[1] = 0;
+            org[2] = 0;
+            if ((frame + i * 9) % 36 == 0)
+                R_ParticleExplosion(org);
+            for (j = 0; j < 8; j++)
+            {
+                org[1] = j * 64;
+                org[2] = (frame % 72) * 14;
+                VectorCopy(org, end);
+                end[2] += 14;
+                R_RocketTrail(org, end, j & 1);
+            }
         }
+        spawntime += Sys_FloatTime() - start;
+
+        start = Sys_FloatTime();
+        CL_RunParticles();
+        runtime += Sys_FloatTime() - start;
+        updates += r_activeparticles;
+        if (peak < r_activeparticles)
+            peak = r_activeparticles;
+
+        start = Sys_FloatTime();
+        R_BuildParticleVerts(true);
+        buildtime += Sys_FloatTime() - start;
     }
-    else
-    {
-        glBegin(GL_TRIANGLES);
-        for (p = active_particles; p; p = p->next)
-        {
-            // hack a scale up to keep particles from disapearing
-            scale = (p->org[0] - r_origin[0]) * vpn[0]
-                + (p->org[1] - r_origin[1]) * vpn[1]
-                + (p->org[2] - r_origin[2]) * vpn[2];
-            if (scale < 20)
-                scale = 1 + 0.08f; //johnfitz -- added .08 to be consistent
-            else
-                scale = 1 + scale * 0.004f;
-
-            scale *= texturescalefactor; //compensate for apparent size of different particle textures
-
-            glVertex3fv(p->org);
 
-            VectorMA(p->org, scale, up, p_up);
-            glVertex3fv(p_up);
+    R_ClearParticles();
+    cl.time = savedtime;
+    cl.oldtime = savedoldtime;
 
-            VectorMA(p->org, scale, right, p_right);
-            glVertex3fv(p_right);
-        }
-        glEnd();
-    }
-}
\ No newline at end of file
+    Con_Printf("particlebench: %i storms, %i frames, %i particles at most (-particles %i)\n", storms, frames, peak, r_numparticles);
+    Con_Printf("update: %8.3f ms, %.0f particles per ms\n", runtime * 1000.0, runtime > 0 ? updates / (runtime * 1000.0) : 0);
+    Con_Printf("spawn:  %8.3f ms\nverts:  %8.3f ms\n", spawntime * 1000.0, buildtime * 1000.0);
+}
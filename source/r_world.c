@@ -22,20 +22,402 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 extern cvar_t gl_fullbrights, r_drawflat, gl_overbright, r_oldwater, r_oldskyleaf, r_showtris; //johnfitz
 
 extern glpoly_t* lightmap_polys[MAX_LIGHTMAPS];
+extern int lightmap_count;
 
 uint8_t* SV_FatPVS(vec3_t org, model_t* worldmodel);
+void R_UpdateWorldLightmaps(void);
+void R_UploadLightmap(int lmap);
+void R_SetFrustum(float fovx, float fovy);
+extern float r_fovx, r_fovy;
 extern uint8_t mod_novis[MAX_MAP_LEAFS / 8];
 int vis_changed; //if true, force pvs to be refreshed
 
+cvar_t r_cullthreads = { "r_cullthreads", "1" };
+
+#define CULL_CHUNK 256 // surfaces per R_CullSurfaces task
+#define OCCLUDE_CHUNK 64 // leafs per R_OccludeWorld task
+
+// what one task of R_CullSurfaces found, merged in chunk order afterwards
+typedef struct
+{
+    int numpolys;
+    int numwarps;
+} cullchunk_t;
+
+static cullchunk_t* cull_chunks;
+static msurface_t** cull_warps; // visible warp surfaces, CULL_CHUNK slots per chunk
+static int* r_visleafs; // leafs[1 + n] for each n in the current pvs, in order
+static int r_numvisleafs;
+static uint8_t* r_visleafhidden; // per r_visleafs entry, set by R_OccludeWorld
+static int r_occlusionframe;
+
+//==============================================================================
+//
+// VERTEX BUFFER BATCHES
+//
+//==============================================================================
+
+// the texture chains as triangle indices into gl_bmodel_vbo, grouped by texture
+// and then by lightmap. only rebuilt when R_MarkSurfaces rebuilds the chains, so
+// the per frame cost of a draw is a few glDrawElements calls per texture
+typedef struct
+{
+    int texture;
+    int lightmap;
+    int first; // in indices
+    int count;
+} vbobatch_t;
+
+bool r_worldvbo; // draw this frame's world from the batches
+
+static bool vbo_dirty;
+static GLuint vbo_indexbuffer;
+static unsigned* vbo_indices;
+static vbobatch_t* vbo_batches;
+static int vbo_numbatches;
+static msurface_t** vbo_sort;
+static int* vbo_texfirst; // per texture, contiguous over all its batches
+static int* vbo_texcount;
+static GLsizei* vbo_lmcounts; // per lightmap, ranges for glMultiDrawElements
+static const void** vbo_lmoffsets;
+static int vbo_lmfirst[MAX_LIGHTMAPS + 1];
+
+/*
+================
+R_InitWorldBatches -- called at level load time, after GL_BuildVertexBuffer
+================
+*/
+void R_InitWorldBatches(void)
+{
+    int i, numindices;
+    msurface_t* s;
+
+    vbo_indices = NULL;
+    vbo_dirty = true;
+    if (!gl_bmodel_vbo)
+        return;
+
+    numindices = 0;
+    for (i = 0, s = cl.worldmodel->surfaces; i < cl.worldmodel->numsurfaces; i++, s++)
+        if (!(s->flags & SURF_DRAWTILED))
+            numindices += (s->polys->numverts - 2) * 3;
+
+    vbo_indices = Hunk_AllocName((numindices + 1) * sizeof(unsigned), "vboindex");
+    vbo_batches = Hunk_AllocName((cl.worldmodel->numsurfaces + 1) * sizeof(vbobatch_t), "vbobatch");
+    vbo_sort = Hunk_AllocName((cl.worldmodel->numsurfaces + 1) * sizeof(msurface_t*), "vbosort");
+    vbo_texfirst = Hunk_AllocName(cl.worldmodel->numtextures * sizeof(int), "vbotex");
+    vbo_texcount = Hunk_AllocName(cl.worldmodel->numtextures * sizeof(int), "vbotex");
+    vbo_lmcounts = Hunk_AllocName((cl.worldmodel->numsurfaces + 1) * sizeof(GLsizei), "vbolm");
+    vbo_lmoffsets = Hunk_AllocName((cl.worldmodel->numsurfaces + 1) * sizeof(void*), "vbolm");
+
+    if (!vbo_indexbuffer)
+        GL_GenBuffersFunc(1, &vbo_indexbuffer);
+}
+
+/*
+================
+R_SortLightmap
+================
+*/
+static int R_SortLightmap(const void* a, const void* b)
+{
+    return (*(msurface_t**)a)->lightmaptexturenum - (*(msurface_t**)b)->lightmaptexturenum;
+}
+
+/*
+================
+R_BuildWorldBatches
+================
+*/
+static void R_BuildWorldBatches(void)
+{
+    int i, j, k, n, numindices, base;
+    int lmnum[MAX_LIGHTMAPS];
+    msurface_t* s;
+    texture_t* t;
+    vbobatch_t* b;
+
+    if (!vbo_dirty)
+        return;
+    vbo_dirty = false;
+
+    numindices = 0;
+    vbo_numbatches = 0;
+    for (i = 0; i < cl.worldmodel->numtextures; i++)
+    {
+        vbo_texfirst[i] = numindices;
+        vbo_texcount[i] = 0;
+
+        t = cl.worldmodel->textures[i];
+        if (!t || !t->texturechain || t->texturechain->flags & SURF_DRAWTILED)
+            continue;
+
+        for (n = 0, s = t->texturechain; s; s = s->texturechain)
+            vbo_sort[n++] = s;
+        qsort(vbo_sort, n, sizeof(msurface_t*), R_SortLightmap);
+
+        b = NULL;
+        for (j = 0; j < n; j++)
+        {
+            s = vbo_sort[j];
+            if (!b || b->lightmap != s->lightmaptexturenum)
+            {
+                b = &vbo_batches[vbo_numbatches++];
+                b->texture = i;
+                b->lightmap = s->lightmaptexturenum;
+                b->first = numindices;
+                b->count = 0;
+            }
+
+            // the polys are convex fans
+            base = s->vbo_firstvert;
+            for (k = 2; k < s->polys->numverts; k++)
+            {
+                vbo_indices[numindices++] = base;
+                vbo_indices[numindices++] = base + k - 1;
+                vbo_indices[numindices++] = base + k;
+            }
+            b->count = numindices - b->first;
+        }
+
+        vbo_texcount[i] = numindices - vbo_texfirst[i];
+    }
+
+    // regroup the batches by lightmap for the lightmap pass
+    memset(lmnum, 0, sizeof(lmnum));
+    for (i = 0, b = vbo_batches; i < vbo_numbatches; i++, b++)
+        lmnum[b->lightmap]++;
+    vbo_lmfirst[0] = 0;
+    for (i = 0; i < MAX_LIGHTMAPS; i++)
+    {
+        vbo_lmfirst[i + 1] = vbo_lmfirst[i] + lmnum[i];
+        lmnum[i] = vbo_lmfirst[i];
+    }
+    for (i = 0, b = vbo_batches; i < vbo_numbatches; i++, b++)
+    {
+        j = lmnum[b->lightmap]++;
+        vbo_lmcounts[j] = b->count;
+        vbo_lmoffsets[j] = (const void*)(b->first * sizeof(unsigned));
+    }
+
+    GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, vbo_indexbuffer);
+    GL_BufferDataFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, numindices * sizeof(unsigned), vbo_indices, GL_DYNAMIC_DRAW_ARB);
+    GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+}
+
+/*
+================
+R_BeginWorldVBO -- binds the buffers and points the arrays at them. texcoords is the
+float offset of the coords for texture unit 0: 3 for diffuse, 5 for lightmap
+================
+*/
+static void R_BeginWorldVBO(int texcoords)
+{
+    GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, gl_bmodel_vbo);
+    GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, vbo_indexbuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, VERTEXSIZE * sizeof(float), (void*)0);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, VERTEXSIZE * sizeof(float), (void*)(texcoords * sizeof(float)));
+}
+
+/*
+================
+R_EndWorldVBO
+================
+*/
+static void R_EndWorldVBO(void)
+{
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    GL_BindBufferFunc(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    GL_BindBufferFunc(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+/*
+================
+R_DrawWorldBatches_Texture -- each texture's batches in one draw
+================
+*/
+static void R_DrawWorldBatches_Texture(bool fullbrights)
+{
+    int i;
+    texture_t* t;
+    gltexture_t* glt;
+
+    R_BeginWorldVBO(3);
+    for (i = 0; i < cl.worldmodel->numtextures; i++)
+    {
+        t = cl.worldmodel->textures[i];
+        if (!vbo_texcount[i])
+            continue;
+        if (fullbrights)
+        {
+            if (!(glt = R_TextureAnimation(t, 0)->fullbright))
+                continue;
+        }
+        else
+            glt = R_TextureAnimation(t, 0)->gltexture;
+
+        GL_Bind(glt);
+        glDrawElements(GL_TRIANGLES, vbo_texcount[i], GL_UNSIGNED_INT, (void*)(vbo_texfirst[i] * sizeof(unsigned)));
+        rs_brushpasses++;
+    }
+    R_EndWorldVBO();
+}
+
+/*
+================
+R_DrawWorldBatches_Lightmap -- all batches on one lightmap in one multidraw
+================
+*/
+static void R_DrawWorldBatches_Lightmap(void)
+{
+    int i, j;
+
+    R_BeginWorldVBO(5);
+    for (i = 0; i < lightmap_count; i++)
+    {
+        if (vbo_lmfirst[i] == vbo_lmfirst[i + 1])
+            continue;
+
+        GL_Bind(lightmap_textures[i]);
+        R_UploadLightmap(i);
+        if (GL_MultiDrawElementsFunc)
+            GL_MultiDrawElementsFunc(GL_TRIANGLES, vbo_lmcounts + vbo_lmfirst[i], GL_UNSIGNED_INT,
+                vbo_lmoffsets + vbo_lmfirst[i], vbo_lmfirst[i + 1] - vbo_lmfirst[i]);
+        else
+            for (j = vbo_lmfirst[i]; j < vbo_lmfirst[i + 1]; j++)
+                glDrawElements(GL_TRIANGLES, vbo_lmcounts[j], GL_UNSIGNED_INT, vbo_lmoffsets[j]);
+        rs_brushpasses++;
+    }
+    R_EndWorldVBO();
+}
+
+/*
+================
+R_DrawWorldBatches_Multitexture -- one draw per texture/lightmap pair
+================
+*/
+static void R_DrawWorldBatches_Multitexture(void)
+{
+    int i, texture;
+    texture_t* t;
+    vbobatch_t* b;
+
+    R_BeginWorldVBO(3);
+    GL_ClientActiveTextureFunc(TEXTURE1);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, VERTEXSIZE * sizeof(float), (void*)(5 * sizeof(float)));
+    GL_ClientActiveTextureFunc(TEXTURE0);
+
+    texture = -1;
+    for (i = 0, b = vbo_batches; i < vbo_numbatches; i++, b++)
+    {
+        t = cl.worldmodel->textures[b->texture];
+        if (t->texturechain->flags & SURF_NOTEXTURE)
+            continue;
+
+        if (b->texture != texture)
+        {
+            GL_DisableMultitexture(); // selects TEXTURE0
+            GL_Bind((R_TextureAnimation(t, 0))->gltexture);
+            GL_EnableMultitexture(); // selects TEXTURE1
+            texture = b->texture;
+        }
+        GL_Bind(lightmap_textures[b->lightmap]);
+        R_UploadLightmap(b->lightmap);
+        glDrawElements(GL_TRIANGLES, b->count, GL_UNSIGNED_INT, (void*)(b->first * sizeof(unsigned)));
+        rs_brushpasses++;
+    }
+    GL_DisableMultitexture(); // selects TEXTURE0
+
+    GL_ClientActiveTextureFunc(TEXTURE1);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    GL_ClientActiveTextureFunc(TEXTURE0);
+    R_EndWorldVBO();
+}
+
 //==============================================================================
 //
 // SETUP CHAINS
 //
 //==============================================================================
 
+/*
+===============
+R_InitWorldCull -- called at level load time
+===============
+*/
+void R_InitWorldCull(void)
+{
+    int numchunks = (cl.worldmodel->numsurfaces + CULL_CHUNK - 1) / CULL_CHUNK;
+
+    r_visleafs = Hunk_AllocName((cl.worldmodel->numleafs + 1) * sizeof(int), "visleafs");
+    r_visleafhidden = Hunk_AllocName(cl.worldmodel->numleafs + 1, "visleafs");
+    cull_chunks = Hunk_AllocName((numchunks + 1) * sizeof(cullchunk_t), "cullchunk");
+    cull_warps = Hunk_AllocName((numchunks * CULL_CHUNK + 1) * sizeof(msurface_t*), "cullwarp");
+}
+
+/*
+===============
+R_FirstBit -- index of the lowest set bit, which must exist
+===============
+*/
+static inline int R_FirstBit(unsigned bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return index;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+/*
+===============
+R_GatherVisLeafs -- lists the leafs set in a pvs, reading it 32 leafs at a time
+===============
+*/
+static void R_GatherVisLeafs(uint8_t* vis)
+{
+    int numleafs, base, i;
+    unsigned bits;
+
+    numleafs = cl.worldmodel->numleafs;
+    r_numvisleafs = 0;
+
+    for (base = 0; base < numleafs; base += 32)
+    {
+        if (numleafs - base >= 32)
+        {
+            memcpy(&bits, vis + (base >> 3), 4);
+            bits = LittleLong(bits);
+        }
+        else // don't read past the end of the pvs
+        {
+            bits = 0;
+            for (i = 0; i < (numleafs - base + 7) >> 3; i++)
+                bits |= vis[(base >> 3) + i] << (i * 8);
+            bits &= (1u << (numleafs - base)) - 1;
+        }
+
+        while (bits)
+        {
+            r_visleafs[r_numvisleafs++] = base + R_FirstBit(bits);
+            bits &= bits - 1;
+        }
+    }
+}
+
 /*
 ===============
 R_MarkSurfaces -- johnfitz -- mark surfaces based on PVS and rebuild texture chains
@@ -68,14 +450,17 @@ void R_MarkSurfaces(void)
     else
         vis = Mod_LeafPVS(r_viewleaf, cl.worldmodel);
 
+    R_GatherVisLeafs(vis);
+
     // if surface chains don't need regenerating, just add static entities and return
     if (r_oldviewleaf == r_viewleaf && !vis_changed && !nearwaterportal)
     {
-        leaf = &cl.worldmodel->leafs[1];
-        for (i = 0; i < cl.worldmodel->numleafs; i++, leaf++)
-            if (vis[i >> 3] & (1 << (i & 7)))
-                if (leaf->efrags)
-                    R_StoreEfrags(&leaf->efrags);
+        for (i = 0; i < r_numvisleafs; i++)
+        {
+            leaf = &cl.worldmodel->leafs[1 + r_visleafs[i]];
+            if (leaf->efrags)
+                R_StoreEfrags(&leaf->efrags);
+        }
         return;
     }
 
@@ -83,21 +468,21 @@ void R_MarkSurfaces(void)
     r_oldviewleaf = r_viewleaf;
 
     // iterate through leaves, marking surfaces
-    leaf = &cl.worldmodel->leafs[1];
-    for (i = 0; i < cl.worldmodel->numleafs; i++, leaf++)
+    for (i = 0; i < r_numvisleafs; i++)
     {
-        if (vis[i >> 3] & (1 << (i & 7)))
-        {
-            if (r_oldskyleaf.value || leaf->contents != CONTENTS_SKY)
-                for (j = 0, mark = leaf->firstmarksurface; j < leaf->nummarksurfaces; j++, mark++)
-                    (*mark)->visframe = r_visframecount;
+        leaf = &cl.worldmodel->leafs[1 + r_visleafs[i]];
 
-            // add static models
-            if (leaf->efrags)
-                R_StoreEfrags(&leaf->efrags);
-        }
+        if (r_oldskyleaf.value || leaf->contents != CONTENTS_SKY)
+            for (j = 0, mark = leaf->firstmarksurface; j < leaf->nummarksurfaces; j++, mark++)
+                (*mark)->visframe = r_visframecount;
+
+        // add static models
+        if (leaf->efrags)
+            R_StoreEfrags(&leaf->efrags);
     }
 
+    vbo_dirty = true;
+
     // set all chains to null
     for (i = 0; i < cl.worldmodel->numtextures; i++)
         if (cl.worldmodel->textures[i])
@@ -162,6 +547,69 @@ bool R_BackFaceCull(msurface_t* surf)
     return false;
 }
 
+/*
+================
+R_CullSurfaceBatch -- frustum and backface culls up to 8 surfaces for R_CullSurfacesTask
+================
+*/
+static void R_CullSurfaceBatch(msurface_t** surfs, int count, cullchunk_t* chunk, msurface_t** warps)
+{
+    msurface_t* s;
+    int i, culled;
+
+    culled = R_CullSurfaceBoxes(surfs, count);
+    for (i = 0; i < count; i++)
+    {
+        s = surfs[i];
+        if ((culled & (1 << i)) || R_BackFaceCull(s))
+            s->culled = true;
+        else
+        {
+            s->culled = false;
+            chunk->numpolys++;
+            if (s->texinfo->texture->warpimage)
+                warps[chunk->numwarps++] = s;
+        }
+    }
+}
+
+/*
+================
+R_CullSurfacesTask -- culls one CULL_CHUNK range of world surfaces. only writes to the
+surfaces in its range and to its own chunk, so any number can run at once
+================
+*/
+static void R_CullSurfacesTask(int index, int thread, void* data)
+{
+    cullchunk_t* chunk = &cull_chunks[index];
+    msurface_t** warps = &cull_warps[index * CULL_CHUNK];
+    msurface_t *batch[8], *s;
+    int i, end, count;
+
+    chunk->numpolys = 0;
+    chunk->numwarps = 0;
+
+    i = index * CULL_CHUNK;
+    end = i + CULL_CHUNK;
+    if (end > cl.worldmodel->nummodelsurfaces)
+        end = cl.worldmodel->nummodelsurfaces;
+
+    count = 0;
+    for (s = &cl.worldmodel->surfaces[cl.worldmodel->firstmodelsurface + i]; i < end; i++, s++)
+    {
+        if (s->visframe != r_visframecount)
+            continue;
+        batch[count++] = s;
+        if (count == 8)
+        {
+            R_CullSurfaceBatch(batch, count, chunk, warps);
+            count = 0;
+        }
+    }
+    if (count)
+        R_CullSurfaceBatch(batch, count, chunk, warps);
+}
+
 /*
 ================
 R_CullSurfaces -- johnfitz
@@ -169,28 +617,161 @@ R_CullSurfaces -- johnfitz
 */
 void R_CullSurfaces(void)
 {
-    msurface_t* s;
-    int i;
+    cullchunk_t* chunk;
+    int i, j, numchunks;
 
     if (!r_drawworld_cheatsafe)
         return;
 
+    numchunks = (cl.worldmodel->nummodelsurfaces + CULL_CHUNK - 1) / CULL_CHUNK;
+    if (r_cullthreads.value)
+        Tasks_ParallelFor(numchunks, R_CullSurfacesTask, NULL);
+    else
+        for (i = 0; i < numchunks; i++)
+            R_CullSurfacesTask(i, 0, NULL);
+
+    // merge in chunk order, so the result doesn't depend on the threads
+    for (i = 0, chunk = cull_chunks; i < numchunks; i++, chunk++)
+    {
+        rs_brushpolys += chunk->numpolys; //count wpolys here
+        for (j = 0; j < chunk->numwarps; j++)
+            cull_warps[i * CULL_CHUNK + j]->texinfo->texture->update_warp = true;
+    }
+}
+
+/*
+================
+R_OccludeLeafsTask -- tests one OCCLUDE_CHUNK range of the pvs against the occlusion buffer
+================
+*/
+static void R_OccludeLeafsTask(int index, int thread, void* data)
+{
+    mleaf_t* leaf;
+    int i, end;
+
+    i = index * OCCLUDE_CHUNK;
+    end = i + OCCLUDE_CHUNK;
+    if (end > r_numvisleafs)
+        end = r_numvisleafs;
+
+    for (; i < end; i++)
+    {
+        leaf = &cl.worldmodel->leafs[1 + r_visleafs[i]];
+        r_visleafhidden[i] = R_OccludedBox(leaf->minmaxs, leaf->minmaxs + 3);
+    }
+}
+
+/*
+================
+R_OccludeWorld -- culls the visible surfaces that are only in leafs hidden behind the
+occluders. do after R_BuildOcclusion
+================
+*/
+void R_OccludeWorld(void)
+{
+    msurface_t *s, **mark;
+    mleaf_t* leaf;
+    int i, j;
+
+    if (!r_occlusionready)
+        return;
+
+    Tasks_ParallelFor((r_numvisleafs + OCCLUDE_CHUNK - 1) / OCCLUDE_CHUNK, R_OccludeLeafsTask, NULL);
+
+    // a surface stays if any leaf it is in can be seen
+    r_occlusionframe++;
+    for (i = 0; i < r_numvisleafs; i++)
+    {
+        leaf = &cl.worldmodel->leafs[1 + r_visleafs[i]];
+        if (r_visleafhidden[i])
+        {
+            rs_occludedleafs++;
+            R_OcclusionShow(leaf->minmaxs, leaf->minmaxs + 3, false);
+        }
+        else if (r_oldskyleaf.value || leaf->contents != CONTENTS_SKY)
+            for (j = 0, mark = leaf->firstmarksurface; j < leaf->nummarksurfaces; j++, mark++)
+                (*mark)->occlusionframe = r_occlusionframe;
+    }
+
     s = &cl.worldmodel->surfaces[cl.worldmodel->firstmodelsurface];
     for (i = 0; i < cl.worldmodel->nummodelsurfaces; i++, s++)
+        if (s->visframe == r_visframecount && !s->culled && s->occlusionframe != r_occlusionframe)
+        {
+            s->culled = true;
+            rs_brushpolys--;
+        }
+}
+
+/*
+================
+R_CullBench_f -- times the per frame world setup (pvs scan, chain rebuild and culling) while
+turning in place, with the cull on the main thread and then on the worker threads.
+nothing is drawn
+
+cullbench [frames]
+================
+*/
+void R_CullBench_f(void)
+{
+    vec3_t savedangles;
+    int frames, frame, pass, savedvisedicts, savedpolys, polys;
+    float savedthreads;
+    double start, marktime[2], culltime[2];
+
+    if (!cl.worldmodel || !r_viewleaf)
+    {
+        Con_Printf("cullbench: no map loaded\n");
+        return;
+    }
+
+    frames = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 360;
+    if (frames < 1)
+        frames = 1;
+
+    VectorCopy(r_refdef.viewangles, savedangles);
+    savedvisedicts = cl_numvisedicts;
+    savedpolys = rs_brushpolys;
+    savedthreads = r_cullthreads.value;
+
+    for (pass = 0; pass < 2; pass++)
     {
-        if (s->visframe == r_visframecount)
+        Cvar_SetValue("r_cullthreads", pass);
+        marktime[pass] = culltime[pass] = 0;
+        rs_brushpolys = 0;
+
+        for (frame = 0; frame < frames; frame++)
         {
-            if (R_CullBox(s->mins, s->maxs) || R_BackFaceCull(s))
-                s->culled = true;
-            else
-            {
-                s->culled = false;
-                rs_brushpolys++; //count wpolys here
-                if (s->texinfo->texture->warpimage)
-                    s->texinfo->texture->update_warp = true;
-            }
+            r_refdef.viewangles[1] = frame * 360.0 / frames;
+            AngleVectors(r_refdef.viewangles, vpn, vright, vup);
+            R_SetFrustum(r_fovx, r_fovy);
+
+            // force the chains to be rebuilt, as if the view moved to another leaf each frame
+            r_oldviewleaf = NULL;
+            cl_numvisedicts = savedvisedicts;
+
+            start = Sys_FloatTime();
+            R_MarkSurfaces();
+            marktime[pass] += Sys_FloatTime() - start;
+
+            start = Sys_FloatTime();
+            R_CullSurfaces();
+            culltime[pass] += Sys_FloatTime() - start;
         }
+        polys = rs_brushpolys;
     }
+
+    Cvar_SetValue("r_cullthreads", savedthreads);
+    VectorCopy(savedangles, r_refdef.viewangles);
+    AngleVectors(r_refdef.viewangles, vpn, vright, vup);
+    R_SetFrustum(r_fovx, r_fovy);
+    cl_numvisedicts = savedvisedicts;
+    rs_brushpolys = savedpolys;
+    r_viewleaf = NULL; // rebuild the chains for the real view next frame
+
+    Con_Printf("cullbench: %i frames, %i leafs in pvs, %.0f surfaces drawn per frame\n", frames, r_numvisleafs, (double)polys / frames);
+    Con_Printf("mark:  %7.3f ms per frame\n", marktime[0] * 1000.0 / frames);
+    Con_Printf("cull:  %7.3f ms per frame, 1 thread\n", culltime[0] * 1000.0 / frames);
+    Con_Printf("cull:  %7.3f ms per frame, %i threads\n", culltime[1] * 1000.0 / frames, task_numthreads);
 }
 
 /*
@@ -316,6 +897,9 @@ void R_DrawTextureChains_Glow(void)
     gltexture_t* glt;
     bool bound;
 
+    if (r_worldvbo)
+        R_DrawWorldBatches_Texture(true);
+
     for (i = 0; i < cl.worldmodel->numtextures; i++)
     {
         t = cl.worldmodel->textures[i];
@@ -323,6 +907,9 @@ void R_DrawTextureChains_Glow(void)
         if (!t || !t->texturechain || !(glt = R_TextureAnimation(t, 0)->fullbright))
             continue;
 
+        if (r_worldvbo && !(t->texturechain->flags & SURF_DRAWTILED)) // already drawn from the batches
+            continue;
+
         bound = false;
 
         for (s = t->texturechain; s; s = s->texturechain)
@@ -352,6 +939,12 @@ void R_DrawTextureChains_Multitexture(void)
     float* v;
     bool bound;
 
+    if (r_worldvbo && GL_ClientActiveTextureFunc)
+    {
+        R_DrawWorldBatches_Multitexture();
+        return;
+    }
+
     for (i = 0; i < cl.worldmodel->numtextures; i++)
     {
         t = cl.worldmodel->textures[i];
@@ -436,6 +1029,12 @@ void R_DrawTextureChains_TextureOnly(void)
     texture_t* t;
     bool bound;
 
+    if (r_worldvbo)
+    {
+        R_DrawWorldBatches_Texture(false);
+        return;
+    }
+
     for (i = 0; i < cl.worldmodel->numtextures; i++)
     {
         t = cl.worldmodel->textures[i];
@@ -579,6 +1178,12 @@ void R_DrawLightmapChains(void)
     glpoly_t* p;
     float* v;
 
+    if (r_worldvbo)
+    {
+        R_DrawWorldBatches_Lightmap();
+        return;
+    }
+
     for (i = 0; i < MAX_LIGHTMAPS; i++)
     {
         if (!lightmap_polys[i])
@@ -608,9 +1213,18 @@ R_DrawWorld -- johnfitz -- rewritten
 */
 void R_DrawWorld(void)
 {
+    r_worldvbo = false;
+
     if (!r_drawworld_cheatsafe)
         return;
 
+    // the batches skip frustum culling, so their index lists only change with the pvs
+    if (gl_vbo.value && gl_bmodel_vbo && vbo_indices)
+    {
+        R_BuildWorldBatches();
+        r_worldvbo = true;
+    }
+
     if (r_drawflat_cheatsafe)
     {
         glDisable(GL_TEXTURE_2D);
@@ -625,6 +1239,8 @@ void R_DrawWorld(void)
         goto fullbrights;
     }
 
+    R_UpdateWorldLightmaps();
+
     if (r_lightmap_cheatsafe)
     {
         R_BuildLightmapChains();
@@ -279,15 +279,7 @@ Sbar_DrawPicAlpha -- johnfitz
 Sbar_DrawPicAlpha(int x, int y, qpic_t* pic, float alpha)
 {
     if (pic)
-    {
-        glDisable(GL_ALPHA_TEST);
-        glEnable(GL_BLEND);
-        glColor4f(1, 1, 1, alpha);
-        Draw_Pic(x, y + 24, pic);
-        glColor3f(1, 1, 1);
-        glDisable(GL_BLEND);
-        glEnable(GL_ALPHA_TEST);
-    }
+        Draw_PicAlpha(x, y + 24, pic, alpha);
 }
 
 /*
@@ -327,6 +319,7 @@ void Sbar_DrawScrollString(int x, int y, int width, char* str)
     if (cl.gametype != GAME_DEATHMATCH)
         left += (((float)glwidth - 320.0 * scale) / 2);
 
+    Draw_Flush(); // the scissor must only clip the scrolling text
     glEnable(GL_SCISSOR_TEST);
     glScissor(left, 0, width * scale, glheight);
 
@@ -338,6 +331,7 @@ void Sbar_DrawScrollString(int x, int y, int width, char* str)
     Sbar_DrawCharacter(x - ofs + len - 16, y, '/');
     Sbar_DrawString(x - ofs + len, y, str);
 
+    Draw_Flush();
     glDisable(GL_SCISSOR_TEST);
 }
 
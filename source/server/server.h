@@ -74,6 +74,8 @@ typedef struct
     uint8_t signon_buf[MAX_MSGLEN - 2]; //johnfitz -- was 8192, now uses MAX_MSGLEN
 
     unsigned protocol; //johnfitz
+
+    packetframe_t* packetframes; // PROTOCOL_BITPACK -- [maxclients][UPDATE_BACKUP] sent snapshots
 } server_t;
 
 #define NUM_PING_TIMES 16
@@ -110,6 +112,8 @@ typedef struct client_s
 
     // client known data for deltas
     int old_frags;
+    int netframe; // PROTOCOL_BITPACK -- sequence of the next svc_packetentities
+    int frameack; // last sequence the client received (low 8 bits), -1 for none
 } client_t;
 
 //=============================================================================
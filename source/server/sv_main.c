@@ -50,8 +50,8 @@ void SV_Protocol_f(void)
         break;
     case 2:
         i = atoi(Cmd_Argv(1));
-        if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE)
-            Con_Printf("sv_protocol must be %i or %i\n", PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE);
+        if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_BITPACK)
+            Con_Printf("sv_protocol must be %i, %i or %i\n", PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_BITPACK);
         else
         {
             sv_protocol = i;
@@ -263,6 +263,7 @@ void SV_SendServerinfo(client_t* client)
 
     MSG_WriteByte(&client->message, svc_serverinfo);
     MSG_WriteLong(&client->message, sv.protocol); //johnfitz -- sv.protocol instead of PROTOCOL_VERSION
+    client->frameack = -1; // snapshots from an earlier level are useless
     MSG_WriteByte(&client->message, svs.maxclients);
 
     if (!coop.value && deathmatch.value)
@@ -502,6 +503,83 @@ bool SV_VisibleToClient(edict_t* client, edict_t* test, model_t* worldmodel)
 
 //=============================================================================
 
+/*
+=============
+SV_EntityVisibleToClient
+
+Decides whether ent goes out in clent's update this frame
+=============
+*/
+static bool SV_EntityVisibleToClient(edict_t* clent, edict_t* ent, uint8_t* pvs)
+{
+    int i;
+
+    if (ent != clent) // clent is ALLWAYS sent
+    {
+        // ignore ents without visible models
+        if (!ent->v.modelindex || !pr_strings[ent->v.model])
+            return false;
+
+        //johnfitz -- don't send model>255 entities if protocol is 15
+        if (sv_protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
+            return false;
+
+        // ignore if not touching a PV leaf
+        for (i = 0; i < ent->num_leafs; i++)
+            if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i] & 7)))
+                break;
+        if (i == ent->num_leafs)
+            return false; // not visible
+    }
+
+    //johnfitz -- alpha
+    if (pr_alpha_supported)
+    {
+        // TODO: find a cleaner place to put this code
+        eval_t* val;
+        val = GetEdictFieldValue(ent, "alpha");
+        if (val)
+            ent->alpha = ENTALPHA_ENCODE(val->_float);
+    }
+
+    //don't send invisible entities unless they have effects
+    if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+        return false;
+    //johnfitz
+
+    return true;
+}
+
+/*
+=============
+SV_PacketOverflow
+=============
+*/
+static void SV_PacketOverflow(void)
+{
+    //johnfitz -- less spammy overflow message
+    if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime)
+    {
+        Con_Printf("Packet overflow!\n");
+        dev_overflows.packetsize = realtime;
+    }
+}
+
+/*
+=============
+SV_PacketStats
+=============
+*/
+static void SV_PacketStats(sizebuf_t* msg)
+{
+    //johnfitz -- devstats
+    if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
+        Con_Warning("%i byte packet exceeds standard limit of 1024.\n", msg->cursize);
+    dev_stats.packetsize = msg->cursize;
+    dev_peakstats.packetsize = max(msg->cursize, dev_peakstats.packetsize);
+    //johnfitz
+}
+
 /*
 =============
 SV_WriteEntitiesToClient
@@ -525,37 +603,15 @@ void SV_WriteEntitiesToClient(edict_t* clent, sizebuf_t* msg)
     ent = NEXT_EDICT(sv.edicts);
     for (e = 1; e < sv.num_edicts; e++, ent = NEXT_EDICT(ent))
     {
-
-        if (ent != clent) // clent is ALLWAYS sent
-        {
-            // ignore ents without visible models
-            if (!ent->v.modelindex || !pr_strings[ent->v.model])
-                continue;
-
-            //johnfitz -- don't send model>255 entities if protocol is 15
-            if (sv_protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
-                continue;
-
-            // ignore if not touching a PV leaf
-            for (i = 0; i < ent->num_leafs; i++)
-                if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i] & 7)))
-                    break;
-            if (i == ent->num_leafs)
-                continue; // not visible
-        }
+        if (!SV_EntityVisibleToClient(clent, ent, pvs))
+            continue;
 
         //johnfitz -- max size for protocol 15 is 18 bytes, not 16 as originally
         //assumed here.  And, for protocol 85 the max size is actually 24 bytes.
         if (msg->cursize + 24 > msg->maxsize)
         {
-            //johnfitz -- less spammy overflow message
-            if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime)
-            {
-                Con_Printf("Packet overflow!\n");
-                dev_overflows.packetsize = realtime;
-            }
-            goto stats;
-            //johnfitz
+            SV_PacketOverflow();
+            break;
         }
 
         // send an update
@@ -595,21 +651,6 @@ void SV_WriteEntitiesToClient(edict_t* clent, sizebuf_t* msg)
         if (ent->baseline.modelindex != ent->v.modelindex)
             bits |= U_MODEL;
 
-        //johnfitz -- alpha
-        if (pr_alpha_supported)
-        {
-            // TODO: find a cleaner place to put this code
-            eval_t* val;
-            val = GetEdictFieldValue(ent, "alpha");
-            if (val)
-                ent->alpha = ENTALPHA_ENCODE(val->_float);
-        }
-
-        //don't send invisible entities unless they have effects
-        if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
-            continue;
-        //johnfitz
-
         //johnfitz -- PROTOCOL_FITZQUAKE
         if (sv.protocol != PROTOCOL_NETQUAKE)
         {
@@ -690,13 +731,123 @@ void SV_WriteEntitiesToClient(edict_t* clent, sizebuf_t* msg)
         //johnfitz
     }
 
-//johnfitz -- devstats
-stats:
-    if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
-        Con_Warning("%i byte packet exceeds standard limit of 1024.\n", msg->cursize);
-    dev_stats.packetsize = msg->cursize;
-    dev_peakstats.packetsize = max(msg->cursize, dev_peakstats.packetsize);
-    //johnfitz
+    SV_PacketStats(msg);
+}
+
+/*
+=============
+SV_PackBaseline
+
+The client's copy of a baseline, for delta compression
+=============
+*/
+static void SV_PackBaseline(int number, packedentity_t* to)
+{
+    Delta_PackState(to, number, &EDICT_NUM(number)->baseline);
+}
+
+/*
+=============
+SV_PackEntity
+=============
+*/
+static void SV_PackEntity(packedentity_t* to, int number, edict_t* ent)
+{
+    int i;
+
+    to->number = number;
+    for (i = 0; i < 3; i++)
+    {
+        to->origin[i] = Delta_PackCoord(ent->v.origin[i]);
+        to->angles[i] = Delta_PackAngle(ent->v.angles[i]);
+    }
+    to->modelindex = ent->v.modelindex;
+    to->frame = ent->v.frame;
+    to->colormap = ent->v.colormap;
+    to->skin = ent->v.skin;
+    to->effects = ent->v.effects;
+    to->alpha = ent->alpha;
+
+    to->flags = 0;
+    if (ent->v.movetype == MOVETYPE_STEP)
+        to->flags |= PEF_STEP;
+
+    // lerpfinish is kept at 0 when unused so it never causes a delta
+    to->lerpfinish = 0;
+    if (ent->sendinterval)
+    {
+        to->flags |= PEF_LERPFINISH;
+        to->lerpfinish = (uint8_t)(Q_rint((ent->v.nextthink - sv.time) * 255));
+    }
+}
+
+/*
+=============
+SV_WritePacketEntities
+
+PROTOCOL_BITPACK version of SV_WriteEntitiesToClient.  The visible entities
+are stored as this frame's snapshot and sent as a delta from the last
+snapshot the client acknowledged in clc_move, or from the baselines if that
+one is gone.
+=============
+*/
+void SV_WritePacketEntities(client_t* client, sizebuf_t* msg)
+{
+    packetframe_t* frames;
+    packetframe_t *from, *to;
+    int e, delta, count;
+    uint8_t* pvs;
+    vec3_t org;
+    edict_t *clent, *ent;
+
+    frames = sv.packetframes + (client - svs.clients) * UPDATE_BACKUP;
+    clent = client->edict;
+
+    from = NULL;
+    delta = 0;
+    if (client->frameack != -1)
+    {
+        delta = (client->netframe - client->frameack) & 255;
+        from = &frames[(client->netframe - delta) & UPDATE_MASK];
+        if (!delta || delta >= UPDATE_BACKUP || !from->valid || from->sequence != client->netframe - delta)
+        {
+            from = NULL;
+            delta = 0;
+        }
+    }
+
+    to = &frames[client->netframe & UPDATE_MASK];
+    to->sequence = client->netframe;
+    to->valid = true;
+    to->numentities = 0;
+
+    // find the client's PVS
+    VectorAdd(clent->v.origin, clent->v.view_ofs, org);
+    pvs = SV_FatPVS(org, sv.worldmodel);
+
+    count = 0;
+    ent = NEXT_EDICT(sv.edicts);
+    for (e = 1; e < sv.num_edicts; e++, ent = NEXT_EDICT(ent))
+    {
+        if (!SV_EntityVisibleToClient(clent, ent, pvs))
+            continue;
+
+        count++;
+        if (to->numentities < MAX_PACKET_ENTITIES)
+            SV_PackEntity(&to->entities[to->numentities++], e, ent);
+    }
+
+    MSG_WriteByte(msg, svc_packetentities);
+    MSG_WriteByte(msg, client->netframe & 255);
+    MSG_WriteByte(msg, delta);
+    MSG_WritePacketEntities(msg, from, to, SV_PackBaseline);
+
+    if (to->numentities < count)
+        SV_PacketOverflow();
+
+    client->netframe++;
+
+    SV_PacketStats(msg);
 }
 
 /*
@@ -921,10 +1072,13 @@ bool SV_SendClientDatagram(client_t* client)
 {
     uint8_t buf[MAX_DATAGRAM];
     sizebuf_t msg;
+    sizebuf_t* segments[2];
+    int numsegments;
 
     msg.data = buf;
     msg.maxsize = sizeof(buf);
     msg.cursize = 0;
+    msg.bitpos = 0;
 
     //johnfitz -- if client is nonlocal, use smaller max size so packets aren't fragmented
     if (Q_strcmp(client->netconnection->address, "LOCAL") != 0)
@@ -937,14 +1091,20 @@ bool SV_SendClientDatagram(client_t* client)
     // add the client specific data to the datagram
     SV_WriteClientdataToMessage(client->edict, &msg);
 
-    SV_WriteEntitiesToClient(client->edict, &msg);
+    if (sv.protocol == PROTOCOL_BITPACK)
+        SV_WritePacketEntities(client, &msg);
+    else
+        SV_WriteEntitiesToClient(client->edict, &msg);
 
-    // copy the server datagram if there is space
+    // append the server datagram if there is space; it is shared by every
+    // client, so it is handed to the driver by reference instead of copied
+    segments[0] = &msg;
+    numsegments = 1;
     if (msg.cursize + sv.datagram.cursize < msg.maxsize)
-        SZ_Write(&msg, sv.datagram.data, sv.datagram.cursize);
+        segments[numsegments++] = &sv.datagram;
 
     // send the datagram
-    if (NET_SendUnreliableMessage(client->netconnection, &msg) == -1)
+    if (NET_SendUnreliableMessageV(client->netconnection, segments, numsegments) == -1)
     {
         SV_DropClient(true); // if the message couldn't send, kick off
         return false;
@@ -986,6 +1146,7 @@ void SV_UpdateToReliableMessages(void)
         if (!client->active)
             continue;
         SZ_Write(&client->message, sv.reliable_datagram.data, sv.reliable_datagram.cursize);
+        net_copybytes += sv.reliable_datagram.cursize;
     }
 
     SZ_Clear(&sv.reliable_datagram);
@@ -1332,6 +1493,9 @@ void SV_SpawnServer(char* server)
     sv.max_edicts = CLAMP(MIN_EDICTS, (int)max_edicts.value, MAX_EDICTS); //johnfitz -- max_edicts cvar
     sv.edicts = Hunk_AllocName(sv.max_edicts * pr_edict_size, "edicts");
 
+    if (sv.protocol == PROTOCOL_BITPACK)
+        sv.packetframes = Hunk_AllocName(svs.maxclients * UPDATE_BACKUP * sizeof(packetframe_t), "packetframes");
+
     sv.datagram.maxsize = sizeof(sv.datagram_buf);
     sv.datagram.cursize = 0;
     sv.datagram.data = sv.datagram_buf;
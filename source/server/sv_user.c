@@ -469,6 +469,10 @@ void SV_ReadClientMove(usercmd_t* move)
     i = MSG_ReadByte();
     if (i)
         host_client->edict->v.impulse = i;
+
+    // PROTOCOL_BITPACK -- the snapshot to delta the next update from
+    if (sv.protocol == PROTOCOL_BITPACK)
+        host_client->frameack = MSG_ReadShort();
 }
 
 /*
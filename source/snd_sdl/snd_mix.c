@@ -141,6 +141,30 @@ void S_TransferStereo16(int endtime)
 #endif
 }
 
+/*
+===============
+S_CaptureMix -- hands the mix to a movie capture as 16 bit stereo, whatever the device takes
+===============
+*/
+static void S_CaptureMix(int endtime)
+{
+    short out[PAINTBUFFER_SIZE * 2];
+    int i, count, vol, val;
+
+    if (!api->capture || !api->capture->Active())
+        return;
+
+    count = endtime - paintedtime;
+    vol = volume.value * 256;
+    for (i = 0; i < count * 2; i++)
+    {
+        val = (((int*)paintbuffer)[i] * vol) >> 8;
+        out[i] = val > 0x7fff ? 0x7fff : val < (short)0x8000 ? (short)0x8000 : val;
+    }
+
+    api->capture->Audio(out, count, shm->speed);
+}
+
 void S_TransferPaintBuffer(int endtime)
 {
     int out_idx;
@@ -158,6 +182,8 @@ void S_TransferPaintBuffer(int endtime)
     HRESULT hresult;
 #endif
 
+    S_CaptureMix(endtime);
+
     if (shm->samplebits == 16 && shm->channels == 2)
     {
         S_TransferStereo16(endtime);
@@ -43,6 +43,9 @@ void Sys_Printf(const char* fmt, ...);
 void Sys_Quit(void);
 
 double Sys_FloatTime(void);
+double Sys_PerfTime(void); // for timing, safe on any thread
+
+int Sys_NumProcessors(void); // logical cpus, for sizing the worker pool
 
 char* Sys_ConsoleInput(void);
 
@@ -187,6 +187,19 @@ SYSTEM IO
 ===============================================================================
 */
 
+/*
+================
+Sys_NumProcessors
+================
+*/
+int Sys_NumProcessors(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
 /*
 ================
 Sys_Init
@@ -375,6 +388,20 @@ double Sys_FloatTime(void)
     return curtime;
 }
 
+/*
+================
+Sys_PerfTime -- seconds from an arbitrary start, without Sys_FloatTime's bookkeeping, so threads other
+than the main one can time themselves
+================
+*/
+double Sys_PerfTime(void)
+{
+    LARGE_INTEGER PerformanceCount;
+
+    QueryPerformanceCounter(&PerformanceCount);
+    return (double)(PerformanceCount.QuadPart >> lowshift) * pfreq;
+}
+
 /*
 ================
 Sys_InitFloatTime
@@ -0,0 +1,259 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// tasks.c -- worker threads for data parallel loops
+
+#define _SDL_main_h
+#include <SDL.h>
+
+#include "quakedef.h"
+
+typedef struct
+{
+    taskfunc_t func;
+    void* data;
+    int count;
+    int next; // first index nobody has claimed yet
+    int batch; // indices claimed per lock
+} taskjob_t;
+
+int task_numthreads = 1;
+
+static SDL_Thread* task_threads[MAX_TASK_THREADS];
+static SDL_sem* task_start; // posted once per worker that should join the job
+static SDL_sem* task_done; // posted by each worker as it runs out of indices
+static SDL_mutex* task_lock;
+static taskjob_t task_job;
+
+static SDL_Thread* task_background;
+static SDL_sem* task_begin; // posted by Tasks_Begin
+static SDL_sem* task_end; // posted by the background thread when its job returns
+static taskfunc_t task_beginfunc;
+static void* task_begindata;
+static bool task_running; // between Tasks_Begin and Tasks_Join
+
+/*
+================
+Tasks_Claim -- grabs the next batch of indices, returns false when the job is exhausted
+================
+*/
+static bool Tasks_Claim(int* first, int* last)
+{
+    SDL_mutexP(task_lock);
+    *first = task_job.next;
+    task_job.next += task_job.batch;
+    if (task_job.next > task_job.count)
+        task_job.next = task_job.count;
+    *last = task_job.next;
+    SDL_mutexV(task_lock);
+
+    return *first < *last;
+}
+
+/*
+================
+Tasks_Run
+================
+*/
+static void Tasks_Run(int thread)
+{
+    int first, last;
+
+    while (Tasks_Claim(&first, &last))
+        for (; first < last; first++)
+            task_job.func(first, thread, task_job.data);
+}
+
+/*
+================
+Tasks_Worker
+================
+*/
+static int SDLCALL Tasks_Worker(void* arg)
+{
+    int thread = (int)(intptr_t)arg;
+
+    for (;;)
+    {
+        SDL_SemWait(task_start);
+        Tasks_Run(thread);
+        SDL_SemPost(task_done);
+    }
+
+    return 0;
+}
+
+/*
+================
+Tasks_ParallelFor
+================
+*/
+void Tasks_ParallelFor(int count, taskfunc_t func, void* data)
+{
+    int i, workers;
+
+    if (count <= 0)
+        return;
+
+    workers = task_numthreads - 1;
+    if (workers > count - 1)
+        workers = count - 1;
+
+    if (!workers)
+    {
+        for (i = 0; i < count; i++)
+            func(i, 0, data);
+        return;
+    }
+
+    task_job.func = func;
+    task_job.data = data;
+    task_job.count = count;
+    task_job.next = 0;
+    // a few batches per thread so an unlucky thread with the expensive indices
+    // doesn't hold everyone else up, without taking the lock per index
+    task_job.batch = count / (task_numthreads * 4);
+    if (task_job.batch < 1)
+        task_job.batch = 1;
+
+    for (i = 0; i < workers; i++)
+        SDL_SemPost(task_start);
+    Tasks_Run(0);
+    for (i = 0; i < workers; i++)
+        SDL_SemWait(task_done);
+}
+
+/*
+================
+Tasks_Background
+================
+*/
+static int SDLCALL Tasks_Background(void* arg)
+{
+    for (;;)
+    {
+        SDL_SemWait(task_begin);
+        task_beginfunc(0, task_numthreads, task_begindata);
+        SDL_SemPost(task_end);
+    }
+
+    return 0;
+}
+
+/*
+================
+Tasks_Begin
+================
+*/
+void Tasks_Begin(taskfunc_t func, void* data)
+{
+    Tasks_Join(); // in case an error jumped out between the last Begin and Join
+
+    if (!task_background)
+    {
+        func(0, task_numthreads, data);
+        return;
+    }
+
+    task_beginfunc = func;
+    task_begindata = data;
+    task_running = true;
+    SDL_SemPost(task_begin);
+}
+
+/*
+================
+Tasks_Join
+================
+*/
+void Tasks_Join(void)
+{
+    if (!task_running)
+        return;
+
+    SDL_SemWait(task_end);
+    task_running = false;
+}
+
+/*
+================
+Tasks_Done
+================
+*/
+bool Tasks_Done(void)
+{
+    if (task_running && SDL_SemTryWait(task_end))
+        return false;
+
+    task_running = false;
+    return true;
+}
+
+/*
+================
+Tasks_Init
+================
+*/
+void Tasks_Init(void)
+{
+    int i;
+
+    i = COM_CheckParm("-threads");
+    if (i && i < com_argc - 1)
+        task_numthreads = Q_atoi(com_argv[i + 1]);
+    else
+        task_numthreads = Sys_NumProcessors();
+
+    if (task_numthreads < 1)
+        task_numthreads = 1;
+    if (task_numthreads > MAX_TASK_THREADS)
+        task_numthreads = MAX_TASK_THREADS;
+
+    if (task_numthreads == 1)
+        return;
+
+    task_start = SDL_CreateSemaphore(0);
+    task_done = SDL_CreateSemaphore(0);
+    task_lock = SDL_CreateMutex();
+    if (!task_start || !task_done || !task_lock)
+        Sys_Error("Tasks_Init: %s", SDL_GetError());
+
+    for (i = 1; i < task_numthreads; i++)
+    {
+        task_threads[i] = SDL_CreateThread(Tasks_Worker, (void*)(intptr_t)i);
+        if (!task_threads[i])
+        {
+            Con_Warning("Tasks_Init: %s\n", SDL_GetError());
+            break;
+        }
+    }
+    task_numthreads = i;
+
+    // the background thread is on top of the workers, it mostly overlaps the main
+    // thread's gl calls rather than the parallel loops
+    task_begin = SDL_CreateSemaphore(0);
+    task_end = SDL_CreateSemaphore(0);
+    if (task_begin && task_end)
+        task_background = SDL_CreateThread(Tasks_Background, NULL);
+    if (!task_background)
+        Con_Warning("Tasks_Init: no background thread\n");
+
+    Con_Printf("%i worker threads\n", task_numthreads - 1);
+}
@@ -0,0 +1,47 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+#pragma once
+
+// tasks.h -- worker threads for data parallel loops
+
+#define MAX_TASK_THREADS 16 // including the main thread
+
+typedef void (*taskfunc_t)(int index, int thread, void* data);
+
+extern int task_numthreads; // worker threads + the main thread, fixed at startup
+
+void Tasks_Init(void);
+
+// calls func(index, thread, data) for every index in [0, count) and returns once
+// they have all finished. thread is in [0, task_numthreads) and never runs two
+// calls at once, so it can index per thread scratch memory. the main thread takes
+// part as thread 0. not reentrant: func must not call Tasks_ParallelFor itself
+void Tasks_ParallelFor(int count, taskfunc_t func, void* data);
+
+// starts func(0, task_numthreads, data) on a thread of its own and returns at once,
+// so the caller can keep working until Tasks_Join. only one is in flight at a time. it may
+// run alongside Tasks_ParallelFor, so it must not call it itself. with no worker
+// threads it runs to completion before returning
+void Tasks_Begin(taskfunc_t func, void* data);
+void Tasks_Join(void);
+
+// true when no job from Tasks_Begin is running. one that has finished is joined
+bool Tasks_Done(void);